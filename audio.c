@@ -0,0 +1,298 @@
+// Audio-reactive uniforms. render.conf can name a WAV file:
+//
+//   audio = music.wav
+//
+// The file is mapped (or taken straight from the asset pack) and never
+// decoded as a whole. Every frame the AUDIO_FFT_SIZE samples centered at
+// the current `time` are mixed down to mono, windowed and transformed, and
+// the magnitudes are uploaded as a 1D texture of AUDIO_BINS texels bound to
+// the `spectrum` sampler. `bands` gets the energy of the 4 frequency bands
+// of `audio_band_edges` and `nyquist` the frequency of the last bin. The
+// spectrum and the bands are pure functions of `time`, so offline renders
+// with a fixed time step are reproducible. Levels are in decibels mapped
+// from [AUDIO_DB_FLOOR, 0] to [0, 1].
+//
+// Nothing is played back, the audio only drives the visuals.
+
+#define AUDIO_FFT_SIZE 8192
+#define AUDIO_BINS (AUDIO_FFT_SIZE/2)
+#define AUDIO_DB_FLOOR -90.0f
+#define AUDIO_BANDS 4
+#define AUDIO_TEXTURES 2
+// For the `nyquist` uniform without audio, the spectrum is silent then
+#define AUDIO_DEFAULT_SAMPLE_RATE 44100
+
+#define WAV_FORMAT_PCM 1
+#define WAV_FORMAT_FLOAT 3
+#define WAV_FORMAT_EXTENSIBLE 0xFFFE
+
+// Upper edges of the bands in Hz: bass, low mids, high mids, highs
+static const float audio_band_edges[AUDIO_BANDS] = {250.0f, 2000.0f, 6000.0f, 20000.0f};
+
+typedef struct {
+    // Either a mapped file or data that lives in the asset pack
+    Mapped_File file;
+    bool mapped;
+    const uint8_t *frames;
+    size_t frames_count;
+    uint16_t format;
+    uint16_t channels;
+    uint16_t bits;
+    size_t frame_size;
+    uint32_t sample_rate;
+
+    Fft fft;
+    float window[AUDIO_FFT_SIZE];
+    // 2/sum(window), so a full scale sine is 0 dB
+    float window_scale;
+    float samples[AUDIO_FFT_SIZE];
+    float spectrum[AUDIO_BINS];
+    float bands[AUDIO_BANDS];
+
+    // Uploads alternate between the textures, so they never have to wait
+    // for the draw of the previous frame that still samples the other one
+    GLuint textures[AUDIO_TEXTURES];
+    size_t current_texture;
+    bool has_time;
+    double time;
+} Audio;
+
+static uint16_t audio_read_u16(const uint8_t *p)
+{
+    return (uint16_t) (p[0] | (p[1] << 8));
+}
+
+static uint32_t audio_read_u32(const uint8_t *p)
+{
+    return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static bool audio_parse_wav(Audio *audio, const char *file_path, const uint8_t *data, size_t size)
+{
+    if (size < 12 || memcmp(data, "RIFF", 4) != 0 || memcmp(data + 8, "WAVE", 4) != 0) {
+        fprintf(stderr, "ERROR: %s is not a WAV file\n", file_path);
+        return false;
+    }
+
+    bool has_fmt = false;
+    size_t cursor = 12;
+    while (cursor + 8 <= size) {
+        const uint8_t *chunk = data + cursor;
+        size_t chunk_size = audio_read_u32(chunk + 4);
+        const uint8_t *body = chunk + 8;
+        size_t available = size - cursor - 8;
+        if (chunk_size > available) chunk_size = available;
+
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+            if (chunk_size < 16) break;
+            audio->format      = audio_read_u16(body + 0);
+            audio->channels    = audio_read_u16(body + 2);
+            audio->sample_rate = audio_read_u32(body + 4);
+            audio->frame_size  = audio_read_u16(body + 12);
+            audio->bits        = audio_read_u16(body + 14);
+            // The actual format is the first 2 bytes of the sub format GUID
+            if (audio->format == WAV_FORMAT_EXTENSIBLE && chunk_size >= 26) {
+                audio->format = audio_read_u16(body + 24);
+            }
+            has_fmt = true;
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            if (!has_fmt) break;
+            bool supported =
+                (audio->format == WAV_FORMAT_PCM && (audio->bits == 8 || audio->bits == 16 || audio->bits == 24 || audio->bits == 32)) ||
+                (audio->format == WAV_FORMAT_FLOAT && audio->bits == 32);
+            if (!supported || audio->channels == 0 || audio->sample_rate == 0 ||
+                    audio->frame_size != (size_t) audio->channels * audio->bits / 8) {
+                fprintf(stderr, "ERROR: %s: unsupported WAV format %u with %u bits and %u channels\n",
+                        file_path, audio->format, audio->bits, audio->channels);
+                return false;
+            }
+            audio->frames = body;
+            audio->frames_count = chunk_size / audio->frame_size;
+            return true;
+        }
+
+        // Chunks are padded to an even size
+        cursor += 8 + chunk_size + (chunk_size & 1);
+    }
+
+    fprintf(stderr, "ERROR: %s: no fmt or data chunk\n", file_path);
+    return false;
+}
+
+// Mono mix of `count` frames starting at `first`, scaled to [-1, 1]
+static void audio_mix_frames(const Audio *audio, size_t first, size_t count, float *out)
+{
+    const uint8_t *p = audio->frames + first*audio->frame_size;
+    size_t channels = audio->channels;
+    // Full scale of the integer formats
+    float scale = 1.0f/(float) channels;
+    if (audio->format == WAV_FORMAT_PCM) scale /= (float) (1u << (audio->bits - 1));
+
+    for (size_t i = 0; i < count; ++i) {
+        float sum = 0.0f;
+        switch (audio->bits) {
+        case 8:
+            for (size_t c = 0; c < channels; ++c, p += 1) sum += (float) p[0] - 128.0f;
+            break;
+        case 16:
+            for (size_t c = 0; c < channels; ++c, p += 2) sum += (float) (int16_t) audio_read_u16(p);
+            break;
+        case 24:
+            for (size_t c = 0; c < channels; ++c, p += 3) {
+                sum += (float) ((int32_t) ((uint32_t) p[0] << 8 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 24) >> 8);
+            }
+            break;
+        case 32:
+            for (size_t c = 0; c < channels; ++c, p += 4) {
+                uint32_t bits = audio_read_u32(p);
+                if (audio->format == WAV_FORMAT_FLOAT) {
+                    float sample;
+                    memcpy(&sample, &bits, sizeof(sample));
+                    sum += sample;
+                } else {
+                    sum += (float) (int32_t) bits;
+                }
+            }
+            break;
+        default:
+            assert(0 && "unreachable");
+        }
+        out[i] = sum*scale;
+    }
+}
+
+// Decibels of the amplitude with `power` mapped from [AUDIO_DB_FLOOR, 0] to
+// [0, 1]. 10*log10(x) is 10*log10(2)*log2(x), log2f() is the faster one.
+static float audio_level(float power)
+{
+    float db = 3.0103f*log2f(power + 1e-18f);
+    float level = (db - AUDIO_DB_FLOOR)/-AUDIO_DB_FLOOR;
+    return level < 0.0f ? 0.0f : level > 1.0f ? 1.0f : level;
+}
+
+void audio_unload(Audio *audio)
+{
+    if (audio->mapped) unmap_file(&audio->file);
+    audio->mapped = false;
+    audio->frames = NULL;
+    audio->frames_count = 0;
+    audio->has_time = false;
+}
+
+// `file_path` may be NULL, which just unloads the current audio. The texture
+// and the FFT are created on the first call and kept for the later ones.
+bool audio_load(Audio *audio, const char *file_path)
+{
+    audio_unload(audio);
+
+    if (audio->textures[0] == 0) {
+        if (!fft_init(&audio->fft, AUDIO_FFT_SIZE)) {
+            fprintf(stderr, "ERROR: could not initialize FFT of size %d\n", AUDIO_FFT_SIZE);
+            return false;
+        }
+
+        double sum = 0.0;
+        for (size_t i = 0; i < AUDIO_FFT_SIZE; ++i) {
+            audio->window[i] = (float) (0.5 - 0.5*cos(2.0*M_PI*(double) i/AUDIO_FFT_SIZE));
+            sum += audio->window[i];
+        }
+        audio->window_scale = (float) (2.0/sum);
+
+        glGenTextures(AUDIO_TEXTURES, audio->textures);
+        for (size_t i = 0; i < AUDIO_TEXTURES; ++i) {
+            glBindTexture(GL_TEXTURE_1D, audio->textures[i]);
+            glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexImage1D(GL_TEXTURE_1D, 0, GL_R32F, AUDIO_BINS, 0, GL_RED, GL_FLOAT, audio->spectrum);
+            mem_track(MEM_TAG_GL_TEXTURES, AUDIO_BINS*sizeof(float));
+        }
+        glBindTexture(GL_TEXTURE_1D, 0);
+    }
+
+    if (file_path == NULL) return true;
+
+    const uint8_t *data = NULL;
+    size_t size = 0;
+    const Pack_Entry *entry = find_packed_asset(file_path, PACK_ASSET_RAW);
+    if (entry != NULL) {
+        data = pack_entry_data(&asset_pack, entry);
+        size = entry->data_size;
+    } else {
+        if (!map_file(file_path, &audio->file)) {
+            fprintf(stderr, "ERROR: could not map %s: %s\n", file_path, strerror(errno));
+            return false;
+        }
+        audio->mapped = true;
+        data = audio->file.data;
+        size = audio->file.size;
+    }
+
+    if (!audio_parse_wav(audio, file_path, data, size)) {
+        audio_unload(audio);
+        return false;
+    }
+
+    printf("Audio: %s, %u Hz, %u channels, %.1f seconds\n", file_path,
+           audio->sample_rate, audio->channels, (double) audio->frames_count / audio->sample_rate);
+    return true;
+}
+
+// Half the sample rate, the frequency in Hz where the `spectrum` ends
+float audio_nyquist(const Audio *audio)
+{
+    uint32_t sample_rate = audio->frames != NULL ? audio->sample_rate : AUDIO_DEFAULT_SAMPLE_RATE;
+    return sample_rate*0.5f;
+}
+
+// Recomputes the spectrum and the bands for `time` unless they are already
+// computed for it. Without loaded audio they stay silent.
+void audio_update(Audio *audio, double time)
+{
+    if (audio->textures[0] == 0 || (audio->has_time && audio->time == time)) return;
+    audio->has_time = true;
+    audio->time = time;
+
+    if (audio->frames == NULL) {
+        memset(audio->spectrum, 0, sizeof(audio->spectrum));
+        memset(audio->bands, 0, sizeof(audio->bands));
+    } else {
+        // Window centered at `time`, silence outside of the file
+        long long start = (long long) floor(time*audio->sample_rate) - AUDIO_FFT_SIZE/2;
+        long long end = start + AUDIO_FFT_SIZE;
+        long long first = start < 0 ? 0 : start;
+        long long last = end < (long long) audio->frames_count ? end : (long long) audio->frames_count;
+        memset(audio->samples, 0, sizeof(audio->samples));
+        if (first < last) {
+            audio_mix_frames(audio, (size_t) first, (size_t) (last - first), audio->samples + (first - start));
+        }
+        for (size_t i = 0; i < AUDIO_FFT_SIZE; ++i) audio->samples[i] *= audio->window[i];
+
+        fft_magnitudes(&audio->fft, audio->samples, audio->spectrum);
+
+        // Band energy is the power of all of its bins together, so a single
+        // loud tone counts as much as broadband noise of the same power
+        float power[AUDIO_BANDS] = {0};
+        float bin_hz = (float) audio->sample_rate/AUDIO_FFT_SIZE;
+        size_t band = 0;
+        for (size_t k = 0; k < AUDIO_BINS; ++k) {
+            float magnitude = audio->spectrum[k]*audio->window_scale;
+            float hz = (float) k*bin_hz;
+            while (band < AUDIO_BANDS && hz >= audio_band_edges[band]) band += 1;
+            if (hz >= 20.0f && band < AUDIO_BANDS) power[band] += magnitude*magnitude;
+            audio->spectrum[k] = audio_level(magnitude*magnitude);
+        }
+        for (size_t i = 0; i < AUDIO_BANDS; ++i) audio->bands[i] = audio_level(power[i]);
+    }
+
+    audio->current_texture = (audio->current_texture + 1) % AUDIO_TEXTURES;
+    glBindTexture(GL_TEXTURE_1D, audio->textures[audio->current_texture]);
+    glTexSubImage1D(GL_TEXTURE_1D, 0, 0, AUDIO_BINS, GL_RED, GL_FLOAT, audio->spectrum);
+    glBindTexture(GL_TEXTURE_1D, 0);
+}
+
+// Texture with the spectrum of the last audio_update()
+GLuint audio_texture(const Audio *audio)
+{
+    return audio->textures[audio->current_texture];
+}
@@ -0,0 +1,441 @@
+// Autotuning of fragment shader defines. A scene in render.conf can list
+// candidate values for defines its fragment shader uses:
+//
+//   frag = shaders/main.frag
+//   tune = STEPS 32 64 128
+//   tune = UNROLL 0 1
+//   tune_tolerance = 0.01
+//
+// The shader has to compile without them too, with `#ifndef` defaults, as
+// that's what the scene renders with until the tuning is done. Once the
+// scene is ready every combination of the values is compiled,
+// with the defines inserted right after `#version`, and rendered into an
+// offscreen target at AUTOTUNE_TIMES fixed values of the `time` uniform.
+// Every render is timed AUTOTUNE_REPEATS times with GL_TIME_ELAPSED and the
+// median counts, the variant with the lowest sum of medians wins. The first
+// value of every define makes the reference variant. With `tune_tolerance`
+// the output of every variant is also read back and a variant whose pixels
+// are further than that from the reference in any channel can't win.
+//
+// The fastest variant depends on the GPU and the driver, so the winner is
+// saved in AUTOTUNE_CACHE_DIR under a hash of the driver identity, the
+// shader sources, the candidates and the tolerance. Later runs on the same
+// driver apply it without benchmarking, `-retune` benchmarks anyway.
+
+#define AUTOTUNE_VERSION 1
+#define AUTOTUNE_VALUES_CAP 16
+#define AUTOTUNE_VARIANTS_CAP 256
+#define AUTOTUNE_REPEATS 5
+#define AUTOTUNE_CACHE_DIR "autotune_cache"
+
+static const float autotune_times[] = {0.0f, 0.5f, 1.0f, 2.0f, 4.0f, 8.0f, 16.0f, 32.0f};
+#define AUTOTUNE_TIMES (sizeof(autotune_times)/sizeof(autotune_times[0]))
+
+typedef struct {
+    String_View name;
+    String_View values[AUTOTUNE_VALUES_CAP];
+    size_t values_count;
+} Autotune_Define;
+
+typedef struct {
+    Autotune_Define defines[SCENE_TUNES_CAP];
+    size_t defines_count;
+    size_t variants_count;
+} Autotune_Space;
+
+typedef struct {
+    // Negative disables the output check
+    float tolerance;
+    // Benchmark even when the cache has a winner
+    bool retune;
+    // Only apply cached winners, never benchmark
+    bool cache_only;
+    // Set on the variants like on the scene, so they render the same uniforms
+    const Timeline *timeline;
+    char driver[512];
+} Autotune;
+
+typedef struct {
+    GLuint program;
+    GLint uniforms[COUNT_UNIFORMS];
+    Timeline_Locations timeline_locations;
+    bool rejected;
+    float max_error;
+    double ms;
+} Autotune_Variant;
+
+static bool autotune_parse_space(const Scene_Conf *conf, Autotune_Space *space)
+{
+    memset(space, 0, sizeof(*space));
+    space->variants_count = 1;
+    for (size_t i = 0; i < conf->tunes_count; ++i) {
+        Autotune_Define *define = &space->defines[space->defines_count++];
+        String_View tune = sv_from_cstr(conf->tunes[i]);
+        define->name = sv_chop_by_delim(&tune, ' ');
+        tune = sv_trim_left(tune);
+        while (tune.count > 0) {
+            if (define->values_count >= AUTOTUNE_VALUES_CAP) {
+                fprintf(stderr, "ERROR: too many values for `"SV_Fmt"`, only %d are supported\n",
+                        SV_Arg(define->name), AUTOTUNE_VALUES_CAP);
+                return false;
+            }
+            define->values[define->values_count++] = sv_chop_by_delim(&tune, ' ');
+            tune = sv_trim_left(tune);
+        }
+        if (define->values_count == 0 || space->variants_count*define->values_count > AUTOTUNE_VARIANTS_CAP) {
+            fprintf(stderr, "ERROR: `"SV_Fmt"` makes no variants or more than %d\n",
+                    SV_Arg(define->name), AUTOTUNE_VARIANTS_CAP);
+            return false;
+        }
+        space->variants_count *= define->values_count;
+    }
+    return true;
+}
+
+// Index of the value of define `d` in `variant`. Variant 0 is the first value of everything.
+static size_t autotune_value_index(const Autotune_Space *space, size_t variant, size_t d)
+{
+    for (size_t i = 0; i < d; ++i) variant /= space->defines[i].values_count;
+    return variant % space->defines[d].values_count;
+}
+
+static void autotune_print_variant(const Autotune_Space *space, size_t variant, FILE *stream)
+{
+    for (size_t d = 0; d < space->defines_count; ++d) {
+        const Autotune_Define *define = &space->defines[d];
+        String_View value = define->values[autotune_value_index(space, variant, d)];
+        fprintf(stream, "%s"SV_Fmt"="SV_Fmt, d > 0 ? " " : "", SV_Arg(define->name), SV_Arg(value));
+    }
+}
+
+// `frag_source` with the defines of `variant` after the `#version` line.
+// `#line` keeps the line numbers of compile errors pointing into the file.
+static char *autotune_variant_source(const Autotune_Space *space, size_t variant, const char *frag_source)
+{
+    const char *insert = frag_source;
+    int line = 1;
+    const char *version = strstr(frag_source, "#version");
+    if (version != NULL) {
+        for (const char *p = frag_source; p < version; ++p) line += *p == '\n';
+        const char *eol = strchr(version, '\n');
+        insert = eol != NULL ? eol + 1 : version + strlen(version);
+        line += 1;
+    }
+
+    size_t size = strlen(frag_source) + 64;
+    for (size_t d = 0; d < space->defines_count; ++d) {
+        const Autotune_Define *define = &space->defines[d];
+        size += define->name.count + define->values[autotune_value_index(space, variant, d)].count + 16;
+    }
+    char *source = mem_alloc(MEM_TAG_SHADERS, size);
+    if (source == NULL) return NULL;
+
+    int n = snprintf(source, size, "%.*s", (int) (insert - frag_source), frag_source);
+    for (size_t d = 0; d < space->defines_count; ++d) {
+        const Autotune_Define *define = &space->defines[d];
+        String_View value = define->values[autotune_value_index(space, variant, d)];
+        n += snprintf(source + n, size - (size_t) n, "#define "SV_Fmt" "SV_Fmt"\n",
+                      SV_Arg(define->name), SV_Arg(value));
+    }
+    snprintf(source + n, size - (size_t) n, "#line %d\n%s", line, insert);
+    return source;
+}
+
+static Hash128 autotune_cache_key(const Autotune *autotune, const Scene_Conf *conf,
+                                  const char *vert_source, const char *frag_source)
+{
+    Hash_State hs;
+    hash_init(&hs, AUTOTUNE_VERSION);
+    // Every part ends with its NUL so moving text between them changes the hash
+    hash_update(&hs, autotune->driver, strlen(autotune->driver) + 1);
+    hash_update(&hs, vert_source, strlen(vert_source) + 1);
+    hash_update(&hs, frag_source, strlen(frag_source) + 1);
+    for (size_t i = 0; i < conf->tunes_count; ++i) hash_update(&hs, conf->tunes[i], strlen(conf->tunes[i]) + 1);
+    hash_update(&hs, &autotune->tolerance, sizeof(autotune->tolerance));
+    return hash_digest128(&hs);
+}
+
+static void autotune_cache_path(Hash128 key, char *path, size_t path_size)
+{
+    snprintf(path, path_size, AUTOTUNE_CACHE_DIR"/"Hash128_Fmt".txt", Hash128_Arg(key));
+}
+
+// The cache holds the winner as `NAME=value` pairs, the same way it's printed
+static bool autotune_cache_load(Hash128 key, const Autotune_Space *space, size_t *variant)
+{
+    char path[256];
+    autotune_cache_path(key, path, sizeof(path));
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) return false;
+    char content[1024];
+    size_t n = fread(content, 1, sizeof(content) - 1, f);
+    fclose(f);
+    content[n] = '\0';
+
+    String_View lines = sv_from_parts(content, n);
+    String_View pairs = sv_trim(sv_chop_by_delim(&lines, '\n'));
+    size_t result = 0;
+    size_t radix = 1;
+    for (size_t d = 0; d < space->defines_count; ++d) {
+        const Autotune_Define *define = &space->defines[d];
+        String_View pair = sv_chop_by_delim(&pairs, ' ');
+        pairs = sv_trim_left(pairs);
+        String_View name = sv_chop_by_delim(&pair, '=');
+        if (!sv_eq(name, define->name)) return false;
+        size_t index = 0;
+        while (index < define->values_count && !sv_eq(define->values[index], pair)) index += 1;
+        if (index >= define->values_count) return false;
+        result += index*radix;
+        radix *= define->values_count;
+    }
+    *variant = result;
+    return true;
+}
+
+static void autotune_cache_save(const Autotune *autotune, Hash128 key, const Autotune_Space *space, size_t variant)
+{
+#ifdef _WIN32
+    _mkdir(AUTOTUNE_CACHE_DIR);
+#else
+    mkdir(AUTOTUNE_CACHE_DIR, 0755);
+#endif // _WIN32
+
+    char path[256];
+    autotune_cache_path(key, path, sizeof(path));
+    // Renamed into place when complete, a truncated file would be taken for the winner
+    char tmp_path[256 + TEMP_FILE_PATH_EXTRA];
+    temp_file_path(path, tmp_path, sizeof(tmp_path));
+
+    // The cache is an optimization, failing to write it is not an error
+    FILE *f = fopen(tmp_path, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "WARNING: could not write autotune cache %s: %s\n", tmp_path, strerror(errno));
+        return;
+    }
+    autotune_print_variant(space, variant, f);
+    fprintf(f, "\n%s\n", autotune->driver);
+    bool ok = !ferror(f);
+    if (fclose(f) != 0) ok = false;
+    if (!commit_temp_file(tmp_path, path, ok)) {
+        fprintf(stderr, "WARNING: could not write autotune cache %s: %s\n", path, strerror(errno));
+    }
+}
+
+static int autotune_u64_cmp(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t*) a;
+    uint64_t y = *(const uint64_t*) b;
+    return (x > y) - (x < y);
+}
+
+static void autotune_draw(const Autotune *autotune, Autotune_Variant *variant, int width, int height, float time,
+                          GLsizei vertices_count)
+{
+    static_assert(COUNT_UNIFORMS == 7, "Update the autotune uniforms");
+    glUseProgram(variant->program);
+    glUniform2f(variant->uniforms[RESOLUTION_UNIFORM], (GLfloat) width, (GLfloat) height);
+    glUniform1f(variant->uniforms[TIME_UNIFORM], time);
+    glUniform2f(variant->uniforms[MOUSE_UNIFORM], (GLfloat) width*0.5f, (GLfloat) height*0.5f);
+    glUniform1i(variant->uniforms[SPECTRUM_UNIFORM], 1);
+    glUniform1i(variant->uniforms[VIDEO_UNIFORM], 2);
+    glUniform4f(variant->uniforms[BANDS_UNIFORM], 0.0f, 0.0f, 0.0f, 0.0f);
+    glUniform1f(variant->uniforms[NYQUIST_UNIFORM], AUDIO_DEFAULT_SAMPLE_RATE*0.5f);
+    if (autotune->timeline != NULL) {
+        timeline_upload(autotune->timeline, &variant->timeline_locations, variant->program);
+    }
+    glDrawArraysInstanced(GL_TRIANGLES, 0, vertices_count, 1);
+}
+
+// Benchmarks all the variants of `space` and returns the index of the winner
+static bool autotune_benchmark(const Autotune *autotune, const Autotune_Space *space, Render_Targets *targets,
+                               const char *vert_source, const char *frag_source,
+                               int width, int height, GLsizei vertices_count, size_t *winner)
+{
+    bool result = true;
+    size_t pixels_count = (size_t) width*height*4;
+    float *reference = NULL;
+    float *pixels = NULL;
+    GLuint queries[AUTOTUNE_REPEATS] = {0};
+    Autotune_Variant *variants = mem_alloc(MEM_TAG_RESOURCES, space->variants_count*sizeof(*variants));
+    Render_Target *target = render_targets_acquire(targets, width, height, GL_RGBA16F, 1);
+    if (variants == NULL || target == NULL) {
+        result = false;
+        goto defer;
+    }
+    memset(variants, 0, space->variants_count*sizeof(*variants));
+    if (autotune->tolerance >= 0.0f) {
+        reference = mem_alloc(MEM_TAG_CAPTURE, pixels_count*sizeof(float));
+        pixels = mem_alloc(MEM_TAG_CAPTURE, pixels_count*sizeof(float));
+        if (reference == NULL || pixels == NULL) {
+            result = false;
+            goto defer;
+        }
+    }
+
+    for (size_t v = 0; v < space->variants_count; ++v) {
+        Autotune_Variant *variant = &variants[v];
+        char *source = autotune_variant_source(space, v, frag_source);
+        if (source == NULL || !create_program(vert_source, source, &variant->program)) {
+            fprintf(stderr, "WARN: autotune variant ");
+            autotune_print_variant(space, v, stderr);
+            fprintf(stderr, " does not compile, skipping it\n");
+            glDeleteProgram(variant->program);
+            variant->program = 0;
+            variant->rejected = true;
+        } else {
+            for (Uniform index = 0; index < COUNT_UNIFORMS; ++index) {
+                variant->uniforms[index] = glGetUniformLocation(variant->program, uniform_names[index]);
+            }
+        }
+        mem_free(source);
+    }
+    if (variants[0].program == 0) {
+        fprintf(stderr, "ERROR: the reference variant of the autotune does not compile\n");
+        result = false;
+        goto defer;
+    }
+
+    GLint framebuffer = 0;
+    GLint viewport[4];
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glBindFramebuffer(GL_FRAMEBUFFER, target->framebuffer);
+    glViewport(0, 0, width, height);
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glGenQueries(AUTOTUNE_REPEATS, queries);
+
+    // Variants take turns at every time sample, so drift of the clocks over
+    // the run is spread over all of them
+    for (size_t t = 0; t < AUTOTUNE_TIMES; ++t) {
+        for (size_t v = 0; v < space->variants_count; ++v) {
+            Autotune_Variant *variant = &variants[v];
+            if (variant->program == 0) continue;
+
+            // The first draw also warms up whatever the driver compiles lazily
+            glClear(GL_COLOR_BUFFER_BIT);
+            autotune_draw(autotune, variant, width, height, autotune_times[t], vertices_count);
+            if (reference != NULL) {
+                glReadPixels(0, 0, width, height, GL_RGBA, GL_FLOAT, v == 0 ? reference : pixels);
+                if (v > 0) {
+                    for (size_t i = 0; i < pixels_count; ++i) {
+                        float error = fabsf(pixels[i] - reference[i]);
+                        // NaN is never within tolerance
+                        if (!(error <= variant->max_error)) variant->max_error = isnan(error) ? INFINITY : error;
+                    }
+                    if (variant->max_error > autotune->tolerance) variant->rejected = true;
+                }
+            }
+
+            // Only the draw is timed, the clear is the same for every variant
+            for (size_t r = 0; r < AUTOTUNE_REPEATS; ++r) {
+                glClear(GL_COLOR_BUFFER_BIT);
+                glBeginQuery(GL_TIME_ELAPSED, queries[r]);
+                autotune_draw(autotune, variant, width, height, autotune_times[t], vertices_count);
+                glEndQuery(GL_TIME_ELAPSED);
+            }
+            uint64_t ns[AUTOTUNE_REPEATS];
+            for (size_t r = 0; r < AUTOTUNE_REPEATS; ++r) {
+                GLuint64 elapsed = 0;
+                glGetQueryObjectui64v(queries[r], GL_QUERY_RESULT, &elapsed);
+                ns[r] = elapsed;
+            }
+            qsort(ns, AUTOTUNE_REPEATS, sizeof(ns[0]), autotune_u64_cmp);
+            variant->ms += (double) ns[AUTOTUNE_REPEATS/2]/1e6;
+        }
+    }
+
+    glDeleteQueries(AUTOTUNE_REPEATS, queries);
+    glBindFramebuffer(GL_FRAMEBUFFER, (GLuint) framebuffer);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+    *winner = 0;
+    printf("Autotune: %zu variants at %dx%d, sum of the median GPU time over %zu time samples:\n",
+           space->variants_count, width, height, AUTOTUNE_TIMES);
+    for (size_t v = 0; v < space->variants_count; ++v) {
+        const Autotune_Variant *variant = &variants[v];
+        if (variant->program == 0) continue;
+        printf("  ");
+        autotune_print_variant(space, v, stdout);
+        printf("  %8.3f ms", variant->ms);
+        if (v == 0) printf("  reference");
+        if (variant->rejected) printf("  REJECTED, off by %g", variant->max_error);
+        printf("\n");
+        if (!variant->rejected && variant->ms < variants[*winner].ms) *winner = v;
+    }
+
+defer:
+    if (variants != NULL) {
+        for (size_t v = 0; v < space->variants_count; ++v) glDeleteProgram(variants[v].program);
+    }
+    mem_free(variants);
+    mem_free(reference);
+    mem_free(pixels);
+    render_targets_release(target);
+    return result;
+}
+
+// Tunes the current scene once it's ready, or applies the cached winner.
+// Benchmarking stalls the frame it happens in.
+void autotune_scene(Autotune *autotune, Scene *scene, Resource_Manager *rm, Render_Targets *targets,
+                    int width, int height, GLsizei vertices_count)
+{
+    if (scene == NULL || scene->tuned || scene->conf.tunes_count == 0) return;
+    if (scene_get_state(scene) != SCENE_READY || width <= 0 || height <= 0) return;
+    // Whatever happens it's not tried again until the scene is reloaded
+    scene->tuned = true;
+
+    if (autotune->driver[0] == '\0') {
+        snprintf(autotune->driver, sizeof(autotune->driver), "%s | %s | %s",
+                 (const char*) glGetString(GL_VENDOR), (const char*) glGetString(GL_RENDERER),
+                 (const char*) glGetString(GL_VERSION));
+    }
+
+    Autotune_Space space;
+    if (!autotune_parse_space(&scene->conf, &space)) return;
+
+    char *vert_source = slurp_asset_into_malloced_cstr(scene->conf.vert_path, MEM_TAG_SHADERS);
+    char *frag_source = slurp_asset_into_malloced_cstr(scene->conf.frag_path, MEM_TAG_SHADERS);
+    char *tuned_source = NULL;
+    if (vert_source == NULL || frag_source == NULL) {
+        fprintf(stderr, "ERROR: could not read the shaders of scene `%s` to tune them: %s\n",
+                scene->conf.name, strerror(errno));
+        goto defer;
+    }
+
+    Hash128 key = autotune_cache_key(autotune, &scene->conf, vert_source, frag_source);
+    size_t winner = 0;
+    bool cached = !autotune->retune && autotune_cache_load(key, &space, &winner);
+    if (!cached && autotune->cache_only) {
+        printf("Autotune: no cached winner for scene `%s`, using the defaults of the shader\n", scene->conf.name);
+        goto defer;
+    }
+    if (!cached) {
+        printf("Autotune: tuning scene `%s`, %zu variants\n", scene->conf.name, space.variants_count);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, resources_use_texture(rm, scene->texture));
+        if (!autotune_benchmark(autotune, &space, targets, vert_source, frag_source,
+                                width, height, vertices_count, &winner)) {
+            fprintf(stderr, "ERROR: could not tune scene `%s`\n", scene->conf.name);
+            goto defer;
+        }
+        autotune_cache_save(autotune, key, &space, winner);
+    }
+
+    tuned_source = autotune_variant_source(&space, winner, frag_source);
+    if (tuned_source == NULL) goto defer;
+    Program_Handle program = resources_load_program_from_sources(rm, scene->conf.vert_path, scene->conf.frag_path,
+                                                                 vert_source, tuned_source);
+    if (resources_use_program(rm, program) == 0) {
+        fprintf(stderr, "ERROR: could not build the tuned shaders of scene `%s`\n", scene->conf.name);
+        goto defer;
+    }
+    scene_set_program(scene, rm, program);
+    printf("Autotune: scene `%s` uses ", scene->conf.name);
+    autotune_print_variant(&space, winner, stdout);
+    printf("%s\n", cached ? " (cached)" : "");
+
+defer:
+    mem_free(vert_source);
+    mem_free(frag_source);
+    mem_free(tuned_source);
+}
@@ -6,3 +6,4 @@ set INCLUDES=/I Dependencies\GLFW\include /I include
 set LIBS=Dependencies\GLFW\lib\glfw3.lib opengl32.lib User32.lib Gdi32.lib Shell32.lib
 
 cl.exe %CFLAGS% %INCLUDES% /Fe"main.exe" ./main.c %LIBS% /link /NODEFAULTLIB:libcmt.lib
+cl.exe /std:c11 /O2 /FC /W4 /WX /wd4996 /nologo /Fe"pack.exe" ./pack.c
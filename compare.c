@@ -0,0 +1,430 @@
+// A/B comparison of two fragment shaders. render.conf names the challenger:
+//
+//   compare = shaders/main_fast.frag
+//
+// and the current scene is rendered with its own fragment shader (A) on the
+// left of a divider and with the challenger (B) on the right, both with the
+// same vertex shader, texture and uniforms. The divider can be dragged with
+// the left mouse button.
+//
+// Every side is timed with its own GL_TIME_ELAPSED query. A side only covers
+// part of the frame, so its time is scaled up to the whole frame before it
+// goes into the samples, otherwise moving the divider would favor the
+// smaller side. The window title shows the mean and the 95th percentile of
+// the last COMPARE_SAMPLES_CAP samples of every side, F7 prints them.
+//
+// F9 switches to the difference view: both shaders render the whole frame
+// into their own target and the frame shows |A - B|, amplified so that
+// differences of a single 8 bit step are visible. An occlusion query counts
+// the pixels that differ, so speed and output are checked in one view. It is
+// skipped while the overdraw view (F10) counts samples with its own query.
+
+#define COMPARE_TIMER_QUERIES 4
+#define COMPARE_SAMPLES_CAP 240
+#define COMPARE_GRAB_PIXELS 8.0
+#define COMPARE_DIVIDER_PIXELS 2
+#define COMPARE_DIFF_GAIN 16.0f
+#define COMPARE_TITLE_SECONDS 0.5
+#define COMPARE_WINDOW_TITLE "OpenGL Template"
+
+typedef enum {
+    COMPARE_A = 0,
+    COMPARE_B,
+    COUNT_COMPARE_SIDES,
+} Compare_Side;
+
+static const char *compare_side_names[COUNT_COMPARE_SIDES] = {
+    [COMPARE_A] = "A",
+    [COMPARE_B] = "B",
+};
+
+// Queries that are picked up a few frames later, so they never stall
+typedef struct {
+    GLuint queries[COMPARE_TIMER_QUERIES];
+    // What the result of every query is multiplied by
+    double scales[COMPARE_TIMER_QUERIES];
+    // Queries in flight, the oldest one is at `head`
+    size_t head;
+    size_t pending;
+    bool running;
+} Compare_Queries;
+
+typedef struct {
+    Compare_Queries timer;
+    // Milliseconds over the whole frame, a ring buffer
+    double samples[COMPARE_SAMPLES_CAP];
+    size_t samples_count;
+    size_t samples_next;
+} Compare_Stats;
+
+typedef struct {
+    const char *frag_path;
+    // The challenger is built for the vertex shader of `scene`
+    const Scene *scene;
+    Program_Handle program;
+    GLint uniforms[COUNT_UNIFORMS];
+    Timeline_Locations timeline_locations;
+    bool failed;
+    bool ready;
+
+    // Divider position as a fraction of the width
+    double split;
+    bool dragging;
+    bool was_pressed;
+    bool diff;
+
+    GLuint diff_program;
+    GLint diff_a_uniform;
+    GLint diff_b_uniform;
+    GLint diff_gain_uniform;
+    Compare_Queries diff_pixels;
+    uint64_t differing_pixels;
+    bool has_differing_pixels;
+
+    // State of the frame between compare_begin() and compare_end()
+    GLint framebuffer;
+    GLint viewport[4];
+    Render_Target *targets[COUNT_COMPARE_SIDES];
+
+    Compare_Stats stats[COUNT_COMPARE_SIDES];
+    double title_time;
+    bool title_changed;
+} Compare;
+
+static const char *compare_diff_frag_source =
+    "#version 330\n"
+    "uniform sampler2D a;\n"
+    "uniform sampler2D b;\n"
+    "uniform float gain;\n"
+    "in vec2 uv;\n"
+    "out vec4 color;\n"
+    "void main(void)\n"
+    "{\n"
+    "    vec3 d = abs(texture(a, uv).rgb - texture(b, uv).rgb);\n"
+    "    float m = max(d.r, max(d.g, d.b));\n"
+    "    // Identical pixels don't pass, so the samples passed are the pixels that differ\n"
+    "    if (m < 0.5/255.0) discard;\n"
+    "    color = vec4(max(d*gain, vec3(0.25)), 1.0);\n"
+    "}\n";
+
+static bool compare_queries_poll(Compare_Queries *q, double *value)
+{
+    if (q->pending == 0) return false;
+    GLuint query = q->queries[q->head];
+    GLint available = 0;
+    glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) return false;
+    GLuint64 result = 0;
+    glGetQueryObjectui64v(query, GL_QUERY_RESULT, &result);
+    *value = (double) result*q->scales[q->head];
+    q->head = (q->head + 1) % COMPARE_TIMER_QUERIES;
+    q->pending -= 1;
+    return true;
+}
+
+// Skips the query when all of them are still in flight or another query of
+// `target` is active, like the GL_SAMPLES_PASSED of the overdraw view, since
+// only one can be active at a time
+static void compare_queries_begin(Compare_Queries *q, GLenum target, double scale)
+{
+    GLint active = 0;
+    glGetQueryiv(target, GL_CURRENT_QUERY, &active);
+    q->running = q->pending < COMPARE_TIMER_QUERIES && active == 0;
+    if (!q->running) return;
+    size_t index = (q->head + q->pending) % COMPARE_TIMER_QUERIES;
+    q->scales[index] = scale;
+    glBeginQuery(target, q->queries[index]);
+}
+
+static void compare_queries_end(Compare_Queries *q, GLenum target)
+{
+    if (!q->running) return;
+    glEndQuery(target);
+    q->pending += 1;
+    q->running = false;
+}
+
+static int compare_double_cmp(const void *a, const void *b)
+{
+    double x = *(const double*) a;
+    double y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+// Returns false when there are no samples yet
+static bool compare_stats_summary(const Compare_Stats *stats, double *mean, double *p95)
+{
+    if (stats->samples_count == 0) return false;
+    double sorted[COMPARE_SAMPLES_CAP];
+    memcpy(sorted, stats->samples, stats->samples_count*sizeof(double));
+    qsort(sorted, stats->samples_count, sizeof(double), compare_double_cmp);
+    double sum = 0.0;
+    for (size_t i = 0; i < stats->samples_count; ++i) sum += sorted[i];
+    *mean = sum/(double) stats->samples_count;
+    *p95 = sorted[(stats->samples_count*95 - 1)/100];
+    return true;
+}
+
+static void compare_stats_reset(Compare_Stats *stats)
+{
+    stats->samples_count = 0;
+    stats->samples_next = 0;
+}
+
+static void compare_unload_program(Compare *compare, Resource_Manager *rm)
+{
+    resources_release_program(rm, compare->program);
+    memset(&compare->program, 0, sizeof(compare->program));
+    compare->scene = NULL;
+    compare->ready = false;
+    compare->failed = false;
+    for (Compare_Side side = 0; side < COUNT_COMPARE_SIDES; ++side) compare_stats_reset(&compare->stats[side]);
+    compare->has_differing_pixels = false;
+}
+
+// `frag_path` may be NULL to turn the comparison off
+bool compare_load(Compare *compare, Resource_Manager *rm, const char *frag_path)
+{
+    compare_unload_program(compare, rm);
+    compare->frag_path = frag_path;
+    compare->title_changed = true;
+    if (frag_path == NULL) return true;
+    if (compare->split <= 0.0) compare->split = 0.5;
+
+    if (compare->diff_program == 0) {
+        if (!create_program(post_vert_source, compare_diff_frag_source, &compare->diff_program)) {
+            fprintf(stderr, "ERROR: could not compile the A/B difference shaders\n");
+            compare->frag_path = NULL;
+            return false;
+        }
+        compare->diff_a_uniform = glGetUniformLocation(compare->diff_program, "a");
+        compare->diff_b_uniform = glGetUniformLocation(compare->diff_program, "b");
+        compare->diff_gain_uniform = glGetUniformLocation(compare->diff_program, "gain");
+        for (Compare_Side side = 0; side < COUNT_COMPARE_SIDES; ++side) {
+            glGenQueries(COMPARE_TIMER_QUERIES, compare->stats[side].timer.queries);
+        }
+        glGenQueries(COMPARE_TIMER_QUERIES, compare->diff_pixels.queries);
+    }
+    printf("A/B: comparing against %s\n", frag_path);
+    return true;
+}
+
+static void compare_poll(Compare *compare)
+{
+    for (Compare_Side side = 0; side < COUNT_COMPARE_SIDES; ++side) {
+        Compare_Stats *stats = &compare->stats[side];
+        double ns = 0.0;
+        while (compare_queries_poll(&stats->timer, &ns)) {
+            stats->samples[stats->samples_next] = ns/1e6;
+            stats->samples_next = (stats->samples_next + 1) % COMPARE_SAMPLES_CAP;
+            if (stats->samples_count < COMPARE_SAMPLES_CAP) stats->samples_count += 1;
+        }
+    }
+    double pixels = 0.0;
+    while (compare_queries_poll(&compare->diff_pixels, &pixels)) {
+        compare->differing_pixels = (uint64_t) pixels;
+        compare->has_differing_pixels = true;
+    }
+}
+
+// Starts rendering `scene` twice. Returns false when there is nothing to
+// compare, the scene is then rendered as usual.
+bool compare_begin(Compare *compare, Resource_Manager *rm, const Scene *scene, Render_Targets *targets)
+{
+    if (compare->frag_path == NULL) return false;
+    if (compare->scene != scene) {
+        compare_unload_program(compare, rm);
+        compare->scene = scene;
+        compare->program = resources_load_program(rm, scene->conf.vert_path, compare->frag_path);
+        GLuint program = resources_use_program(rm, compare->program);
+        if (program == 0) {
+            fprintf(stderr, "ERROR: could not build %s with %s for A/B\n", compare->frag_path, scene->conf.vert_path);
+            compare->failed = true;
+        } else {
+            for (Uniform index = 0; index < COUNT_UNIFORMS; ++index) {
+                compare->uniforms[index] = glGetUniformLocation(program, uniform_names[index]);
+            }
+            compare->timeline_locations = (Timeline_Locations) {0};
+            compare->ready = true;
+        }
+    }
+    if (!compare->ready) return false;
+
+    compare_poll(compare);
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &compare->framebuffer);
+    glGetIntegerv(GL_VIEWPORT, compare->viewport);
+    if (compare->diff) {
+        for (Compare_Side side = 0; side < COUNT_COMPARE_SIDES; ++side) {
+            compare->targets[side] = render_targets_acquire(targets, compare->viewport[2], compare->viewport[3],
+                                                            GL_RGBA16F, 1);
+        }
+        if (compare->targets[COMPARE_A] == NULL || compare->targets[COMPARE_B] == NULL) {
+            for (Compare_Side side = 0; side < COUNT_COMPARE_SIDES; ++side) {
+                render_targets_release(compare->targets[side]);
+                compare->targets[side] = NULL;
+            }
+            compare->diff = false;
+        }
+    }
+    return true;
+}
+
+// Returns the program to render `side` with and its uniforms. `program` and
+// `uniforms` are the ones of the scene.
+GLuint compare_begin_side(Compare *compare, Resource_Manager *rm, Compare_Side side,
+                          GLuint program, const GLint *uniforms, const GLint **side_uniforms)
+{
+    const GLint *vp = compare->viewport;
+    double scale = 1.0;
+    if (compare->diff) {
+        Render_Target *target = compare->targets[side];
+        glBindFramebuffer(GL_FRAMEBUFFER, target->framebuffer);
+        glViewport(0, 0, target->width, target->height);
+        glClear(GL_COLOR_BUFFER_BIT);
+    } else {
+        int split = (int) (compare->split*vp[2]);
+        int x = side == COMPARE_A ? 0 : split;
+        int width = side == COMPARE_A ? split : vp[2] - split;
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(vp[0] + x, vp[1], width, vp[3]);
+        // A side with no pixels says nothing about the speed of its shader
+        scale = width > 0 ? (double) vp[2]/(double) width : 0.0;
+    }
+    if (scale > 0.0) compare_queries_begin(&compare->stats[side].timer, GL_TIME_ELAPSED, scale);
+
+    if (side == COMPARE_A) {
+        *side_uniforms = uniforms;
+        return program;
+    }
+    *side_uniforms = compare->uniforms;
+    return resources_use_program(rm, compare->program);
+}
+
+void compare_end_side(Compare *compare, Compare_Side side)
+{
+    compare_queries_end(&compare->stats[side].timer, GL_TIME_ELAPSED);
+}
+
+// Puts the two renders together into the framebuffer that was bound at compare_begin()
+void compare_end(Compare *compare)
+{
+    const GLint *vp = compare->viewport;
+    GLfloat clear_color[4];
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, clear_color);
+    glBindFramebuffer(GL_FRAMEBUFFER, (GLuint) compare->framebuffer);
+    glViewport(vp[0], vp[1], vp[2], vp[3]);
+
+    if (compare->diff) {
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        GLboolean blend = glIsEnabled(GL_BLEND);
+        glDisable(GL_BLEND);
+        glUseProgram(compare->diff_program);
+        glUniform1i(compare->diff_a_uniform, 0);
+        glUniform1i(compare->diff_b_uniform, 3);
+        glUniform1f(compare->diff_gain_uniform, COMPARE_DIFF_GAIN);
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_2D, compare->targets[COMPARE_B]->texture);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, compare->targets[COMPARE_A]->texture);
+        compare_queries_begin(&compare->diff_pixels, GL_SAMPLES_PASSED, 1.0);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        compare_queries_end(&compare->diff_pixels, GL_SAMPLES_PASSED);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glActiveTexture(GL_TEXTURE0);
+        if (blend) glEnable(GL_BLEND);
+        for (Compare_Side side = 0; side < COUNT_COMPARE_SIDES; ++side) {
+            render_targets_release(compare->targets[side]);
+            compare->targets[side] = NULL;
+        }
+    } else {
+        int split = (int) (compare->split*vp[2]);
+        glScissor(vp[0] + split - COMPARE_DIVIDER_PIXELS/2, vp[1], COMPARE_DIVIDER_PIXELS, vp[3]);
+        glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glDisable(GL_SCISSOR_TEST);
+    }
+    glClearColor(clear_color[0], clear_color[1], clear_color[2], clear_color[3]);
+}
+
+void compare_toggle_diff(Compare *compare)
+{
+    if (compare->frag_path == NULL) return;
+    compare->diff = !compare->diff;
+    compare->has_differing_pixels = false;
+    printf("A/B: %s\n", compare->diff ? "difference" : "split");
+}
+
+// Drags the divider with the left mouse button. Returns true while the
+// divider is being dragged, so the drag isn't used for anything else.
+bool compare_update(Compare *compare, GLFWwindow *window, double now)
+{
+    if (compare->title_changed || (compare->ready && now - compare->title_time >= COMPARE_TITLE_SECONDS)) {
+        char title[256];
+        if (compare->ready) {
+            int n = snprintf(title, sizeof(title), "A/B:");
+            for (Compare_Side side = 0; side < COUNT_COMPARE_SIDES; ++side) {
+                double mean, p95;
+                if (compare_stats_summary(&compare->stats[side], &mean, &p95)) {
+                    n += snprintf(title + n, sizeof(title) - (size_t) n, "%s %s %.3f ms (p95 %.3f)",
+                                  side == COMPARE_A ? "" : ",", compare_side_names[side], mean, p95);
+                }
+            }
+            if (compare->diff && compare->has_differing_pixels) {
+                snprintf(title + n, sizeof(title) - (size_t) n, ", %llu pixels differ",
+                         (unsigned long long) compare->differing_pixels);
+            }
+        } else {
+            snprintf(title, sizeof(title), "%s", COMPARE_WINDOW_TITLE);
+        }
+        glfwSetWindowTitle(window, title);
+        compare->title_time = now;
+        compare->title_changed = false;
+    }
+
+    if (!compare->ready || compare->diff) {
+        compare->dragging = false;
+        return false;
+    }
+    int width, height;
+    glfwGetWindowSize(window, &width, &height);
+    if (width <= 0) return false;
+    double xpos, ypos;
+    glfwGetCursorPos(window, &xpos, &ypos);
+    bool pressed = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+    if (pressed && !compare->was_pressed && fabs(xpos - compare->split*width) <= COMPARE_GRAB_PIXELS) {
+        compare->dragging = true;
+    }
+    if (!pressed) compare->dragging = false;
+    compare->was_pressed = pressed;
+    if (compare->dragging) {
+        double split = xpos/width;
+        compare->split = split < 0.0 ? 0.0 : split > 1.0 ? 1.0 : split;
+    }
+    return compare->dragging;
+}
+
+void compare_print_stats(const Compare *compare)
+{
+    if (!compare->ready) return;
+    printf("A/B GPU time over the whole frame, last %d samples:\n", COMPARE_SAMPLES_CAP);
+    double means[COUNT_COMPARE_SIDES] = {0};
+    bool has_means = true;
+    for (Compare_Side side = 0; side < COUNT_COMPARE_SIDES; ++side) {
+        double p95;
+        if (compare_stats_summary(&compare->stats[side], &means[side], &p95)) {
+            printf("  %s %8.3f ms mean %8.3f ms p95  %s\n", compare_side_names[side], means[side], p95,
+                   side == COMPARE_A ? compare->scene->conf.frag_path : compare->frag_path);
+        } else {
+            has_means = false;
+        }
+    }
+    if (has_means && means[COMPARE_A] > 0.0) {
+        printf("  B takes %.1f%% of the time of A\n", means[COMPARE_B]/means[COMPARE_A]*100.0);
+    }
+    if (compare->has_differing_pixels) {
+        printf("  %llu pixels differ\n", (unsigned long long) compare->differing_pixels);
+    }
+}
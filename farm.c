@@ -0,0 +1,425 @@
+// Offline rendering of a range of frames at a fixed time step:
+//
+//   ./main -frames 0:599 -fps 60 -out frames
+//
+// renders frames 0 to 599 with `time` at frame/fps into
+// frames/frame_000000.png and so on, with a hidden window, the mouse in the
+// middle of it and every scene loaded before the first frame, so the
+// output doesn't depend on how fast the machine is. The PNGs are encoded on
+// the job pool while the next frames render.
+//
+// `-farm N` splits the range across N worker processes, each with its own
+// GL context. The coordinator doesn't render, it starts the workers with
+// its own command line plus `-farm-worker <index>`, waits for them and
+// reports how fast every one of them went. The range is cut into chunks of
+// a few frames and every worker starts with a contiguous run of
+// FARM_CHUNKS_PER_WORKER of them. A worker claims its chunks front to back
+// by creating `<out>/.farm/chunk_<n>` exclusively, and once it runs out
+// it steals the last unclaimed chunk of the worker with the most left, so
+// the workers finish at about the same time even when some frames are much
+// more expensive than others. Frames are named by their number, so the
+// outputs of all the workers make one ordered sequence, which the
+// coordinator checks for holes before it cleans up the claims.
+
+#define FARM_CHUNKS_PER_WORKER 16
+#define FARM_WORKERS_CAP 64
+#define FARM_CLAIMS_DIR ".farm"
+
+typedef struct {
+    // Set by the command line, `enabled` by -frames
+    bool enabled;
+    size_t first;
+    size_t last;
+    double fps;
+    const char *out_dir;
+    // Workers to split the range across, 0 renders in this process
+    size_t workers;
+    // Index of this worker or -1
+    long worker;
+
+    char *claims_dir;
+    size_t chunk_frames;
+    size_t chunks_count;
+    size_t next_frame;
+    size_t chunk_end;
+    size_t next_own_chunk;
+    size_t frames_done;
+    size_t chunks_done;
+    size_t chunks_stolen;
+    double start_time;
+} Farm;
+
+typedef struct {
+    unsigned char *pixels;
+    int width;
+    int height;
+    char path[512];
+} Farm_Encode;
+
+// Wall clock that works without GLFW, which the coordinator never initializes
+static double farm_now(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double) ts.tv_sec + (double) ts.tv_nsec*1e-9;
+}
+
+static void farm_mkdir(const char *path)
+{
+#ifdef _WIN32
+    _mkdir(path);
+#else
+    mkdir(path, 0755);
+#endif // _WIN32
+}
+
+static void farm_rmdir(const char *path)
+{
+#ifdef _WIN32
+    _rmdir(path);
+#else
+    rmdir(path);
+#endif // _WIN32
+}
+
+// Parses `<first>:<last>`
+bool farm_parse_range(Farm *farm, const char *range)
+{
+    char *end = NULL;
+    unsigned long long first = strtoull(range, &end, 10);
+    if (end == range || *end != ':') return false;
+    const char *last_start = end + 1;
+    unsigned long long last = strtoull(last_start, &end, 10);
+    if (end == last_start || *end != '\0' || last < first) return false;
+    farm->first = (size_t) first;
+    farm->last = (size_t) last;
+    farm->enabled = true;
+    return true;
+}
+
+static void farm_layout(Farm *farm)
+{
+    size_t frames = farm->last - farm->first + 1;
+    size_t workers = farm->workers > 0 ? farm->workers : 1;
+    size_t chunks = workers*FARM_CHUNKS_PER_WORKER;
+    farm->chunk_frames = (frames + chunks - 1)/chunks;
+    farm->chunks_count = (frames + farm->chunk_frames - 1)/farm->chunk_frames;
+}
+
+// Chunks of `worker` are [*begin, *end)
+static void farm_worker_chunks(const Farm *farm, size_t worker, size_t *begin, size_t *end)
+{
+    *begin = worker*farm->chunks_count/farm->workers;
+    *end = (worker + 1)*farm->chunks_count/farm->workers;
+}
+
+static void farm_claim_path(const Farm *farm, size_t chunk, char *path, size_t path_size)
+{
+    snprintf(path, path_size, "%s/chunk_%06zu", farm->claims_dir, chunk);
+}
+
+static void farm_worker_stats_path(const Farm *farm, size_t worker, char *path, size_t path_size)
+{
+    snprintf(path, path_size, "%s/worker_%zu.txt", farm->claims_dir, worker);
+}
+
+static bool farm_is_claimed(const Farm *farm, size_t chunk)
+{
+    char path[512];
+    farm_claim_path(farm, chunk, path, sizeof(path));
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) return false;
+    fclose(f);
+    return true;
+}
+
+// Creating the claim fails if any other worker got there first
+static bool farm_claim(const Farm *farm, size_t chunk)
+{
+    char path[512];
+    farm_claim_path(farm, chunk, path, sizeof(path));
+    FILE *f = fopen(path, "wx");
+    if (f == NULL) return false;
+    fprintf(f, "%ld\n", farm->worker);
+    fclose(f);
+    return true;
+}
+
+// Claims the last unclaimed chunk of the worker with the most unclaimed chunks
+static bool farm_steal(Farm *farm, size_t *chunk)
+{
+    for (;;) {
+        size_t victim = 0;
+        size_t victim_left = 0;
+        size_t victim_last = 0;
+        for (size_t w = 0; w < farm->workers; ++w) {
+            size_t begin, end;
+            farm_worker_chunks(farm, w, &begin, &end);
+            size_t left = 0;
+            size_t last = 0;
+            for (size_t c = begin; c < end; ++c) {
+                if (farm_is_claimed(farm, c)) continue;
+                left += 1;
+                last = c;
+            }
+            if (left > victim_left) {
+                victim = w;
+                victim_left = left;
+                victim_last = last;
+            }
+        }
+        if (victim_left == 0) return false;
+        // Somebody else may take it in the meantime, then look again
+        if (farm_claim(farm, victim_last)) {
+            if (victim != (size_t) farm->worker) farm->chunks_stolen += 1;
+            *chunk = victim_last;
+            return true;
+        }
+    }
+}
+
+static bool farm_next_chunk(Farm *farm, size_t *chunk)
+{
+    size_t begin, end;
+    farm_worker_chunks(farm, (size_t) farm->worker, &begin, &end);
+    if (farm->next_own_chunk < begin) farm->next_own_chunk = begin;
+    // Thieves take chunks from the back, so the first claimed one means the rest are gone too
+    if (farm->next_own_chunk < end && farm_claim(farm, farm->next_own_chunk)) {
+        *chunk = farm->next_own_chunk++;
+        return true;
+    }
+    farm->next_own_chunk = end;
+    return farm_steal(farm, chunk);
+}
+
+static bool farm_init_claims(Farm *farm)
+{
+    farm_layout(farm);
+    size_t size = strlen(farm->out_dir) + sizeof("/"FARM_CLAIMS_DIR);
+    farm->claims_dir = mem_alloc(MEM_TAG_CONFIG, size);
+    if (farm->claims_dir == NULL) return false;
+    snprintf(farm->claims_dir, size, "%s/"FARM_CLAIMS_DIR, farm->out_dir);
+    return true;
+}
+
+// Prepares rendering of the range in this process, as the only renderer or as a worker
+bool farm_begin(Farm *farm)
+{
+    farm_mkdir(farm->out_dir);
+    farm->next_frame = farm->first;
+    farm->chunk_end = farm->first;
+    farm->start_time = farm_now();
+    if (farm->worker < 0) {
+        farm->chunk_end = farm->last + 1;
+        return true;
+    }
+    return farm_init_claims(farm);
+}
+
+// Returns false once there's nothing left to render
+bool farm_next_frame(Farm *farm, size_t *frame)
+{
+    if (farm->next_frame >= farm->chunk_end) {
+        size_t chunk;
+        if (farm->worker < 0 || !farm_next_chunk(farm, &chunk)) return false;
+        farm->next_frame = farm->first + chunk*farm->chunk_frames;
+        farm->chunk_end = farm->next_frame + farm->chunk_frames;
+        if (farm->chunk_end > farm->last + 1) farm->chunk_end = farm->last + 1;
+        farm->chunks_done += 1;
+    }
+    *frame = farm->next_frame++;
+    return true;
+}
+
+double farm_frame_time(const Farm *farm, size_t frame)
+{
+    return (double) frame/farm->fps;
+}
+
+static void farm_encode_job(void *arg)
+{
+    Farm_Encode *encode = arg;
+    if (!save_rgb_png(encode->path, encode->width, encode->height, encode->pixels)) {
+        fprintf(stderr, "ERROR: could not write %s: %s\n", encode->path, strerror(errno));
+    }
+    mem_free(encode->pixels);
+    mem_free(encode);
+}
+
+// Reads back the finished frame from the window and saves it on the job pool
+void farm_capture(Farm *farm, Job_Pool *pool, size_t frame, int width, int height)
+{
+    if (width <= 0 || height <= 0) return;
+    Farm_Encode *encode = mem_alloc(MEM_TAG_CAPTURE, sizeof(*encode));
+    unsigned char *pixels = mem_alloc(MEM_TAG_CAPTURE, (size_t) width*height*3);
+    if (encode == NULL || pixels == NULL) {
+        fprintf(stderr, "ERROR: could not allocate memory for frame %zu\n", frame);
+        mem_free(encode);
+        mem_free(pixels);
+        return;
+    }
+    read_rgb_pixels(width, height, pixels);
+    encode->pixels = pixels;
+    encode->width = width;
+    encode->height = height;
+    snprintf(encode->path, sizeof(encode->path), "%s/frame_%06zu.png", farm->out_dir, frame);
+    if (!job_pool_submit(pool, farm_encode_job, encode)) farm_encode_job(encode);
+    farm->frames_done += 1;
+}
+
+// Expects the encoding jobs to be done, i.e. job_pool_wait() before farm_end()
+void farm_end(Farm *farm)
+{
+    double seconds = farm_now() - farm->start_time;
+    if (farm->worker < 0) {
+        printf("Offline: %zu frames in %.2f s, %.2f frames/s\n", farm->frames_done, seconds,
+               seconds > 0.0 ? (double) farm->frames_done/seconds : 0.0);
+    } else {
+        char path[512];
+        farm_worker_stats_path(farm, (size_t) farm->worker, path, sizeof(path));
+        FILE *f = fopen(path, "w");
+        if (f == NULL) {
+            fprintf(stderr, "ERROR: could not write %s: %s\n", path, strerror(errno));
+        } else {
+            fprintf(f, "%zu %zu %zu %f\n", farm->frames_done, farm->chunks_done, farm->chunks_stolen, seconds);
+            fclose(f);
+        }
+    }
+    mem_free(farm->claims_dir);
+    farm->claims_dir = NULL;
+}
+
+#ifdef _WIN32
+typedef intptr_t Farm_Process;
+#else
+typedef pid_t Farm_Process;
+#endif // _WIN32
+
+static bool farm_spawn(char **args, Farm_Process *process)
+{
+#ifdef _WIN32
+    *process = _spawnvp(_P_NOWAIT, args[0], (const char * const*) args);
+    return *process != -1;
+#else
+    *process = fork();
+    if (*process < 0) return false;
+    if (*process == 0) {
+        execvp(args[0], args);
+        fprintf(stderr, "ERROR: could not start %s: %s\n", args[0], strerror(errno));
+        _exit(127);
+    }
+    return true;
+#endif // _WIN32
+}
+
+static bool farm_wait(Farm_Process process)
+{
+#ifdef _WIN32
+    int status = 0;
+    if (_cwait(&status, process, _WAIT_CHILD) == -1) return false;
+    return status == 0;
+#else
+    int status = 0;
+    if (waitpid(process, &status, 0) < 0) return false;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+#endif // _WIN32
+}
+
+// Runs the workers with the command line `argv` of the coordinator and
+// returns the exit code of the coordinator
+int farm_coordinate(Farm *farm, int argc, char **argv)
+{
+    if (farm->workers > FARM_WORKERS_CAP) {
+        fprintf(stderr, "ERROR: at most %d workers are supported\n", FARM_WORKERS_CAP);
+        return 1;
+    }
+    farm_mkdir(farm->out_dir);
+    if (!farm_init_claims(farm)) return 1;
+    farm_mkdir(farm->claims_dir);
+
+    // Claims of an earlier run would keep their chunks from being rendered
+    char path[512];
+    for (size_t c = 0; c < farm->chunks_count; ++c) {
+        farm_claim_path(farm, c, path, sizeof(path));
+        remove(path);
+    }
+    for (size_t w = 0; w < farm->workers; ++w) {
+        farm_worker_stats_path(farm, w, path, sizeof(path));
+        remove(path);
+    }
+
+    printf("Farm: frames %zu to %zu at %g fps, %zu workers, %zu chunks of %zu frames\n",
+           farm->first, farm->last, farm->fps, farm->workers, farm->chunks_count, farm->chunk_frames);
+    fflush(stdout);
+
+    char **args = mem_alloc(MEM_TAG_CONFIG, (size_t) (argc + 3)*sizeof(*args));
+    if (args == NULL) return 1;
+    memcpy(args, argv, (size_t) argc*sizeof(*args));
+    char index[32];
+    args[argc] = "-farm-worker";
+    args[argc + 1] = index;
+    args[argc + 2] = NULL;
+
+    Farm_Process processes[FARM_WORKERS_CAP];
+    bool ok = true;
+    size_t started = 0;
+    double start = farm_now();
+    for (; started < farm->workers; ++started) {
+        snprintf(index, sizeof(index), "%zu", started);
+        if (!farm_spawn(args, &processes[started])) {
+            fprintf(stderr, "ERROR: could not start worker %zu: %s\n", started, strerror(errno));
+            ok = false;
+            break;
+        }
+    }
+    for (size_t w = 0; w < started; ++w) {
+        if (!farm_wait(processes[w])) {
+            fprintf(stderr, "ERROR: worker %zu failed\n", w);
+            ok = false;
+        }
+    }
+    double seconds = farm_now() - start;
+    mem_free(args);
+
+    for (size_t w = 0; w < started; ++w) {
+        farm_worker_stats_path(farm, w, path, sizeof(path));
+        FILE *f = fopen(path, "r");
+        size_t frames = 0, chunks = 0, stolen = 0;
+        double worker_seconds = 0.0;
+        if (f == NULL || fscanf(f, "%zu %zu %zu %lf", &frames, &chunks, &stolen, &worker_seconds) != 4) {
+            printf("Worker %zu: no stats\n", w);
+        } else {
+            printf("Worker %zu: %zu frames in %.2f s, %.2f frames/s, %zu chunks, %zu stolen\n",
+                   w, frames, worker_seconds, worker_seconds > 0.0 ? (double) frames/worker_seconds : 0.0,
+                   chunks, stolen);
+        }
+        if (f != NULL) fclose(f);
+        remove(path);
+    }
+
+    size_t missing = 0;
+    for (size_t frame = farm->first; frame <= farm->last; ++frame) {
+        snprintf(path, sizeof(path), "%s/frame_%06zu.png", farm->out_dir, frame);
+        FILE *f = fopen(path, "rb");
+        if (f == NULL) {
+            if (missing < 8) fprintf(stderr, "ERROR: frame %zu is missing\n", frame);
+            missing += 1;
+        } else {
+            fclose(f);
+        }
+    }
+    if (missing > 0) ok = false;
+
+    for (size_t c = 0; c < farm->chunks_count; ++c) {
+        farm_claim_path(farm, c, path, sizeof(path));
+        remove(path);
+    }
+    farm_rmdir(farm->claims_dir);
+    mem_free(farm->claims_dir);
+    farm->claims_dir = NULL;
+
+    size_t frames = farm->last - farm->first + 1 - missing;
+    printf("Farm: %zu frames in %.2f s, %.2f frames/s%s\n", frames, seconds,
+           seconds > 0.0 ? (double) frames/seconds : 0.0, missing > 0 ? ", INCOMPLETE" : "");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,253 @@
+#ifndef FFT_H_
+#define FFT_H_
+
+// Fast Fourier transform of real signals.
+//
+// A real signal of `n` samples is transformed as a complex signal of `n/2`
+// samples (even samples are the real parts, odd ones the imaginary parts)
+// with an iterative radix-4 FFT and then split into the spectrum of the real
+// signal. So `n/2` has to be a power of 4: 512, 2048, 8192, 32768, ...
+//
+// The butterflies run 4 at a time with SSE2 when it's available. Define
+// FFT_NO_SIMD to force the scalar code.
+//
+// USAGE:
+//   Fft fft = {0};
+//   if (!fft_init(&fft, 8192)) ...;
+//   fft_magnitudes(&fft, samples, magnitudes); // 8192 samples in, 4096 bins out
+//   fft_free(&fft);
+//
+// An Fft keeps its scratch buffers inside, so use one per thread.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef FFTDEF
+#define FFTDEF
+#endif // FFTDEF
+
+typedef struct {
+    // Real samples
+    size_t n;
+    // Complex samples, n/2
+    size_t m;
+    // Base 4 digit reversal of [0, m)
+    uint32_t *reverse;
+    // Every stage with a quarter size of q has 6 arrays of q floats: w1, w2
+    // and w3 with the real and imaginary parts split, in this order
+    float *twiddles;
+    // cos and sin of -2*pi*k/n for the final split, m each
+    float *split;
+    // Scratch, m each
+    float *re;
+    float *im;
+} Fft;
+
+FFTDEF bool fft_init(Fft *fft, size_t n);
+FFTDEF void fft_free(Fft *fft);
+// Complex spectrum of `fft->n` real samples, bins [0, n/2)
+FFTDEF void fft_real(Fft *fft, const float *samples, float *out_re, float *out_im);
+// Magnitudes of the bins [0, n/2)
+FFTDEF void fft_magnitudes(Fft *fft, const float *samples, float *magnitudes);
+
+#endif // FFT_H_
+
+#if defined(FFT_IMPLEMENTATION) && !defined(FFT_IMPLEMENTATION_)
+#define FFT_IMPLEMENTATION_
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef FFT_MALLOC
+#define FFT_MALLOC malloc
+#define FFT_FREE free
+#endif // FFT_MALLOC
+
+#if !defined(FFT_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define FFT_SSE2
+#include <emmintrin.h>
+#endif
+
+#define FFT__TAU 6.28318530717958647692
+
+FFTDEF bool fft_init(Fft *fft, size_t n)
+{
+    memset(fft, 0, sizeof(*fft));
+
+    size_t m = n / 2;
+    size_t digits = 0;
+    while (((size_t) 1 << (2*digits)) < m) digits += 1;
+    if (n < 8 || ((size_t) 1 << (2*digits)) != m) return false;
+
+    fft->n = n;
+    fft->m = m;
+    // Sum of the quarter sizes of all the stages is (m - 1)/3
+    fft->twiddles = FFT_MALLOC(6 * m * sizeof(float));
+    fft->reverse = FFT_MALLOC(m * sizeof(uint32_t));
+    fft->split = FFT_MALLOC(2 * m * sizeof(float));
+    fft->re = FFT_MALLOC(m * sizeof(float));
+    fft->im = FFT_MALLOC(m * sizeof(float));
+    if (fft->twiddles == NULL || fft->reverse == NULL || fft->split == NULL ||
+            fft->re == NULL || fft->im == NULL) {
+        fft_free(fft);
+        return false;
+    }
+
+    for (size_t i = 0; i < m; ++i) {
+        size_t r = 0;
+        for (size_t d = 0, x = i; d < digits; ++d, x >>= 2) r = (r << 2) | (x & 3);
+        fft->reverse[i] = (uint32_t) r;
+    }
+
+    float *w = fft->twiddles;
+    for (size_t q = 1; q < m; q *= 4) {
+        for (size_t j = 0; j < q; ++j) {
+            for (size_t k = 1; k <= 3; ++k) {
+                double angle = -FFT__TAU * (double) (j * k) / (double) (4 * q);
+                w[(2*k - 2)*q + j] = (float) cos(angle);
+                w[(2*k - 1)*q + j] = (float) sin(angle);
+            }
+        }
+        w += 6*q;
+    }
+
+    for (size_t k = 0; k < m; ++k) {
+        double angle = -FFT__TAU * (double) k / (double) n;
+        fft->split[k] = (float) cos(angle);
+        fft->split[m + k] = (float) sin(angle);
+    }
+
+    return true;
+}
+
+FFTDEF void fft_free(Fft *fft)
+{
+    FFT_FREE(fft->twiddles);
+    FFT_FREE(fft->reverse);
+    FFT_FREE(fft->split);
+    FFT_FREE(fft->re);
+    FFT_FREE(fft->im);
+    memset(fft, 0, sizeof(*fft));
+}
+
+// One radix-4 butterfly over the elements j, j+q, j+2q, j+3q of a block
+static inline void fft__butterfly(float *re, float *im, size_t q, size_t j, const float *w)
+{
+    float a0r = re[j],       a0i = im[j];
+    float b1r = re[j + q],   b1i = im[j + q];
+    float b2r = re[j + 2*q], b2i = im[j + 2*q];
+    float b3r = re[j + 3*q], b3i = im[j + 3*q];
+
+    float w1r = w[0*q + j], w1i = w[1*q + j];
+    float w2r = w[2*q + j], w2i = w[3*q + j];
+    float w3r = w[4*q + j], w3i = w[5*q + j];
+
+    float a1r = b1r*w1r - b1i*w1i, a1i = b1r*w1i + b1i*w1r;
+    float a2r = b2r*w2r - b2i*w2i, a2i = b2r*w2i + b2i*w2r;
+    float a3r = b3r*w3r - b3i*w3i, a3i = b3r*w3i + b3i*w3r;
+
+    float t0r = a0r + a2r, t0i = a0i + a2i;
+    float t1r = a0r - a2r, t1i = a0i - a2i;
+    float t2r = a1r + a3r, t2i = a1i + a3i;
+    // (a1 - a3) * -i
+    float t3r = a1i - a3i, t3i = a3r - a1r;
+
+    re[j]       = t0r + t2r; im[j]       = t0i + t2i;
+    re[j + q]   = t1r + t3r; im[j + q]   = t1i + t3i;
+    re[j + 2*q] = t0r - t2r; im[j + 2*q] = t0i - t2i;
+    re[j + 3*q] = t1r - t3r; im[j + 3*q] = t1i - t3i;
+}
+
+#ifdef FFT_SSE2
+// fft__butterfly() for j..j+3 at once
+static inline void fft__butterfly4(float *re, float *im, size_t q, size_t j, const float *w)
+{
+    __m128 a0r = _mm_loadu_ps(re + j),       a0i = _mm_loadu_ps(im + j);
+    __m128 b1r = _mm_loadu_ps(re + j + q),   b1i = _mm_loadu_ps(im + j + q);
+    __m128 b2r = _mm_loadu_ps(re + j + 2*q), b2i = _mm_loadu_ps(im + j + 2*q);
+    __m128 b3r = _mm_loadu_ps(re + j + 3*q), b3i = _mm_loadu_ps(im + j + 3*q);
+
+    __m128 w1r = _mm_loadu_ps(w + 0*q + j), w1i = _mm_loadu_ps(w + 1*q + j);
+    __m128 w2r = _mm_loadu_ps(w + 2*q + j), w2i = _mm_loadu_ps(w + 3*q + j);
+    __m128 w3r = _mm_loadu_ps(w + 4*q + j), w3i = _mm_loadu_ps(w + 5*q + j);
+
+    __m128 a1r = _mm_sub_ps(_mm_mul_ps(b1r, w1r), _mm_mul_ps(b1i, w1i));
+    __m128 a1i = _mm_add_ps(_mm_mul_ps(b1r, w1i), _mm_mul_ps(b1i, w1r));
+    __m128 a2r = _mm_sub_ps(_mm_mul_ps(b2r, w2r), _mm_mul_ps(b2i, w2i));
+    __m128 a2i = _mm_add_ps(_mm_mul_ps(b2r, w2i), _mm_mul_ps(b2i, w2r));
+    __m128 a3r = _mm_sub_ps(_mm_mul_ps(b3r, w3r), _mm_mul_ps(b3i, w3i));
+    __m128 a3i = _mm_add_ps(_mm_mul_ps(b3r, w3i), _mm_mul_ps(b3i, w3r));
+
+    __m128 t0r = _mm_add_ps(a0r, a2r), t0i = _mm_add_ps(a0i, a2i);
+    __m128 t1r = _mm_sub_ps(a0r, a2r), t1i = _mm_sub_ps(a0i, a2i);
+    __m128 t2r = _mm_add_ps(a1r, a3r), t2i = _mm_add_ps(a1i, a3i);
+    __m128 t3r = _mm_sub_ps(a1i, a3i), t3i = _mm_sub_ps(a3r, a1r);
+
+    _mm_storeu_ps(re + j,       _mm_add_ps(t0r, t2r)); _mm_storeu_ps(im + j,       _mm_add_ps(t0i, t2i));
+    _mm_storeu_ps(re + j + q,   _mm_add_ps(t1r, t3r)); _mm_storeu_ps(im + j + q,   _mm_add_ps(t1i, t3i));
+    _mm_storeu_ps(re + j + 2*q, _mm_sub_ps(t0r, t2r)); _mm_storeu_ps(im + j + 2*q, _mm_sub_ps(t0i, t2i));
+    _mm_storeu_ps(re + j + 3*q, _mm_sub_ps(t1r, t3r)); _mm_storeu_ps(im + j + 3*q, _mm_sub_ps(t1i, t3i));
+}
+#endif // FFT_SSE2
+
+static void fft__complex(Fft *fft)
+{
+    float *re = fft->re;
+    float *im = fft->im;
+    const float *w = fft->twiddles;
+    for (size_t q = 1; q < fft->m; q *= 4) {
+        for (size_t block = 0; block < fft->m; block += 4*q) {
+            size_t j = 0;
+#ifdef FFT_SSE2
+            for (; j + 4 <= q; j += 4) fft__butterfly4(re + block, im + block, q, j, w);
+#endif // FFT_SSE2
+            for (; j < q; ++j) fft__butterfly(re + block, im + block, q, j, w);
+        }
+        w += 6*q;
+    }
+}
+
+static void fft__packed(Fft *fft, const float *samples)
+{
+    for (size_t i = 0; i < fft->m; ++i) {
+        uint32_t r = fft->reverse[i];
+        fft->re[r] = samples[2*i + 0];
+        fft->im[r] = samples[2*i + 1];
+    }
+    fft__complex(fft);
+}
+
+// With Z the spectrum of the packed signal, the spectra of the even and odd
+// samples are E[k] = (Z[k] + conj(Z[m-k]))/2 and O[k] = -i(Z[k] - conj(Z[m-k]))/2,
+// and the spectrum of the whole signal is X[k] = E[k] + e^(-2*pi*i*k/n) O[k]
+static inline void fft__split(const Fft *fft, size_t k, float *xr, float *xi)
+{
+    size_t mk = (fft->m - k) & (fft->m - 1);
+    float zr = fft->re[k], zi = fft->im[k];
+    float cr = fft->re[mk], ci = -fft->im[mk];
+    float er = 0.5f*(zr + cr), ei = 0.5f*(zi + ci);
+    float odd_r = 0.5f*(zi - ci), odd_i = -0.5f*(zr - cr);
+    float wr = fft->split[k], wi = fft->split[fft->m + k];
+    *xr = er + wr*odd_r - wi*odd_i;
+    *xi = ei + wr*odd_i + wi*odd_r;
+}
+
+FFTDEF void fft_real(Fft *fft, const float *samples, float *out_re, float *out_im)
+{
+    fft__packed(fft, samples);
+    for (size_t k = 0; k < fft->m; ++k) fft__split(fft, k, &out_re[k], &out_im[k]);
+}
+
+FFTDEF void fft_magnitudes(Fft *fft, const float *samples, float *magnitudes)
+{
+    fft__packed(fft, samples);
+    for (size_t k = 0; k < fft->m; ++k) {
+        float xr, xi;
+        fft__split(fft, k, &xr, &xi);
+        magnitudes[k] = sqrtf(xr*xr + xi*xi);
+    }
+}
+
+#endif // FFT_IMPLEMENTATION
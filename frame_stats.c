@@ -0,0 +1,448 @@
+// Statistics of the rendered frames computed on the GPU. With stats enabled
+// the scene is rendered into the RGBA16F scene target of the post-processing
+// stack instead of the window, so values above 1.0 and NaNs that a shader
+// outputs survive. Two passes run over that texture every frame:
+//
+// - a reduction that repeatedly shrinks blocks of FRAME_STATS_BLOCK x
+//   FRAME_STATS_BLOCK texels into one, down to a single texel with the
+//   minimum, maximum and sum of the luminance together with the number of
+//   NaN and clipped pixels,
+// - a histogram of the luminance that draws a point per pixel into a
+//   FRAME_STATS_BINS x 1 float texture with additive blending.
+//
+// Their results, about a kilobyte, are read back into one of
+// FRAME_STATS_READBACKS pixel pack buffers and picked up a couple of frames
+// later by frame_stats_poll() once a fence says the GPU is done with them,
+// so the main thread never waits for the GPU and never reads whole frames.
+//
+// OpenGL 3.3 has no compute shaders, everything is done with fragment and
+// vertex shaders.
+//
+// Luminance is Rec. 709 of the RGB values as they are, the histogram covers
+// [0, 1] and everything brighter lands in the last bin. A pixel is clipped
+// when any of its channels is 1.0 or more.
+
+#define FRAME_STATS_BINS 256
+#define FRAME_STATS_BLOCK 8
+#define FRAME_STATS_MAX_LEVELS 16
+#define FRAME_STATS_READBACKS 3
+#define FRAME_STATS_STR_(x) #x
+#define FRAME_STATS_STR(x) FRAME_STATS_STR_(x)
+// Histogram, then the two texels of the last reduction level
+#define FRAME_STATS_READBACK_SIZE (FRAME_STATS_BINS*sizeof(float) + 2*4*sizeof(float))
+
+typedef struct {
+    size_t frame;
+    double time;
+    int width;
+    int height;
+    // Of the pixels that are not NaN, all 0 when there are none
+    float min;
+    float max;
+    float mean;
+    size_t nan_count;
+    size_t clipped_count;
+    uint32_t histogram[FRAME_STATS_BINS];
+} Frame_Stats_Result;
+
+typedef struct {
+    GLuint framebuffer;
+    // Pass 0 reads the frame, pass N reads the textures of level N-1
+    // 0: minimum, maximum and sum of the luminance, number of pixels that are not NaN
+    // 1: number of NaN pixels, number of clipped pixels
+    GLuint textures[2];
+    int width;
+    int height;
+} Frame_Stats_Level;
+
+typedef struct {
+    GLuint pbo;
+    GLsync fence;
+    size_t frame;
+    double time;
+    int width;
+    int height;
+} Frame_Stats_Readback;
+
+typedef struct {
+    bool enabled;
+
+    int width;
+    int height;
+    size_t texture_bytes;
+
+    GLuint reduce_program;
+    GLint reduce_first_uniform;
+    GLint reduce_source_uniforms[2];
+    Frame_Stats_Level levels[FRAME_STATS_MAX_LEVELS];
+    size_t levels_count;
+
+    GLuint histogram_program;
+    GLint histogram_frame_uniform;
+    GLuint histogram_framebuffer;
+    GLuint histogram_texture;
+    // Points of the histogram don't have attributes, but core profile needs a VAO to draw
+    GLuint vao;
+
+    // Ring of readbacks in flight, the oldest one is at `head`
+    Frame_Stats_Readback readbacks[FRAME_STATS_READBACKS];
+    size_t head;
+    size_t pending;
+} Frame_Stats;
+
+static const char *frame_stats_reduce_vert_source =
+    "#version 330\n"
+    "void main(void)\n"
+    "{\n"
+    "    vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);\n"
+    "    gl_Position = vec4(p*2.0 - 1.0, 0.0, 1.0);\n"
+    "}\n";
+
+static const char *frame_stats_reduce_frag_source =
+    "#version 330\n"
+    "#define BLOCK " FRAME_STATS_STR(FRAME_STATS_BLOCK) "\n"
+    "uniform sampler2D source0;\n"
+    "uniform sampler2D source1;\n"
+    "uniform bool first;\n"
+    "layout(location = 0) out vec4 out_stats0;\n"
+    "layout(location = 1) out vec4 out_stats1;\n"
+    "void main(void)\n"
+    "{\n"
+    "    ivec2 size = textureSize(source0, 0);\n"
+    "    ivec2 begin = ivec2(gl_FragCoord.xy)*BLOCK;\n"
+    "    ivec2 end = min(begin + BLOCK, size);\n"
+    "    vec4 stats0 = vec4(uintBitsToFloat(0x7F800000u), -uintBitsToFloat(0x7F800000u), 0.0, 0.0);\n"
+    "    vec4 stats1 = vec4(0.0);\n"
+    "    for (int y = begin.y; y < end.y; ++y) {\n"
+    "        for (int x = begin.x; x < end.x; ++x) {\n"
+    "            if (first) {\n"
+    "                vec3 c = texelFetch(source0, ivec2(x, y), 0).rgb;\n"
+    "                float l = dot(c, vec3(0.2126, 0.7152, 0.0722));\n"
+    "                if (isnan(l)) {\n"
+    "                    stats1.x += 1.0;\n"
+    "                } else {\n"
+    "                    stats0 = vec4(min(stats0.x, l), max(stats0.y, l), stats0.z + l, stats0.w + 1.0);\n"
+    "                }\n"
+    "                if (any(greaterThanEqual(c, vec3(1.0)))) stats1.y += 1.0;\n"
+    "            } else {\n"
+    "                vec4 s0 = texelFetch(source0, ivec2(x, y), 0);\n"
+    "                vec4 s1 = texelFetch(source1, ivec2(x, y), 0);\n"
+    "                stats0 = vec4(min(stats0.x, s0.x), max(stats0.y, s0.y), stats0.zw + s0.zw);\n"
+    "                stats1 += s1;\n"
+    "            }\n"
+    "        }\n"
+    "    }\n"
+    "    out_stats0 = stats0;\n"
+    "    out_stats1 = stats1;\n"
+    "}\n";
+
+static const char *frame_stats_histogram_vert_source =
+    "#version 330\n"
+    "#define BINS " FRAME_STATS_STR(FRAME_STATS_BINS) "\n"
+    "uniform sampler2D frame;\n"
+    "void main(void)\n"
+    "{\n"
+    "    int width = textureSize(frame, 0).x;\n"
+    "    vec3 c = texelFetch(frame, ivec2(gl_VertexID%width, gl_VertexID/width), 0).rgb;\n"
+    "    float l = dot(c, vec3(0.2126, 0.7152, 0.0722));\n"
+    "    int bin = min(int(clamp(l, 0.0, 1.0)*BINS), BINS - 1);\n"
+    "    // NaNs are counted by the reduction, their points are clipped away\n"
+    "    float x = isnan(l) ? 2.0 : (float(bin) + 0.5)/BINS*2.0 - 1.0;\n"
+    "    gl_Position = vec4(x, 0.0, 0.0, 1.0);\n"
+    "    gl_PointSize = 1.0;\n"
+    "}\n";
+
+static const char *frame_stats_histogram_frag_source =
+    "#version 330\n"
+    "out vec4 out_color;\n"
+    "void main(void)\n"
+    "{\n"
+    "    out_color = vec4(1.0);\n"
+    "}\n";
+
+static GLuint frame_stats_create_texture(void)
+{
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texture;
+}
+
+bool frame_stats_init(Frame_Stats *stats)
+{
+    if (!create_program(frame_stats_reduce_vert_source, frame_stats_reduce_frag_source,
+                        &stats->reduce_program)) {
+        return false;
+    }
+    stats->reduce_first_uniform = glGetUniformLocation(stats->reduce_program, "first");
+    stats->reduce_source_uniforms[0] = glGetUniformLocation(stats->reduce_program, "source0");
+    stats->reduce_source_uniforms[1] = glGetUniformLocation(stats->reduce_program, "source1");
+
+    if (!create_program(frame_stats_histogram_vert_source, frame_stats_histogram_frag_source,
+                        &stats->histogram_program)) {
+        return false;
+    }
+    stats->histogram_frame_uniform = glGetUniformLocation(stats->histogram_program, "frame");
+
+    stats->histogram_texture = frame_stats_create_texture();
+    glBindTexture(GL_TEXTURE_2D, stats->histogram_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, FRAME_STATS_BINS, 1, 0, GL_RED, GL_FLOAT, NULL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glGenFramebuffers(1, &stats->histogram_framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, stats->histogram_framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, stats->histogram_texture, 0);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "ERROR: frame stats histogram framebuffer is incomplete: 0x%x\n", status);
+        return false;
+    }
+    mem_track(MEM_TAG_GL_TEXTURES, FRAME_STATS_BINS*sizeof(float));
+
+    glGenVertexArrays(1, &stats->vao);
+
+    for (size_t i = 0; i < FRAME_STATS_READBACKS; ++i) {
+        glGenBuffers(1, &stats->readbacks[i].pbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, stats->readbacks[i].pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, FRAME_STATS_READBACK_SIZE, NULL, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    mem_track(MEM_TAG_GL_BUFFERS, FRAME_STATS_READBACKS*FRAME_STATS_READBACK_SIZE);
+
+    stats->enabled = true;
+    return true;
+}
+
+// (Re)allocates the reduction levels for a new frame size
+static bool frame_stats_resize(Frame_Stats *stats, int width, int height)
+{
+    stats->width = width;
+    stats->height = height;
+    size_t texture_bytes = 0;
+    GLenum status = GL_FRAMEBUFFER_COMPLETE;
+
+    static const GLenum draw_buffers[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+    stats->levels_count = 0;
+    int level_width = width;
+    int level_height = height;
+    while (status == GL_FRAMEBUFFER_COMPLETE && (stats->levels_count == 0 || level_width > 1 || level_height > 1)) {
+        assert(stats->levels_count < FRAME_STATS_MAX_LEVELS);
+        level_width = (level_width + FRAME_STATS_BLOCK - 1)/FRAME_STATS_BLOCK;
+        level_height = (level_height + FRAME_STATS_BLOCK - 1)/FRAME_STATS_BLOCK;
+
+        Frame_Stats_Level *level = &stats->levels[stats->levels_count++];
+        if (level->framebuffer == 0) {
+            glGenFramebuffers(1, &level->framebuffer);
+            level->textures[0] = frame_stats_create_texture();
+            level->textures[1] = frame_stats_create_texture();
+        }
+        level->width = level_width;
+        level->height = level_height;
+        glBindFramebuffer(GL_FRAMEBUFFER, level->framebuffer);
+        for (size_t i = 0; i < 2; ++i) {
+            glBindTexture(GL_TEXTURE_2D, level->textures[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, level_width, level_height, 0, GL_RGBA, GL_FLOAT, NULL);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, draw_buffers[i], GL_TEXTURE_2D, level->textures[i], 0);
+        }
+        glDrawBuffers(2, draw_buffers);
+        status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        texture_bytes += (size_t) level_width*level_height*2*4*sizeof(float);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    mem_track(MEM_TAG_GL_TEXTURES, (ptrdiff_t) texture_bytes - (ptrdiff_t) stats->texture_bytes);
+    stats->texture_bytes = texture_bytes;
+
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "ERROR: frame stats framebuffer is incomplete: 0x%x\n", status);
+        return false;
+    }
+    return true;
+}
+
+static void frame_stats_reduce(Frame_Stats *stats, GLuint frame_texture)
+{
+    glUseProgram(stats->reduce_program);
+    glUniform1i(stats->reduce_source_uniforms[0], 0);
+    glUniform1i(stats->reduce_source_uniforms[1], 1);
+    for (size_t i = 0; i < stats->levels_count; ++i) {
+        Frame_Stats_Level *level = &stats->levels[i];
+        glBindFramebuffer(GL_FRAMEBUFFER, level->framebuffer);
+        glViewport(0, 0, level->width, level->height);
+        glUniform1i(stats->reduce_first_uniform, i == 0);
+        if (i == 0) {
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, frame_texture);
+        } else {
+            for (size_t j = 0; j < 2; ++j) {
+                glActiveTexture(GL_TEXTURE0 + (GLenum) j);
+                glBindTexture(GL_TEXTURE_2D, stats->levels[i - 1].textures[j]);
+            }
+        }
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
+
+static void frame_stats_histogram(Frame_Stats *stats, GLuint frame_texture)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, stats->histogram_framebuffer);
+    glViewport(0, 0, FRAME_STATS_BINS, 1);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    GLint blend_src = 0;
+    GLint blend_dst = 0;
+    glGetIntegerv(GL_BLEND_SRC_RGB, &blend_src);
+    glGetIntegerv(GL_BLEND_DST_RGB, &blend_dst);
+    glBlendFunc(GL_ONE, GL_ONE);
+
+    glUseProgram(stats->histogram_program);
+    glUniform1i(stats->histogram_frame_uniform, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, frame_texture);
+    glDrawArrays(GL_POINTS, 0, stats->width*stats->height);
+
+    glBlendFunc((GLenum) blend_src, (GLenum) blend_dst);
+}
+
+static void frame_stats_read_back(Frame_Stats *stats, size_t frame, double time)
+{
+    assert(stats->pending < FRAME_STATS_READBACKS);
+    Frame_Stats_Readback *readback = &stats->readbacks[(stats->head + stats->pending) % FRAME_STATS_READBACKS];
+    readback->frame = frame;
+    readback->time = time;
+    readback->width = stats->width;
+    readback->height = stats->height;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->pbo);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, stats->histogram_framebuffer);
+    glReadPixels(0, 0, FRAME_STATS_BINS, 1, GL_RED, GL_FLOAT, (void*) 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, stats->levels[stats->levels_count - 1].framebuffer);
+    for (size_t i = 0; i < 2; ++i) {
+        glReadBuffer(GL_COLOR_ATTACHMENT0 + (GLenum) i);
+        glReadPixels(0, 0, 1, 1, GL_RGBA, GL_FLOAT, (void*) (FRAME_STATS_BINS*sizeof(float) + i*4*sizeof(float)));
+    }
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    readback->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    stats->pending += 1;
+}
+
+// Computes the stats of `frame_texture` of `width` x `height` pixels and starts
+// reading them back. Only reads back when frame_stats_poll() has made room
+// for it.
+void frame_stats_compute(Frame_Stats *stats, GLuint frame_texture, int width, int height, size_t frame, double time)
+{
+    if (!stats->enabled || frame_texture == 0 || stats->pending >= FRAME_STATS_READBACKS) return;
+    if (stats->width != width || stats->height != height) {
+        if (!frame_stats_resize(stats, width, height)) {
+            fprintf(stderr, "ERROR: disabling frame stats\n");
+            stats->enabled = false;
+            return;
+        }
+    }
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    GLint vao = 0;
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &vao);
+    GLint framebuffer = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+    GLboolean blend = glIsEnabled(GL_BLEND);
+    glBindVertexArray(stats->vao);
+
+    glDisable(GL_BLEND);
+    frame_stats_reduce(stats, frame_texture);
+    glEnable(GL_BLEND);
+    frame_stats_histogram(stats, frame_texture);
+    if (!blend) glDisable(GL_BLEND);
+    frame_stats_read_back(stats, frame, time);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, (GLuint) framebuffer);
+    glBindVertexArray((GLuint) vao);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+// Takes the stats of the oldest frame off the GPU when they're ready. With
+// `wait` it waits for them if there are any in flight. It also waits when all
+// the readbacks are in flight, so call it before frame_stats_compute() every frame
+// and no frame is skipped.
+bool frame_stats_poll(Frame_Stats *stats, Frame_Stats_Result *result, bool wait)
+{
+    if (stats->pending == 0) return false;
+
+    Frame_Stats_Readback *readback = &stats->readbacks[stats->head];
+    GLuint64 timeout = wait || stats->pending == FRAME_STATS_READBACKS ? 1000000000 : 0;
+    GLenum status = glClientWaitSync(readback->fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) return false;
+    glDeleteSync(readback->fence);
+    readback->fence = NULL;
+    stats->head = (stats->head + 1) % FRAME_STATS_READBACKS;
+    stats->pending -= 1;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->pbo);
+    const float *data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, FRAME_STATS_READBACK_SIZE, GL_MAP_READ_BIT);
+    if (data == NULL) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        return false;
+    }
+    memset(result, 0, sizeof(*result));
+    result->frame = readback->frame;
+    result->time = readback->time;
+    result->width = readback->width;
+    result->height = readback->height;
+    for (size_t i = 0; i < FRAME_STATS_BINS; ++i) result->histogram[i] = (uint32_t) data[i];
+    const float *stats0 = data + FRAME_STATS_BINS;
+    const float *stats1 = stats0 + 4;
+    if (stats0[3] > 0.0f) {
+        result->min = stats0[0];
+        result->max = stats0[1];
+        result->mean = stats0[2]/stats0[3];
+    }
+    result->nan_count = (size_t) stats1[0];
+    result->clipped_count = (size_t) stats1[1];
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return true;
+}
+
+void frame_stats_print(const Frame_Stats_Result *result)
+{
+    printf("Frame %zu (%dx%d, time %.3f):\n", result->frame, result->width, result->height, result->time);
+    printf("  luminance min %.4f, max %.4f, mean %.4f\n", result->min, result->max, result->mean);
+    printf("  NaN pixels %zu, clipped pixels %zu\n", result->nan_count, result->clipped_count);
+}
+
+// JSON has no infinities, a shader can output them though
+static void frame_stats_write_json_float(FILE *f, const char *key, float x)
+{
+    if (isfinite(x)) {
+        fprintf(f, "\"%s\": %.6g, ", key, x);
+    } else {
+        fprintf(f, "\"%s\": null, ", key);
+    }
+}
+
+// One line of JSON, so a file of them can be appended to frame by frame
+bool frame_stats_write_json(FILE *f, const Frame_Stats_Result *result)
+{
+    fprintf(f, "{\"frame\": %zu, \"time\": %.6f, \"width\": %d, \"height\": %d, ",
+            result->frame, result->time, result->width, result->height);
+    frame_stats_write_json_float(f, "min", result->min);
+    frame_stats_write_json_float(f, "max", result->max);
+    frame_stats_write_json_float(f, "mean", result->mean);
+    fprintf(f, "\"nan\": %zu, \"clipped\": %zu, \"histogram\": [", result->nan_count, result->clipped_count);
+    for (size_t i = 0; i < FRAME_STATS_BINS; ++i) {
+        fprintf(f, "%s%u", i > 0 ? ", " : "", (unsigned) result->histogram[i]);
+    }
+    fprintf(f, "]}\n");
+    return !ferror(f);
+}
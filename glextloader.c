@@ -11,19 +11,62 @@ static PFNGLGETPROGRAMINFOLOGPROC glGetProgramInfoLog = NULL;
 static PFNGLDELETESHADERPROC glDeleteShader = NULL;
 static PFNGLUSEPROGRAMPROC glUseProgram = NULL;
 static PFNGLGENVERTEXARRAYSPROC glGenVertexArrays = NULL;
+static PFNGLDELETEVERTEXARRAYSPROC glDeleteVertexArrays = NULL;
 static PFNGLBINDVERTEXARRAYPROC glBindVertexArray = NULL;
 static PFNGLDEBUGMESSAGECALLBACKPROC glDebugMessageCallback = NULL;
 static PFNGLDELETEPROGRAMPROC glDeleteProgram = NULL;
 static PFNGLGETUNIFORMLOCATIONPROC glGetUniformLocation = NULL;
 static PFNGLUNIFORM2FPROC glUniform2f = NULL;
+static PFNGLUNIFORM1FVPROC glUniform1fv = NULL;
+static PFNGLUNIFORM2FVPROC glUniform2fv = NULL;
+static PFNGLUNIFORM3FVPROC glUniform3fv = NULL;
+static PFNGLUNIFORM4FVPROC glUniform4fv = NULL;
+static PFNGLUNIFORM3FPROC glUniform3f = NULL;
+static PFNGLUNIFORM2IPROC glUniform2i = NULL;
 static PFNGLGENBUFFERSPROC glGenBuffers = NULL;
+static PFNGLDELETEBUFFERSPROC glDeleteBuffers = NULL;
 static PFNGLBINDBUFFERPROC glBindBuffer = NULL;
 static PFNGLBUFFERDATAPROC glBufferData = NULL;
 static PFNGLENABLEVERTEXATTRIBARRAYPROC glEnableVertexAttribArray = NULL;
 static PFNGLVERTEXATTRIBPOINTERPROC glVertexAttribPointer = NULL;
 static PFNGLUNIFORM1FPROC glUniform1f = NULL;
+static PFNGLUNIFORM1IPROC glUniform1i = NULL;
+static PFNGLUNIFORM4FPROC glUniform4f = NULL;
+static PFNGLGENFRAMEBUFFERSPROC glGenFramebuffers = NULL;
+static PFNGLBINDFRAMEBUFFERPROC glBindFramebuffer = NULL;
+static PFNGLFRAMEBUFFERTEXTURE2DPROC glFramebufferTexture2D = NULL;
+static PFNGLCHECKFRAMEBUFFERSTATUSPROC glCheckFramebufferStatus = NULL;
+static PFNGLMAPBUFFERRANGEPROC glMapBufferRange = NULL;
+static PFNGLUNMAPBUFFERPROC glUnmapBuffer = NULL;
 static PFNGLBUFFERSUBDATAPROC glBufferSubData = NULL;
+static PFNGLDRAWBUFFERSPROC glDrawBuffers = NULL;
+static PFNGLBLITFRAMEBUFFERPROC glBlitFramebuffer = NULL;
+static PFNGLFENCESYNCPROC glFenceSync = NULL;
+static PFNGLCLIENTWAITSYNCPROC glClientWaitSync = NULL;
+static PFNGLDELETESYNCPROC glDeleteSync = NULL;
+static PFNGLGENQUERIESPROC glGenQueries = NULL;
+static PFNGLDELETEQUERIESPROC glDeleteQueries = NULL;
+static PFNGLBEGINQUERYPROC glBeginQuery = NULL;
+static PFNGLENDQUERYPROC glEndQuery = NULL;
+static PFNGLGETQUERYIVPROC glGetQueryiv = NULL;
+static PFNGLGETQUERYOBJECTIVPROC glGetQueryObjectiv = NULL;
+static PFNGLGETQUERYOBJECTUI64VPROC glGetQueryObjectui64v = NULL;
+static PFNGLDELETEFRAMEBUFFERSPROC glDeleteFramebuffers = NULL;
+static PFNGLTEXIMAGE2DMULTISAMPLEPROC glTexImage2DMultisample = NULL;
+static PFNGLVERTEXATTRIBDIVISORPROC glVertexAttribDivisor = NULL;
+static PFNGLBINDBUFFERBASEPROC glBindBufferBase = NULL;
+static PFNGLMULTIDRAWARRAYSINDIRECTPROC glMultiDrawArraysIndirect = NULL;
+static PFNGLDRAWARRAYSINDIRECTPROC glDrawArraysIndirect = NULL;
+static PFNGLDISPATCHCOMPUTEPROC glDispatchCompute = NULL;
+static PFNGLMEMORYBARRIERPROC glMemoryBarrier = NULL;
+static PFNGLGETBUFFERSUBDATAPROC glGetBufferSubData = NULL;
 static PFNGLDRAWARRAYSINSTANCEDPROC glDrawArraysInstanced = NULL;
+#ifdef _WIN32
+// opengl32.lib only exports OpenGL 1.1
+static PFNGLACTIVETEXTUREPROC glActiveTexture = NULL;
+static PFNGLTEXIMAGE3DPROC glTexImage3D = NULL;
+static PFNGLTEXSUBIMAGE3DPROC glTexSubImage3D = NULL;
+#endif // _WIN32
 
 static void load_gl_extensions(void)
 {
@@ -42,17 +85,60 @@ static void load_gl_extensions(void)
     glDeleteShader            = (PFNGLDELETESHADERPROC) glfwGetProcAddress("glDeleteShader");
     glUseProgram              = (PFNGLUSEPROGRAMPROC) glfwGetProcAddress("glUseProgram");
     glGenVertexArrays         = (PFNGLGENVERTEXARRAYSPROC) glfwGetProcAddress("glGenVertexArrays");
+    glDeleteVertexArrays      = (PFNGLDELETEVERTEXARRAYSPROC) glfwGetProcAddress("glDeleteVertexArrays");
     glBindVertexArray         = (PFNGLBINDVERTEXARRAYPROC) glfwGetProcAddress("glBindVertexArray");
     glDeleteProgram           = (PFNGLDELETEPROGRAMPROC) glfwGetProcAddress("glDeleteProgram");
     glGetUniformLocation      = (PFNGLGETUNIFORMLOCATIONPROC) glfwGetProcAddress("glGetUniformLocation");
     glUniform2f               = (PFNGLUNIFORM2FPROC) glfwGetProcAddress("glUniform2f");
+    glUniform1fv              = (PFNGLUNIFORM1FVPROC) glfwGetProcAddress("glUniform1fv");
+    glUniform2fv              = (PFNGLUNIFORM2FVPROC) glfwGetProcAddress("glUniform2fv");
+    glUniform3fv              = (PFNGLUNIFORM3FVPROC) glfwGetProcAddress("glUniform3fv");
+    glUniform4fv              = (PFNGLUNIFORM4FVPROC) glfwGetProcAddress("glUniform4fv");
+    glUniform3f               = (PFNGLUNIFORM3FPROC) glfwGetProcAddress("glUniform3f");
+    glUniform2i               = (PFNGLUNIFORM2IPROC) glfwGetProcAddress("glUniform2i");
     glGenBuffers              = (PFNGLGENBUFFERSPROC) glfwGetProcAddress("glGenBuffers");
+    glDeleteBuffers           = (PFNGLDELETEBUFFERSPROC) glfwGetProcAddress("glDeleteBuffers");
     glBindBuffer              = (PFNGLBINDBUFFERPROC) glfwGetProcAddress("glBindBuffer");
     glBufferData              = (PFNGLBUFFERDATAPROC) glfwGetProcAddress("glBufferData");
     glEnableVertexAttribArray = (PFNGLENABLEVERTEXATTRIBARRAYPROC) glfwGetProcAddress("glEnableVertexAttribArray");
     glVertexAttribPointer     = (PFNGLVERTEXATTRIBPOINTERPROC) glfwGetProcAddress("glVertexAttribPointer");
     glUniform1f               = (PFNGLUNIFORM1FPROC) glfwGetProcAddress("glUniform1f");
+    glUniform1i               = (PFNGLUNIFORM1IPROC) glfwGetProcAddress("glUniform1i");
+    glUniform4f               = (PFNGLUNIFORM4FPROC) glfwGetProcAddress("glUniform4f");
+    glGenFramebuffers         = (PFNGLGENFRAMEBUFFERSPROC) glfwGetProcAddress("glGenFramebuffers");
+    glBindFramebuffer         = (PFNGLBINDFRAMEBUFFERPROC) glfwGetProcAddress("glBindFramebuffer");
+    glFramebufferTexture2D    = (PFNGLFRAMEBUFFERTEXTURE2DPROC) glfwGetProcAddress("glFramebufferTexture2D");
+    glCheckFramebufferStatus  = (PFNGLCHECKFRAMEBUFFERSTATUSPROC) glfwGetProcAddress("glCheckFramebufferStatus");
+    glMapBufferRange          = (PFNGLMAPBUFFERRANGEPROC) glfwGetProcAddress("glMapBufferRange");
+    glUnmapBuffer             = (PFNGLUNMAPBUFFERPROC) glfwGetProcAddress("glUnmapBuffer");
     glBufferSubData           = (PFNGLBUFFERSUBDATAPROC) glfwGetProcAddress("glBufferSubData");
+    glDrawBuffers             = (PFNGLDRAWBUFFERSPROC) glfwGetProcAddress("glDrawBuffers");
+    glBlitFramebuffer         = (PFNGLBLITFRAMEBUFFERPROC) glfwGetProcAddress("glBlitFramebuffer");
+    glFenceSync               = (PFNGLFENCESYNCPROC) glfwGetProcAddress("glFenceSync");
+    glClientWaitSync          = (PFNGLCLIENTWAITSYNCPROC) glfwGetProcAddress("glClientWaitSync");
+    glDeleteSync              = (PFNGLDELETESYNCPROC) glfwGetProcAddress("glDeleteSync");
+    glGenQueries              = (PFNGLGENQUERIESPROC) glfwGetProcAddress("glGenQueries");
+    glDeleteQueries           = (PFNGLDELETEQUERIESPROC) glfwGetProcAddress("glDeleteQueries");
+    glBeginQuery              = (PFNGLBEGINQUERYPROC) glfwGetProcAddress("glBeginQuery");
+    glEndQuery                = (PFNGLENDQUERYPROC) glfwGetProcAddress("glEndQuery");
+    glGetQueryiv              = (PFNGLGETQUERYIVPROC) glfwGetProcAddress("glGetQueryiv");
+    glGetQueryObjectiv        = (PFNGLGETQUERYOBJECTIVPROC) glfwGetProcAddress("glGetQueryObjectiv");
+    glGetQueryObjectui64v     = (PFNGLGETQUERYOBJECTUI64VPROC) glfwGetProcAddress("glGetQueryObjectui64v");
+    glDeleteFramebuffers      = (PFNGLDELETEFRAMEBUFFERSPROC) glfwGetProcAddress("glDeleteFramebuffers");
+    glTexImage2DMultisample   = (PFNGLTEXIMAGE2DMULTISAMPLEPROC) glfwGetProcAddress("glTexImage2DMultisample");
+    glVertexAttribDivisor     = (PFNGLVERTEXATTRIBDIVISORPROC) glfwGetProcAddress("glVertexAttribDivisor");
+    glBindBufferBase          = (PFNGLBINDBUFFERBASEPROC) glfwGetProcAddress("glBindBufferBase");
+    glGetBufferSubData        = (PFNGLGETBUFFERSUBDATAPROC) glfwGetProcAddress("glGetBufferSubData");
+    // GL 4.0 and 4.3, only used when the context is new enough
+    glMultiDrawArraysIndirect = (PFNGLMULTIDRAWARRAYSINDIRECTPROC) glfwGetProcAddress("glMultiDrawArraysIndirect");
+    glDrawArraysIndirect      = (PFNGLDRAWARRAYSINDIRECTPROC) glfwGetProcAddress("glDrawArraysIndirect");
+    glDispatchCompute         = (PFNGLDISPATCHCOMPUTEPROC) glfwGetProcAddress("glDispatchCompute");
+    glMemoryBarrier           = (PFNGLMEMORYBARRIERPROC) glfwGetProcAddress("glMemoryBarrier");
+#ifdef _WIN32
+    glActiveTexture           = (PFNGLACTIVETEXTUREPROC) glfwGetProcAddress("glActiveTexture");
+    glTexImage3D              = (PFNGLTEXIMAGE3DPROC) glfwGetProcAddress("glTexImage3D");
+    glTexSubImage3D           = (PFNGLTEXSUBIMAGE3DPROC) glfwGetProcAddress("glTexSubImage3D");
+#endif // _WIN32
 
     if (glfwExtensionSupported("GL_ARB_debug_output")) {
         fprintf(stderr, "INFO: ARB_debug_output is supported\n");
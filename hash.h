@@ -0,0 +1,464 @@
+#ifndef HASH_H_
+#define HASH_H_
+
+// Fast non-cryptographic 64/128-bit content hash for cache keys.
+//
+// The core loop follows the XXH3 design: 8 lanes of 64-bit accumulators
+// that are fed 64-byte stripes with a 32x32->64 multiply per lane and
+// scrambled once per 1 KiB block. The lanes map directly onto SSE2 and AVX2
+// registers, so on x86 the bulk of the input is processed at memory speed.
+// The SIMD path is selected at runtime and every path produces exactly the
+// same digests, so hashes can be stored on disk and compared across machines.
+//
+// The digests are NOT compatible with the reference XXH3 implementation.
+//
+// USAGE:
+//   uint64_t h = hash64(data, size, 0);
+//
+//   Hash_State state;
+//   hash_init(&state, 0);
+//   hash_update(&state, chunk1, chunk1_size);
+//   hash_update(&state, chunk2, chunk2_size);
+//   Hash128 h = hash_digest128(&state);
+//
+// Define HASH_NO_SIMD before the implementation to force the scalar path.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef HASHDEF
+#define HASHDEF
+#endif // HASHDEF
+
+#define HASH_STRIPE_LEN 64
+#define HASH_SECRET_SIZE 192
+#define HASH_STRIPES_PER_BLOCK ((HASH_SECRET_SIZE - HASH_STRIPE_LEN) / 8)
+#define HASH_BLOCK_LEN (HASH_STRIPE_LEN * HASH_STRIPES_PER_BLOCK)
+
+typedef struct {
+    uint64_t lo;
+    uint64_t hi;
+} Hash128;
+
+#define Hash128_Fmt "%016llx%016llx"
+#define Hash128_Arg(h) (unsigned long long) (h).hi, (unsigned long long) (h).lo
+
+typedef struct {
+    uint64_t acc[8];
+    uint64_t total_len;
+    size_t stripes_in_block;
+    size_t buffer_sz;
+    unsigned char buffer[HASH_STRIPE_LEN];
+    unsigned char secret[HASH_SECRET_SIZE];
+} Hash_State;
+
+HASHDEF void hash_init(Hash_State *state, uint64_t seed);
+HASHDEF void hash_update(Hash_State *state, const void *data, size_t size);
+HASHDEF uint64_t hash_digest64(const Hash_State *state);
+HASHDEF Hash128 hash_digest128(const Hash_State *state);
+HASHDEF uint64_t hash64(const void *data, size_t size, uint64_t seed);
+HASHDEF Hash128 hash128(const void *data, size_t size, uint64_t seed);
+HASHDEF bool hash128_eq(Hash128 a, Hash128 b);
+// Name of the accumulation path picked for this CPU: "avx2", "sse2" or "scalar"
+HASHDEF const char *hash_simd_name(void);
+
+#endif // HASH_H_
+
+#if defined(HASH_IMPLEMENTATION) && !defined(HASH_IMPLEMENTATION_)
+#define HASH_IMPLEMENTATION_
+
+#include <string.h>
+
+#if !defined(HASH_NO_SIMD) && (defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86))
+#  define HASH__X86 1
+#  include <immintrin.h>
+#  ifdef _MSC_VER
+#    include <intrin.h>
+#    define HASH__TARGET_AVX2
+#  else
+#    include <cpuid.h>
+#    define HASH__TARGET_AVX2 __attribute__((target("avx2")))
+#  endif
+#  if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    define HASH__SSE2 1
+#  endif
+#endif
+
+#define HASH__PRIME32_1 0x9E3779B1U
+#define HASH__PRIME32_2 0x85EBCA77U
+#define HASH__PRIME32_3 0xC2B2AE3DU
+#define HASH__PRIME64_1 0x9E3779B185EBCA87ULL
+#define HASH__PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define HASH__PRIME64_3 0x165667B19E3779F9ULL
+#define HASH__PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define HASH__PRIME64_5 0x27D4EB2F165667C5ULL
+
+// 192 bytes of splitmix64 output. Seeded hashes derive their own secret from it.
+static const unsigned char hash__default_secret[HASH_SECRET_SIZE] = {
+    0xf4, 0x65, 0xb9, 0xa1, 0x6a, 0x9e, 0x78, 0x6e, 0x4f, 0x45, 0x09, 0x80, 0x18, 0x5d, 0xc4, 0x06,
+    0xec, 0x81, 0x4c, 0x72, 0xa8, 0xb8, 0x8b, 0xf8, 0x9b, 0x74, 0xa8, 0x51, 0x6a, 0x89, 0x39, 0x1b,
+    0xea, 0xa2, 0x7e, 0x74, 0x0c, 0x9f, 0xcb, 0x53, 0xe1, 0x32, 0x45, 0x1f, 0xbe, 0x9a, 0x82, 0x2c,
+    0x3c, 0xab, 0x16, 0xc9, 0x3a, 0x13, 0x84, 0xc5, 0xc3, 0x8a, 0xc9, 0x41, 0x90, 0x78, 0xe5, 0x3e,
+    0xa6, 0xb0, 0x8c, 0x36, 0x8c, 0x48, 0xb8, 0xf3, 0x09, 0x3d, 0xb1, 0x3c, 0xdd, 0xec, 0x7e, 0x65,
+    0xf6, 0xde, 0x5b, 0x05, 0xe0, 0x26, 0xd3, 0xc2, 0x7b, 0xdb, 0xbb, 0xe0, 0x3f, 0xa0, 0x21, 0x86,
+    0x2f, 0xa9, 0x3a, 0x98, 0x55, 0x75, 0x1f, 0x8e, 0x19, 0x4d, 0xcc, 0x00, 0x16, 0x0f, 0x4e, 0xb5,
+    0xab, 0x80, 0x1d, 0x97, 0x97, 0x3f, 0xbb, 0x84, 0x55, 0x12, 0x52, 0x75, 0x5c, 0x82, 0x29, 0x7d,
+    0x86, 0x7f, 0x7f, 0x2b, 0x10, 0x17, 0xcf, 0xc3, 0x64, 0x4f, 0x91, 0x83, 0xa0, 0xe9, 0x66, 0x34,
+    0xac, 0x85, 0x44, 0x5a, 0x2b, 0x8d, 0x1a, 0xd8, 0xd7, 0x9e, 0x0b, 0x10, 0x2b, 0x60, 0x01, 0xdb,
+    0x0d, 0xf1, 0x25, 0x18, 0x92, 0x8a, 0x03, 0xa9, 0x6a, 0x2f, 0xca, 0x0d, 0xd9, 0xf1, 0xf5, 0xed,
+    0x4c, 0x63, 0xd2, 0x7b, 0xd6, 0x6a, 0x49, 0x54, 0x69, 0x72, 0x40, 0xf5, 0xd4, 0x01, 0x7c, 0xdd,
+};
+
+static inline uint64_t hash__read64(const void *p)
+{
+    uint64_t x;
+    memcpy(&x, p, sizeof(x));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    x = __builtin_bswap64(x);
+#endif
+    return x;
+}
+
+static inline void hash__write64(void *p, uint64_t x)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    x = __builtin_bswap64(x);
+#endif
+    memcpy(p, &x, sizeof(x));
+}
+
+static inline uint64_t hash__mul128_fold64(uint64_t a, uint64_t b)
+{
+#if defined(__SIZEOF_INT128__)
+    __uint128_t product = (__uint128_t) a * b;
+    return (uint64_t) product ^ (uint64_t) (product >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    uint64_t hi;
+    uint64_t lo = _umul128(a, b, &hi);
+    return lo ^ hi;
+#else
+    uint64_t lo_lo = (a & 0xFFFFFFFF) * (b & 0xFFFFFFFF);
+    uint64_t hi_lo = (a >> 32) * (b & 0xFFFFFFFF);
+    uint64_t lo_hi = (a & 0xFFFFFFFF) * (b >> 32);
+    uint64_t hi_hi = (a >> 32) * (b >> 32);
+    uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFF) + lo_hi;
+    uint64_t upper = (hi_lo >> 32) + (cross >> 32) + hi_hi;
+    uint64_t lower = (cross << 32) | (lo_lo & 0xFFFFFFFF);
+    return lower ^ upper;
+#endif
+}
+
+static inline uint64_t hash__avalanche(uint64_t h)
+{
+    h ^= h >> 37;
+    h *= 0x165667919E3779F9ULL;
+    h ^= h >> 32;
+    return h;
+}
+
+typedef void (*Hash__Accumulate)(uint64_t *acc, const unsigned char *input,
+                                 const unsigned char *secret, size_t stripes);
+typedef void (*Hash__Scramble)(uint64_t *acc, const unsigned char *secret);
+
+static void hash__accumulate_scalar(uint64_t *acc, const unsigned char *input,
+                                    const unsigned char *secret, size_t stripes)
+{
+    for (size_t n = 0; n < stripes; ++n) {
+        const unsigned char *in = input + n * HASH_STRIPE_LEN;
+        const unsigned char *key = secret + n * 8;
+        for (size_t i = 0; i < 8; ++i) {
+            uint64_t data_val = hash__read64(in + 8 * i);
+            uint64_t data_key = data_val ^ hash__read64(key + 8 * i);
+            acc[i ^ 1] += data_val;
+            acc[i] += (data_key & 0xFFFFFFFF) * (data_key >> 32);
+        }
+    }
+}
+
+static void hash__scramble_scalar(uint64_t *acc, const unsigned char *secret)
+{
+    for (size_t i = 0; i < 8; ++i) {
+        uint64_t a = acc[i];
+        a ^= a >> 47;
+        a ^= hash__read64(secret + 8 * i);
+        a *= HASH__PRIME32_1;
+        acc[i] = a;
+    }
+}
+
+#ifdef HASH__SSE2
+static void hash__accumulate_sse2(uint64_t *acc, const unsigned char *input,
+                                  const unsigned char *secret, size_t stripes)
+{
+    __m128i *xacc = (__m128i *) acc;
+    __m128i a[4];
+    for (int i = 0; i < 4; ++i) a[i] = _mm_loadu_si128(xacc + i);
+
+    for (size_t n = 0; n < stripes; ++n) {
+        const __m128i *in = (const __m128i *) (input + n * HASH_STRIPE_LEN);
+        const __m128i *key = (const __m128i *) (secret + n * 8);
+        for (int i = 0; i < 4; ++i) {
+            __m128i data_vec = _mm_loadu_si128(in + i);
+            __m128i key_vec = _mm_loadu_si128(key + i);
+            __m128i data_key = _mm_xor_si128(data_vec, key_vec);
+            __m128i data_key_hi = _mm_shuffle_epi32(data_key, _MM_SHUFFLE(0, 3, 0, 1));
+            __m128i product = _mm_mul_epu32(data_key, data_key_hi);
+            __m128i data_swap = _mm_shuffle_epi32(data_vec, _MM_SHUFFLE(1, 0, 3, 2));
+            a[i] = _mm_add_epi64(a[i], data_swap);
+            a[i] = _mm_add_epi64(a[i], product);
+        }
+    }
+
+    for (int i = 0; i < 4; ++i) _mm_storeu_si128(xacc + i, a[i]);
+}
+
+static void hash__scramble_sse2(uint64_t *acc, const unsigned char *secret)
+{
+    __m128i *xacc = (__m128i *) acc;
+    const __m128i prime32 = _mm_set1_epi32((int) HASH__PRIME32_1);
+    for (int i = 0; i < 4; ++i) {
+        __m128i a = _mm_loadu_si128(xacc + i);
+        a = _mm_xor_si128(a, _mm_srli_epi64(a, 47));
+        a = _mm_xor_si128(a, _mm_loadu_si128((const __m128i *) secret + i));
+        __m128i a_hi = _mm_shuffle_epi32(a, _MM_SHUFFLE(0, 3, 0, 1));
+        __m128i product_lo = _mm_mul_epu32(a, prime32);
+        __m128i product_hi = _mm_mul_epu32(a_hi, prime32);
+        _mm_storeu_si128(xacc + i, _mm_add_epi64(product_lo, _mm_slli_epi64(product_hi, 32)));
+    }
+}
+#endif // HASH__SSE2
+
+#ifdef HASH__X86
+HASH__TARGET_AVX2
+static void hash__accumulate_avx2(uint64_t *acc, const unsigned char *input,
+                                  const unsigned char *secret, size_t stripes)
+{
+    __m256i *xacc = (__m256i *) acc;
+    __m256i a0 = _mm256_loadu_si256(xacc + 0);
+    __m256i a1 = _mm256_loadu_si256(xacc + 1);
+
+    for (size_t n = 0; n < stripes; ++n) {
+        const __m256i *in = (const __m256i *) (input + n * HASH_STRIPE_LEN);
+        const __m256i *key = (const __m256i *) (secret + n * 8);
+
+        __m256i data0 = _mm256_loadu_si256(in + 0);
+        __m256i data1 = _mm256_loadu_si256(in + 1);
+        __m256i data_key0 = _mm256_xor_si256(data0, _mm256_loadu_si256(key + 0));
+        __m256i data_key1 = _mm256_xor_si256(data1, _mm256_loadu_si256(key + 1));
+        __m256i product0 = _mm256_mul_epu32(data_key0, _mm256_shuffle_epi32(data_key0, _MM_SHUFFLE(0, 3, 0, 1)));
+        __m256i product1 = _mm256_mul_epu32(data_key1, _mm256_shuffle_epi32(data_key1, _MM_SHUFFLE(0, 3, 0, 1)));
+        a0 = _mm256_add_epi64(a0, _mm256_shuffle_epi32(data0, _MM_SHUFFLE(1, 0, 3, 2)));
+        a1 = _mm256_add_epi64(a1, _mm256_shuffle_epi32(data1, _MM_SHUFFLE(1, 0, 3, 2)));
+        a0 = _mm256_add_epi64(a0, product0);
+        a1 = _mm256_add_epi64(a1, product1);
+    }
+
+    _mm256_storeu_si256(xacc + 0, a0);
+    _mm256_storeu_si256(xacc + 1, a1);
+}
+
+HASH__TARGET_AVX2
+static void hash__scramble_avx2(uint64_t *acc, const unsigned char *secret)
+{
+    __m256i *xacc = (__m256i *) acc;
+    const __m256i prime32 = _mm256_set1_epi32((int) HASH__PRIME32_1);
+    for (int i = 0; i < 2; ++i) {
+        __m256i a = _mm256_loadu_si256(xacc + i);
+        a = _mm256_xor_si256(a, _mm256_srli_epi64(a, 47));
+        a = _mm256_xor_si256(a, _mm256_loadu_si256((const __m256i *) secret + i));
+        __m256i a_hi = _mm256_shuffle_epi32(a, _MM_SHUFFLE(0, 3, 0, 1));
+        __m256i product_lo = _mm256_mul_epu32(a, prime32);
+        __m256i product_hi = _mm256_mul_epu32(a_hi, prime32);
+        _mm256_storeu_si256(xacc + i, _mm256_add_epi64(product_lo, _mm256_slli_epi64(product_hi, 32)));
+    }
+}
+
+static bool hash__cpu_has_avx2(void)
+{
+#ifdef _MSC_VER
+    int regs[4];
+    __cpuid(regs, 0);
+    if (regs[0] < 7) return false;
+    __cpuid(regs, 1);
+    bool osxsave = (regs[2] & (1 << 27)) != 0;
+    if (!osxsave || (_xgetbv(0) & 0x6) != 0x6) return false;
+    __cpuidex(regs, 7, 0);
+    return (regs[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif // HASH__X86
+
+static Hash__Accumulate hash__accumulate = NULL;
+static Hash__Scramble hash__scramble = NULL;
+static const char *hash__simd_name = NULL;
+
+static void hash__select_impl(void)
+{
+    if (hash__accumulate != NULL) return;
+
+    Hash__Accumulate accumulate = hash__accumulate_scalar;
+    Hash__Scramble scramble = hash__scramble_scalar;
+    const char *name = "scalar";
+#ifdef HASH__SSE2
+    accumulate = hash__accumulate_sse2;
+    scramble = hash__scramble_sse2;
+    name = "sse2";
+#endif
+#ifdef HASH__X86
+    if (hash__cpu_has_avx2()) {
+        accumulate = hash__accumulate_avx2;
+        scramble = hash__scramble_avx2;
+        name = "avx2";
+    }
+#endif
+    // NOTE: racing threads all compute the same values, so no locking is needed here
+    hash__scramble = scramble;
+    hash__simd_name = name;
+    hash__accumulate = accumulate;
+}
+
+HASHDEF const char *hash_simd_name(void)
+{
+    hash__select_impl();
+    return hash__simd_name;
+}
+
+HASHDEF void hash_init(Hash_State *state, uint64_t seed)
+{
+    hash__select_impl();
+
+    state->acc[0] = HASH__PRIME32_3;
+    state->acc[1] = HASH__PRIME64_1;
+    state->acc[2] = HASH__PRIME64_2;
+    state->acc[3] = HASH__PRIME64_3;
+    state->acc[4] = HASH__PRIME64_4;
+    state->acc[5] = HASH__PRIME32_2;
+    state->acc[6] = HASH__PRIME64_5;
+    state->acc[7] = HASH__PRIME32_1;
+    state->total_len = 0;
+    state->stripes_in_block = 0;
+    state->buffer_sz = 0;
+
+    for (size_t i = 0; i < HASH_SECRET_SIZE; i += 16) {
+        hash__write64(state->secret + i, hash__read64(hash__default_secret + i) + seed);
+        hash__write64(state->secret + i + 8, hash__read64(hash__default_secret + i + 8) - seed);
+    }
+}
+
+// Accumulates `stripes` full stripes scrambling at every block boundary
+static void hash__consume_stripes(Hash_State *state, const unsigned char *input, size_t stripes)
+{
+    while (stripes > 0) {
+        size_t n = HASH_STRIPES_PER_BLOCK - state->stripes_in_block;
+        if (n > stripes) n = stripes;
+
+        hash__accumulate(state->acc, input, state->secret + state->stripes_in_block * 8, n);
+        state->stripes_in_block += n;
+        input += n * HASH_STRIPE_LEN;
+        stripes -= n;
+
+        if (state->stripes_in_block == HASH_STRIPES_PER_BLOCK) {
+            hash__scramble(state->acc, state->secret + HASH_SECRET_SIZE - HASH_STRIPE_LEN);
+            state->stripes_in_block = 0;
+        }
+    }
+}
+
+HASHDEF void hash_update(Hash_State *state, const void *data, size_t size)
+{
+    const unsigned char *input = data;
+    state->total_len += size;
+
+    // The last (possibly full) stripe always stays in the buffer so the
+    // digest has something to finish with. That keeps the streaming and
+    // one-shot digests identical no matter how the input was split.
+    if (state->buffer_sz + size <= HASH_STRIPE_LEN) {
+        memcpy(state->buffer + state->buffer_sz, input, size);
+        state->buffer_sz += size;
+        return;
+    }
+
+    if (state->buffer_sz > 0) {
+        size_t n = HASH_STRIPE_LEN - state->buffer_sz;
+        memcpy(state->buffer + state->buffer_sz, input, n);
+        input += n;
+        size -= n;
+        hash__consume_stripes(state, state->buffer, 1);
+        state->buffer_sz = 0;
+    }
+
+    if (size > HASH_STRIPE_LEN) {
+        size_t stripes = (size - 1) / HASH_STRIPE_LEN;
+        hash__consume_stripes(state, input, stripes);
+        input += stripes * HASH_STRIPE_LEN;
+        size -= stripes * HASH_STRIPE_LEN;
+    }
+
+    memcpy(state->buffer, input, size);
+    state->buffer_sz = size;
+}
+
+static uint64_t hash__merge_accs(const uint64_t *acc, const unsigned char *secret, uint64_t start)
+{
+    uint64_t result = start;
+    for (size_t i = 0; i < 4; ++i) {
+        result += hash__mul128_fold64(acc[2 * i] ^ hash__read64(secret + 16 * i),
+                                      acc[2 * i + 1] ^ hash__read64(secret + 16 * i + 8));
+    }
+    return hash__avalanche(result);
+}
+
+static void hash__final_accs(const Hash_State *state, uint64_t *acc)
+{
+    memcpy(acc, state->acc, sizeof(state->acc));
+    if (state->buffer_sz > 0) {
+        unsigned char last[HASH_STRIPE_LEN] = {0};
+        memcpy(last, state->buffer, state->buffer_sz);
+        hash__accumulate(acc, last, state->secret + HASH_SECRET_SIZE - HASH_STRIPE_LEN - 7, 1);
+    }
+}
+
+HASHDEF uint64_t hash_digest64(const Hash_State *state)
+{
+    uint64_t acc[8];
+    hash__final_accs(state, acc);
+    return hash__merge_accs(acc, state->secret + 11, state->total_len * HASH__PRIME64_1);
+}
+
+HASHDEF Hash128 hash_digest128(const Hash_State *state)
+{
+    uint64_t acc[8];
+    hash__final_accs(state, acc);
+    Hash128 result;
+    result.lo = hash__merge_accs(acc, state->secret + 11, state->total_len * HASH__PRIME64_1);
+    result.hi = hash__merge_accs(acc, state->secret + HASH_SECRET_SIZE - HASH_STRIPE_LEN - 11,
+                                 ~(state->total_len * HASH__PRIME64_2));
+    return result;
+}
+
+HASHDEF uint64_t hash64(const void *data, size_t size, uint64_t seed)
+{
+    Hash_State state;
+    hash_init(&state, seed);
+    hash_update(&state, data, size);
+    return hash_digest64(&state);
+}
+
+HASHDEF Hash128 hash128(const void *data, size_t size, uint64_t seed)
+{
+    Hash_State state;
+    hash_init(&state, seed);
+    hash_update(&state, data, size);
+    return hash_digest128(&state);
+}
+
+HASHDEF bool hash128_eq(Hash128 a, Hash128 b)
+{
+    return a.lo == b.lo && a.hi == b.hi;
+}
+
+#endif // HASH_IMPLEMENTATION
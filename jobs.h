@@ -0,0 +1,424 @@
+#ifndef JOBS_H_
+#define JOBS_H_
+
+// Minimal job pool: a fixed set of worker threads pulling jobs from a FIFO.
+//
+// Jobs must not touch the GL context, it belongs to the main thread. The
+// usual pattern is to do I/O and decoding in a job and hand the result back
+// to the main thread for the upload.
+//
+// USAGE:
+//   Job_Pool pool = {0};
+//   job_pool_init(&pool, 0);              // one worker per CPU
+//   job_pool_submit(&pool, func, arg);
+//   job_pool_wait(&pool);                 // until everything submitted is done, never from a job
+//   job_pool_destroy(&pool);
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+typedef SRWLOCK Jobs_Mutex;
+typedef CONDITION_VARIABLE Jobs_Cond;
+typedef HANDLE Jobs_Thread;
+#define JOBS_MUTEX_INIT SRWLOCK_INIT
+#else
+#include <pthread.h>
+typedef pthread_mutex_t Jobs_Mutex;
+typedef pthread_cond_t Jobs_Cond;
+typedef pthread_t Jobs_Thread;
+#define JOBS_MUTEX_INIT PTHREAD_MUTEX_INITIALIZER
+#endif // _WIN32
+
+#ifndef JOBSDEF
+#define JOBSDEF
+#endif // JOBSDEF
+
+typedef void (*Job_Func)(void *arg);
+// Processes the items [begin, end) of a parallel for
+typedef void (*Job_Range_Func)(void *arg, size_t begin, size_t end);
+
+typedef struct {
+    Job_Func func;
+    void *arg;
+} Job;
+
+#define JOB_POOL_MAX_THREADS 64
+
+typedef struct {
+    Jobs_Mutex mutex;
+    Jobs_Cond has_jobs;
+    Jobs_Cond all_done;
+    Jobs_Thread threads[JOB_POOL_MAX_THREADS];
+    size_t threads_count;
+    // Ring buffer of pending jobs
+    Job *queue;
+    size_t queue_capacity;
+    size_t queue_begin;
+    size_t queue_count;
+    // Submitted but not finished yet, including the ones being executed
+    size_t pending;
+    bool quit;
+} Job_Pool;
+
+JOBSDEF void jobs_mutex_init(Jobs_Mutex *mutex);
+JOBSDEF void jobs_mutex_lock(Jobs_Mutex *mutex);
+JOBSDEF void jobs_mutex_unlock(Jobs_Mutex *mutex);
+JOBSDEF void jobs_mutex_destroy(Jobs_Mutex *mutex);
+JOBSDEF size_t jobs_cpu_count(void);
+
+// `threads_count == 0` means one worker per CPU
+JOBSDEF bool job_pool_init(Job_Pool *pool, size_t threads_count);
+JOBSDEF bool job_pool_submit(Job_Pool *pool, Job_Func func, void *arg);
+// Waits for every job submitted so far, running queued ones meanwhile. Must
+// not be called from a job of the same pool: that job is one of the pending
+// ones, so the wait would never end.
+JOBSDEF void job_pool_wait(Job_Pool *pool);
+JOBSDEF void job_pool_destroy(Job_Pool *pool);
+// Splits [0, count) into batches of `batch_size` items, runs them on the pool
+// and the calling thread, and returns when all of them are done. Runs inline
+// when the pool has no workers.
+JOBSDEF void job_pool_parallel_for(Job_Pool *pool, size_t count, size_t batch_size,
+                                   Job_Range_Func func, void *arg);
+
+#endif // JOBS_H_
+
+#if defined(JOBS_IMPLEMENTATION) && !defined(JOBS_IMPLEMENTATION_)
+#define JOBS_IMPLEMENTATION_
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#define JOBS__THREAD_LOCAL __declspec(thread)
+#else
+#define JOBS__THREAD_LOCAL _Thread_local
+#endif // _MSC_VER
+
+// Pool of the job the calling thread is running, to catch job_pool_wait() from inside a job
+static JOBS__THREAD_LOCAL Job_Pool *jobs__running_pool = NULL;
+
+#ifdef _WIN32
+
+JOBSDEF void jobs_mutex_init(Jobs_Mutex *mutex) { InitializeSRWLock(mutex); }
+JOBSDEF void jobs_mutex_lock(Jobs_Mutex *mutex) { AcquireSRWLockExclusive(mutex); }
+JOBSDEF void jobs_mutex_unlock(Jobs_Mutex *mutex) { ReleaseSRWLockExclusive(mutex); }
+JOBSDEF void jobs_mutex_destroy(Jobs_Mutex *mutex) { (void) mutex; }
+
+static void jobs__cond_init(Jobs_Cond *cond) { InitializeConditionVariable(cond); }
+static void jobs__cond_wait(Jobs_Cond *cond, Jobs_Mutex *mutex) { SleepConditionVariableSRW(cond, mutex, INFINITE, 0); }
+static void jobs__cond_signal(Jobs_Cond *cond) { WakeConditionVariable(cond); }
+static void jobs__cond_broadcast(Jobs_Cond *cond) { WakeAllConditionVariable(cond); }
+static void jobs__cond_destroy(Jobs_Cond *cond) { (void) cond; }
+
+JOBSDEF size_t jobs_cpu_count(void)
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (size_t) info.dwNumberOfProcessors : 1;
+}
+
+static DWORD WINAPI jobs__worker_entry(LPVOID arg);
+
+static bool jobs__thread_start(Jobs_Thread *thread, Job_Pool *pool)
+{
+    *thread = CreateThread(NULL, 0, jobs__worker_entry, pool, 0, NULL);
+    return *thread != NULL;
+}
+
+static void jobs__thread_join(Jobs_Thread thread)
+{
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+#else
+
+#include <unistd.h>
+
+JOBSDEF void jobs_mutex_init(Jobs_Mutex *mutex) { pthread_mutex_init(mutex, NULL); }
+JOBSDEF void jobs_mutex_lock(Jobs_Mutex *mutex) { pthread_mutex_lock(mutex); }
+JOBSDEF void jobs_mutex_unlock(Jobs_Mutex *mutex) { pthread_mutex_unlock(mutex); }
+JOBSDEF void jobs_mutex_destroy(Jobs_Mutex *mutex) { pthread_mutex_destroy(mutex); }
+
+static void jobs__cond_init(Jobs_Cond *cond) { pthread_cond_init(cond, NULL); }
+static void jobs__cond_wait(Jobs_Cond *cond, Jobs_Mutex *mutex) { pthread_cond_wait(cond, mutex); }
+static void jobs__cond_signal(Jobs_Cond *cond) { pthread_cond_signal(cond); }
+static void jobs__cond_broadcast(Jobs_Cond *cond) { pthread_cond_broadcast(cond); }
+static void jobs__cond_destroy(Jobs_Cond *cond) { pthread_cond_destroy(cond); }
+
+JOBSDEF size_t jobs_cpu_count(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (size_t) n : 1;
+}
+
+static void *jobs__worker_entry(void *arg);
+
+static bool jobs__thread_start(Jobs_Thread *thread, Job_Pool *pool)
+{
+    return pthread_create(thread, NULL, jobs__worker_entry, pool) == 0;
+}
+
+static void jobs__thread_join(Jobs_Thread thread)
+{
+    pthread_join(thread, NULL);
+}
+
+#endif // _WIN32
+
+// Expects the mutex to be locked
+static bool jobs__pop(Job_Pool *pool, Job *job)
+{
+    if (pool->queue_count == 0) return false;
+    *job = pool->queue[pool->queue_begin];
+    pool->queue_begin = (pool->queue_begin + 1) % pool->queue_capacity;
+    pool->queue_count -= 1;
+    return true;
+}
+
+static void jobs__run(Job_Pool *pool, Job job)
+{
+    Job_Pool *outer = jobs__running_pool;
+    jobs__running_pool = pool;
+    job.func(job.arg);
+    jobs__running_pool = outer;
+}
+
+// Expects the mutex to be locked
+static void jobs__finish(Job_Pool *pool)
+{
+    pool->pending -= 1;
+    if (pool->pending == 0) jobs__cond_broadcast(&pool->all_done);
+}
+
+static void jobs__worker(Job_Pool *pool)
+{
+    jobs_mutex_lock(&pool->mutex);
+    for (;;) {
+        Job job;
+        while (!pool->quit && !jobs__pop(pool, &job)) {
+            jobs__cond_wait(&pool->has_jobs, &pool->mutex);
+        }
+        if (pool->quit) break;
+
+        jobs_mutex_unlock(&pool->mutex);
+        jobs__run(pool, job);
+        jobs_mutex_lock(&pool->mutex);
+
+        jobs__finish(pool);
+    }
+    jobs_mutex_unlock(&pool->mutex);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI jobs__worker_entry(LPVOID arg)
+{
+    jobs__worker(arg);
+    return 0;
+}
+#else
+static void *jobs__worker_entry(void *arg)
+{
+    jobs__worker(arg);
+    return NULL;
+}
+#endif // _WIN32
+
+JOBSDEF bool job_pool_init(Job_Pool *pool, size_t threads_count)
+{
+    memset(pool, 0, sizeof(*pool));
+    jobs_mutex_init(&pool->mutex);
+    jobs__cond_init(&pool->has_jobs);
+    jobs__cond_init(&pool->all_done);
+
+    if (threads_count == 0) threads_count = jobs_cpu_count();
+    if (threads_count > JOB_POOL_MAX_THREADS) threads_count = JOB_POOL_MAX_THREADS;
+
+    for (size_t i = 0; i < threads_count; ++i) {
+        if (!jobs__thread_start(&pool->threads[pool->threads_count], pool)) break;
+        pool->threads_count += 1;
+    }
+
+    return pool->threads_count > 0;
+}
+
+JOBSDEF bool job_pool_submit(Job_Pool *pool, Job_Func func, void *arg)
+{
+    if (pool->threads_count == 0) {
+        func(arg);
+        return true;
+    }
+
+    jobs_mutex_lock(&pool->mutex);
+    if (pool->queue_count >= pool->queue_capacity) {
+        size_t new_capacity = pool->queue_capacity == 0 ? 64 : pool->queue_capacity * 2;
+        Job *new_queue = malloc(new_capacity * sizeof(*new_queue));
+        if (new_queue == NULL) {
+            jobs_mutex_unlock(&pool->mutex);
+            return false;
+        }
+        for (size_t i = 0; i < pool->queue_count; ++i) {
+            new_queue[i] = pool->queue[(pool->queue_begin + i) % pool->queue_capacity];
+        }
+        free(pool->queue);
+        pool->queue = new_queue;
+        pool->queue_capacity = new_capacity;
+        pool->queue_begin = 0;
+    }
+
+    pool->queue[(pool->queue_begin + pool->queue_count) % pool->queue_capacity] = (Job) { func, arg };
+    pool->queue_count += 1;
+    pool->pending += 1;
+    jobs__cond_signal(&pool->has_jobs);
+    jobs_mutex_unlock(&pool->mutex);
+    return true;
+}
+
+JOBSDEF void job_pool_wait(Job_Pool *pool)
+{
+    assert(jobs__running_pool != pool && "job_pool_wait() from a job of the same pool never returns");
+    jobs_mutex_lock(&pool->mutex);
+    while (pool->pending > 0) {
+        // Help instead of sleeping
+        Job job;
+        if (jobs__pop(pool, &job)) {
+            jobs_mutex_unlock(&pool->mutex);
+            jobs__run(pool, job);
+            jobs_mutex_lock(&pool->mutex);
+            jobs__finish(pool);
+        } else {
+            jobs__cond_wait(&pool->all_done, &pool->mutex);
+        }
+    }
+    jobs_mutex_unlock(&pool->mutex);
+}
+
+JOBSDEF void job_pool_destroy(Job_Pool *pool)
+{
+    job_pool_wait(pool);
+
+    jobs_mutex_lock(&pool->mutex);
+    pool->quit = true;
+    jobs__cond_broadcast(&pool->has_jobs);
+    jobs_mutex_unlock(&pool->mutex);
+
+    for (size_t i = 0; i < pool->threads_count; ++i) {
+        jobs__thread_join(pool->threads[i]);
+    }
+
+    free(pool->queue);
+    jobs__cond_destroy(&pool->has_jobs);
+    jobs__cond_destroy(&pool->all_done);
+    jobs_mutex_destroy(&pool->mutex);
+    memset(pool, 0, sizeof(*pool));
+}
+
+// Shared by the caller and the helper jobs of one parallel for. The helpers
+// may be dequeued long after all the batches are done (the queue is FIFO and
+// can have unrelated jobs in front of them), so the state is refcounted
+// instead of living on the caller's stack.
+typedef struct {
+    Jobs_Mutex mutex;
+    Jobs_Cond done;
+    Job_Range_Func func;
+    void *arg;
+    size_t count;
+    size_t batch_size;
+    size_t next;
+    size_t batches;
+    size_t batches_done;
+    size_t refs;
+} Jobs__Parallel_For;
+
+// Keeps grabbing batches until there are none left, so uneven batches balance out by themselves
+static void jobs__parallel_for_run(Jobs__Parallel_For *pf)
+{
+    for (;;) {
+        jobs_mutex_lock(&pf->mutex);
+        size_t begin = pf->next;
+        if (begin >= pf->count) {
+            jobs_mutex_unlock(&pf->mutex);
+            break;
+        }
+        pf->next += pf->batch_size;
+        jobs_mutex_unlock(&pf->mutex);
+
+        size_t end = begin + pf->batch_size;
+        if (end > pf->count) end = pf->count;
+        pf->func(pf->arg, begin, end);
+
+        jobs_mutex_lock(&pf->mutex);
+        pf->batches_done += 1;
+        if (pf->batches_done == pf->batches) jobs__cond_broadcast(&pf->done);
+        jobs_mutex_unlock(&pf->mutex);
+    }
+}
+
+static void jobs__parallel_for_unref(Jobs__Parallel_For *pf)
+{
+    jobs_mutex_lock(&pf->mutex);
+    pf->refs -= 1;
+    bool last = pf->refs == 0;
+    jobs_mutex_unlock(&pf->mutex);
+
+    if (last) {
+        jobs__cond_destroy(&pf->done);
+        jobs_mutex_destroy(&pf->mutex);
+        free(pf);
+    }
+}
+
+static void jobs__parallel_for_job(void *arg)
+{
+    Jobs__Parallel_For *pf = arg;
+    jobs__parallel_for_run(pf);
+    jobs__parallel_for_unref(pf);
+}
+
+JOBSDEF void job_pool_parallel_for(Job_Pool *pool, size_t count, size_t batch_size,
+                                   Job_Range_Func func, void *arg)
+{
+    if (count == 0) return;
+    if (batch_size == 0) batch_size = 1;
+
+    Jobs__Parallel_For *pf = NULL;
+    if (pool == NULL || pool->threads_count == 0 || count <= batch_size
+            || (pf = calloc(1, sizeof(*pf))) == NULL) {
+        func(arg, 0, count);
+        return;
+    }
+
+    jobs_mutex_init(&pf->mutex);
+    jobs__cond_init(&pf->done);
+    pf->func = func;
+    pf->arg = arg;
+    pf->count = count;
+    pf->batch_size = batch_size;
+    pf->batches = (count + batch_size - 1) / batch_size;
+
+    size_t helpers = pool->threads_count < pf->batches - 1 ? pool->threads_count : pf->batches - 1;
+    pf->refs = 1 + helpers;
+    for (size_t i = 0; i < helpers; ++i) {
+        if (!job_pool_submit(pool, jobs__parallel_for_job, pf)) {
+            jobs_mutex_lock(&pf->mutex);
+            pf->refs -= 1;
+            jobs_mutex_unlock(&pf->mutex);
+        }
+    }
+
+    jobs__parallel_for_run(pf);
+
+    jobs_mutex_lock(&pf->mutex);
+    while (pf->batches_done < pf->batches) {
+        jobs__cond_wait(&pf->done, &pf->mutex);
+    }
+    jobs_mutex_unlock(&pf->mutex);
+
+    jobs__parallel_for_unref(pf);
+}
+
+#endif // JOBS_IMPLEMENTATION
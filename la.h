@@ -1,7 +1,19 @@
 #ifndef LA_H_
 #define LA_H_
 
+#include <assert.h>
 #include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Define LA_NO_SIMD to force the portable code paths. Both paths produce
+// bit-identical random streams.
+#if !defined(LA_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define LA_SSE2
+#include <emmintrin.h>
+#endif
 
 #ifndef LADEF
 #define LADEF static inline
@@ -367,6 +379,31 @@ LADEF V4u v4u_max(V4u a, V4u b);
 LADEF V4u v4u_clamp(V4u x, V4u a, V4u b);
 LADEF unsigned int v4u_sqrlen(V4u a);
 
+// Random numbers: 4 interleaved xoshiro128+ streams, so one step produces a
+// whole SSE register of numbers. A generator is fully determined by the seed
+// and the stream, so give every thread (or every tile of work) its own stream
+// and the results don't depend on the scheduling.
+typedef struct {
+    // s[word][lane]
+    uint32_t s[4][4];
+} Rng;
+
+LADEF void rng_seed(Rng *rng, uint64_t seed, uint64_t stream);
+LADEF void rng_u32x4(Rng *rng, uint32_t out[4]);
+// Uniform in [0, 1)
+LADEF void rng_uniformf(Rng *rng, float *out, size_t count);
+LADEF void rng_uniform_v2f(Rng *rng, V2f *out, size_t count);
+LADEF void rng_uniform_v4f(Rng *rng, V4f *out, size_t count);
+// Normal distribution with mean 0 and standard deviation 1 (Box-Muller)
+LADEF void rng_normalf(Rng *rng, float *out, size_t count);
+LADEF void rng_normal_v2f(Rng *rng, V2f *out, size_t count);
+LADEF void rng_normal_v4f(Rng *rng, V4f *out, size_t count);
+// Halton low discrepancy sequence starting at `index`. Index 0 is always
+// zero, so starting at 1 is usually what you want. `base` is at least 2.
+LADEF float halton(uint32_t index, uint32_t base);
+LADEF void halton_v2f(V2f *out, size_t count, uint32_t index);
+LADEF void halton_v4f(V4f *out, size_t count, uint32_t index);
+
 #endif // LA_H_
 
 #ifdef LA_IMPLEMENTATION
@@ -2875,4 +2912,196 @@ LADEF unsigned int v4u_sqrlen(V4u a)
     return a.x*a.x + a.y*a.y + a.z*a.z + a.w*a.w;
 }
 
+static inline uint64_t la__splitmix64(uint64_t *x)
+{
+    uint64_t z = (*x += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+LADEF void rng_seed(Rng *rng, uint64_t seed, uint64_t stream)
+{
+    uint64_t x = seed ^ (stream * 0xD1B54A32D192ED03ull);
+    la__splitmix64(&x);
+    x ^= stream;
+    for (int lane = 0; lane < 4; ++lane) {
+        for (int word = 0; word < 4; word += 2) {
+            uint64_t z = la__splitmix64(&x);
+            rng->s[word + 0][lane] = (uint32_t) z;
+            rng->s[word + 1][lane] = (uint32_t) (z >> 32);
+        }
+        // xoshiro must never be in the all zero state
+        if ((rng->s[0][lane] | rng->s[1][lane] | rng->s[2][lane] | rng->s[3][lane]) == 0) {
+            rng->s[0][lane] = 1;
+        }
+    }
+}
+
+#define LA__UNIFORM_SCALE (1.0f / 16777216.0f)
+
+// Fills `out` with `count4`*4 numbers. Uniform floats are made of the top 24
+// bits when `uniform` is true, raw 32 bit numbers are written otherwise.
+static inline void la__rng_fill(Rng *rng, void *out, size_t count4, bool uniform)
+{
+#ifdef LA_SSE2
+    __m128i s0 = _mm_loadu_si128((const __m128i*) rng->s[0]);
+    __m128i s1 = _mm_loadu_si128((const __m128i*) rng->s[1]);
+    __m128i s2 = _mm_loadu_si128((const __m128i*) rng->s[2]);
+    __m128i s3 = _mm_loadu_si128((const __m128i*) rng->s[3]);
+    const __m128 scale = _mm_set1_ps(LA__UNIFORM_SCALE);
+    for (size_t i = 0; i < count4; ++i) {
+        __m128i result = _mm_add_epi32(s0, s3);
+        __m128i t = _mm_slli_epi32(s1, 9);
+        s2 = _mm_xor_si128(s2, s0);
+        s3 = _mm_xor_si128(s3, s1);
+        s1 = _mm_xor_si128(s1, s2);
+        s0 = _mm_xor_si128(s0, s3);
+        s2 = _mm_xor_si128(s2, t);
+        s3 = _mm_or_si128(_mm_slli_epi32(s3, 11), _mm_srli_epi32(s3, 21));
+        if (uniform) {
+            __m128 f = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(result, 8)), scale);
+            _mm_storeu_ps((float*) out + i*4, f);
+        } else {
+            _mm_storeu_si128((__m128i*) out + i, result);
+        }
+    }
+    _mm_storeu_si128((__m128i*) rng->s[0], s0);
+    _mm_storeu_si128((__m128i*) rng->s[1], s1);
+    _mm_storeu_si128((__m128i*) rng->s[2], s2);
+    _mm_storeu_si128((__m128i*) rng->s[3], s3);
+#else
+    for (size_t i = 0; i < count4; ++i) {
+        for (int lane = 0; lane < 4; ++lane) {
+            uint32_t s0 = rng->s[0][lane];
+            uint32_t s1 = rng->s[1][lane];
+            uint32_t s2 = rng->s[2][lane];
+            uint32_t s3 = rng->s[3][lane];
+            uint32_t result = s0 + s3;
+            uint32_t t = s1 << 9;
+            s2 ^= s0;
+            s3 ^= s1;
+            s1 ^= s2;
+            s0 ^= s3;
+            s2 ^= t;
+            s3 = (s3 << 11) | (s3 >> 21);
+            rng->s[0][lane] = s0;
+            rng->s[1][lane] = s1;
+            rng->s[2][lane] = s2;
+            rng->s[3][lane] = s3;
+            if (uniform) {
+                ((float*) out)[i*4 + lane] = (float) (result >> 8) * LA__UNIFORM_SCALE;
+            } else {
+                ((uint32_t*) out)[i*4 + lane] = result;
+            }
+        }
+    }
+#endif // LA_SSE2
+}
+
+LADEF void rng_u32x4(Rng *rng, uint32_t out[4])
+{
+    la__rng_fill(rng, out, 1, false);
+}
+
+LADEF void rng_uniformf(Rng *rng, float *out, size_t count)
+{
+    la__rng_fill(rng, out, count / 4, true);
+    size_t rest = count % 4;
+    if (rest > 0) {
+        float tail[4];
+        la__rng_fill(rng, tail, 1, true);
+        memcpy(out + count - rest, tail, rest * sizeof(float));
+    }
+}
+
+// Vectors are arrays of floats without padding, so they are filled as such
+LADEF void rng_uniform_v2f(Rng *rng, V2f *out, size_t count)
+{
+    rng_uniformf(rng, (float*) out, count * 2);
+}
+
+LADEF void rng_uniform_v4f(Rng *rng, V4f *out, size_t count)
+{
+    rng_uniformf(rng, (float*) out, count * 4);
+}
+
+LADEF void rng_normalf(Rng *rng, float *out, size_t count)
+{
+    // Uniforms are generated in batches in place and transformed pairwise
+    size_t pairs = count / 2;
+    size_t i = 0;
+    while (i < pairs) {
+        size_t batch = pairs - i < 256 ? pairs - i : 256;
+        float *u = out + i*2;
+        rng_uniformf(rng, u, batch * 2);
+        for (size_t j = 0; j < batch; ++j) {
+            // 1 - u is in (0, 1], so the log never sees 0
+            float r = sqrtf(-2.0f * logf(1.0f - u[j*2 + 0]));
+            float theta = 6.28318530718f * u[j*2 + 1];
+            u[j*2 + 0] = r * cosf(theta);
+            u[j*2 + 1] = r * sinf(theta);
+        }
+        i += batch;
+    }
+    if (count % 2 != 0) {
+        float u[4];
+        rng_uniformf(rng, u, 2);
+        out[count - 1] = sqrtf(-2.0f * logf(1.0f - u[0])) * cosf(6.28318530718f * u[1]);
+    }
+}
+
+LADEF void rng_normal_v2f(Rng *rng, V2f *out, size_t count)
+{
+    rng_normalf(rng, (float*) out, count * 2);
+}
+
+LADEF void rng_normal_v4f(Rng *rng, V4f *out, size_t count)
+{
+    rng_normalf(rng, (float*) out, count * 4);
+}
+
+LADEF float halton(uint32_t index, uint32_t base)
+{
+    // Base 0 divides by zero and base 1 never runs out of digits
+    assert(base >= 2);
+    if (base == 2) {
+        // Radical inverse in base 2 is just reversing the bits
+        index = (index << 16) | (index >> 16);
+        index = ((index & 0x00FF00FFu) << 8) | ((index & 0xFF00FF00u) >> 8);
+        index = ((index & 0x0F0F0F0Fu) << 4) | ((index & 0xF0F0F0F0u) >> 4);
+        index = ((index & 0x33333333u) << 2) | ((index & 0xCCCCCCCCu) >> 2);
+        index = ((index & 0x55555555u) << 1) | ((index & 0xAAAAAAAAu) >> 1);
+        return (float) (index >> 8) * LA__UNIFORM_SCALE;
+    }
+
+    double inv_base = 1.0 / base;
+    double f = inv_base;
+    double r = 0.0;
+    while (index > 0) {
+        r += f * (index % base);
+        index /= base;
+        f *= inv_base;
+    }
+    return (float) r;
+}
+
+LADEF void halton_v2f(V2f *out, size_t count, uint32_t index)
+{
+    for (size_t i = 0; i < count; ++i) {
+        out[i].x = halton(index + (uint32_t) i, 2);
+        out[i].y = halton(index + (uint32_t) i, 3);
+    }
+}
+
+LADEF void halton_v4f(V4f *out, size_t count, uint32_t index)
+{
+    for (size_t i = 0; i < count; ++i) {
+        out[i].x = halton(index + (uint32_t) i, 2);
+        out[i].y = halton(index + (uint32_t) i, 3);
+        out[i].z = halton(index + (uint32_t) i, 5);
+        out[i].w = halton(index + (uint32_t) i, 7);
+    }
+}
+
 #endif // LA_IMPLEMENTATION
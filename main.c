@@ -6,6 +6,18 @@
 #include <string.h>
 #include <errno.h>
 #include <math.h>
+#include <ctype.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#else
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#endif // _WIN32
 
 #define GLFW_INCLUDE_GLEXT
 #include <GLFW/glfw3.h>
@@ -13,9 +25,28 @@
 #define LA_IMPLEMENTATION
 #include "la.h"
 
+#define HASH_IMPLEMENTATION
+#include "hash.h"
+
 #define SV_IMPLEMENTATION
 #include "sv.h"
 
+#define MAPPED_FILE_IMPLEMENTATION
+#include "mapped_file.h"
+
+#define PACK_IMPLEMENTATION
+#include "pack.h"
+
+#define JOBS_IMPLEMENTATION
+#include "jobs.h"
+
+#include "mem.c"
+
+#define FFT_MALLOC(size) mem_alloc(MEM_TAG_AUDIO, (size))
+#define FFT_FREE(ptr)    mem_free(ptr)
+#define FFT_IMPLEMENTATION
+#include "fft.h"
+
 #define DEFAULT_SCREEN_WIDTH 1600
 #define DEFAULT_SCREEN_HEIGHT 900
 #define MANUAL_TIME_STEP 0.1
@@ -28,7 +59,7 @@
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
 
-char *slurp_file_into_malloced_cstr(const char *file_path)
+char *slurp_file_into_malloced_cstr(const char *file_path, Mem_Tag tag)
 {
     FILE *f = NULL;
     char *buffer = NULL;
@@ -40,7 +71,7 @@ char *slurp_file_into_malloced_cstr(const char *file_path)
     long size = ftell(f);
     if (size < 0) goto fail;
 
-    buffer = malloc(size + 1);
+    buffer = mem_alloc(tag, size + 1);
     if (buffer == NULL) goto fail;
 
     if (fseek(f, 0, SEEK_SET) < 0) goto fail;
@@ -62,11 +93,35 @@ fail:
         errno = saved_errno;
     }
     if (buffer) {
-        free(buffer);
+        mem_free(buffer);
     }
     return NULL;
 }
 
+// When loaded, assets are resolved from the pack first and from the file system second
+static Pack asset_pack = {0};
+// Loads assets in the background and generates procedural ones
+static Job_Pool global_jobs = {0};
+
+const Pack_Entry *find_packed_asset(const char *file_path, Pack_Asset_Kind kind)
+{
+    const Pack_Entry *entry = pack_find(&asset_pack, file_path);
+    if (entry == NULL || entry->kind != (uint32_t) kind) return NULL;
+    return entry;
+}
+
+char *slurp_asset_into_malloced_cstr(const char *file_path, Mem_Tag tag)
+{
+    const Pack_Entry *entry = find_packed_asset(file_path, PACK_ASSET_RAW);
+    if (entry == NULL) return slurp_file_into_malloced_cstr(file_path, tag);
+
+    char *buffer = mem_alloc(tag, entry->data_size + 1);
+    if (buffer == NULL) return NULL;
+    memcpy(buffer, pack_entry_data(&asset_pack, entry), entry->data_size);
+    buffer[entry->data_size] = '\0';
+    return buffer;
+}
+
 const char *shader_type_as_cstr(GLuint shader)
 {
     switch (shader) {
@@ -74,6 +129,8 @@ const char *shader_type_as_cstr(GLuint shader)
         return "GL_VERTEX_SHADER";
     case GL_FRAGMENT_SHADER:
         return "GL_FRAGMENT_SHADER";
+    case GL_COMPUTE_SHADER:
+        return "GL_COMPUTE_SHADER";
     default:
         return "(Unknown)";
     }
@@ -100,22 +157,6 @@ bool compile_shader_source(const GLchar *source, GLenum shader_type, GLuint *sha
     return true;
 }
 
-bool compile_shader_file(const char *file_path, GLenum shader_type, GLuint *shader)
-{
-    char *source = slurp_file_into_malloced_cstr(file_path);
-    if (source == NULL) {
-        fprintf(stderr, "ERROR: failed to read file `%s`: %s\n", file_path, strerror(errno));
-        errno = 0;
-        return false;
-    }
-    bool ok = compile_shader_source(source, shader_type, shader);
-    if (!ok) {
-        fprintf(stderr, "ERROR: failed to compile `%s` shader file\n", file_path);
-    }
-    free(source);
-    return ok;
-}
-
 bool link_program(GLuint vert_shader, GLuint frag_shader, GLuint *program)
 {
     *program = glCreateProgram();
@@ -137,23 +178,150 @@ bool link_program(GLuint vert_shader, GLuint frag_shader, GLuint *program)
     glDeleteShader(vert_shader);
     glDeleteShader(frag_shader);
 
-    return program;
+    return linked;
+}
+
+// For the shaders built into the program
+bool create_program(const char *vert_source, const char *frag_source, GLuint *program)
+{
+    GLuint vert = 0;
+    GLuint frag = 0;
+    if (!compile_shader_source(vert_source, GL_VERTEX_SHADER, &vert)) return false;
+    if (!compile_shader_source(frag_source, GL_FRAGMENT_SHADER, &frag)) {
+        glDeleteShader(vert);
+        return false;
+    }
+    if (!link_program(vert, frag, program)) {
+        glDeleteProgram(*program);
+        *program = 0;
+        return false;
+    }
+    return true;
+}
+
+// Needs a GL 4.3 context
+bool create_compute_program(const char *source, GLuint *program)
+{
+    GLuint shader = 0;
+    if (!compile_shader_source(source, GL_COMPUTE_SHADER, &shader)) return false;
+    *program = glCreateProgram();
+    glAttachShader(*program, shader);
+    glLinkProgram(*program);
+    glDeleteShader(shader);
+
+    GLint linked = 0;
+    glGetProgramiv(*program, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        GLsizei message_size = 0;
+        GLchar message[1024];
+        glGetProgramInfoLog(*program, sizeof(message), &message_size, message);
+        fprintf(stderr, "Program Linking: %.*s\n", message_size, message);
+        glDeleteProgram(*program);
+        *program = 0;
+        return false;
+    }
+    return true;
+}
+
+// Reads the bound framebuffer as tightly packed RGB, bottom row first
+void read_rgb_pixels(int width, int height, unsigned char *pixels)
+{
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
 }
 
+// Saves RGB pixels as read back from GL. Doesn't touch GL, so it runs on
+// the job pool too
+bool save_rgb_png(const char *path, int width, int height, unsigned char *pixels)
+{
+    // GL rows go bottom up
+    size_t stride = (size_t) width*3;
+    for (int y = 0; y < height/2; ++y) {
+        unsigned char *a = pixels + (size_t) y*stride;
+        unsigned char *b = pixels + (size_t) (height - 1 - y)*stride;
+        for (size_t i = 0; i < stride; ++i) {
+            unsigned char t = a[i];
+            a[i] = b[i];
+            b[i] = t;
+        }
+    }
+    return stbi_write_png(path, width, height, 3, pixels, (int) stride) != 0;
+}
+
+// Files other runs and processes read are written under a name of this
+// process and renamed over `path` by commit_temp_file() when complete, so a
+// crash or another instance never leaves a truncated file at `path`
+#define TEMP_FILE_PATH_EXTRA 32
+void temp_file_path(const char *path, char *tmp_path, size_t tmp_size)
+{
+#ifdef _WIN32
+    snprintf(tmp_path, tmp_size, "%s.%d.tmp", path, _getpid());
+#else
+    snprintf(tmp_path, tmp_size, "%s.%d.tmp", path, (int) getpid());
+#endif // _WIN32
+}
+
+// Moves `tmp_path` over `path` when `ok`, otherwise removes it. On failure
+// errno is the one of the failure, for the message of the caller
+bool commit_temp_file(const char *tmp_path, const char *path, bool ok)
+{
+    if (ok) {
+#ifdef _WIN32
+        // rename() doesn't replace existing files on Windows
+        remove(path);
+#endif // _WIN32
+        if (rename(tmp_path, path) == 0) return true;
+    }
+    int error = errno;
+    remove(tmp_path);
+    errno = error;
+    return false;
+}
+
+#include "noise.c"
+#include "resources.c"
+#include "audio.c"
+#include "video.c"
+#include "plot.c"
+#include "tilemap.c"
+#include "sprites.c"
+#include "paths.c"
+#include "targets.c"
+#include "post.c"
+#include "frame_stats.c"
+#include "overdraw.c"
+#include "timeline.c"
+
 typedef enum {
     RESOLUTION_UNIFORM = 0,
     TIME_UNIFORM,
     MOUSE_UNIFORM,
+    SPECTRUM_UNIFORM,
+    BANDS_UNIFORM,
+    NYQUIST_UNIFORM,
+    VIDEO_UNIFORM,
     COUNT_UNIFORMS
 } Uniform;
 
-static_assert(COUNT_UNIFORMS == 3, "Update list of uniform names");
+static_assert(COUNT_UNIFORMS == 7, "Update list of uniform names");
 static const char *uniform_names[COUNT_UNIFORMS] = {
     [RESOLUTION_UNIFORM] = "resolution",
     [TIME_UNIFORM] = "time",
     [MOUSE_UNIFORM] = "mouse",
+    [SPECTRUM_UNIFORM] = "spectrum",
+    [BANDS_UNIFORM] = "bands",
+    [NYQUIST_UNIFORM] = "nyquist",
+    [VIDEO_UNIFORM] = "video",
 };
 
+#include "scenes.c"
+#include "compare.c"
+#include "autotune.c"
+#include "sweep.c"
+#include "server.c"
+#include "farm.c"
+
 typedef enum {
     VA_POS = 0,
     VA_UV,
@@ -171,18 +339,32 @@ typedef struct {
 typedef struct {
     GLuint vao;
     GLuint vbo;
-    bool program_failed;
-    GLuint program;
-    GLint uniforms[COUNT_UNIFORMS];
     Vertex vertex_buf[VERTEX_BUF_CAP];
     size_t vertex_buf_sz;
-    GLuint texture;
+    Resource_Manager resources;
+    Scenes scenes;
 } Renderer;
 
 // Global variables (fragile people with CS degree look away)
-static double time = 0.0;
-static bool pause = false;
+static double global_time = 0.0;
+static bool paused = false;
 static Renderer global_renderer = {0};
+static Audio global_audio = {0};
+static Video global_video = {0};
+static Plot global_plot = {0};
+static Tilemap global_tilemap = {0};
+static Sprites global_sprites = {0};
+static Paths global_paths = {0};
+static Render_Targets global_targets = {0};
+static Render_Size global_render_size = {0};
+static Post global_post = {0};
+static Frame_Stats global_frame_stats = {0};
+static Compare global_compare = {0};
+static Autotune global_autotune = {0};
+static Overdraw global_overdraw = {0};
+static Timeline global_timeline = {0};
+static Farm global_farm = {.fps = 60.0, .out_dir = "frames", .worker = -1};
+static size_t global_frame = 0;
 
 void renderer_push_vertex(Renderer *r, V2f pos, V2f uv, V4f color)
 {
@@ -232,37 +414,33 @@ void renderer_sync(Renderer *r)
                     r->vertex_buf);
 }
 
-bool load_shader_program(const char *vertex_file_path,
-                         const char *fragment_file_path,
-                         GLuint *program)
-{
-    GLuint vert = 0;
-    if (!compile_shader_file(vertex_file_path, GL_VERTEX_SHADER, &vert)) {
-        return false;
-    }
-
-    GLuint frag = 0;
-    if (!compile_shader_file(fragment_file_path, GL_FRAGMENT_SHADER, &frag)) {
-        return false;
-    }
-
-    if (!link_program(vert, frag, program)) {
-        return false;
-    }
-
-    return true;
-}
-
 static char *render_conf = NULL;
-const char *vert_path = NULL;
-const char *frag_path = NULL;
-const char *texture_path = NULL;
+Scene_Conf scene_confs[SCENES_CAP] = {0};
+size_t scene_confs_count = 0;
+size_t vram_budget_mb = 0;
+const char *audio_path = NULL;
+const char *video_path = NULL;
+const char *plot_path = NULL;
+Plot_Style plot_style = PLOT_LINES;
+const char *tilemap_path = NULL;
+const char *compare_path = NULL;
+const char *timeline_path = NULL;
+float tune_tolerance = -1.0f;
+int sweep_cell_width = 192;
+int sweep_cell_height = 108;
+const char *tileset_path = NULL;
+int tile_size = 16;
+float tile_scale = 1.0f;
+Sprites_Conf sprites_conf = {0};
+const char *paths_path = NULL;
+float path_tolerance = 0.25f;
+Post_Conf post_conf = {0};
 
 void reload_render_conf(const char *render_conf_path)
 {
-    if (render_conf) free(render_conf);
+    if (render_conf) mem_free(render_conf);
 
-    render_conf = slurp_file_into_malloced_cstr(render_conf_path);
+    render_conf = slurp_asset_into_malloced_cstr(render_conf_path, MEM_TAG_CONFIG);
     if (render_conf == NULL) {
         fprintf(stderr, "ERROR: could not load %s: %s\n", render_conf_path, strerror(errno));
         exit(1);
@@ -270,9 +448,30 @@ void reload_render_conf(const char *render_conf_path)
 
     String_View content = sv_from_cstr(render_conf);
 
-    vert_path = NULL;
-    frag_path = NULL;
-    texture_path = NULL;
+    // Keys before the first `scene` describe the first scene. Every `scene` key
+    // starts a new one that inherits the paths of the previous one.
+    memset(scene_confs, 0, sizeof(scene_confs));
+    scene_confs_count = 1;
+    scene_confs[0].name = "default";
+    bool scene_has_keys = false;
+    vram_budget_mb = 0;
+    audio_path = NULL;
+    video_path = NULL;
+    plot_path = NULL;
+    plot_style = PLOT_LINES;
+    tilemap_path = NULL;
+    compare_path = NULL;
+    timeline_path = NULL;
+    tune_tolerance = -1.0f;
+    sweep_cell_width = 192;
+    sweep_cell_height = 108;
+    tileset_path = NULL;
+    tile_size = 16;
+    tile_scale = 1.0f;
+    sprites_conf = sprites_conf_default;
+    paths_path = NULL;
+    path_tolerance = 0.25f;
+    post_conf = post_conf_default;
     for (int row = 0; content.count > 0; row++) {
         String_View line = sv_chop_by_delim(&content, '\n');
         const char *line_start = line.data;
@@ -300,15 +499,199 @@ void reload_render_conf(const char *render_conf_path)
             // There is always something after `value`. It's either `\n` or `\0`. With all of these 
             // invariats in place writing to `value.data[value.count]` should be safe.
 
-            if (sv_eq(key, SV("vert"))) {
-                vert_path = value.data;
-                printf("Vertex Path: %s\n", vert_path);
+            Scene_Conf *conf = &scene_confs[scene_confs_count - 1];
+            if (sv_eq(key, SV("scene"))) {
+                if (scene_has_keys) {
+                    if (scene_confs_count >= SCENES_CAP) {
+                        printf("%s:%d:%ld: ERROR: too many scenes, only %d are supported\n",
+                               render_conf_path, row, key.data - line_start, SCENES_CAP);
+                        continue;
+                    }
+                    scene_confs[scene_confs_count] = *conf;
+                    conf = &scene_confs[scene_confs_count++];
+                }
+                conf->name = value.data;
+                scene_has_keys = true;
+                printf("Scene %zu: %s\n", scene_confs_count, conf->name);
+            } else if (sv_eq(key, SV("vert"))) {
+                conf->vert_path = value.data;
+                scene_has_keys = true;
+                printf("Vertex Path: %s\n", conf->vert_path);
             } else if (sv_eq(key, SV("frag"))) {
-                frag_path = value.data;
-                printf("Fragment Path: %s\n", frag_path);
+                conf->frag_path = value.data;
+                scene_has_keys = true;
+                printf("Fragment Path: %s\n", conf->frag_path);
             } else if (sv_eq(key, SV("texture"))) {
-                texture_path = value.data;
-                printf("Texture Path: %s\n", texture_path);
+                conf->texture_path = value.data;
+                scene_has_keys = true;
+                printf("Texture Path: %s\n", conf->texture_path);
+            } else if (sv_eq(key, SV("tune"))) {
+                String_View define = value;
+                sv_chop_by_delim(&define, ' ');
+                if (sv_trim_left(define).count == 0) {
+                    printf("%s:%d:%ld: ERROR: `tune` needs a define name followed by its candidate values\n",
+                           render_conf_path, row, value.data - line_start);
+                } else if (conf->tunes_count >= SCENE_TUNES_CAP) {
+                    printf("%s:%d:%ld: ERROR: too many tuned defines, only %d are supported\n",
+                           render_conf_path, row, key.data - line_start, SCENE_TUNES_CAP);
+                } else {
+                    conf->tunes[conf->tunes_count++] = value.data;
+                    scene_has_keys = true;
+                    printf("Tune: %s\n", value.data);
+                }
+            } else if (sv_eq(key, SV("sweep"))) {
+                String_View sweep = value;
+                sv_chop_by_delim(&sweep, ' ');
+                char *end = (char*) sweep.data;
+                size_t numbers = 0;
+                for (; numbers < 3; ++numbers) {
+                    char *start = end;
+                    strtod(start, &end);
+                    if (end == start) break;
+                }
+                if (numbers < 3 || *sv_trim_left(sv_from_cstr(end)).data != '\0') {
+                    printf("%s:%d:%ld: ERROR: `sweep` needs a uniform name followed by from, to and steps\n",
+                           render_conf_path, row, value.data - line_start);
+                } else if (conf->sweeps_count >= SCENE_SWEEPS_CAP) {
+                    printf("%s:%d:%ld: ERROR: too many swept uniforms, only %d are supported\n",
+                           render_conf_path, row, key.data - line_start, SCENE_SWEEPS_CAP);
+                } else {
+                    conf->sweeps[conf->sweeps_count++] = value.data;
+                    scene_has_keys = true;
+                    printf("Sweep: %s\n", value.data);
+                }
+            } else if (sv_eq(key, SV("sweep_cell"))) {
+                char *end = (char*) value.data;
+                long width = strtol(end, &end, 10);
+                long height = strtol(end, &end, 10);
+                if (width <= 0 || height <= 0) {
+                    printf("%s:%d:%ld: ERROR: `sweep_cell` needs a width and a height\n",
+                           render_conf_path, row, value.data - line_start);
+                } else {
+                    sweep_cell_width = (int) width;
+                    sweep_cell_height = (int) height;
+                }
+            } else if (sv_eq(key, SV("tune_tolerance"))) {
+                tune_tolerance = strtof(value.data, NULL);
+            } else if (sv_eq(key, SV("timeline"))) {
+                timeline_path = value.data;
+                printf("Timeline Path: %s\n", timeline_path);
+            } else if (sv_eq(key, SV("compare"))) {
+                compare_path = value.data;
+                printf("A/B Fragment Path: %s\n", compare_path);
+            } else if (sv_eq(key, SV("vram_budget_mb"))) {
+                vram_budget_mb = sv_to_u64(value);
+                printf("VRAM Budget: %zu MB\n", vram_budget_mb);
+            } else if (sv_eq(key, SV("audio"))) {
+                audio_path = value.data;
+                printf("Audio Path: %s\n", audio_path);
+            } else if (sv_eq(key, SV("video"))) {
+                video_path = value.data;
+                printf("Video Path: %s\n", video_path);
+            } else if (sv_eq(key, SV("plot"))) {
+                plot_path = value.data;
+                printf("Plot Path: %s\n", plot_path);
+            } else if (sv_eq(key, SV("plot_style"))) {
+                if (!plot_style_by_name(value, &plot_style)) {
+                    printf("%s:%d:%ld: ERROR: unknown plot style `"SV_Fmt"`, expected lines or points\n",
+                           render_conf_path, row, value.data - line_start, SV_Arg(value));
+                }
+            } else if (sv_eq(key, SV("tilemap"))) {
+                tilemap_path = value.data;
+                printf("Tilemap Path: %s\n", tilemap_path);
+            } else if (sv_eq(key, SV("tileset"))) {
+                tileset_path = value.data;
+                printf("Tileset Path: %s\n", tileset_path);
+            } else if (sv_eq(key, SV("tile_size"))) {
+                tile_size = (int) sv_to_u64(value);
+            } else if (sv_eq(key, SV("tile_scale"))) {
+                tile_scale = strtof(value.data, NULL);
+            } else if (sv_eq(key, SV("sprites"))) {
+                sprites_conf.count = sv_to_u64(value);
+            } else if (sv_eq(key, SV("sprite_textures"))) {
+                sprites_conf.textures_count = 0;
+                String_View names = value;
+                while (names.count > 0) {
+                    String_View name = sv_chop_by_delim(&names, ' ');
+                    names = sv_trim_left(names);
+                    if (sprites_conf.textures_count >= SPRITES_MATERIALS_CAP) {
+                        printf("%s:%d:%ld: ERROR: too many sprite textures, only %d are supported\n",
+                               render_conf_path, row, name.data - line_start, SPRITES_MATERIALS_CAP);
+                        break;
+                    }
+                    // Same as with `value`, the name is followed by a space or the end of `value`
+                    ((char*)name.data)[name.count] = '\0';
+                    sprites_conf.texture_paths[sprites_conf.textures_count++] = name.data;
+                }
+            } else if (sv_eq(key, SV("sprite_world"))) {
+                sprites_conf.world_size = (int) sv_to_u64(value);
+            } else if (sv_eq(key, SV("sprite_scroll"))) {
+                sprites_conf.scroll = strtof(value.data, NULL);
+            } else if (sv_eq(key, SV("sprite_frames"))) {
+                char *end = (char*) value.data;
+                long columns = strtol(end, &end, 10);
+                long rows = strtol(end, &end, 10);
+                if (columns <= 0 || rows <= 0) {
+                    printf("%s:%d:%ld: ERROR: `sprite_frames` needs the columns and the rows of the sprite sheets\n",
+                           render_conf_path, row, value.data - line_start);
+                } else {
+                    sprites_conf.frames[0] = (int) columns;
+                    sprites_conf.frames[1] = (int) rows;
+                }
+            } else if (sv_eq(key, SV("sprite_clip"))) {
+                char *end = (char*) value.data;
+                long first = strtol(end, &end, 10);
+                long count = strtol(end, &end, 10);
+                char *fps_start = end;
+                float fps = strtof(fps_start, &end);
+                if (first < 0 || count <= 0 || end == fps_start || fps < 0.0f) {
+                    printf("%s:%d:%ld: ERROR: `sprite_clip` needs the first frame, the number of frames and the frames per second\n",
+                           render_conf_path, row, value.data - line_start);
+                } else if (sprites_conf.clips_count >= SPRITES_CLIPS_CAP) {
+                    printf("%s:%d:%ld: ERROR: too many sprite clips, only %d are supported\n",
+                           render_conf_path, row, key.data - line_start, SPRITES_CLIPS_CAP);
+                } else {
+                    float *clip = sprites_conf.clips[sprites_conf.clips_count++];
+                    clip[0] = (float) first;
+                    clip[1] = (float) count;
+                    clip[2] = fps;
+                }
+            } else if (sv_eq(key, SV("sprite_submit"))) {
+                if (!sprites_submit_by_name(value, &sprites_conf.submit)) {
+                    printf("%s:%d:%ld: ERROR: unknown sprite submission `"SV_Fmt"`, expected auto, draws, indirect or gpu\n",
+                           render_conf_path, row, value.data - line_start, SV_Arg(value));
+                }
+            } else if (sv_eq(key, SV("paths"))) {
+                paths_path = value.data;
+                printf("Paths Path: %s\n", paths_path);
+            } else if (sv_eq(key, SV("path_tolerance"))) {
+                path_tolerance = strtof(value.data, NULL);
+            } else if (sv_eq(key, SV("post"))) {
+                memset(post_conf.effects, 0, sizeof(post_conf.effects));
+                String_View names = value;
+                while (names.count > 0) {
+                    String_View name = sv_chop_by_delim(&names, ' ');
+                    names = sv_trim_left(names);
+                    Post_Effect effect;
+                    if (post_effect_by_name(name, &effect)) {
+                        post_conf.effects[effect] = true;
+                    } else {
+                        printf("%s:%d:%ld: ERROR: unknown post-processing effect `"SV_Fmt"`\n",
+                               render_conf_path, row, name.data - line_start, SV_Arg(name));
+                    }
+                }
+                if (post_conf.effects[POST_ACES] && post_conf.effects[POST_REINHARD]) {
+                    printf("%s:%d:%ld: ERROR: only one of aces and reinhard can be used, using aces\n",
+                           render_conf_path, row, value.data - line_start);
+                    post_conf.effects[POST_REINHARD] = false;
+                }
+                printf("Post-processing: %s\n", value.data);
+            } else if (sv_eq(key, SV("bloom_threshold"))) {
+                post_conf.bloom_threshold = strtof(value.data, NULL);
+            } else if (sv_eq(key, SV("bloom_intensity"))) {
+                post_conf.bloom_intensity = strtof(value.data, NULL);
+            } else if (sv_eq(key, SV("vignette_strength"))) {
+                post_conf.vignette_strength = strtof(value.data, NULL);
             } else {
                 printf("%s:%d:%ld: ERROR: unsupported key `"SV_Fmt"`\n",
                        render_conf_path, row, key.data - line_start, 
@@ -318,61 +701,51 @@ void reload_render_conf(const char *render_conf_path)
     }
 }
 
-void renderer_reload_textures(Renderer *r)
+// Expects no scene jobs in flight, i.e. job_pool_wait() before reload_render_conf()
+void renderer_reload_scenes(Renderer *r)
 {
-    int texture_width, texture_height;
-    unsigned char *texture_pixels = stbi_load(texture_path, &texture_width, &texture_height, NULL, 4);
-    if (texture_pixels == NULL) {
-        fprintf(stderr, "ERROR: could not load image %s: %s\n",
-                texture_path, strerror(errno));
-        return;
-    }
-
-    glDeleteTextures(1, &r->texture);
-    glGenTextures(1, &r->texture);
-    glBindTexture(GL_TEXTURE_2D, r->texture);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-
-    glTexImage2D(GL_TEXTURE_2D,
-                 0,
-                 GL_RGBA,
-                 texture_width,
-                 texture_height,
-                 0,
-                 GL_RGBA,
-                 GL_UNSIGNED_BYTE,
-                 texture_pixels);
-
-    stbi_image_free(texture_pixels);
+    r->resources.vram_budget = vram_budget_mb * 1024 * 1024;
+
+    // The old scenes are released after the new ones are loaded so everything
+    // that didn't change is reused instead of being compiled and uploaded again
+    Scenes old_scenes = r->scenes;
+    scenes_load(&r->scenes, &global_jobs, scene_confs, scene_confs_count);
+    job_pool_wait(&global_jobs);
+    while (scenes_upload_prepared(&r->scenes, &r->resources)) {}
+    scenes_unload(&old_scenes, &r->resources);
+
+    resources_print_summary(&r->resources);
 }
 
-void renderer_reload_shaders(Renderer *r)
-{
-    glDeleteProgram(r->program);
+static const char *frame_stats_path = NULL;
+static FILE *frame_stats_file = NULL;
+static Frame_Stats_Result last_frame_stats = {0};
+static bool has_last_frame_stats = false;
+static bool screenshot_stats_pending = false;
+static size_t screenshot_stats_frame = 0;
 
-    r->program_failed = true;
-    glClearColor(1.0f, 0.0f, 0.0f, 1.0f);
+#define SCREENSHOT_JSON_PATH "screenshot.json"
 
-    {
-        if (!load_shader_program(vert_path, frag_path, &r->program)) {
-            return;
-        }
+static void handle_frame_stats(const Frame_Stats_Result *result)
+{
+    last_frame_stats = *result;
+    has_last_frame_stats = true;
 
-        glUseProgram(r->program);
+    if (frame_stats_file != NULL && !frame_stats_write_json(frame_stats_file, result)) {
+        fprintf(stderr, "ERROR: could not write frame stats to %s: %s\n", frame_stats_path, strerror(errno));
+        fclose(frame_stats_file);
+        frame_stats_file = NULL;
+    }
 
-        for (Uniform index = 0; index < COUNT_UNIFORMS; ++index) {
-            r->uniforms[index] = glGetUniformLocation(r->program, uniform_names[index]);
+    if (screenshot_stats_pending && result->frame == screenshot_stats_frame) {
+        screenshot_stats_pending = false;
+        FILE *f = fopen(SCREENSHOT_JSON_PATH, "w");
+        bool ok = f != NULL && frame_stats_write_json(f, result);
+        if (f != NULL && fclose(f) != 0) ok = false;
+        if (!ok) {
+            fprintf(stderr, "ERROR: could not save %s: %s\n", SCREENSHOT_JSON_PATH, strerror(errno));
         }
     }
-
-    r->program_failed = false;
-    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-
-    printf("Successfully Reload the Shaders\n");
 }
 
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
@@ -383,15 +756,27 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 
     if (action == GLFW_PRESS) {
         if (key == GLFW_KEY_F5) {
+            job_pool_wait(&global_jobs);
             reload_render_conf("render.conf");
-            renderer_reload_textures(&global_renderer);
-            renderer_reload_shaders(&global_renderer);
+            renderer_reload_scenes(&global_renderer);
+            compare_load(&global_compare, &global_renderer.resources, compare_path);
+            global_autotune.tolerance = tune_tolerance;
+            timeline_load(&global_timeline, timeline_path);
+            audio_load(&global_audio, audio_path);
+            video_load(&global_video, &global_jobs, video_path);
+            plot_load(&global_plot, &global_jobs, plot_path, plot_style);
+            tilemap_load(&global_tilemap, tilemap_path, tileset_path, tile_size, tile_scale);
+            sprites_load(&global_sprites, &sprites_conf);
+            paths_load(&global_paths, &global_jobs, paths_path, path_tolerance);
+            post_load(&global_post, &post_conf);
+        } else if (GLFW_KEY_1 <= key && key <= GLFW_KEY_9) {
+            scenes_switch(&global_renderer.scenes, key - GLFW_KEY_1);
         } else if (key == GLFW_KEY_F6) {
 #define SCREENSHOT_PNG_PATH "screenshot.png"
             printf("Saving the screenshot at %s\n", SCREENSHOT_PNG_PATH);
             int width, height;
             glfwGetWindowSize(window, &width, &height);
-            void *pixels = malloc(4 * width * height);
+            void *pixels = mem_alloc(MEM_TAG_CAPTURE, 4 * width * height);
             if (pixels == NULL) {
                 fprintf(stderr, "ERROR: could not allocate memory for pixels to make a screenshot: %s\n",
                         strerror(errno));
@@ -401,23 +786,117 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
             if (!stbi_write_png(SCREENSHOT_PNG_PATH, width, height, 4, pixels, width * 4)) {
                 fprintf(stderr, "ERROR: could not save %s: %s\n", SCREENSHOT_PNG_PATH, strerror(errno));
             }
-            free(pixels);
+            mem_free(pixels);
+            // The stats of the frame are still on their way from the GPU
+            if (global_frame_stats.enabled && global_frame > 0) {
+                screenshot_stats_pending = true;
+                screenshot_stats_frame = global_frame - 1;
+            }
+        } else if (key == GLFW_KEY_F7) {
+            mem_print_stats();
+            render_targets_print_summary(&global_targets);
+            sprites_print_stats(&global_sprites);
+            post_print_timers(&global_post);
+            compare_print_stats(&global_compare);
+            overdraw_print_stats(&global_overdraw);
+            if (has_last_frame_stats) frame_stats_print(&last_frame_stats);
+        } else if (key == GLFW_KEY_F8) {
+            global_post.bypass = !global_post.bypass;
+            printf("Post-processing %s\n", global_post.bypass ? "off" : "on");
+        } else if (key == GLFW_KEY_F9) {
+            compare_toggle_diff(&global_compare);
+        } else if (key == GLFW_KEY_F10) {
+            overdraw_toggle(&global_overdraw);
+        } else if (key == GLFW_KEY_F11) {
+            sweep_scene(scenes_current(&global_renderer.scenes), &global_renderer.resources, &global_targets,
+                        &global_timeline, sweep_cell_width, sweep_cell_height, (float) global_time, global_audio.bands,
+                        audio_nyquist(&global_audio));
+        } else if (key == GLFW_KEY_HOME) {
+            plot_reset_view(&global_plot);
         } else if (key == GLFW_KEY_SPACE) {
-            pause = !pause;
+            paused = !paused;
         } else if (key == GLFW_KEY_Q) {
             exit(1);
         }
 
-        if (pause) {
+        if (paused) {
             if (key == GLFW_KEY_LEFT) {
-                time -= MANUAL_TIME_STEP;
+                global_time -= MANUAL_TIME_STEP;
             } else if (key == GLFW_KEY_RIGHT) {
-                time += MANUAL_TIME_STEP;
+                global_time += MANUAL_TIME_STEP;
             }
         }
     }
 }
 
+void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
+{
+    (void) xoffset;
+    int width, height;
+    glfwGetWindowSize(window, &width, &height);
+    double xpos, ypos;
+    glfwGetCursorPos(window, &xpos, &ypos);
+    if (width > 0) plot_zoom(&global_plot, pow(0.8, yoffset), xpos/width);
+}
+
+// Right click cycles the tile under the cursor on the last layer of the map
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
+{
+    (void) mods;
+    if (button != GLFW_MOUSE_BUTTON_RIGHT || action != GLFW_PRESS) return;
+    if (global_tilemap.layers_count == 0) return;
+
+    int width, height, framebuffer_width, framebuffer_height;
+    glfwGetWindowSize(window, &width, &height);
+    glfwGetFramebufferSize(window, &framebuffer_width, &framebuffer_height);
+    if (width <= 0 || height <= 0) return;
+    double xpos, ypos;
+    glfwGetCursorPos(window, &xpos, &ypos);
+    int x, y;
+    if (!tilemap_cell_at(&global_tilemap, xpos*framebuffer_width/width, ypos*framebuffer_height/height, &x, &y)) return;
+    size_t layer = global_tilemap.layers_count - 1;
+    uint16_t tile = tilemap_get_tile(&global_tilemap, layer, x, y);
+    tilemap_set_tile(&global_tilemap, layer, x, y, (uint16_t) ((tile + 1)%(global_tilemap.tiles_count + 1)));
+}
+
+// Dragging with the left mouse button pans the plot unless the drag is used for something else
+void update_plot(GLFWwindow *window, bool pan)
+{
+    static bool dragging = false;
+    static double drag_x = 0.0;
+
+    int width, height;
+    glfwGetWindowSize(window, &width, &height);
+    double xpos, ypos;
+    glfwGetCursorPos(window, &xpos, &ypos);
+    bool pressed = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+    if (pan && pressed && dragging && width > 0) plot_pan(&global_plot, (drag_x - xpos)/width);
+    dragging = pressed;
+    drag_x = xpos;
+
+    plot_render(&global_plot, width, height);
+}
+
+// `scale_x` and `scale_y` map the window to the size the scene is rendered at
+void sync_scene_uniforms(GLFWwindow *window, const GLint *uniforms, GLfloat scale_x, GLfloat scale_y)
+{
+    static_assert(COUNT_UNIFORMS == 7, "Update the uniform sync");
+    int width, height;
+    glfwGetWindowSize(window, &width, &height);
+    glUniform2f(uniforms[RESOLUTION_UNIFORM], (GLfloat) width*scale_x, (GLfloat) height*scale_y);
+    glUniform1f(uniforms[TIME_UNIFORM], (GLfloat) global_time);
+    double xpos = width*0.5;
+    double ypos = height*0.5;
+    // Offline renders keep the mouse in the middle, whatever the real one does
+    if (!global_farm.enabled) glfwGetCursorPos(window, &xpos, &ypos);
+    glUniform2f(uniforms[MOUSE_UNIFORM], (GLfloat) xpos*scale_x, (GLfloat) (height - ypos)*scale_y);
+    glUniform1i(uniforms[SPECTRUM_UNIFORM], 1);
+    glUniform1i(uniforms[VIDEO_UNIFORM], 2);
+    glUniform4f(uniforms[BANDS_UNIFORM],
+                global_audio.bands[0], global_audio.bands[1], global_audio.bands[2], global_audio.bands[3]);
+    glUniform1f(uniforms[NYQUIST_UNIFORM], audio_nyquist(&global_audio));
+}
+
 void window_size_callback(GLFWwindow* window, int width, int height)
 {
     (void) window;
@@ -450,6 +929,7 @@ void renderer_init(Renderer *r)
     glGenBuffers(1, &r->vbo);
     glBindBuffer(GL_ARRAY_BUFFER, r->vbo);
     glBufferData(GL_ARRAY_BUFFER, sizeof(r->vertex_buf), r->vertex_buf, GL_DYNAMIC_DRAW);
+    mem_track(MEM_TAG_GL_BUFFERS, sizeof(r->vertex_buf));
 
     glEnableVertexAttribArray(VA_POS);
     glVertexAttribPointer(VA_POS,
@@ -476,25 +956,196 @@ void renderer_init(Renderer *r)
                           (void*) offsetof(Vertex, color));
 }
 
-int main(void)
+char *shift_args(int *argc, char ***argv)
+{
+    assert(*argc > 0);
+    char *result = **argv;
+    *argc -= 1;
+    *argv += 1;
+    return result;
+}
+
+void usage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [OPTIONS]\n", program);
+    fprintf(stderr, "OPTIONS:\n");
+    fprintf(stderr, "    -pack <file.pack>    Load render.conf and its assets from an asset pack made by ./pack\n");
+    fprintf(stderr, "    -mem-stats <file.json> Save per-subsystem memory stats to a JSON file on exit\n");
+    fprintf(stderr, "    -frame-stats <file.jsonl> Compute luminance stats of every frame on the GPU and save them\n");
+    fprintf(stderr, "    -retune              Benchmark the `tune` defines even when a winner is cached\n");
+    fprintf(stderr, "    -frames <first>:<last> Render the frames at a fixed time step into PNGs and exit\n");
+    fprintf(stderr, "    -fps <n>             Frames per second of -frames (default: 60)\n");
+    fprintf(stderr, "    -out <dir>           Directory for the frames of -frames (default: frames)\n");
+    fprintf(stderr, "    -farm <workers>      Split the frames of -frames across this many processes\n");
+    fprintf(stderr, "    -serve <spool_dir>   Run headless and render the jobs dropped into spool_dir, see server.c\n");
+    fprintf(stderr, "    -help                Print this help\n");
+}
+
+static const char *mem_stats_path = NULL;
+static const char *serve_dir = NULL;
+
+static void save_mem_stats(void)
 {
-    reload_render_conf("render.conf");
+    if (!mem_save_stats_json(mem_stats_path)) {
+        fprintf(stderr, "ERROR: could not save memory stats to %s: %s\n", mem_stats_path, strerror(errno));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int all_argc = argc;
+    char **all_argv = argv;
+    const char *program = shift_args(&argc, &argv);
+    while (argc > 0) {
+        const char *flag = shift_args(&argc, &argv);
+        if (strcmp(flag, "-pack") == 0) {
+            if (argc <= 0) {
+                usage(program);
+                fprintf(stderr, "ERROR: no value provided for %s\n", flag);
+                exit(1);
+            }
+            const char *pack_path = shift_args(&argc, &argv);
+            if (!pack_open(pack_path, &asset_pack)) {
+                fprintf(stderr, "ERROR: could not open asset pack %s: %s\n", pack_path, strerror(errno));
+                exit(1);
+            }
+            printf("Asset Pack: %s (%u assets)\n", pack_path, asset_pack.header->entry_count);
+        } else if (strcmp(flag, "-mem-stats") == 0) {
+            if (argc <= 0) {
+                usage(program);
+                fprintf(stderr, "ERROR: no value provided for %s\n", flag);
+                exit(1);
+            }
+            mem_stats_path = shift_args(&argc, &argv);
+        } else if (strcmp(flag, "-frame-stats") == 0) {
+            if (argc <= 0) {
+                usage(program);
+                fprintf(stderr, "ERROR: no value provided for %s\n", flag);
+                exit(1);
+            }
+            frame_stats_path = shift_args(&argc, &argv);
+        } else if (strcmp(flag, "-retune") == 0) {
+            global_autotune.retune = true;
+        } else if (strcmp(flag, "-frames") == 0) {
+            if (argc <= 0) {
+                usage(program);
+                fprintf(stderr, "ERROR: no value provided for %s\n", flag);
+                exit(1);
+            }
+            const char *range = shift_args(&argc, &argv);
+            if (!farm_parse_range(&global_farm, range)) {
+                usage(program);
+                fprintf(stderr, "ERROR: invalid frame range `%s`, expected <first>:<last>\n", range);
+                exit(1);
+            }
+        } else if (strcmp(flag, "-fps") == 0) {
+            if (argc <= 0) {
+                usage(program);
+                fprintf(stderr, "ERROR: no value provided for %s\n", flag);
+                exit(1);
+            }
+            global_farm.fps = strtod(shift_args(&argc, &argv), NULL);
+            if (!(global_farm.fps > 0.0)) {
+                fprintf(stderr, "ERROR: %s must be positive\n", flag);
+                exit(1);
+            }
+        } else if (strcmp(flag, "-out") == 0) {
+            if (argc <= 0) {
+                usage(program);
+                fprintf(stderr, "ERROR: no value provided for %s\n", flag);
+                exit(1);
+            }
+            global_farm.out_dir = shift_args(&argc, &argv);
+        } else if (strcmp(flag, "-farm") == 0) {
+            if (argc <= 0) {
+                usage(program);
+                fprintf(stderr, "ERROR: no value provided for %s\n", flag);
+                exit(1);
+            }
+            global_farm.workers = (size_t) strtoull(shift_args(&argc, &argv), NULL, 10);
+            if (global_farm.workers == 0) {
+                fprintf(stderr, "ERROR: %s needs at least one worker\n", flag);
+                exit(1);
+            }
+        } else if (strcmp(flag, "-farm-worker") == 0) {
+            // Added by the coordinator of -farm, not meant to be used by hand
+            if (argc <= 0) {
+                usage(program);
+                fprintf(stderr, "ERROR: no value provided for %s\n", flag);
+                exit(1);
+            }
+            global_farm.worker = strtol(shift_args(&argc, &argv), NULL, 10);
+        } else if (strcmp(flag, "-serve") == 0) {
+            if (argc <= 0) {
+                usage(program);
+                fprintf(stderr, "ERROR: no value provided for %s\n", flag);
+                exit(1);
+            }
+            serve_dir = shift_args(&argc, &argv);
+        } else if (strcmp(flag, "-help") == 0) {
+            usage(program);
+            exit(0);
+        } else {
+            usage(program);
+            fprintf(stderr, "ERROR: unknown flag %s\n", flag);
+            exit(1);
+        }
+    }
+
+    if (global_farm.workers > 0 && !global_farm.enabled) {
+        fprintf(stderr, "ERROR: -farm needs the frames to render with -frames\n");
+        exit(1);
+    }
+    if (global_farm.workers > 0 && global_farm.worker < 0) {
+        return farm_coordinate(&global_farm, all_argc, all_argv);
+    }
+    if (global_farm.worker >= 0 && (global_farm.workers == 0 || (size_t) global_farm.worker >= global_farm.workers)) {
+        fprintf(stderr, "ERROR: -farm-worker needs -farm and an index below the number of workers\n");
+        exit(1);
+    }
+
+    // Written on any exit, including quitting with `q`
+    if (mem_stats_path != NULL) atexit(save_mem_stats);
+    mem_track(MEM_TAG_RENDERER, sizeof(global_renderer));
+    mem_track(MEM_TAG_AUDIO, sizeof(global_audio));
+    mem_track(MEM_TAG_VIDEO, sizeof(global_video));
+    mem_track(MEM_TAG_PLOT, sizeof(global_plot));
+    mem_track(MEM_TAG_TILEMAP, sizeof(global_tilemap));
+    mem_track(MEM_TAG_SPRITES, sizeof(global_sprites));
+    mem_track(MEM_TAG_PATHS, sizeof(global_paths));
+    mem_track(MEM_TAG_RENDERER, sizeof(global_targets));
+    mem_track(MEM_TAG_RENDERER, sizeof(global_post));
+    mem_track(MEM_TAG_RENDERER, sizeof(global_frame_stats));
+    mem_track(MEM_TAG_RENDERER, sizeof(global_compare));
+    mem_track(MEM_TAG_RENDERER, sizeof(global_autotune));
+    mem_track(MEM_TAG_RENDERER, sizeof(global_overdraw));
+    mem_track(MEM_TAG_RENDERER, sizeof(global_timeline));
+
+    // The server takes everything it renders from its jobs
+    if (serve_dir == NULL) reload_render_conf("render.conf");
 
     if (!glfwInit()) {
         fprintf(stderr, "ERROR: could not initialize GLFW\n");
         exit(1);
     }
 
+    // GL 4.3 unlocks the indirect sprite submission, everything else only needs 3.3
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-
-    GLFWwindow * const window = glfwCreateWindow(
-                                    DEFAULT_SCREEN_WIDTH,
-                                    DEFAULT_SCREEN_HEIGHT,
-                                    "OpenGL Template",
-                                    NULL,
-                                    NULL);
+    if (serve_dir != NULL || global_farm.enabled) glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+    GLFWwindow *window = glfwCreateWindow(
+                             DEFAULT_SCREEN_WIDTH,
+                             DEFAULT_SCREEN_HEIGHT,
+                             "OpenGL Template",
+                             NULL,
+                             NULL);
+    if (window == NULL) {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        window = glfwCreateWindow(DEFAULT_SCREEN_WIDTH, DEFAULT_SCREEN_HEIGHT, "OpenGL Template", NULL, NULL);
+    }
     if (window == NULL) {
         fprintf(stderr, "ERROR: could not create a window.\n");
         glfwTerminate();
@@ -529,37 +1180,178 @@ int main(void)
         0
     });
     renderer_sync(&global_renderer);
-    renderer_reload_textures(&global_renderer);
-    renderer_reload_shaders(&global_renderer);
+
+    job_pool_init(&global_jobs, 0);
+    if (serve_dir != NULL) {
+        bool ok = server_run(serve_dir, &global_jobs, &global_renderer.resources, &global_targets,
+                             (GLsizei) global_renderer.vertex_buf_sz);
+        glfwTerminate();
+        return ok ? 0 : 1;
+    }
+    scenes_init();
+    video_init(&global_video);
+    global_renderer.resources.vram_budget = vram_budget_mb * 1024 * 1024;
+    scenes_load(&global_renderer.scenes, &global_jobs, scene_confs, scene_confs_count);
+    audio_load(&global_audio, audio_path);
+    video_load(&global_video, &global_jobs, video_path);
+    plot_load(&global_plot, &global_jobs, plot_path, plot_style);
+    tilemap_load(&global_tilemap, tilemap_path, tileset_path, tile_size, tile_scale);
+    sprites_load(&global_sprites, &sprites_conf);
+    paths_load(&global_paths, &global_jobs, paths_path, path_tolerance);
+    post_load(&global_post, &post_conf);
+    compare_load(&global_compare, &global_renderer.resources, compare_path);
+    global_autotune.tolerance = tune_tolerance;
+    global_autotune.timeline = &global_timeline;
+    timeline_load(&global_timeline, timeline_path);
+
+    if (frame_stats_path != NULL) {
+        frame_stats_file = fopen(frame_stats_path, "w");
+        if (frame_stats_file == NULL) {
+            fprintf(stderr, "ERROR: could not open %s: %s\n", frame_stats_path, strerror(errno));
+            exit(1);
+        }
+        if (!frame_stats_init(&global_frame_stats)) {
+            fprintf(stderr, "ERROR: could not initialize frame stats\n");
+            exit(1);
+        }
+    }
 
     glfwSetKeyCallback(window, key_callback);
+    glfwSetScrollCallback(window, scroll_callback);
+    glfwSetMouseButtonCallback(window, mouse_button_callback);
     glfwSetFramebufferSizeCallback(window, window_size_callback);
 
-    time = glfwGetTime();
+    if (global_farm.enabled) {
+        if (!farm_begin(&global_farm)) exit(1);
+        // Hidden windows don't need to wait for the display
+        glfwSwapInterval(0);
+        // Every frame has to see the scenes, so nothing may still be loading when the first one renders
+        job_pool_wait(&global_jobs);
+        while (scenes_upload_prepared(&global_renderer.scenes, &global_renderer.resources)) {}
+        // Benchmarks would make every worker pick its own variant
+        global_autotune.cache_only = true;
+    }
+
+    global_time = glfwGetTime();
     double prev_time = 0.0;
+    size_t offline_frame = 0;
     while (!glfwWindowShouldClose(window)) {
+        if (global_farm.enabled) {
+            if (!farm_next_frame(&global_farm, &offline_frame)) break;
+            global_time = farm_frame_time(&global_farm, offline_frame);
+        }
+        resources_begin_frame(&global_renderer.resources);
+        scenes_upload_prepared(&global_renderer.scenes, &global_renderer.resources);
+        audio_update(&global_audio, global_time);
+        timeline_update(&global_timeline, global_time);
+        video_update(&global_video, &global_jobs, global_time);
+        int framebuffer_width, framebuffer_height;
+        glfwGetFramebufferSize(window, &framebuffer_width, &framebuffer_height);
+        render_size_update(&global_render_size, framebuffer_width, framebuffer_height, glfwGetTime());
+        autotune_scene(&global_autotune, scenes_current(&global_renderer.scenes), &global_renderer.resources,
+                       &global_targets, global_render_size.width, global_render_size.height,
+                       (GLsizei) global_renderer.vertex_buf_sz);
+        int render_width = global_render_size.width;
+        int render_height = global_render_size.height;
+        // The overdraw view replaces post-processing and frame stats
+        bool overdraw = overdraw_begin(&global_overdraw, render_width, render_height);
+        bool offscreen = overdraw || ((post_enabled(&global_post) || global_frame_stats.enabled) &&
+                                      post_begin(&global_post, &global_targets, render_width, render_height));
+
+        Scene *scene = scenes_current(&global_renderer.scenes);
+        if (scene != NULL && scene_get_state(scene) == SCENE_FAILED) {
+            glClearColor(1.0f, 0.0f, 0.0f, 1.0f);
+        } else {
+            glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        }
         glClear(GL_COLOR_BUFFER_BIT);
 
-        if (!global_renderer.program_failed) {
-            static_assert(COUNT_UNIFORMS == 3, "Update the uniform sync");
-            int width, height;
-            glfwGetWindowSize(window, &width, &height);
-            glUniform2f(global_renderer.uniforms[RESOLUTION_UNIFORM], (GLfloat) width, (GLfloat) height);
-            glUniform1f(global_renderer.uniforms[TIME_UNIFORM], (GLfloat) time);
-            double xpos, ypos;
-            glfwGetCursorPos(window, &xpos, &ypos);
-            glUniform2f(global_renderer.uniforms[MOUSE_UNIFORM], (GLfloat) xpos, (GLfloat) (height - ypos));
-            glDrawArraysInstanced(GL_TRIANGLES, 0, (GLsizei) global_renderer.vertex_buf_sz, 1);
+        overdraw_begin_pass(&global_overdraw, OVERDRAW_PASS_SCENE);
+        if (scene != NULL && scene_get_state(scene) == SCENE_READY) {
+            GLuint program = resources_use_program(&global_renderer.resources, scene->program);
+            glBindTexture(GL_TEXTURE_2D, resources_use_texture(&global_renderer.resources, scene->texture));
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_1D, audio_texture(&global_audio));
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_2D, video_texture(&global_video));
+            glActiveTexture(GL_TEXTURE0);
+
+            // The scene may be rendered at the old size while the window is being resized
+            GLfloat scale_x = 1.0f;
+            GLfloat scale_y = 1.0f;
+            if (offscreen && framebuffer_width > 0 && framebuffer_height > 0) {
+                scale_x = (GLfloat) render_width/(GLfloat) framebuffer_width;
+                scale_y = (GLfloat) render_height/(GLfloat) framebuffer_height;
+            }
+            if (compare_begin(&global_compare, &global_renderer.resources, scene, &global_targets)) {
+                for (Compare_Side side = 0; side < COUNT_COMPARE_SIDES; ++side) {
+                    const GLint *uniforms = NULL;
+                    GLuint side_program = compare_begin_side(&global_compare, &global_renderer.resources, side,
+                                                             program, scene->uniforms, &uniforms);
+                    glUseProgram(side_program);
+                    sync_scene_uniforms(window, uniforms, scale_x, scale_y);
+                    Timeline_Locations *locations = side == COMPARE_A ? &scene->timeline_locations
+                                                                      : &global_compare.timeline_locations;
+                    timeline_upload(&global_timeline, locations, side_program);
+                    glDrawArraysInstanced(GL_TRIANGLES, 0, (GLsizei) global_renderer.vertex_buf_sz, 1);
+                    compare_end_side(&global_compare, side);
+                }
+                compare_end(&global_compare);
+            } else {
+                glUseProgram(program);
+                sync_scene_uniforms(window, scene->uniforms, scale_x, scale_y);
+                timeline_upload(&global_timeline, &scene->timeline_locations, program);
+                glDrawArraysInstanced(GL_TRIANGLES, 0, (GLsizei) global_renderer.vertex_buf_sz, 1);
+            }
         }
+        overdraw_end_pass(&global_overdraw, OVERDRAW_PASS_SCENE);
+        overdraw_begin_pass(&global_overdraw, OVERDRAW_PASS_TILEMAP);
+        tilemap_render(&global_tilemap, offscreen ? render_width : framebuffer_width,
+                       offscreen ? render_height : framebuffer_height);
+        overdraw_end_pass(&global_overdraw, OVERDRAW_PASS_TILEMAP);
+        overdraw_begin_pass(&global_overdraw, OVERDRAW_PASS_SPRITES);
+        sprites_render(&global_sprites, offscreen ? render_width : framebuffer_width,
+                       offscreen ? render_height : framebuffer_height, global_time);
+        overdraw_end_pass(&global_overdraw, OVERDRAW_PASS_SPRITES);
+        overdraw_begin_pass(&global_overdraw, OVERDRAW_PASS_PATHS);
+        paths_render(&global_paths, offscreen ? render_width : framebuffer_width,
+                     offscreen ? render_height : framebuffer_height);
+        overdraw_end_pass(&global_overdraw, OVERDRAW_PASS_PATHS);
+
+        Frame_Stats_Result frame_stats;
+        while (frame_stats_poll(&global_frame_stats, &frame_stats, false)) handle_frame_stats(&frame_stats);
+        if (overdraw) {
+            overdraw_end(&global_overdraw, framebuffer_width, framebuffer_height);
+        } else if (offscreen) {
+            frame_stats_compute(&global_frame_stats, post_scene_texture(&global_post),
+                                render_width, render_height, global_frame, global_time);
+            post_end(&global_post, &global_targets, framebuffer_width, framebuffer_height);
+        }
+        render_targets_end_frame(&global_targets);
+        global_frame += 1;
+
+        bool dragging_divider = compare_update(&global_compare, window, glfwGetTime());
+        update_plot(window, !dragging_divider);
 
+        if (global_farm.enabled) {
+            farm_capture(&global_farm, &global_jobs, offline_frame, framebuffer_width, framebuffer_height);
+        }
         glfwSwapBuffers(window);
         glfwPollEvents();
         double cur_time = glfwGetTime();
-        if (!pause) {
-            time += cur_time - prev_time;
+        if (!paused) {
+            global_time += cur_time - prev_time;
         }
         prev_time = cur_time;
     }
 
+    Frame_Stats_Result frame_stats;
+    while (frame_stats_poll(&global_frame_stats, &frame_stats, true)) handle_frame_stats(&frame_stats);
+    if (frame_stats_file != NULL) fclose(frame_stats_file);
+    if (global_farm.enabled) {
+        job_pool_wait(&global_jobs);
+        farm_end(&global_farm);
+    }
+
     return 0;
 }
@@ -0,0 +1,133 @@
+#ifndef MAPPED_FILE_H_
+#define MAPPED_FILE_H_
+
+// Read-only memory mapping of whole files.
+//
+// Uses mmap(2) on POSIX and CreateFileMapping on Windows. Empty files map
+// successfully with `data == NULL` and `size == 0`.
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifndef MFDEF
+#define MFDEF
+#endif // MFDEF
+
+typedef struct {
+    void *data;
+    size_t size;
+    // Platform handles, opaque to the users
+    void *file_handle;
+    void *mapping_handle;
+} Mapped_File;
+
+MFDEF bool map_file(const char *file_path, Mapped_File *mf);
+MFDEF void unmap_file(Mapped_File *mf);
+
+#endif // MAPPED_FILE_H_
+
+#if defined(MAPPED_FILE_IMPLEMENTATION) && !defined(MAPPED_FILE_IMPLEMENTATION_)
+#define MAPPED_FILE_IMPLEMENTATION_
+
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+MFDEF bool map_file(const char *file_path, Mapped_File *mf)
+{
+    memset(mf, 0, sizeof(*mf));
+
+    HANDLE file = CreateFileA(file_path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        return false;
+    }
+
+    if (size.QuadPart == 0) {
+        CloseHandle(file);
+        return true;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL) {
+        CloseHandle(file);
+        return false;
+    }
+
+    void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (data == NULL) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    mf->data = data;
+    mf->size = (size_t) size.QuadPart;
+    mf->file_handle = file;
+    mf->mapping_handle = mapping;
+    return true;
+}
+
+MFDEF void unmap_file(Mapped_File *mf)
+{
+    if (mf->data) UnmapViewOfFile(mf->data);
+    if (mf->mapping_handle) CloseHandle(mf->mapping_handle);
+    if (mf->file_handle) CloseHandle(mf->file_handle);
+    memset(mf, 0, sizeof(*mf));
+}
+
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MFDEF bool map_file(const char *file_path, Mapped_File *mf)
+{
+    memset(mf, 0, sizeof(*mf));
+
+    int fd = open(file_path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat statbuf;
+    if (fstat(fd, &statbuf) < 0) {
+        int saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+        return false;
+    }
+
+    if (statbuf.st_size == 0) {
+        close(fd);
+        return true;
+    }
+
+    void *data = mmap(NULL, (size_t) statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    int saved_errno = errno;
+    // The mapping keeps its own reference to the file
+    close(fd);
+    if (data == MAP_FAILED) {
+        errno = saved_errno;
+        return false;
+    }
+
+    mf->data = data;
+    mf->size = (size_t) statbuf.st_size;
+    return true;
+}
+
+MFDEF void unmap_file(Mapped_File *mf)
+{
+    if (mf->data) munmap(mf->data, mf->size);
+    memset(mf, 0, sizeof(*mf));
+}
+#endif // _WIN32
+
+#endif // MAPPED_FILE_IMPLEMENTATION
@@ -0,0 +1,207 @@
+// Memory accounting. Every heap allocation of the application goes through
+// mem_alloc()/mem_realloc()/mem_free() with a tag of the subsystem it belongs
+// to, including the ones made by stb_image and stb_image_write. Memory that
+// is not allocated here, like static buffers and GL objects, is reported with
+// mem_track() so it shows up in the same table.
+//
+// Allocations are prefixed with a small header that remembers the size and
+// the tag, so mem_free() doesn't need either. Counters are guarded by a mutex
+// because images are decoded on the job pool.
+
+typedef enum {
+    MEM_TAG_CONFIG = 0,
+    MEM_TAG_SHADERS,
+    MEM_TAG_IMAGES,
+    MEM_TAG_CAPTURE,
+    MEM_TAG_RESOURCES,
+    MEM_TAG_RENDERER,
+    MEM_TAG_AUDIO,
+    MEM_TAG_VIDEO,
+    MEM_TAG_PLOT,
+    MEM_TAG_TILEMAP,
+    MEM_TAG_SPRITES,
+    MEM_TAG_PATHS,
+    // Estimates of video memory, reported with mem_track()
+    MEM_TAG_GL_TEXTURES,
+    MEM_TAG_GL_BUFFERS,
+    COUNT_MEM_TAGS,
+} Mem_Tag;
+
+static const char *mem_tag_names[COUNT_MEM_TAGS] = {
+    [MEM_TAG_CONFIG]      = "config",
+    [MEM_TAG_SHADERS]     = "shaders",
+    [MEM_TAG_IMAGES]      = "images",
+    [MEM_TAG_CAPTURE]     = "capture",
+    [MEM_TAG_RESOURCES]   = "resources",
+    [MEM_TAG_RENDERER]    = "renderer",
+    [MEM_TAG_AUDIO]       = "audio",
+    [MEM_TAG_VIDEO]       = "video",
+    [MEM_TAG_PLOT]        = "plot",
+    [MEM_TAG_TILEMAP]     = "tilemap",
+    [MEM_TAG_SPRITES]     = "sprites",
+    [MEM_TAG_PATHS]       = "paths",
+    [MEM_TAG_GL_TEXTURES] = "gl_textures",
+    [MEM_TAG_GL_BUFFERS]  = "gl_buffers",
+};
+
+typedef struct {
+    size_t current;
+    size_t peak;
+    // Allocations that are still alive
+    size_t live;
+    // Allocations ever made
+    size_t allocs;
+} Mem_Counter;
+
+// Keeps the user pointer aligned the same way malloc() aligns
+typedef struct {
+    size_t size;
+    size_t tag;
+} Mem_Header;
+
+static Jobs_Mutex mem_mutex = JOBS_MUTEX_INIT;
+static Mem_Counter mem_counters[COUNT_MEM_TAGS] = {0};
+
+// Expects `mem_mutex` to be locked
+static void mem_account(Mem_Tag tag, size_t added, size_t removed, bool allocated, bool freed)
+{
+    Mem_Counter *c = &mem_counters[tag];
+    c->current = c->current + added - removed;
+    if (c->current > c->peak) c->peak = c->current;
+    if (allocated) {
+        c->live += 1;
+        c->allocs += 1;
+    }
+    if (freed) c->live -= 1;
+}
+
+void *mem_alloc(Mem_Tag tag, size_t size)
+{
+    assert(tag < COUNT_MEM_TAGS);
+    Mem_Header *header = malloc(sizeof(Mem_Header) + size);
+    if (header == NULL) return NULL;
+    header->size = size;
+    header->tag = tag;
+
+    jobs_mutex_lock(&mem_mutex);
+    mem_account(tag, size, 0, true, false);
+    jobs_mutex_unlock(&mem_mutex);
+
+    return header + 1;
+}
+
+void mem_free(void *ptr)
+{
+    if (ptr == NULL) return;
+    Mem_Header *header = (Mem_Header*) ptr - 1;
+
+    jobs_mutex_lock(&mem_mutex);
+    mem_account(header->tag, 0, header->size, false, true);
+    jobs_mutex_unlock(&mem_mutex);
+
+    free(header);
+}
+
+// The block keeps the tag it was allocated with if `ptr` is not NULL
+void *mem_realloc(Mem_Tag tag, void *ptr, size_t size)
+{
+    if (ptr == NULL) return mem_alloc(tag, size);
+    if (size == 0) {
+        mem_free(ptr);
+        return NULL;
+    }
+
+    Mem_Header *header = (Mem_Header*) ptr - 1;
+    size_t old_size = header->size;
+    Mem_Header *new_header = realloc(header, sizeof(Mem_Header) + size);
+    if (new_header == NULL) return NULL;
+    new_header->size = size;
+
+    jobs_mutex_lock(&mem_mutex);
+    mem_account(new_header->tag, size, old_size, false, false);
+    jobs_mutex_unlock(&mem_mutex);
+
+    return new_header + 1;
+}
+
+char *mem_strdup(Mem_Tag tag, const char *cstr)
+{
+    size_t size = strlen(cstr) + 1;
+    char *result = mem_alloc(tag, size);
+    if (result == NULL) return NULL;
+    memcpy(result, cstr, size);
+    return result;
+}
+
+// Reports memory that is not allocated through mem_alloc(): static buffers
+// and GL objects. Positive `delta` is an allocation, negative is a release
+// and zero is neither.
+void mem_track(Mem_Tag tag, ptrdiff_t delta)
+{
+    assert(tag < COUNT_MEM_TAGS);
+    if (delta == 0) return;
+    jobs_mutex_lock(&mem_mutex);
+    if (delta > 0) {
+        mem_account(tag, (size_t) delta, 0, true, false);
+    } else {
+        mem_account(tag, 0, (size_t) -delta, false, true);
+    }
+    jobs_mutex_unlock(&mem_mutex);
+}
+
+static void mem_snapshot(Mem_Counter counters[COUNT_MEM_TAGS])
+{
+    jobs_mutex_lock(&mem_mutex);
+    memcpy(counters, mem_counters, sizeof(mem_counters));
+    jobs_mutex_unlock(&mem_mutex);
+}
+
+void mem_print_stats(void)
+{
+    Mem_Counter counters[COUNT_MEM_TAGS];
+    mem_snapshot(counters);
+
+    printf("Memory:\n");
+    printf("  %-12s %12s %12s %8s %8s\n", "tag", "current KB", "peak KB", "live", "allocs");
+    size_t current = 0;
+    size_t peak = 0;
+    for (Mem_Tag tag = 0; tag < COUNT_MEM_TAGS; ++tag) {
+        Mem_Counter *c = &counters[tag];
+        printf("  %-12s %12zu %12zu %8zu %8zu\n", mem_tag_names[tag],
+               c->current / 1024, c->peak / 1024, c->live, c->allocs);
+        current += c->current;
+        peak += c->peak;
+    }
+    // The sum of the peaks is an upper bound, the tags don't peak at the same time
+    printf("  %-12s %12zu %12zu\n", "total", current / 1024, peak / 1024);
+}
+
+bool mem_save_stats_json(const char *file_path)
+{
+    Mem_Counter counters[COUNT_MEM_TAGS];
+    mem_snapshot(counters);
+
+    FILE *f = fopen(file_path, "w");
+    if (f == NULL) return false;
+
+    fprintf(f, "{\n  \"memory\": {\n");
+    for (Mem_Tag tag = 0; tag < COUNT_MEM_TAGS; ++tag) {
+        Mem_Counter *c = &counters[tag];
+        fprintf(f, "    \"%s\": {\"current\": %zu, \"peak\": %zu, \"live\": %zu, \"allocs\": %zu}%s\n",
+                mem_tag_names[tag], c->current, c->peak, c->live, c->allocs,
+                tag + 1 < COUNT_MEM_TAGS ? "," : "");
+    }
+    fprintf(f, "  }\n}\n");
+
+    bool ok = !ferror(f);
+    if (fclose(f) != 0) ok = false;
+    return ok;
+}
+
+#define STBI_MALLOC(size)            mem_alloc(MEM_TAG_IMAGES, (size))
+#define STBI_REALLOC(ptr, new_size)  mem_realloc(MEM_TAG_IMAGES, (ptr), (new_size))
+#define STBI_FREE(ptr)               mem_free(ptr)
+
+#define STBIW_MALLOC(size)           mem_alloc(MEM_TAG_CAPTURE, (size))
+#define STBIW_REALLOC(ptr, new_size) mem_realloc(MEM_TAG_CAPTURE, (ptr), (new_size))
+#define STBIW_FREE(ptr)              mem_free(ptr)
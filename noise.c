@@ -0,0 +1,545 @@
+// Procedural noise textures. render.conf can use them in place of an image:
+//
+//   texture = noise:<kind>:<size>[:<cells>[:<seed>]]
+//
+// where <kind> is perlin, simplex, worley or blue. <cells> is the lattice
+// period of the first octave (8 by default) and <seed> picks a different
+// pattern (0 by default). All kinds tile seamlessly, so shaders can sample
+// them with GL_REPEAT at any scale.
+//
+// Generation is split into rows on the job pool. Blue noise uses the
+// void-and-cluster method, which is quadratic in the number of pixels, so it
+// is limited to NOISE_BLUE_MAX_SIZE. Generated textures are cached in
+// NOISE_CACHE_DIR and mapped straight from there on the next start.
+
+#define NOISE_PREFIX "noise:"
+#define NOISE_VERSION 1
+#define NOISE_MAX_SIZE 8192
+#define NOISE_BLUE_MAX_SIZE 256
+#define NOISE_MAX_OCTAVES 5
+#define NOISE_CACHE_DIR "noise_cache"
+
+typedef enum {
+    NOISE_PERLIN = 0,
+    NOISE_SIMPLEX,
+    NOISE_WORLEY,
+    NOISE_BLUE,
+    COUNT_NOISE_KINDS,
+} Noise_Kind;
+
+static const char *noise_kind_names[COUNT_NOISE_KINDS] = {
+    [NOISE_PERLIN]  = "perlin",
+    [NOISE_SIMPLEX] = "simplex",
+    [NOISE_WORLEY]  = "worley",
+    [NOISE_BLUE]    = "blue",
+};
+
+typedef struct {
+    Noise_Kind kind;
+    int size;
+    int cells;
+    uint64_t seed;
+} Noise_Spec;
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    Hash128 spec_hash;
+} Noise_Cache_Header;
+
+static_assert(sizeof(Noise_Cache_Header) == 32, "The noise cache header is stored as is");
+
+bool noise_is_spec(const char *path)
+{
+    return strncmp(path, NOISE_PREFIX, strlen(NOISE_PREFIX)) == 0;
+}
+
+static bool noise_parse_int(String_View sv, uint64_t *result)
+{
+    if (sv.count == 0) return false;
+    for (size_t i = 0; i < sv.count; ++i) {
+        if (!isdigit((unsigned char) sv.data[i])) return false;
+    }
+    *result = sv_to_u64(sv);
+    return true;
+}
+
+bool noise_parse_spec(const char *path, Noise_Spec *spec)
+{
+    String_View sv = sv_from_cstr(path);
+    sv_chop_by_delim(&sv, ':');
+    String_View kind = sv_chop_by_delim(&sv, ':');
+    String_View size = sv_chop_by_delim(&sv, ':');
+    String_View cells = sv_chop_by_delim(&sv, ':');
+    String_View seed = sv;
+
+    memset(spec, 0, sizeof(*spec));
+    spec->kind = COUNT_NOISE_KINDS;
+    for (Noise_Kind k = 0; k < COUNT_NOISE_KINDS; ++k) {
+        if (sv_eq(kind, sv_from_cstr(noise_kind_names[k]))) spec->kind = k;
+    }
+    if (spec->kind == COUNT_NOISE_KINDS) {
+        fprintf(stderr, "ERROR: %s: unknown noise `"SV_Fmt"`, expected perlin, simplex, worley or blue\n",
+                path, SV_Arg(kind));
+        return false;
+    }
+
+    uint64_t value = 0;
+    if (!noise_parse_int(size, &value) || value == 0 || value > NOISE_MAX_SIZE) {
+        fprintf(stderr, "ERROR: %s: size must be a number from 1 to %d\n", path, NOISE_MAX_SIZE);
+        return false;
+    }
+    spec->size = (int) value;
+
+    value = 8;
+    if (cells.count > 0 && (!noise_parse_int(cells, &value) || value == 0)) {
+        fprintf(stderr, "ERROR: %s: cells must be a positive number\n", path);
+        return false;
+    }
+    spec->cells = (int) (value < (uint64_t) spec->size ? value : (uint64_t) spec->size);
+
+    if (seed.count > 0 && !noise_parse_int(seed, &spec->seed)) {
+        fprintf(stderr, "ERROR: %s: seed must be a number\n", path);
+        return false;
+    }
+
+    if (spec->kind == NOISE_SIMPLEX && spec->cells % 2 != 0) {
+        // The simplex lattice is staggered by half a cell every other row
+        fprintf(stderr, "ERROR: %s: simplex noise needs an even number of cells to tile\n", path);
+        return false;
+    }
+    if (spec->kind == NOISE_BLUE && spec->size > NOISE_BLUE_MAX_SIZE) {
+        fprintf(stderr, "ERROR: %s: blue noise is limited to %d pixels, use GL_REPEAT for larger areas\n",
+                path, NOISE_BLUE_MAX_SIZE);
+        return false;
+    }
+
+    return true;
+}
+
+Hash128 noise_spec_hash(const Noise_Spec *spec)
+{
+    char canonical[128];
+    int n = snprintf(canonical, sizeof(canonical), "%s:%d:%d:%llu",
+                     noise_kind_names[spec->kind], spec->size, spec->cells,
+                     (unsigned long long) spec->seed);
+    return hash128(canonical, (size_t) n, NOISE_VERSION);
+}
+
+// Random unit gradients of a `cells`x`cells` periodic lattice
+static V2f *noise_make_gradients(int cells, uint64_t seed, uint64_t stream)
+{
+    size_t count = (size_t) cells * cells;
+    V2f *grads = mem_alloc(MEM_TAG_IMAGES, count * sizeof(*grads));
+    if (grads == NULL) return NULL;
+
+    Rng rng;
+    rng_seed(&rng, seed, stream);
+    rng_uniform_v2f(&rng, grads, count);
+    for (size_t i = 0; i < count; ++i) {
+        float angle = grads[i].x * 6.28318530718f;
+        grads[i] = v2f(cosf(angle), sinf(angle));
+    }
+    return grads;
+}
+
+static inline int noise_wrap(int x, int period)
+{
+    x %= period;
+    return x < 0 ? x + period : x;
+}
+
+static inline float noise_fade(float t)
+{
+    return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f);
+}
+
+static float noise_perlin(const V2f *grads, int cells, float x, float y)
+{
+    int ix = (int) floorf(x);
+    int iy = (int) floorf(y);
+    float fx = x - ix;
+    float fy = y - iy;
+
+    int x0 = noise_wrap(ix, cells), x1 = noise_wrap(ix + 1, cells);
+    int y0 = noise_wrap(iy, cells), y1 = noise_wrap(iy + 1, cells);
+    V2f g00 = grads[y0*cells + x0];
+    V2f g10 = grads[y0*cells + x1];
+    V2f g01 = grads[y1*cells + x0];
+    V2f g11 = grads[y1*cells + x1];
+
+    float n00 = g00.x*fx + g00.y*fy;
+    float n10 = g10.x*(fx - 1.0f) + g10.y*fy;
+    float n01 = g01.x*fx + g01.y*(fy - 1.0f);
+    float n11 = g11.x*(fx - 1.0f) + g11.y*(fy - 1.0f);
+
+    float u = noise_fade(fx);
+    float v = noise_fade(fy);
+    // Gradient noise in 2D stays within [-sqrt(0.5), sqrt(0.5)]
+    return lerpf(lerpf(n00, n10, u), lerpf(n01, n11, u), v) * 1.41421356f;
+}
+
+// Tiling simplex noise after "Tiling simplex noise and flow noise in two and
+// three dimensions" by Gustavson and McEwan. The lattice is wrapped in texture
+// space, so `cells` has to be even.
+static float noise_simplex(const V2f *grads, int cells, float x, float y)
+{
+    // Simplex space, an axis aligned grid of the staggered triangles
+    float u = x + y*0.5f;
+    float v = y;
+    float i0u = floorf(u);
+    float i0v = floorf(v);
+    float o1u = (u - i0u) >= (v - i0v) ? 1.0f : 0.0f;
+    float o1v = 1.0f - o1u;
+
+    // Corners back in texture space
+    float cx[3], cy[3];
+    cx[0] = i0u - i0v*0.5f;
+    cy[0] = i0v;
+    cx[1] = cx[0] + o1u - o1v*0.5f;
+    cy[1] = cy[0] + o1v;
+    cx[2] = cx[0] + 0.5f;
+    cy[2] = cy[0] + 1.0f;
+
+    float n = 0.0f;
+    for (int i = 0; i < 3; ++i) {
+        float dx = x - cx[i];
+        float dy = y - cy[i];
+        float w = 0.8f - dx*dx - dy*dy;
+        if (w <= 0.0f) continue;
+
+        // Every row has `cells` corners, odd rows are shifted by half a cell
+        int row = noise_wrap((int) cy[i], cells);
+        int col = noise_wrap((int) floorf(cx[i]), cells);
+        V2f g = grads[row*cells + col];
+
+        w *= w;
+        n += w*w * (g.x*dx + g.y*dy);
+    }
+    return 10.9f * n;
+}
+
+static float noise_worley(const V2f *points, int cells, float x, float y)
+{
+    int ix = (int) floorf(x);
+    int iy = (int) floorf(y);
+    float best = 2.0f;
+    for (int dy = -1; dy <= 1; ++dy) {
+        for (int dx = -1; dx <= 1; ++dx) {
+            V2f p = points[noise_wrap(iy + dy, cells)*cells + noise_wrap(ix + dx, cells)];
+            float ox = (float) (ix + dx) + p.x - x;
+            float oy = (float) (iy + dy) + p.y - y;
+            float d = ox*ox + oy*oy;
+            if (d < best) best = d;
+        }
+    }
+    return sqrtf(best);
+}
+
+typedef struct {
+    const Noise_Spec *spec;
+    unsigned char *pixels;
+    V2f *tables[NOISE_MAX_OCTAVES];
+    int octaves;
+} Noise_Rows;
+
+static inline void noise_put(unsigned char *pixel, float value)
+{
+    unsigned char c = (unsigned char) (clampf(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+    pixel[0] = c;
+    pixel[1] = c;
+    pixel[2] = c;
+    pixel[3] = 255;
+}
+
+static void noise_rows(void *arg, size_t begin, size_t end)
+{
+    Noise_Rows *nr = arg;
+    const Noise_Spec *spec = nr->spec;
+    float inv_size = 1.0f / (float) spec->size;
+
+    for (size_t y = begin; y < end; ++y) {
+        unsigned char *row = nr->pixels + y*spec->size*4;
+        for (int x = 0; x < spec->size; ++x) {
+            // Pixel centers, in units of the texture
+            float px = ((float) x + 0.5f) * inv_size;
+            float py = ((float) y + 0.5f) * inv_size;
+
+            float value = 0.0f;
+            if (spec->kind == NOISE_WORLEY) {
+                value = noise_worley(nr->tables[0], spec->cells, px*spec->cells, py*spec->cells);
+            } else {
+                float sum = 0.0f;
+                float amplitude = 1.0f;
+                // Octaves are independent, so their sum grows with the root of
+                // the sum of the squared amplitudes rather than with the sum
+                float amplitudes2 = 0.0f;
+                for (int o = 0; o < nr->octaves; ++o) {
+                    int cells = spec->cells << o;
+                    if (spec->kind == NOISE_PERLIN) {
+                        sum += amplitude * noise_perlin(nr->tables[o], cells, px*cells, py*cells);
+                    } else {
+                        sum += amplitude * noise_simplex(nr->tables[o], cells, px*cells, py*cells);
+                    }
+                    amplitudes2 += amplitude*amplitude;
+                    amplitude *= 0.5f;
+                }
+                value = 0.5f + 0.5f*sum/sqrtf(amplitudes2);
+            }
+            noise_put(row + x*4, value);
+        }
+    }
+}
+
+// Index of the smallest element, the first one on ties
+static size_t noise_argmin(const float *xs, size_t n)
+{
+    size_t i = 0;
+    float min = INFINITY;
+#ifdef LA_SSE2
+    __m128 m = _mm_set1_ps(INFINITY);
+    for (; i + 4 <= n; i += 4) m = _mm_min_ps(m, _mm_loadu_ps(xs + i));
+    m = _mm_min_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+    m = _mm_min_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+    min = _mm_cvtss_f32(m);
+#endif // LA_SSE2
+    for (; i < n; ++i) {
+        if (xs[i] < min) min = xs[i];
+    }
+    for (i = 0; i < n; ++i) {
+        if (xs[i] == min) return i;
+    }
+    return 0;
+}
+
+#define NOISE_BLUE_SIGMA 1.5f
+#define NOISE_BLUE_RADIUS 5
+
+typedef struct {
+    int size;
+    int radius;
+    float kernel[(2*NOISE_BLUE_RADIUS + 1)*(2*NOISE_BLUE_RADIUS + 1)];
+    unsigned char *bits;
+    // Energy of the minority pixels around every pixel, wrapped around the edges
+    float *energy;
+    // Copies of the energy where only one kind of pixels is eligible, so the
+    // searches are plain argmin: minus the energy of the set pixels and the
+    // energy of the empty ones. The rest is INFINITY.
+    float *clusters;
+    float *voids;
+} Noise_Blue;
+
+static void noise_blue_set(Noise_Blue *nb, size_t p, bool set)
+{
+    int n = nb->size;
+    int px = (int) (p % n);
+    int py = (int) (p / n);
+    float sign = set ? 1.0f : -1.0f;
+    nb->bits[p] = set;
+
+    size_t k = 0;
+    for (int dy = -nb->radius; dy <= nb->radius; ++dy) {
+        for (int dx = -nb->radius; dx <= nb->radius; ++dx, ++k) {
+            size_t q = (size_t) noise_wrap(py + dy, n)*n + noise_wrap(px + dx, n);
+            nb->energy[q] += sign*nb->kernel[k];
+            nb->clusters[q] = nb->bits[q] ? -nb->energy[q] : INFINITY;
+            nb->voids[q] = nb->bits[q] ? INFINITY : nb->energy[q];
+        }
+    }
+}
+
+// Void-and-cluster by Ulichney. Every pixel gets the rank at which it is added
+// to a pattern that stays as evenly distributed as possible.
+static bool noise_blue(const Noise_Spec *spec, unsigned char *pixels)
+{
+    int n = spec->size;
+    size_t count = (size_t) n*n;
+
+    Noise_Blue nb = {0};
+    nb.size = n;
+    nb.radius = NOISE_BLUE_RADIUS < (n - 1)/2 ? NOISE_BLUE_RADIUS : (n - 1)/2;
+    size_t k = 0;
+    for (int dy = -nb.radius; dy <= nb.radius; ++dy) {
+        for (int dx = -nb.radius; dx <= nb.radius; ++dx) {
+            nb.kernel[k++] = expf(-(float) (dx*dx + dy*dy) / (2.0f*NOISE_BLUE_SIGMA*NOISE_BLUE_SIGMA));
+        }
+    }
+
+    bool ok = false;
+    uint32_t *ranks = mem_alloc(MEM_TAG_IMAGES, count*sizeof(*ranks));
+    unsigned char *proto_bits = mem_alloc(MEM_TAG_IMAGES, count);
+    float *proto = mem_alloc(MEM_TAG_IMAGES, 3*count*sizeof(float));
+    nb.bits = mem_alloc(MEM_TAG_IMAGES, count);
+    nb.energy = mem_alloc(MEM_TAG_IMAGES, 3*count*sizeof(float));
+    if (ranks == NULL || proto_bits == NULL || proto == NULL || nb.bits == NULL || nb.energy == NULL) goto defer;
+    nb.clusters = nb.energy + count;
+    nb.voids = nb.energy + 2*count;
+
+    memset(nb.bits, 0, count);
+    for (size_t i = 0; i < count; ++i) {
+        nb.energy[i] = 0.0f;
+        nb.clusters[i] = INFINITY;
+        nb.voids[i] = 0.0f;
+    }
+
+    // Initial random pattern of about 10% of the pixels
+    Rng rng;
+    rng_seed(&rng, spec->seed, COUNT_NOISE_KINDS);
+    size_t ones = count/10 > 0 ? count/10 : 1;
+    for (size_t placed = 0; placed < ones;) {
+        uint32_t r[4];
+        rng_u32x4(&rng, r);
+        for (int i = 0; i < 4 && placed < ones; ++i) {
+            size_t p = r[i] % count;
+            if (nb.bits[p]) continue;
+            noise_blue_set(&nb, p, true);
+            placed += 1;
+        }
+    }
+
+    // Move the tightest cluster into the largest void until it stays in place
+    for (size_t i = 0; i < count; ++i) {
+        size_t cluster = noise_argmin(nb.clusters, count);
+        noise_blue_set(&nb, cluster, false);
+        size_t hole = noise_argmin(nb.voids, count);
+        noise_blue_set(&nb, hole, true);
+        if (hole == cluster) break;
+    }
+
+    memcpy(proto_bits, nb.bits, count);
+    memcpy(proto, nb.energy, 3*count*sizeof(float));
+
+    // Ranks below the initial pattern: remove the tightest clusters
+    for (size_t rank = ones; rank > 0; --rank) {
+        size_t cluster = noise_argmin(nb.clusters, count);
+        noise_blue_set(&nb, cluster, false);
+        ranks[cluster] = (uint32_t) (rank - 1);
+    }
+
+    // Ranks above it: fill the largest voids. Past the half the void of the
+    // set pixels is the same as the cluster of the empty ones, so one loop is enough.
+    memcpy(nb.bits, proto_bits, count);
+    memcpy(nb.energy, proto, 3*count*sizeof(float));
+    for (size_t rank = ones; rank < count; ++rank) {
+        size_t hole = noise_argmin(nb.voids, count);
+        noise_blue_set(&nb, hole, true);
+        ranks[hole] = (uint32_t) rank;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        noise_put(pixels + i*4, ((float) ranks[i] + 0.5f) / (float) count);
+    }
+    ok = true;
+
+defer:
+    mem_free(ranks);
+    mem_free(proto_bits);
+    mem_free(proto);
+    mem_free(nb.bits);
+    mem_free(nb.energy);
+    return ok;
+}
+
+// Fills `size`x`size` RGBA8 `pixels`
+bool noise_generate(const Noise_Spec *spec, Job_Pool *pool, unsigned char *pixels)
+{
+    if (spec->kind == NOISE_BLUE) return noise_blue(spec, pixels);
+
+    Noise_Rows nr = {0};
+    nr.spec = spec;
+    nr.pixels = pixels;
+    nr.octaves = 1;
+    if (spec->kind != NOISE_WORLEY) {
+        // Octaves finer than two pixels per cell only add aliasing
+        while (nr.octaves < NOISE_MAX_OCTAVES && (spec->cells << nr.octaves) <= spec->size/2) {
+            nr.octaves += 1;
+        }
+    }
+
+    bool ok = true;
+    for (int o = 0; o < nr.octaves; ++o) {
+        int cells = spec->cells << o;
+        if (spec->kind == NOISE_WORLEY) {
+            // Feature points are offsets within their cells
+            nr.tables[o] = mem_alloc(MEM_TAG_IMAGES, (size_t) cells*cells*sizeof(V2f));
+            if (nr.tables[o] != NULL) {
+                Rng rng;
+                rng_seed(&rng, spec->seed, o);
+                rng_uniform_v2f(&rng, nr.tables[o], (size_t) cells*cells);
+            }
+        } else {
+            nr.tables[o] = noise_make_gradients(cells, spec->seed, o);
+        }
+        if (nr.tables[o] == NULL) ok = false;
+    }
+
+    if (ok) job_pool_parallel_for(pool, (size_t) spec->size, 16, noise_rows, &nr);
+
+    for (int o = 0; o < nr.octaves; ++o) mem_free(nr.tables[o]);
+    return ok;
+}
+
+static void noise_cache_path(Hash128 spec_hash, char *path, size_t path_size)
+{
+    snprintf(path, path_size, NOISE_CACHE_DIR"/"Hash128_Fmt".rgba", Hash128_Arg(spec_hash));
+}
+
+// Maps a previously generated texture. The pixels point into `file`.
+bool noise_cache_load(Hash128 spec_hash, int size, Mapped_File *file, unsigned char **pixels)
+{
+    char path[256];
+    noise_cache_path(spec_hash, path, sizeof(path));
+    if (!map_file(path, file)) return false;
+
+    size_t pixels_size = (size_t) size*size*4;
+    const Noise_Cache_Header *header = file->data;
+    if (file->size != sizeof(*header) + pixels_size ||
+            memcmp(header->magic, "TNOI", 4) != 0 ||
+            header->version != NOISE_VERSION ||
+            header->width != (uint32_t) size || header->height != (uint32_t) size ||
+            !hash128_eq(header->spec_hash, spec_hash)) {
+        unmap_file(file);
+        return false;
+    }
+
+    *pixels = (unsigned char *) file->data + sizeof(*header);
+    return true;
+}
+
+void noise_cache_save(Hash128 spec_hash, int size, const unsigned char *pixels)
+{
+#ifdef _WIN32
+    _mkdir(NOISE_CACHE_DIR);
+#else
+    mkdir(NOISE_CACHE_DIR, 0755);
+#endif // _WIN32
+
+    char path[256];
+    noise_cache_path(spec_hash, path, sizeof(path));
+
+    Noise_Cache_Header header = {0};
+    memcpy(header.magic, "TNOI", 4);
+    header.version = NOISE_VERSION;
+    header.width = (uint32_t) size;
+    header.height = (uint32_t) size;
+    header.spec_hash = spec_hash;
+
+    char tmp_path[256 + TEMP_FILE_PATH_EXTRA];
+    temp_file_path(path, tmp_path, sizeof(tmp_path));
+
+    // The cache is an optimization, failing to write it is not an error
+    FILE *f = fopen(tmp_path, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "WARNING: could not write noise cache %s: %s\n", tmp_path, strerror(errno));
+        return;
+    }
+    fwrite(&header, sizeof(header), 1, f);
+    fwrite(pixels, (size_t) size*size*4, 1, f);
+    bool ok = !ferror(f);
+    if (fclose(f) != 0) ok = false;
+    if (!commit_temp_file(tmp_path, path, ok)) {
+        fprintf(stderr, "WARNING: could not write noise cache %s: %s\n", path, strerror(errno));
+    }
+}
@@ -0,0 +1,266 @@
+// Overdraw debug view, toggled with F10. The frame is rendered with its
+// usual shaders and geometry into a framebuffer with a stencil buffer that
+// every fragment increments, so the stencil ends up holding how many
+// fragments landed on every pixel, translucent or not. The counts are then
+// drawn as a heatmap with one full screen pass per bucket of
+// overdraw_buckets, each one only touching the pixels whose count reached
+// the bucket, which works without stencil texturing on GL 3.3. Counts
+// saturate at 255.
+//
+// The scene, the tilemap, the sprites and the paths are each wrapped in a
+// GL_SAMPLES_PASSED query, read back a few frames later, so F7 can tell the
+// total number of fragments of the frame and which part of it they come
+// from.
+
+#define OVERDRAW_QUERIES 4
+
+typedef enum {
+    OVERDRAW_PASS_SCENE = 0,
+    OVERDRAW_PASS_TILEMAP,
+    OVERDRAW_PASS_SPRITES,
+    OVERDRAW_PASS_PATHS,
+    COUNT_OVERDRAW_PASSES,
+} Overdraw_Pass;
+
+static const char *overdraw_pass_names[COUNT_OVERDRAW_PASSES] = {
+    [OVERDRAW_PASS_SCENE]   = "scene",
+    [OVERDRAW_PASS_TILEMAP] = "tilemap",
+    [OVERDRAW_PASS_SPRITES] = "sprites",
+    [OVERDRAW_PASS_PATHS]   = "paths",
+};
+
+typedef struct {
+    // Lowest count of the bucket
+    GLint count;
+    float color[3];
+} Overdraw_Bucket;
+
+// Pixels with no fragments stay black
+static const Overdraw_Bucket overdraw_buckets[] = {
+    {1,   {0.0f, 0.0f, 0.5f}},
+    {2,   {0.0f, 0.0f, 1.0f}},
+    {3,   {0.0f, 0.5f, 1.0f}},
+    {4,   {0.0f, 1.0f, 1.0f}},
+    {6,   {0.0f, 1.0f, 0.0f}},
+    {8,   {0.5f, 1.0f, 0.0f}},
+    {12,  {1.0f, 1.0f, 0.0f}},
+    {16,  {1.0f, 0.5f, 0.0f}},
+    {32,  {1.0f, 0.0f, 0.0f}},
+    {64,  {1.0f, 0.0f, 1.0f}},
+    {128, {1.0f, 1.0f, 1.0f}},
+};
+#define OVERDRAW_BUCKETS (sizeof(overdraw_buckets)/sizeof(overdraw_buckets[0]))
+
+typedef struct {
+    GLuint queries[OVERDRAW_QUERIES];
+    // Queries in flight, the oldest one is at `head`
+    size_t head;
+    size_t pending;
+    bool running;
+    uint64_t fragments;
+    bool has_fragments;
+} Overdraw_Counter;
+
+typedef struct {
+    bool enabled;
+    bool ready;
+    GLuint program;
+    GLint color_uniform;
+    GLuint vao;
+
+    GLuint framebuffer;
+    GLuint color;
+    GLuint depth_stencil;
+    int width;
+    int height;
+
+    GLint viewport[4];
+    // Pixels of the last frame, to tell the average overdraw
+    uint64_t pixels;
+    Overdraw_Counter counters[COUNT_OVERDRAW_PASSES];
+} Overdraw;
+
+static const char *overdraw_frag_source =
+    "#version 330\n"
+    "uniform vec3 color;\n"
+    "out vec4 out_color;\n"
+    "void main(void)\n"
+    "{\n"
+    "    out_color = vec4(color, 1.0);\n"
+    "}\n";
+
+static void overdraw_counter_poll(Overdraw_Counter *counter)
+{
+    while (counter->pending > 0) {
+        GLuint query = counter->queries[counter->head];
+        GLint available = 0;
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) break;
+        GLuint64 samples = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &samples);
+        counter->fragments = samples;
+        counter->has_fragments = true;
+        counter->head = (counter->head + 1) % OVERDRAW_QUERIES;
+        counter->pending -= 1;
+    }
+}
+
+static void overdraw_delete_framebuffer(Overdraw *overdraw)
+{
+    if (overdraw->framebuffer == 0) return;
+    glDeleteFramebuffers(1, &overdraw->framebuffer);
+    glDeleteTextures(1, &overdraw->color);
+    glDeleteTextures(1, &overdraw->depth_stencil);
+    mem_track(MEM_TAG_GL_TEXTURES, -(ptrdiff_t) ((size_t) overdraw->width*overdraw->height*8));
+    overdraw->framebuffer = 0;
+    overdraw->color = 0;
+    overdraw->depth_stencil = 0;
+}
+
+static bool overdraw_create_framebuffer(Overdraw *overdraw, int width, int height)
+{
+    overdraw_delete_framebuffer(overdraw);
+    overdraw->width = width;
+    overdraw->height = height;
+
+    glGenTextures(1, &overdraw->color);
+    glBindTexture(GL_TEXTURE_2D, overdraw->color);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glGenTextures(1, &overdraw->depth_stencil);
+    glBindTexture(GL_TEXTURE_2D, overdraw->depth_stencil);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, width, height, 0,
+                 GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    mem_track(MEM_TAG_GL_TEXTURES, (ptrdiff_t) ((size_t) width*height*8));
+
+    glGenFramebuffers(1, &overdraw->framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, overdraw->framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, overdraw->color, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, overdraw->depth_stencil, 0);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "ERROR: overdraw framebuffer %dx%d is incomplete: 0x%x\n", width, height, status);
+        overdraw_delete_framebuffer(overdraw);
+        return false;
+    }
+    return true;
+}
+
+void overdraw_toggle(Overdraw *overdraw)
+{
+    if (!overdraw->ready) {
+        if (!create_program(post_vert_source, overdraw_frag_source, &overdraw->program)) {
+            fprintf(stderr, "ERROR: could not compile the overdraw shaders\n");
+            return;
+        }
+        overdraw->color_uniform = glGetUniformLocation(overdraw->program, "color");
+        glGenVertexArrays(1, &overdraw->vao);
+        for (Overdraw_Pass pass = 0; pass < COUNT_OVERDRAW_PASSES; ++pass) {
+            glGenQueries(OVERDRAW_QUERIES, overdraw->counters[pass].queries);
+        }
+        overdraw->ready = true;
+    }
+    overdraw->enabled = !overdraw->enabled;
+    for (Overdraw_Pass pass = 0; pass < COUNT_OVERDRAW_PASSES; ++pass) {
+        overdraw->counters[pass].has_fragments = false;
+    }
+    if (!overdraw->enabled) overdraw_delete_framebuffer(overdraw);
+    printf("Overdraw view %s\n", overdraw->enabled ? "on" : "off");
+}
+
+// Redirects rendering into the counting framebuffer. Call before clearing
+// the frame, returns false when the view is off.
+bool overdraw_begin(Overdraw *overdraw, int width, int height)
+{
+    if (!overdraw->enabled || width <= 0 || height <= 0) return false;
+    if ((overdraw->framebuffer == 0 || overdraw->width != width || overdraw->height != height) &&
+            !overdraw_create_framebuffer(overdraw, width, height)) {
+        overdraw->enabled = false;
+        return false;
+    }
+    for (Overdraw_Pass pass = 0; pass < COUNT_OVERDRAW_PASSES; ++pass) {
+        overdraw_counter_poll(&overdraw->counters[pass]);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, overdraw->framebuffer);
+    glGetIntegerv(GL_VIEWPORT, overdraw->viewport);
+    glViewport(0, 0, width, height);
+    glClearStencil(0);
+    glClear(GL_STENCIL_BUFFER_BIT);
+    glEnable(GL_STENCIL_TEST);
+    glStencilFunc(GL_ALWAYS, 0, 0xFF);
+    glStencilOp(GL_KEEP, GL_KEEP, GL_INCR);
+    overdraw->pixels = (uint64_t) width*height;
+    return true;
+}
+
+// Skips counting when all the queries of the pass are still in flight
+void overdraw_begin_pass(Overdraw *overdraw, Overdraw_Pass pass)
+{
+    if (!overdraw->enabled) return;
+    Overdraw_Counter *counter = &overdraw->counters[pass];
+    counter->running = counter->pending < OVERDRAW_QUERIES;
+    if (!counter->running) return;
+    glBeginQuery(GL_SAMPLES_PASSED, counter->queries[(counter->head + counter->pending) % OVERDRAW_QUERIES]);
+}
+
+void overdraw_end_pass(Overdraw *overdraw, Overdraw_Pass pass)
+{
+    Overdraw_Counter *counter = &overdraw->counters[pass];
+    if (!counter->running) return;
+    glEndQuery(GL_SAMPLES_PASSED);
+    counter->pending += 1;
+    counter->running = false;
+}
+
+// Replaces the frame with the heatmap and puts it into the window
+void overdraw_end(Overdraw *overdraw, int window_width, int window_height)
+{
+    GLint vao = 0;
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &vao);
+    GLboolean blend = glIsEnabled(GL_BLEND);
+    glDisable(GL_BLEND);
+    GLfloat clear_color[4];
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, clear_color);
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    // Every bucket paints over the ones below it, so a pixel ends up with the highest bucket it reached
+    glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+    glUseProgram(overdraw->program);
+    glBindVertexArray(overdraw->vao);
+    for (size_t i = 0; i < OVERDRAW_BUCKETS; ++i) {
+        const Overdraw_Bucket *bucket = &overdraw_buckets[i];
+        glStencilFunc(GL_LEQUAL, bucket->count, 0xFF);
+        glUniform3f(overdraw->color_uniform, bucket->color[0], bucket->color[1], bucket->color[2]);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+    glDisable(GL_STENCIL_TEST);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, overdraw->framebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, overdraw->width, overdraw->height, 0, 0, window_width, window_height,
+                      GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(overdraw->viewport[0], overdraw->viewport[1], overdraw->viewport[2], overdraw->viewport[3]);
+
+    glClearColor(clear_color[0], clear_color[1], clear_color[2], clear_color[3]);
+    if (blend) glEnable(GL_BLEND);
+    glBindVertexArray((GLuint) vao);
+}
+
+void overdraw_print_stats(const Overdraw *overdraw)
+{
+    if (!overdraw->enabled) return;
+    uint64_t total = 0;
+    printf("Overdraw:\n");
+    for (Overdraw_Pass pass = 0; pass < COUNT_OVERDRAW_PASSES; ++pass) {
+        const Overdraw_Counter *counter = &overdraw->counters[pass];
+        if (!counter->has_fragments) continue;
+        printf("  %-10s %12llu fragments\n", overdraw_pass_names[pass], (unsigned long long) counter->fragments);
+        total += counter->fragments;
+    }
+    printf("  %-10s %12llu fragments, %.2f per pixel\n", "total", (unsigned long long) total,
+           overdraw->pixels > 0 ? (double) total/(double) overdraw->pixels : 0.0);
+}
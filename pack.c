@@ -0,0 +1,223 @@
+// Bundles render.conf and every file it refers to into a single asset pack
+// that `main -pack <file>` can map at startup. See pack.h for the format.
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+
+#define HASH_IMPLEMENTATION
+#include "hash.h"
+
+#define SV_IMPLEMENTATION
+#include "sv.h"
+
+#define MAPPED_FILE_IMPLEMENTATION
+#include "mapped_file.h"
+
+#define PACK_IMPLEMENTATION
+#include "pack.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+static bool pack_file(Pack_Builder *pb, const char *file_path)
+{
+    Mapped_File mf;
+    if (!map_file(file_path, &mf)) {
+        fprintf(stderr, "ERROR: could not read file %s: %s\n", file_path, strerror(errno));
+        return false;
+    }
+
+    Hash128 source_hash = hash128(mf.data, mf.size, 0);
+
+    int width, height, comp;
+    if (mf.size > 0 && stbi_info_from_memory(mf.data, (int) mf.size, &width, &height, &comp)) {
+        unsigned char *pixels = stbi_load_from_memory(mf.data, (int) mf.size, &width, &height, NULL, 4);
+        unmap_file(&mf);
+        if (pixels == NULL) {
+            fprintf(stderr, "ERROR: could not decode image %s: %s\n", file_path, stbi_failure_reason());
+            return false;
+        }
+        // stbi_image_free() is free() with the default STBI_FREE
+        size_t size = (size_t) width * height * 4;
+        printf("  %-40s texture %dx%d (%zu bytes)\n", file_path, width, height, size);
+        return pack_builder_add(pb, file_path, PACK_ASSET_TEXTURE_RGBA8, pixels, size,
+                                (uint32_t) width, (uint32_t) height, source_hash);
+    }
+
+    size_t size = mf.size;
+    void *data = malloc(size + 1);
+    if (data == NULL) {
+        unmap_file(&mf);
+        return false;
+    }
+    if (size > 0) memcpy(data, mf.data, size);
+    unmap_file(&mf);
+
+    printf("  %-40s raw (%zu bytes)\n", file_path, size);
+    return pack_builder_add(pb, file_path, PACK_ASSET_RAW, data, size, 0, 0, source_hash);
+}
+
+static bool file_exists(const char *file_path)
+{
+    FILE *f = fopen(file_path, "rb");
+    if (f == NULL) return false;
+    fclose(f);
+    return true;
+}
+
+typedef bool (*Conf_File_Visit)(void *context, const char *file_path);
+
+// Calls `visit` on `value` if it names an existing file, `exists` may be NULL
+static bool conf_visit_value(String_View value, Conf_File_Visit visit, void *context, bool *exists)
+{
+    char *path = malloc(value.count + 1);
+    if (path == NULL) return false;
+    memcpy(path, value.data, value.count);
+    path[value.count] = '\0';
+
+    bool ok = true;
+    bool found = file_exists(path);
+    if (found) ok = visit(context, path);
+    if (exists != NULL) *exists = found;
+    free(path);
+    return ok;
+}
+
+// Calls `visit` on every value of the config that names an existing file.
+// Values that don't are split on spaces like the lists of `sprite_textures`,
+// and every item that names an existing file is visited instead.
+static bool conf_visit_files(String_View content, Conf_File_Visit visit, void *context)
+{
+    bool ok = true;
+    while (ok && content.count > 0) {
+        String_View line = sv_trim_left(sv_chop_by_delim(&content, '\n'));
+        if (line.count == 0 || line.data[0] == '#') continue;
+
+        sv_chop_by_delim(&line, '=');
+        String_View value = sv_trim(line);
+        if (value.count == 0) continue;
+
+        bool exists = false;
+        ok = conf_visit_value(value, visit, context, &exists);
+        while (ok && !exists && value.count > 0) {
+            String_View item = sv_chop_by_delim(&value, ' ');
+            value = sv_trim_left(value);
+            if (item.count > 0) ok = conf_visit_value(item, visit, context, NULL);
+        }
+    }
+    return ok;
+}
+
+static bool pack_conf_file(void *context, const char *file_path)
+{
+    return pack_file(context, file_path);
+}
+
+// Packs the config itself and every file it refers to
+static bool pack_render_conf(Pack_Builder *pb, const char *render_conf_path)
+{
+    Mapped_File mf;
+    if (!map_file(render_conf_path, &mf)) {
+        fprintf(stderr, "ERROR: could not load %s: %s\n", render_conf_path, strerror(errno));
+        return false;
+    }
+
+    bool ok = pack_file(pb, render_conf_path);
+    if (ok) ok = conf_visit_files(sv_from_parts(mf.data, mf.size), pack_conf_file, pb);
+
+    unmap_file(&mf);
+    return ok;
+}
+
+static bool verify_conf_file(void *context, const char *file_path)
+{
+    const Pack *pack = context;
+    const Pack_Entry *entry = pack_find(pack, file_path);
+    if (entry == NULL) {
+        fprintf(stderr, "ERROR: %s is referred to by the packed config but missing from the pack\n", file_path);
+        return false;
+    }
+
+    Mapped_File mf;
+    if (!map_file(file_path, &mf)) {
+        fprintf(stderr, "ERROR: could not read file %s: %s\n", file_path, strerror(errno));
+        return false;
+    }
+    Hash128 source_hash = hash128(mf.data, mf.size, 0);
+    unmap_file(&mf);
+    if (memcmp(&source_hash, &entry->source_hash, sizeof(source_hash)) != 0) {
+        fprintf(stderr, "ERROR: %s in the pack does not match the file\n", file_path);
+        return false;
+    }
+    return true;
+}
+
+// Reopens the saved pack the way `main -pack` does and looks up the config
+// and every file the config *from the pack* refers to
+static bool pack_verify(const char *pack_path, const char *render_conf_path)
+{
+    Pack pack;
+    if (!pack_open(pack_path, &pack)) {
+        fprintf(stderr, "ERROR: could not reopen %s: %s\n", pack_path, strerror(errno));
+        return false;
+    }
+
+    bool ok = true;
+    const Pack_Entry *conf = pack_find(&pack, render_conf_path);
+    if (conf == NULL) {
+        fprintf(stderr, "ERROR: %s is missing from the pack\n", render_conf_path);
+        ok = false;
+    } else {
+        String_View content = sv_from_parts(pack_entry_data(&pack, conf), conf->data_size);
+        ok = conf_visit_files(content, verify_conf_file, &pack);
+    }
+
+    pack_close(&pack);
+    return ok;
+}
+
+void usage(const char *program)
+{
+    fprintf(stderr, "Usage: %s <output.pack> [render.conf] [extra files...]\n", program);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        usage(argv[0]);
+        fprintf(stderr, "ERROR: no output file is provided\n");
+        return 1;
+    }
+
+    const char *output_path = argv[1];
+    const char *render_conf_path = argc > 2 ? argv[2] : "render.conf";
+
+    Pack_Builder pb = {0};
+    printf("Packing %s into %s\n", render_conf_path, output_path);
+    if (!pack_render_conf(&pb, render_conf_path)) {
+        pack_builder_free(&pb);
+        return 1;
+    }
+
+    for (int i = 3; i < argc; ++i) {
+        if (!pack_file(&pb, argv[i])) {
+            pack_builder_free(&pb);
+            return 1;
+        }
+    }
+
+    if (!pack_builder_save(&pb, output_path)) {
+        fprintf(stderr, "ERROR: could not save %s: %s\n", output_path, strerror(errno));
+        pack_builder_free(&pb);
+        return 1;
+    }
+
+    printf("Packed %zu assets\n", pb.assets_count);
+    pack_builder_free(&pb);
+
+    if (!pack_verify(output_path, render_conf_path)) return 1;
+    return 0;
+}
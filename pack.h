@@ -0,0 +1,394 @@
+#ifndef PACK_H_
+#define PACK_H_
+
+// Single-file asset pack.
+//
+// Layout (all integers little-endian, every section aligned to PACK_ALIGNMENT):
+//
+// ```
+// Pack_Header
+// uint32_t buckets[bucket_count]   // open addressing table, 1-based index into entries, 0 is empty
+// Pack_Entry entries[entry_count]
+// char strings[]                   // asset paths, not NUL-terminated
+// data blobs                       // each one followed by at least one '\0' byte
+// ```
+//
+// The runtime maps the whole file once and resolves assets by path with a
+// single hash probe sequence. Blobs are stored ready to use: shader sources
+// as NUL-terminated text, textures as decoded RGBA8 pixels.
+//
+// Depends on hash.h and mapped_file.h.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "hash.h"
+#include "mapped_file.h"
+
+#ifndef PACKDEF
+#define PACKDEF
+#endif // PACKDEF
+
+#define PACK_MAGIC "TPAK"
+#define PACK_VERSION 1
+#define PACK_ALIGNMENT 64
+
+typedef enum {
+    PACK_ASSET_RAW = 0,
+    PACK_ASSET_TEXTURE_RGBA8,
+    COUNT_PACK_ASSETS,
+} Pack_Asset_Kind;
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t entry_count;
+    uint32_t bucket_count;
+    uint64_t buckets_offset;
+    uint64_t entries_offset;
+    uint64_t strings_offset;
+    uint64_t file_size;
+    uint64_t reserved[2];
+} Pack_Header;
+
+typedef struct {
+    uint64_t path_hash;
+    uint64_t data_offset;
+    uint64_t data_size;
+    // Hash of the source file the blob was produced from, NOT of the blob itself
+    Hash128 source_hash;
+    uint32_t path_offset;
+    uint32_t path_len;
+    uint32_t kind;
+    uint32_t width;
+    uint32_t height;
+    uint32_t reserved;
+} Pack_Entry;
+
+typedef struct {
+    Mapped_File file;
+    const Pack_Header *header;
+    const uint32_t *buckets;
+    const Pack_Entry *entries;
+    const char *strings;
+} Pack;
+
+PACKDEF bool pack_open(const char *file_path, Pack *pack);
+PACKDEF void pack_close(Pack *pack);
+PACKDEF const Pack_Entry *pack_find(const Pack *pack, const char *asset_path);
+PACKDEF const void *pack_entry_data(const Pack *pack, const Pack_Entry *entry);
+
+typedef struct {
+    char *path;
+    Pack_Asset_Kind kind;
+    void *data;
+    size_t data_size;
+    uint32_t width;
+    uint32_t height;
+    Hash128 source_hash;
+} Pack_Builder_Asset;
+
+typedef struct {
+    Pack_Builder_Asset *assets;
+    size_t assets_count;
+    size_t assets_capacity;
+} Pack_Builder;
+
+// Takes ownership of `data`, which must be malloc-ed
+PACKDEF bool pack_builder_add(Pack_Builder *pb, const char *asset_path, Pack_Asset_Kind kind,
+                              void *data, size_t data_size, uint32_t width, uint32_t height,
+                              Hash128 source_hash);
+PACKDEF bool pack_builder_save(const Pack_Builder *pb, const char *file_path);
+PACKDEF void pack_builder_free(Pack_Builder *pb);
+
+#endif // PACK_H_
+
+#if defined(PACK_IMPLEMENTATION) && !defined(PACK_IMPLEMENTATION_)
+#define PACK_IMPLEMENTATION_
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static_assert(sizeof(Pack_Header) == 64, "Pack_Header is part of the on-disk format");
+static_assert(sizeof(Pack_Entry) == 64, "Pack_Entry is part of the on-disk format");
+
+static uint64_t pack__align(uint64_t x)
+{
+    return (x + PACK_ALIGNMENT - 1) & ~(uint64_t) (PACK_ALIGNMENT - 1);
+}
+
+// `./shaders/main.frag` and `shaders/main.frag` refer to the same asset
+static const char *pack__normalize_path(const char *path)
+{
+    while (path[0] == '.' && path[1] == '/') path += 2;
+    return path;
+}
+
+static uint64_t pack__hash_path(const char *path, size_t path_len)
+{
+    return hash64(path, path_len, 0);
+}
+
+PACKDEF bool pack_open(const char *file_path, Pack *pack)
+{
+    memset(pack, 0, sizeof(*pack));
+    if (!map_file(file_path, &pack->file)) return false;
+
+    const unsigned char *base = pack->file.data;
+    size_t size = pack->file.size;
+    const Pack_Header *header = (const Pack_Header *) base;
+
+    if (size < sizeof(Pack_Header)
+            || memcmp(header->magic, PACK_MAGIC, 4) != 0
+            || header->version != PACK_VERSION
+            || header->file_size != size
+            || header->bucket_count == 0
+            || (header->bucket_count & (header->bucket_count - 1)) != 0
+            || header->buckets_offset > size
+            || (uint64_t) header->bucket_count * sizeof(uint32_t) > size - header->buckets_offset
+            || header->entries_offset > size
+            || (uint64_t) header->entry_count * sizeof(Pack_Entry) > size - header->entries_offset
+            || header->strings_offset > size) {
+        unmap_file(&pack->file);
+        errno = EINVAL;
+        return false;
+    }
+
+    pack->header = header;
+    pack->buckets = (const uint32_t *) (base + header->buckets_offset);
+    pack->entries = (const Pack_Entry *) (base + header->entries_offset);
+    pack->strings = (const char *) (base + header->strings_offset);
+
+    // Offsets are compared against what is left of the file, so a crafted
+    // one can't wrap around, and textures have to hold all of their pixels
+    for (uint32_t i = 0; i < header->entry_count; ++i) {
+        const Pack_Entry *e = &pack->entries[i];
+        if (header->strings_offset + e->path_offset + e->path_len > size
+                || e->data_offset > size
+                || e->data_size > size - e->data_offset
+                || (e->kind == PACK_ASSET_TEXTURE_RGBA8
+                    && (uint64_t) e->width * e->height * 4 != e->data_size)) {
+            pack_close(pack);
+            errno = EINVAL;
+            return false;
+        }
+    }
+
+    // pack_find() indexes the entries with whatever the buckets hold
+    for (uint32_t i = 0; i < header->bucket_count; ++i) {
+        if (pack->buckets[i] > header->entry_count) {
+            pack_close(pack);
+            errno = EINVAL;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+PACKDEF void pack_close(Pack *pack)
+{
+    unmap_file(&pack->file);
+    memset(pack, 0, sizeof(*pack));
+}
+
+PACKDEF const Pack_Entry *pack_find(const Pack *pack, const char *asset_path)
+{
+    if (pack->header == NULL) return NULL;
+
+    asset_path = pack__normalize_path(asset_path);
+    size_t path_len = strlen(asset_path);
+    uint64_t h = pack__hash_path(asset_path, path_len);
+    uint32_t mask = pack->header->bucket_count - 1;
+
+    for (uint32_t i = (uint32_t) h & mask, probes = 0;
+            probes <= mask;
+            i = (i + 1) & mask, ++probes) {
+        uint32_t slot = pack->buckets[i];
+        if (slot == 0) return NULL;
+
+        const Pack_Entry *e = &pack->entries[slot - 1];
+        if (e->path_hash == h
+                && e->path_len == path_len
+                && memcmp(pack->strings + e->path_offset, asset_path, path_len) == 0) {
+            return e;
+        }
+    }
+
+    return NULL;
+}
+
+PACKDEF const void *pack_entry_data(const Pack *pack, const Pack_Entry *entry)
+{
+    return (const unsigned char *) pack->file.data + entry->data_offset;
+}
+
+PACKDEF bool pack_builder_add(Pack_Builder *pb, const char *asset_path, Pack_Asset_Kind kind,
+                              void *data, size_t data_size, uint32_t width, uint32_t height,
+                              Hash128 source_hash)
+{
+    asset_path = pack__normalize_path(asset_path);
+
+    for (size_t i = 0; i < pb->assets_count; ++i) {
+        if (strcmp(pb->assets[i].path, asset_path) == 0) {
+            // The same file referred to twice, keep the first one
+            free(data);
+            return true;
+        }
+    }
+
+    if (pb->assets_count >= pb->assets_capacity) {
+        size_t new_capacity = pb->assets_capacity == 0 ? 16 : pb->assets_capacity * 2;
+        Pack_Builder_Asset *new_assets = realloc(pb->assets, new_capacity * sizeof(*new_assets));
+        if (new_assets == NULL) return false;
+        pb->assets = new_assets;
+        pb->assets_capacity = new_capacity;
+    }
+
+    char *path = strdup(asset_path);
+    if (path == NULL) return false;
+
+    Pack_Builder_Asset *asset = &pb->assets[pb->assets_count++];
+    asset->path = path;
+    asset->kind = kind;
+    asset->data = data;
+    asset->data_size = data_size;
+    asset->width = width;
+    asset->height = height;
+    asset->source_hash = source_hash;
+    return true;
+}
+
+static bool pack__write_padding(FILE *f, uint64_t *offset, uint64_t target)
+{
+    static const char zeros[PACK_ALIGNMENT] = {0};
+    while (*offset < target) {
+        uint64_t n = target - *offset;
+        if (n > sizeof(zeros)) n = sizeof(zeros);
+        if (fwrite(zeros, 1, (size_t) n, f) != n) return false;
+        *offset += n;
+    }
+    return true;
+}
+
+PACKDEF bool pack_builder_save(const Pack_Builder *pb, const char *file_path)
+{
+    bool result = true;
+    FILE *f = NULL;
+    uint32_t *buckets = NULL;
+    Pack_Entry *entries = NULL;
+
+    uint32_t bucket_count = 1;
+    while (bucket_count < 2 * pb->assets_count) bucket_count *= 2;
+
+    buckets = calloc(bucket_count, sizeof(*buckets));
+    entries = calloc(pb->assets_count + 1, sizeof(*entries));
+    if (buckets == NULL || entries == NULL) {
+        result = false;
+        goto defer;
+    }
+
+    Pack_Header header = {0};
+    memcpy(header.magic, PACK_MAGIC, 4);
+    header.version = PACK_VERSION;
+    header.entry_count = (uint32_t) pb->assets_count;
+    header.bucket_count = bucket_count;
+    header.buckets_offset = pack__align(sizeof(header));
+    header.entries_offset = pack__align(header.buckets_offset + bucket_count * sizeof(*buckets));
+    header.strings_offset = pack__align(header.entries_offset + pb->assets_count * sizeof(*entries));
+
+    uint64_t strings_size = 0;
+    for (size_t i = 0; i < pb->assets_count; ++i) {
+        entries[i].path_offset = (uint32_t) strings_size;
+        entries[i].path_len = (uint32_t) strlen(pb->assets[i].path);
+        strings_size += entries[i].path_len;
+    }
+
+    uint64_t data_offset = pack__align(header.strings_offset + strings_size);
+    for (size_t i = 0; i < pb->assets_count; ++i) {
+        const Pack_Builder_Asset *asset = &pb->assets[i];
+        Pack_Entry *e = &entries[i];
+
+        e->path_hash = pack__hash_path(asset->path, e->path_len);
+        e->data_offset = data_offset;
+        e->data_size = asset->data_size;
+        e->source_hash = asset->source_hash;
+        e->kind = asset->kind;
+        e->width = asset->width;
+        e->height = asset->height;
+        data_offset = pack__align(data_offset + asset->data_size + 1);
+
+        uint32_t mask = bucket_count - 1;
+        uint32_t slot = (uint32_t) e->path_hash & mask;
+        while (buckets[slot] != 0) slot = (slot + 1) & mask;
+        buckets[slot] = (uint32_t) i + 1;
+    }
+    header.file_size = data_offset;
+
+    f = fopen(file_path, "wb");
+    if (f == NULL) {
+        result = false;
+        goto defer;
+    }
+
+    uint64_t offset = 0;
+#define PACK__WRITE(ptr, size)                                  \
+    do {                                                        \
+        if (fwrite((ptr), 1, (size), f) != (size)) {            \
+            result = false;                                     \
+            goto defer;                                         \
+        }                                                       \
+        offset += (size);                                       \
+    } while (0)
+#define PACK__PAD(target)                                       \
+    do {                                                        \
+        if (!pack__write_padding(f, &offset, (target))) {       \
+            result = false;                                     \
+            goto defer;                                         \
+        }                                                       \
+    } while (0)
+
+    PACK__WRITE(&header, sizeof(header));
+    PACK__PAD(header.buckets_offset);
+    PACK__WRITE(buckets, bucket_count * sizeof(*buckets));
+    PACK__PAD(header.entries_offset);
+    PACK__WRITE(entries, pb->assets_count * sizeof(*entries));
+    PACK__PAD(header.strings_offset);
+    for (size_t i = 0; i < pb->assets_count; ++i) {
+        PACK__WRITE(pb->assets[i].path, entries[i].path_len);
+    }
+    for (size_t i = 0; i < pb->assets_count; ++i) {
+        PACK__PAD(entries[i].data_offset);
+        PACK__WRITE(pb->assets[i].data, pb->assets[i].data_size);
+    }
+    PACK__PAD(header.file_size);
+
+#undef PACK__WRITE
+#undef PACK__PAD
+
+defer:
+    if (f) {
+        int saved_errno = errno;
+        if (fclose(f) != 0) result = false;
+        errno = saved_errno;
+    }
+    free(buckets);
+    free(entries);
+    return result;
+}
+
+PACKDEF void pack_builder_free(Pack_Builder *pb)
+{
+    for (size_t i = 0; i < pb->assets_count; ++i) {
+        free(pb->assets[i].path);
+        free(pb->assets[i].data);
+    }
+    free(pb->assets);
+    memset(pb, 0, sizeof(*pb));
+}
+
+#endif // PACK_IMPLEMENTATION
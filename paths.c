@@ -0,0 +1,1151 @@
+// Vector paths. render.conf can name a file of filled and stroked shapes
+// that are drawn over the scene:
+//
+//   paths = assets/logo.paths
+//   path_tolerance = 0.25
+//
+// The file is a list of paths. `fill` or `stroke` starts a new one with its
+// paint, and the commands after it up to the next one make its outline:
+//
+//   # a triangle with a curved side, then its outline
+//   fill 1 0.8 0 1
+//   M 100 100 L 300 100 Q 300 300 100 300 Z
+//   stroke 4 0 0 0 1 round
+//   M 100 100 L 300 100 Q 300 300 100 300 Z
+//
+// Colors are RGBA from 0 to 1 and a stroke has a width and a join, `miter`
+// (default), `round` or `bevel`. The commands are `M x y`, `L x y`,
+// `Q cx cy x y`, `C c1x c1y c2x c2y x y` and `Z` to close the contour, in
+// pixels from the top left corner of the window. Every `M` starts a new
+// contour, and every contour of a fill is filled on its own, so holes are
+// not cut out. A contour that crosses itself fills every loop it makes,
+// both lobes of `M 10 10 L 60 60 L 60 10 L 10 60 Z`.
+//
+// Curves are flattened into as many segments as Wang's formula asks for to
+// stay within `path_tolerance` pixels of the curve, so flat curves cost a
+// segment or two and tight ones get more. Fills are cut at their crossings
+// into simple loops that are triangulated by ear clipping, and strokes are
+// a quad per segment with a join at every corner and butt ends.
+//
+// Every path is hashed with its paint and the tolerance. The paths that
+// were not there on the previous load are tessellated in parallel on the
+// job pool, the rest are copied out of the vertex arena of the previous
+// load, so reloading static art costs a hash per path. The arena holds the
+// triangles of all the paths in file order and is uploaded once, then
+// drawn every frame with a single draw call, or one per run of paths when a
+// path repeats an earlier one.
+
+#define PATHS_CAP 65536
+#define PATH_CURVE_SEGMENTS_CAP 256
+#define PATH_ROUND_SEGMENTS_CAP 64
+// Most crossings a fill contour is split at, what remains is clipped as is
+#define PATH_FILL_SPLITS_CAP 64
+// Longest miter before it becomes a bevel, in stroke widths
+#define PATH_MITER_LIMIT 4.0f
+
+typedef enum {
+    PATH_MOVE = 0,
+    PATH_LINE,
+    PATH_QUAD,
+    PATH_CUBIC,
+    PATH_CLOSE,
+} Path_Verb;
+
+typedef enum {
+    PATH_FILL = 0,
+    PATH_STROKE,
+} Path_Paint;
+
+typedef enum {
+    PATH_JOIN_MITER = 0,
+    PATH_JOIN_ROUND,
+    PATH_JOIN_BEVEL,
+    COUNT_PATH_JOINS,
+} Path_Join;
+
+static const char *path_join_names[COUNT_PATH_JOINS] = {
+    [PATH_JOIN_MITER] = "miter",
+    [PATH_JOIN_ROUND] = "round",
+    [PATH_JOIN_BEVEL] = "bevel",
+};
+
+// Hashed as it is, so it has no padding
+typedef struct {
+    Path_Paint paint;
+    Path_Join join;
+    float width;
+    uint8_t color[4];
+} Path_Style;
+
+// Every verb takes 0 to 3 points out of `points`, in pixels with y going down
+typedef struct {
+    Path_Style style;
+    uint8_t *verbs;
+    size_t verbs_count;
+    size_t verbs_capacity;
+    V2f *points;
+    size_t points_count;
+    size_t points_capacity;
+} Path;
+
+typedef struct {
+    V2f pos;
+    uint8_t color[4];
+} Path_Vertex;
+
+typedef struct {
+    uint64_t hash;
+    // Vertices of the path in the arena
+    size_t first;
+    size_t count;
+} Paths_Entry;
+
+typedef struct {
+    Path *paths;
+    size_t paths_count;
+    // Entry of every path, paths with the same hash share one
+    size_t *path_entries;
+    Paths_Entry *entries;
+    size_t entries_count;
+    Path_Vertex *arena;
+    size_t arena_count;
+    // Contiguous runs of the arena that draw the paths in file order
+    size_t *draw_first;
+    size_t *draw_count;
+    size_t draws_count;
+
+    GLuint program;
+    GLint resolution_uniform;
+    GLuint vao;
+    GLuint vbo;
+    size_t vbo_bytes;
+} Paths;
+
+static const char *paths_vert_source =
+    "#version 330\n"
+    "layout(location = 0) in vec2 pos;\n"
+    "layout(location = 1) in vec4 ver_color;\n"
+    "uniform vec2 resolution;\n"
+    "out vec4 color;\n"
+    "void main(void)\n"
+    "{\n"
+    "    gl_Position = vec4(pos.x/resolution.x*2.0 - 1.0, 1.0 - pos.y/resolution.y*2.0, 0.0, 1.0);\n"
+    "    color = ver_color;\n"
+    "}\n";
+
+static const char *paths_frag_source =
+    "#version 330\n"
+    "in vec4 color;\n"
+    "out vec4 out_color;\n"
+    "void main(void)\n"
+    "{\n"
+    "    out_color = color;\n"
+    "}\n";
+
+static bool path_push(Path *path, Path_Verb verb, const V2f *points, size_t points_count)
+{
+    if (path->verbs_count >= path->verbs_capacity) {
+        size_t capacity = path->verbs_capacity > 0 ? path->verbs_capacity*2 : 16;
+        uint8_t *verbs = mem_realloc(MEM_TAG_PATHS, path->verbs, capacity*sizeof(*verbs));
+        if (verbs == NULL) return false;
+        path->verbs = verbs;
+        path->verbs_capacity = capacity;
+    }
+    if (path->points_count + points_count > path->points_capacity) {
+        size_t capacity = path->points_capacity > 0 ? path->points_capacity*2 : 32;
+        V2f *new_points = mem_realloc(MEM_TAG_PATHS, path->points, capacity*sizeof(*new_points));
+        if (new_points == NULL) return false;
+        path->points = new_points;
+        path->points_capacity = capacity;
+    }
+    path->verbs[path->verbs_count++] = (uint8_t) verb;
+    memcpy(path->points + path->points_count, points, points_count*sizeof(*points));
+    path->points_count += points_count;
+    return true;
+}
+
+bool path_move_to(Path *path, V2f p)
+{
+    return path_push(path, PATH_MOVE, &p, 1);
+}
+
+bool path_line_to(Path *path, V2f p)
+{
+    return path_push(path, PATH_LINE, &p, 1);
+}
+
+bool path_quad_to(Path *path, V2f control, V2f p)
+{
+    V2f points[2] = {control, p};
+    return path_push(path, PATH_QUAD, points, 2);
+}
+
+bool path_cubic_to(Path *path, V2f control1, V2f control2, V2f p)
+{
+    V2f points[3] = {control1, control2, p};
+    return path_push(path, PATH_CUBIC, points, 3);
+}
+
+bool path_close(Path *path)
+{
+    return path_push(path, PATH_CLOSE, NULL, 0);
+}
+
+void path_free(Path *path)
+{
+    mem_free(path->verbs);
+    mem_free(path->points);
+    memset(path, 0, sizeof(*path));
+}
+
+uint64_t path_hash(const Path *path, float tolerance)
+{
+    Hash_State state;
+    hash_init(&state, 0);
+    hash_update(&state, &path->style, sizeof(path->style));
+    hash_update(&state, &tolerance, sizeof(tolerance));
+    hash_update(&state, &path->verbs_count, sizeof(path->verbs_count));
+    hash_update(&state, path->verbs, path->verbs_count*sizeof(*path->verbs));
+    hash_update(&state, path->points, path->points_count*sizeof(*path->points));
+    return hash_digest64(&state);
+}
+
+typedef struct {
+    size_t first;
+    size_t count;
+    bool closed;
+} Path_Contour;
+
+// Segment `index` of a loop, from corner `index` to the next one
+typedef struct {
+    float min_y;
+    float max_y;
+    int index;
+} Path_Segment;
+
+// Scratch of one thread of the tessellation, reused from path to path
+typedef struct {
+    V2f *points;
+    size_t points_count;
+    size_t points_capacity;
+    Path_Contour *contours;
+    size_t contours_count;
+    size_t contours_capacity;
+    int *prev;
+    int *next;
+    size_t links_capacity;
+    // Simple loops a fill contour is split into, as ranges of `loop_points`
+    V2f *loop_points;
+    size_t loop_points_count;
+    size_t loop_points_capacity;
+    Path_Contour *loops;
+    size_t loops_count;
+    size_t loops_capacity;
+    Path_Segment *segments;
+    size_t segments_capacity;
+
+    Path_Vertex *vertices;
+    size_t vertices_count;
+    size_t vertices_capacity;
+    const uint8_t *color;
+    bool failed;
+} Path_Tessellator;
+
+static void path_tessellator_free(Path_Tessellator *t)
+{
+    mem_free(t->points);
+    mem_free(t->contours);
+    mem_free(t->prev);
+    mem_free(t->next);
+    mem_free(t->loop_points);
+    mem_free(t->loops);
+    mem_free(t->segments);
+    mem_free(t->vertices);
+    memset(t, 0, sizeof(*t));
+}
+
+static void path_emit_point(Path_Tessellator *t, V2f p)
+{
+    if (t->failed) return;
+    Path_Contour *contour = &t->contours[t->contours_count - 1];
+    // Repeated points make zero length segments, which have no direction to stroke or clip along
+    if (contour->count > 0) {
+        V2f last = t->points[t->points_count - 1];
+        if (fabsf(last.x - p.x) < 1e-4f && fabsf(last.y - p.y) < 1e-4f) return;
+    }
+    if (t->points_count >= t->points_capacity) {
+        size_t capacity = t->points_capacity > 0 ? t->points_capacity*2 : 256;
+        V2f *points = mem_realloc(MEM_TAG_PATHS, t->points, capacity*sizeof(*points));
+        if (points == NULL) {
+            t->failed = true;
+            return;
+        }
+        t->points = points;
+        t->points_capacity = capacity;
+    }
+    t->points[t->points_count++] = p;
+    contour->count += 1;
+}
+
+static void path_begin_contour(Path_Tessellator *t)
+{
+    if (t->failed) return;
+    if (t->contours_count > 0 && t->contours[t->contours_count - 1].count == 0) return;
+    if (t->contours_count >= t->contours_capacity) {
+        size_t capacity = t->contours_capacity > 0 ? t->contours_capacity*2 : 16;
+        Path_Contour *contours = mem_realloc(MEM_TAG_PATHS, t->contours, capacity*sizeof(*contours));
+        if (contours == NULL) {
+            t->failed = true;
+            return;
+        }
+        t->contours = contours;
+        t->contours_capacity = capacity;
+    }
+    t->contours[t->contours_count++] = (Path_Contour) {.first = t->points_count};
+}
+
+// Wang's formula: a curve of degree d split into n equal steps of t stays
+// within `tolerance` of its chords when n >= sqrt(d(d-1)/8*M/tolerance),
+// with M the longest second difference of the control points
+static size_t path_curve_segments(float d_factor, float second_difference, float tolerance)
+{
+    float n = ceilf(sqrtf(d_factor*second_difference/tolerance));
+    if (!(n >= 1.0f)) return 1;
+    if (n > PATH_CURVE_SEGMENTS_CAP) return PATH_CURVE_SEGMENTS_CAP;
+    return (size_t) n;
+}
+
+static void path_flatten(Path_Tessellator *t, const Path *path, float tolerance)
+{
+    t->points_count = 0;
+    t->contours_count = 0;
+    V2f start = v2f(0.0f, 0.0f);
+    V2f current = start;
+    bool in_contour = false;
+    const V2f *p = path->points;
+    for (size_t i = 0; i < path->verbs_count; ++i) {
+        Path_Verb verb = path->verbs[i];
+        if (verb == PATH_MOVE) {
+            start = current = p[0];
+            path_begin_contour(t);
+            path_emit_point(t, current);
+            in_contour = true;
+            p += 1;
+            continue;
+        }
+        if (verb == PATH_CLOSE) {
+            if (in_contour && !t->failed) {
+                Path_Contour *contour = &t->contours[t->contours_count - 1];
+                contour->closed = true;
+                // The way back to the first point is implied by `closed`
+                V2f first = t->points[contour->first];
+                V2f last = t->points[t->points_count - 1];
+                if (contour->count > 1 && fabsf(last.x - first.x) < 1e-4f && fabsf(last.y - first.y) < 1e-4f) {
+                    contour->count -= 1;
+                    t->points_count -= 1;
+                }
+            }
+            // Drawing on after `Z` starts a new contour where the closed one started
+            in_contour = false;
+            current = start;
+            continue;
+        }
+        if (!in_contour) {
+            path_begin_contour(t);
+            path_emit_point(t, current);
+            in_contour = true;
+        }
+
+        switch (verb) {
+        case PATH_LINE:
+            current = p[0];
+            path_emit_point(t, current);
+            p += 1;
+            break;
+        case PATH_QUAD: {
+            V2f p0 = current, p1 = p[0], p2 = p[1];
+            float dd = v2f_len(v2f_sum(v2f_sub(p0, v2f_mul(p1, v2ff(2.0f))), p2));
+            size_t n = path_curve_segments(2.0f/8.0f, dd, tolerance);
+            for (size_t k = 1; k <= n; ++k) {
+                float s = (float) k/(float) n;
+                float r = 1.0f - s;
+                path_emit_point(t, v2f(r*r*p0.x + 2.0f*r*s*p1.x + s*s*p2.x,
+                                       r*r*p0.y + 2.0f*r*s*p1.y + s*s*p2.y));
+            }
+            current = p2;
+            p += 2;
+        } break;
+        case PATH_CUBIC: {
+            V2f p0 = current, p1 = p[0], p2 = p[1], p3 = p[2];
+            float dd0 = v2f_len(v2f_sum(v2f_sub(p0, v2f_mul(p1, v2ff(2.0f))), p2));
+            float dd1 = v2f_len(v2f_sum(v2f_sub(p1, v2f_mul(p2, v2ff(2.0f))), p3));
+            size_t n = path_curve_segments(6.0f/8.0f, dd0 > dd1 ? dd0 : dd1, tolerance);
+            for (size_t k = 1; k <= n; ++k) {
+                float s = (float) k/(float) n;
+                float r = 1.0f - s;
+                float a = r*r*r, b = 3.0f*r*r*s, c = 3.0f*r*s*s, d = s*s*s;
+                path_emit_point(t, v2f(a*p0.x + b*p1.x + c*p2.x + d*p3.x,
+                                       a*p0.y + b*p1.y + c*p2.y + d*p3.y));
+            }
+            current = p3;
+            p += 3;
+        } break;
+        default:
+            assert(0 && "unreachable");
+        }
+    }
+}
+
+static void path_emit_triangle(Path_Tessellator *t, V2f a, V2f b, V2f c)
+{
+    if (t->failed) return;
+    if (t->vertices_count + 3 > t->vertices_capacity) {
+        size_t capacity = t->vertices_capacity > 0 ? t->vertices_capacity*2 : 1024;
+        Path_Vertex *vertices = mem_realloc(MEM_TAG_PATHS, t->vertices, capacity*sizeof(*vertices));
+        if (vertices == NULL) {
+            t->failed = true;
+            return;
+        }
+        t->vertices = vertices;
+        t->vertices_capacity = capacity;
+    }
+    V2f corners[3] = {a, b, c};
+    for (size_t i = 0; i < 3; ++i) {
+        Path_Vertex *v = &t->vertices[t->vertices_count++];
+        v->pos = corners[i];
+        memcpy(v->color, t->color, sizeof(v->color));
+    }
+}
+
+static float path_cross(V2f o, V2f a, V2f b)
+{
+    return (a.x - o.x)*(b.y - o.y) - (a.y - o.y)*(b.x - o.x);
+}
+
+// Ear clipping of a simple loop. A convex corner is an ear when no reflex
+// corner of the loop lies inside its triangle. Loops that still touch or
+// intersect themselves can run out of ears, then the next corner is
+// clipped anyway so the loop ends.
+static void path_clip_ears(Path_Tessellator *t, const V2f *p, int n)
+{
+    if ((size_t) n > t->links_capacity) {
+        mem_free(t->prev);
+        mem_free(t->next);
+        t->prev = mem_alloc(MEM_TAG_PATHS, (size_t) n*sizeof(int));
+        t->next = mem_alloc(MEM_TAG_PATHS, (size_t) n*sizeof(int));
+        t->links_capacity = (size_t) n;
+        if (t->prev == NULL || t->next == NULL) {
+            t->links_capacity = 0;
+            t->failed = true;
+            return;
+        }
+    }
+
+    float area = 0.0f;
+    for (int i = 0; i < n; ++i) {
+        V2f a = p[i];
+        V2f b = p[(i + 1)%n];
+        area += a.x*b.y - b.x*a.y;
+    }
+    // Once the crossings are split off, a loop without area covers no pixels
+    if (fabsf(area) < 1e-6f) return;
+    float orientation = area > 0.0f ? 1.0f : -1.0f;
+    for (int i = 0; i < n; ++i) {
+        t->prev[i] = (i + n - 1)%n;
+        t->next[i] = (i + 1)%n;
+    }
+
+    int remaining = n;
+    int i = 0;
+    int misses = 0;
+    while (remaining > 3 && !t->failed) {
+        int a = t->prev[i];
+        int c = t->next[i];
+        bool ear = path_cross(p[a], p[i], p[c])*orientation > 0.0f;
+        for (int j = t->next[c]; ear && j != a; j = t->next[j]) {
+            if (path_cross(p[t->prev[j]], p[j], p[t->next[j]])*orientation > 0.0f) continue;
+            // Corners sitting on the triangle count as inside, so touching contours don't get bridged
+            ear = !(path_cross(p[a], p[i], p[j])*orientation >= 0.0f &&
+                    path_cross(p[i], p[c], p[j])*orientation >= 0.0f &&
+                    path_cross(p[c], p[a], p[j])*orientation >= 0.0f);
+        }
+        if (ear || misses >= remaining) {
+            path_emit_triangle(t, p[a], p[i], p[c]);
+            t->next[a] = c;
+            t->prev[c] = a;
+            remaining -= 1;
+            misses = 0;
+            i = a;
+        } else {
+            misses += 1;
+            i = c;
+        }
+    }
+    path_emit_triangle(t, p[t->prev[i]], p[i], p[t->next[i]]);
+}
+
+static bool path_loops_push(Path_Tessellator *t, Path_Contour loop)
+{
+    if (t->loops_count >= t->loops_capacity) {
+        size_t capacity = t->loops_capacity > 0 ? t->loops_capacity*2 : 16;
+        Path_Contour *loops = mem_realloc(MEM_TAG_PATHS, t->loops, capacity*sizeof(*loops));
+        if (loops == NULL) return false;
+        t->loops = loops;
+        t->loops_capacity = capacity;
+    }
+    t->loops[t->loops_count++] = loop;
+    return true;
+}
+
+// Makes room for `count` more loop points, which may move `loop_points`
+static bool path_loop_points_reserve(Path_Tessellator *t, size_t count)
+{
+    if (t->loop_points_count + count <= t->loop_points_capacity) return true;
+    size_t capacity = t->loop_points_capacity > 0 ? t->loop_points_capacity : 256;
+    while (capacity < t->loop_points_count + count) capacity *= 2;
+    V2f *points = mem_realloc(MEM_TAG_PATHS, t->loop_points, capacity*sizeof(*points));
+    if (points == NULL) return false;
+    t->loop_points = points;
+    t->loop_points_capacity = capacity;
+    return true;
+}
+
+static int path_compare_segments(const void *a, const void *b)
+{
+    float x = ((const Path_Segment*) a)->min_y;
+    float y = ((const Path_Segment*) b)->min_y;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+// Finds segments i and j > i of the loop that cross each other, not just
+// touch, and where. The segments are sorted by their top, so every one is
+// only tested against the ones that start above its bottom.
+static bool path_find_crossing(Path_Tessellator *t, const V2f *p, int n, int *i_out, int *j_out, V2f *at)
+{
+    if ((size_t) n > t->segments_capacity) {
+        mem_free(t->segments);
+        t->segments = mem_alloc(MEM_TAG_PATHS, (size_t) n*sizeof(*t->segments));
+        t->segments_capacity = (size_t) n;
+        if (t->segments == NULL) {
+            t->segments_capacity = 0;
+            t->failed = true;
+            return false;
+        }
+    }
+    Path_Segment *segments = t->segments;
+    for (int k = 0; k < n; ++k) {
+        float y0 = p[k].y;
+        float y1 = p[(k + 1)%n].y;
+        segments[k] = (Path_Segment) {fminf(y0, y1), fmaxf(y0, y1), k};
+    }
+    qsort(segments, (size_t) n, sizeof(*segments), path_compare_segments);
+
+    for (int s0 = 0; s0 < n; ++s0) {
+        for (int s1 = s0 + 1; s1 < n && segments[s1].min_y <= segments[s0].max_y; ++s1) {
+            int i = segments[s0].index;
+            int j = segments[s1].index;
+            if (i > j) {
+                int tmp = i;
+                i = j;
+                j = tmp;
+            }
+            // Neighbors share a corner, the last segment and the first one too
+            if (j == i + 1 || (i == 0 && j == n - 1)) continue;
+            V2f a = p[i];
+            V2f b = p[(i + 1)%n];
+            V2f c = p[j];
+            V2f d = p[(j + 1)%n];
+            if (fmaxf(c.x, d.x) < fminf(a.x, b.x) || fminf(c.x, d.x) > fmaxf(a.x, b.x)) continue;
+            float d1 = path_cross(a, b, c);
+            float d2 = path_cross(a, b, d);
+            if (!(d1*d2 < 0.0f)) continue;
+            if (!(path_cross(c, d, a)*path_cross(c, d, b) < 0.0f)) continue;
+            float u = d1/(d1 - d2);
+            *at = v2f(c.x + (d.x - c.x)*u, c.y + (d.y - c.y)*u);
+            *i_out = i;
+            *j_out = j;
+            return true;
+        }
+    }
+    return false;
+}
+
+// A self-intersecting contour is cut at its crossings into simple loops,
+// the lobes of a figure eight or the points of a pentagram, and every loop
+// is clipped with its own orientation. Loops that overlap are all filled,
+// like separate contours are.
+static void path_fill_contour(Path_Tessellator *t, const Path_Contour *contour)
+{
+    if (contour->count < 3) return;
+    t->loop_points_count = 0;
+    t->loops_count = 0;
+    if (!path_loop_points_reserve(t, contour->count) ||
+            !path_loops_push(t, (Path_Contour) {.first = 0, .count = contour->count})) {
+        t->failed = true;
+        return;
+    }
+    memcpy(t->loop_points, t->points + contour->first, contour->count*sizeof(V2f));
+    t->loop_points_count = contour->count;
+
+    size_t loops_split = 0;
+    while (t->loops_count > 0 && !t->failed) {
+        Path_Contour loop = t->loops[--t->loops_count];
+        int n = (int) loop.count;
+        int i, j;
+        V2f at;
+        if (loops_split >= PATH_FILL_SPLITS_CAP ||
+                !path_find_crossing(t, t->loop_points + loop.first, n, &i, &j, &at)) {
+            path_clip_ears(t, t->loop_points + loop.first, n);
+            continue;
+        }
+
+        // The crossing and the corners on either side of it, i+1..j and j+1..i
+        size_t inner = (size_t) (j - i);
+        size_t outer = (size_t) n - inner;
+        if (!path_loop_points_reserve(t, inner + outer + 2)) {
+            t->failed = true;
+            return;
+        }
+        const V2f *p = t->loop_points + loop.first;
+        V2f *q = t->loop_points + t->loop_points_count;
+        q[0] = at;
+        memcpy(q + 1, p + i + 1, inner*sizeof(V2f));
+        q[inner + 1] = at;
+        for (size_t k = 0; k < outer; ++k) q[inner + 2 + k] = p[((size_t) j + 1 + k)%(size_t) n];
+        Path_Contour a = {.first = t->loop_points_count, .count = inner + 1};
+        Path_Contour b = {.first = t->loop_points_count + inner + 1, .count = outer + 1};
+        t->loop_points_count += inner + outer + 2;
+        if (!path_loops_push(t, a) || !path_loops_push(t, b)) {
+            t->failed = true;
+            return;
+        }
+        loops_split += 1;
+    }
+}
+
+static V2f path_normal(V2f a, V2f b, float half_width)
+{
+    V2f d = v2f_sub(b, a);
+    float len = v2f_len(d);
+    return v2f(-d.y/len*half_width, d.x/len*half_width);
+}
+
+// Fills the wedge between the two segments at `v` on the outer side of the turn
+static void path_join(Path_Tessellator *t, const Path_Style *style, float tolerance, V2f a, V2f v, V2f b)
+{
+    float half = style->width*0.5f;
+    V2f n0 = path_normal(a, v, half);
+    V2f n1 = path_normal(v, b, half);
+    float cross = n0.x*n1.y - n0.y*n1.x;
+    float dot = n0.x*n1.x + n0.y*n1.y;
+    if (fabsf(cross) < 1e-6f*half*half && dot > 0.0f) return;
+    // The outer side is the one the normals turn away from
+    float side = cross > 0.0f ? -1.0f : 1.0f;
+    V2f p0 = v2f_sum(v, v2f_mul(n0, v2ff(side)));
+    V2f p1 = v2f_sum(v, v2f_mul(n1, v2ff(side)));
+
+    switch (style->join) {
+    case PATH_JOIN_MITER: {
+        V2f m = v2f_sum(n0, n1);
+        float m_len = v2f_len(m);
+        if (m_len > 1e-6f) {
+            // The tip is where the outer edges meet, half/cos(angle/2) away from the corner
+            float cos_half = (m.x*n0.x + m.y*n0.y)/(m_len*half);
+            float length = half/cos_half;
+            if (length <= PATH_MITER_LIMIT*style->width*0.5f) {
+                V2f tip = v2f_sum(v, v2f_mul(m, v2ff(side*length/m_len)));
+                path_emit_triangle(t, v, p0, tip);
+                path_emit_triangle(t, v, tip, p1);
+                return;
+            }
+        }
+        path_emit_triangle(t, v, p0, p1);
+    } break;
+    case PATH_JOIN_ROUND: {
+        V2f r0 = v2f_sub(p0, v);
+        V2f r1 = v2f_sub(p1, v);
+        float sweep = atan2f(r0.x*r1.y - r0.y*r1.x, r0.x*r1.x + r0.y*r1.y);
+        // Every step of the arc stays within `tolerance` of the circle
+        float step = half > tolerance ? 2.0f*acosf(1.0f - tolerance/half) : 3.14159265f;
+        size_t n = (size_t) ceilf(fabsf(sweep)/step);
+        if (n < 1) n = 1;
+        if (n > PATH_ROUND_SEGMENTS_CAP) n = PATH_ROUND_SEGMENTS_CAP;
+        float angle = sweep/(float) n;
+        float c = cosf(angle), s = sinf(angle);
+        V2f prev = p0;
+        for (size_t k = 1; k <= n; ++k) {
+            V2f next = k == n ? p1 : v2f_sum(v, v2f(r0.x*c - r0.y*s, r0.x*s + r0.y*c));
+            path_emit_triangle(t, v, prev, next);
+            r0 = v2f_sub(next, v);
+            prev = next;
+        }
+    } break;
+    case PATH_JOIN_BEVEL:
+        path_emit_triangle(t, v, p0, p1);
+        break;
+    default:
+        assert(0 && "unreachable");
+    }
+}
+
+static void path_stroke_contour(Path_Tessellator *t, const Path_Style *style, float tolerance,
+                                const Path_Contour *contour)
+{
+    const V2f *p = t->points + contour->first;
+    size_t n = contour->count;
+    if (n < 2) return;
+    size_t segments = contour->closed && n > 2 ? n : n - 1;
+    float half = style->width*0.5f;
+    for (size_t i = 0; i < segments; ++i) {
+        V2f a = p[i];
+        V2f b = p[(i + 1)%n];
+        V2f normal = path_normal(a, b, half);
+        V2f a0 = v2f_sum(a, normal), a1 = v2f_sub(a, normal);
+        V2f b0 = v2f_sum(b, normal), b1 = v2f_sub(b, normal);
+        path_emit_triangle(t, a0, b0, a1);
+        path_emit_triangle(t, b0, b1, a1);
+    }
+    size_t first_join = contour->closed && n > 2 ? 0 : 1;
+    size_t last_join = contour->closed && n > 2 ? n : n - 1;
+    for (size_t i = first_join; i < last_join; ++i) {
+        path_join(t, style, tolerance, p[(i + n - 1)%n], p[i], p[(i + 1)%n]);
+    }
+}
+
+// Leaves the triangles of `path` in `t->vertices`
+static bool path_tessellate(Path_Tessellator *t, const Path *path, float tolerance)
+{
+    t->vertices_count = 0;
+    t->failed = false;
+    t->color = path->style.color;
+    path_flatten(t, path, tolerance);
+    for (size_t i = 0; i < t->contours_count && !t->failed; ++i) {
+        if (path->style.paint == PATH_FILL) {
+            path_fill_contour(t, &t->contours[i]);
+        } else {
+            path_stroke_contour(t, &path->style, tolerance, &t->contours[i]);
+        }
+    }
+    return !t->failed;
+}
+
+typedef struct {
+    const Path *path;
+    Path_Vertex *vertices;
+    size_t vertices_count;
+    bool failed;
+} Paths_Job;
+
+typedef struct {
+    Paths_Job *jobs;
+    float tolerance;
+} Paths_Build;
+
+static void paths_tessellate_range(void *arg, size_t begin, size_t end)
+{
+    Paths_Build *build = arg;
+    Path_Tessellator t = {0};
+    for (size_t i = begin; i < end; ++i) {
+        Paths_Job *job = &build->jobs[i];
+        if (!path_tessellate(&t, job->path, build->tolerance)) {
+            job->failed = true;
+            continue;
+        }
+        job->vertices_count = t.vertices_count;
+        job->vertices = mem_alloc(MEM_TAG_PATHS, t.vertices_count*sizeof(Path_Vertex));
+        if (job->vertices == NULL) {
+            job->failed = true;
+            continue;
+        }
+        memcpy(job->vertices, t.vertices, t.vertices_count*sizeof(Path_Vertex));
+    }
+    path_tessellator_free(&t);
+}
+
+static bool paths_parse_number(char **cursor, float *x)
+{
+    char *end = NULL;
+    *x = strtof(*cursor, &end);
+    if (end == *cursor) return false;
+    *cursor = end;
+    return true;
+}
+
+static bool paths_parse_numbers(char **cursor, float *xs, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        if (!paths_parse_number(cursor, &xs[i])) return false;
+    }
+    return true;
+}
+
+static bool paths_parse_color(char **cursor, uint8_t color[4])
+{
+    float rgba[4];
+    if (!paths_parse_numbers(cursor, rgba, 4)) return false;
+    for (size_t i = 0; i < 4; ++i) {
+        float c = rgba[i] < 0.0f ? 0.0f : rgba[i] > 1.0f ? 1.0f : rgba[i];
+        color[i] = (uint8_t) (c*255.0f + 0.5f);
+    }
+    return true;
+}
+
+// The next word of the line, NUL terminated in place
+static String_View paths_parse_word(char **cursor)
+{
+    char *start = *cursor;
+    while (*start == ' ' || *start == '\t' || *start == '\r') start += 1;
+    char *end = start;
+    while (*end != '\0' && *end != ' ' && *end != '\t' && *end != '\r') end += 1;
+    *cursor = end;
+    return (String_View) {.count = (size_t) (end - start), .data = start};
+}
+
+static bool paths_parse(Paths *paths, const char *file_path, char *content)
+{
+    size_t paths_capacity = 0;
+    bool has_point = false;
+    char *next_line = content;
+    for (int row = 0; next_line != NULL; row++) {
+        char *line = next_line;
+        next_line = strchr(line, '\n');
+        if (next_line != NULL) *next_line++ = '\0';
+
+        char *cursor = line;
+        for (;;) {
+            String_View word = paths_parse_word(&cursor);
+            if (word.count == 0 || word.data[0] == '#') break;
+            long column = word.data - line;
+
+            if (sv_eq(word, SV("fill")) || sv_eq(word, SV("stroke"))) {
+                if (paths->paths_count >= PATHS_CAP) {
+                    fprintf(stderr, "%s:%d:%ld: ERROR: too many paths, only %d are supported\n",
+                            file_path, row, column, PATHS_CAP);
+                    return false;
+                }
+                if (paths->paths_count >= paths_capacity) {
+                    size_t capacity = paths_capacity > 0 ? paths_capacity*2 : 64;
+                    Path *new_paths = mem_realloc(MEM_TAG_PATHS, paths->paths, capacity*sizeof(*new_paths));
+                    if (new_paths == NULL) return false;
+                    paths->paths = new_paths;
+                    paths_capacity = capacity;
+                }
+                Path *path = &paths->paths[paths->paths_count++];
+                memset(path, 0, sizeof(*path));
+                has_point = false;
+                bool stroke = sv_eq(word, SV("stroke"));
+                path->style.paint = stroke ? PATH_STROKE : PATH_FILL;
+                if (stroke && (!paths_parse_number(&cursor, &path->style.width) || path->style.width <= 0.0f)) {
+                    fprintf(stderr, "%s:%d:%ld: ERROR: `stroke` needs a width followed by a color\n",
+                            file_path, row, column);
+                    return false;
+                }
+                if (!paths_parse_color(&cursor, path->style.color)) {
+                    fprintf(stderr, "%s:%d:%ld: ERROR: `"SV_Fmt"` needs a color of 4 numbers from 0 to 1\n",
+                            file_path, row, column, SV_Arg(word));
+                    return false;
+                }
+                if (stroke) {
+                    char *join_start = cursor;
+                    String_View join = paths_parse_word(&cursor);
+                    path->style.join = PATH_JOIN_MITER;
+                    if (join.count > 0 && join.data[0] != '#') {
+                        bool found = false;
+                        for (Path_Join j = 0; j < COUNT_PATH_JOINS; ++j) {
+                            if (sv_eq(join, sv_from_cstr(path_join_names[j]))) {
+                                path->style.join = j;
+                                found = true;
+                            }
+                        }
+                        if (!found) {
+                            fprintf(stderr, "%s:%d:%ld: ERROR: unknown join `"SV_Fmt"`, expected miter, round or bevel\n",
+                                    file_path, row, join.data - line, SV_Arg(join));
+                            return false;
+                        }
+                    } else {
+                        cursor = join_start;
+                    }
+                }
+                continue;
+            }
+
+            if (word.count != 1 || strchr("MLQCZ", word.data[0]) == NULL) {
+                fprintf(stderr, "%s:%d:%ld: ERROR: unknown command `"SV_Fmt"`, expected fill, stroke, M, L, Q, C or Z\n",
+                        file_path, row, column, SV_Arg(word));
+                return false;
+            }
+            if (paths->paths_count == 0) {
+                fprintf(stderr, "%s:%d:%ld: ERROR: `"SV_Fmt"` before the first `fill` or `stroke`\n",
+                        file_path, row, column, SV_Arg(word));
+                return false;
+            }
+            Path *path = &paths->paths[paths->paths_count - 1];
+            if (word.data[0] != 'M' && !has_point) {
+                fprintf(stderr, "%s:%d:%ld: ERROR: `"SV_Fmt"` needs a current point, start the path with `M`\n",
+                        file_path, row, column, SV_Arg(word));
+                return false;
+            }
+
+            float xs[6];
+            size_t count = word.data[0] == 'Q' ? 4 : word.data[0] == 'C' ? 6 : word.data[0] == 'Z' ? 0 : 2;
+            if (!paths_parse_numbers(&cursor, xs, count)) {
+                fprintf(stderr, "%s:%d:%ld: ERROR: `"SV_Fmt"` needs %zu coordinates\n",
+                        file_path, row, column, SV_Arg(word), count);
+                return false;
+            }
+            bool ok = true;
+            switch (word.data[0]) {
+            case 'M': ok = path_move_to(path, v2f(xs[0], xs[1])); break;
+            case 'L': ok = path_line_to(path, v2f(xs[0], xs[1])); break;
+            case 'Q': ok = path_quad_to(path, v2f(xs[0], xs[1]), v2f(xs[2], xs[3])); break;
+            case 'C': ok = path_cubic_to(path, v2f(xs[0], xs[1]), v2f(xs[2], xs[3]), v2f(xs[4], xs[5])); break;
+            case 'Z': ok = path_close(path); break;
+            default: assert(0 && "unreachable");
+            }
+            if (!ok) return false;
+            has_point = true;
+        }
+    }
+    return true;
+}
+
+static void paths_free_file(Paths *paths)
+{
+    for (size_t i = 0; i < paths->paths_count; ++i) path_free(&paths->paths[i]);
+    mem_free(paths->paths);
+    mem_free(paths->path_entries);
+    mem_free(paths->draw_first);
+    mem_free(paths->draw_count);
+    paths->paths = NULL;
+    paths->paths_count = 0;
+    paths->path_entries = NULL;
+    paths->draw_first = NULL;
+    paths->draw_count = NULL;
+    paths->draws_count = 0;
+}
+
+void paths_unload(Paths *paths)
+{
+    paths_free_file(paths);
+    mem_free(paths->entries);
+    mem_free(paths->arena);
+    paths->entries = NULL;
+    paths->entries_count = 0;
+    paths->arena = NULL;
+    paths->arena_count = 0;
+    if (paths->vbo_bytes > 0) {
+        mem_track(MEM_TAG_GL_BUFFERS, -(ptrdiff_t) paths->vbo_bytes);
+        paths->vbo_bytes = 0;
+    }
+}
+
+static bool paths_create_gl_objects(Paths *paths)
+{
+    if (!create_program(paths_vert_source, paths_frag_source, &paths->program)) return false;
+    paths->resolution_uniform = glGetUniformLocation(paths->program, "resolution");
+
+    GLint vao = 0;
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &vao);
+    glGenVertexArrays(1, &paths->vao);
+    glBindVertexArray(paths->vao);
+    glGenBuffers(1, &paths->vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, paths->vbo);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Path_Vertex), (void*) offsetof(Path_Vertex, pos));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Path_Vertex), (void*) offsetof(Path_Vertex, color));
+    glBindVertexArray((GLuint) vao);
+    return true;
+}
+
+static int paths_compare_entries(const void *a, const void *b)
+{
+    uint64_t x = ((const Paths_Entry*) a)->hash;
+    uint64_t y = ((const Paths_Entry*) b)->hash;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+// Entries of the previous load are sorted by hash for the lookups
+static const Paths_Entry *paths_find_entry(const Paths_Entry *entries, size_t count, uint64_t hash)
+{
+    Paths_Entry key = {.hash = hash};
+    return bsearch(&key, entries, count, sizeof(*entries), paths_compare_entries);
+}
+
+// `file_path` may be NULL, which just unloads the paths. The tessellation of
+// the paths of the previous load is kept as long as the new file has them.
+bool paths_load(Paths *paths, Job_Pool *pool, const char *file_path, float tolerance)
+{
+    paths_free_file(paths);
+    Paths_Entry *old_entries = paths->entries;
+    size_t old_entries_count = paths->entries_count;
+    Path_Vertex *old_arena = paths->arena;
+    paths->entries = NULL;
+    paths->entries_count = 0;
+    paths->arena = NULL;
+    paths->arena_count = 0;
+    if (file_path == NULL) {
+        mem_free(old_entries);
+        mem_free(old_arena);
+        paths_unload(paths);
+        return true;
+    }
+    if (!(tolerance > 0.0f)) {
+        fprintf(stderr, "ERROR: invalid path tolerance %f\n", tolerance);
+        mem_free(old_entries);
+        mem_free(old_arena);
+        paths_unload(paths);
+        return false;
+    }
+    if (paths->program == 0 && !paths_create_gl_objects(paths)) {
+        fprintf(stderr, "ERROR: could not compile the path shaders\n");
+        mem_free(old_entries);
+        mem_free(old_arena);
+        return false;
+    }
+
+    double start = glfwGetTime();
+    char *content = slurp_asset_into_malloced_cstr(file_path, MEM_TAG_PATHS);
+    if (content == NULL) {
+        fprintf(stderr, "ERROR: could not load %s: %s\n", file_path, strerror(errno));
+        mem_free(old_entries);
+        mem_free(old_arena);
+        paths_unload(paths);
+        return false;
+    }
+    bool ok = paths_parse(paths, file_path, content);
+    mem_free(content);
+
+    size_t count = paths->paths_count;
+    uint64_t *hashes = NULL;
+    size_t *slots = NULL;
+    size_t slots_mask = 0;
+    Paths_Job *jobs = NULL;
+    size_t jobs_count = 0;
+    if (ok && count > 0) {
+        size_t slots_count = 1;
+        while (slots_count < 2*count) slots_count *= 2;
+        slots_mask = slots_count - 1;
+        hashes = mem_alloc(MEM_TAG_PATHS, count*sizeof(*hashes));
+        slots = mem_alloc(MEM_TAG_PATHS, slots_count*sizeof(*slots));
+        paths->path_entries = mem_alloc(MEM_TAG_PATHS, count*sizeof(*paths->path_entries));
+        paths->entries = mem_alloc(MEM_TAG_PATHS, count*sizeof(*paths->entries));
+        jobs = mem_alloc(MEM_TAG_PATHS, count*sizeof(*jobs));
+        ok = hashes != NULL && slots != NULL && paths->path_entries != NULL && paths->entries != NULL && jobs != NULL;
+        if (ok) memset(slots, 0xFF, slots_count*sizeof(*slots));
+    }
+
+    // Every distinct hash gets an entry, the ones the previous load doesn't have get a job
+    size_t cached = 0;
+    if (ok && count > 0) {
+        if (old_entries_count > 0) qsort(old_entries, old_entries_count, sizeof(*old_entries), paths_compare_entries);
+        for (size_t i = 0; i < count; ++i) {
+            hashes[i] = path_hash(&paths->paths[i], tolerance);
+            size_t slot = (size_t) hashes[i] & slots_mask;
+            while (slots[slot] != SIZE_MAX && paths->entries[slots[slot]].hash != hashes[i]) {
+                slot = (slot + 1) & slots_mask;
+            }
+            if (slots[slot] == SIZE_MAX) {
+                slots[slot] = paths->entries_count;
+                Paths_Entry *entry = &paths->entries[paths->entries_count++];
+                entry->hash = hashes[i];
+                const Paths_Entry *old = paths_find_entry(old_entries, old_entries_count, hashes[i]);
+                if (old != NULL) {
+                    // Points at the old arena until the new one is put together
+                    entry->first = old->first;
+                    entry->count = old->count;
+                    cached += 1;
+                } else {
+                    entry->first = SIZE_MAX;
+                    entry->count = jobs_count;
+                    jobs[jobs_count++] = (Paths_Job) {.path = &paths->paths[i]};
+                }
+            }
+            paths->path_entries[i] = slots[slot];
+        }
+
+        Paths_Build build = {.jobs = jobs, .tolerance = tolerance};
+        job_pool_parallel_for(pool, jobs_count, 1, paths_tessellate_range, &build);
+        for (size_t i = 0; i < jobs_count; ++i) {
+            if (jobs[i].failed) ok = false;
+        }
+    }
+
+    // The new arena is put together in the order of the entries, which is the order the paths first appear in
+    if (ok && count > 0) {
+        size_t arena_count = 0;
+        for (size_t e = 0; e < paths->entries_count; ++e) {
+            const Paths_Entry *entry = &paths->entries[e];
+            arena_count += entry->first == SIZE_MAX ? jobs[entry->count].vertices_count : entry->count;
+        }
+        paths->arena = mem_alloc(MEM_TAG_PATHS, arena_count*sizeof(Path_Vertex));
+        paths->draw_first = mem_alloc(MEM_TAG_PATHS, count*sizeof(*paths->draw_first));
+        paths->draw_count = mem_alloc(MEM_TAG_PATHS, count*sizeof(*paths->draw_count));
+        ok = paths->arena != NULL && paths->draw_first != NULL && paths->draw_count != NULL;
+        for (size_t e = 0; ok && e < paths->entries_count; ++e) {
+            Paths_Entry *entry = &paths->entries[e];
+            if (entry->first == SIZE_MAX) {
+                const Paths_Job *job = &jobs[entry->count];
+                memcpy(paths->arena + paths->arena_count, job->vertices, job->vertices_count*sizeof(Path_Vertex));
+                entry->count = job->vertices_count;
+            } else {
+                memcpy(paths->arena + paths->arena_count, old_arena + entry->first, entry->count*sizeof(Path_Vertex));
+            }
+            entry->first = paths->arena_count;
+            paths->arena_count += entry->count;
+        }
+
+        // Paths drawn back to back from consecutive parts of the arena go in one draw
+        for (size_t i = 0; ok && i < count; ++i) {
+            const Paths_Entry *entry = &paths->entries[paths->path_entries[i]];
+            if (entry->count == 0) continue;
+            size_t d = paths->draws_count;
+            if (d > 0 && paths->draw_first[d - 1] + paths->draw_count[d - 1] == entry->first) {
+                paths->draw_count[d - 1] += entry->count;
+            } else {
+                paths->draw_first[d] = entry->first;
+                paths->draw_count[d] = entry->count;
+                paths->draws_count += 1;
+            }
+        }
+    }
+
+    for (size_t i = 0; jobs != NULL && i < jobs_count; ++i) mem_free(jobs[i].vertices);
+    mem_free(jobs);
+    mem_free(hashes);
+    mem_free(slots);
+    mem_free(old_entries);
+    mem_free(old_arena);
+    if (!ok) {
+        fprintf(stderr, "ERROR: could not load the paths of %s\n", file_path);
+        paths_unload(paths);
+        return false;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, paths->vbo);
+    glBufferData(GL_ARRAY_BUFFER, paths->arena_count*sizeof(Path_Vertex), paths->arena, GL_STATIC_DRAW);
+    if (paths->vbo_bytes > 0) mem_track(MEM_TAG_GL_BUFFERS, -(ptrdiff_t) paths->vbo_bytes);
+    paths->vbo_bytes = paths->arena_count*sizeof(Path_Vertex);
+    mem_track(MEM_TAG_GL_BUFFERS, (ptrdiff_t) paths->vbo_bytes);
+
+    printf("Paths: %s, %zu paths, %zu tessellated and %zu cached, %zu triangles in %zu draws, %.1f ms\n",
+           file_path, count, jobs_count, cached, paths->arena_count/3, paths->draws_count,
+           (glfwGetTime() - start)*1000.0);
+    return true;
+}
+
+// Draws the paths over whatever is in the `width` x `height` framebuffer
+void paths_render(Paths *paths, int width, int height)
+{
+    if (paths->draws_count == 0 || width <= 0 || height <= 0) return;
+
+    GLint vao = 0;
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &vao);
+    glUseProgram(paths->program);
+    glUniform2f(paths->resolution_uniform, (GLfloat) width, (GLfloat) height);
+    glBindVertexArray(paths->vao);
+    for (size_t i = 0; i < paths->draws_count; ++i) {
+        glDrawArrays(GL_TRIANGLES, (GLint) paths->draw_first[i], (GLsizei) paths->draw_count[i]);
+    }
+    glBindVertexArray((GLuint) vao);
+}
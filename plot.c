@@ -0,0 +1,502 @@
+// Plotting of large data series. render.conf can name a binary file of
+// little-endian float32 (x, y) pairs with non-decreasing x, like telemetry
+// dumps:
+//
+//   plot = samples.bin
+//   plot_style = lines
+//
+// The file is mapped and never copied as a whole. On load a min/max pyramid
+// is built over it: blocks of PLOT_BLOCK_SIZE points on the first level and
+// PLOT_FANOUT blocks of the level below on every next one. Every frame the
+// visible x range is split into pixel columns and the min and max y of every
+// column is found with a few blocks of the pyramid plus at most two partial
+// blocks of raw points, so the cost depends on the width of the window and
+// not on the number of points. When there are fewer visible points than
+// pixel columns they are drawn as they are, streamed from the mapping into
+// the vertex buffer in chunks of PLOT_CHUNK_POINTS.
+//
+// The y range follows the visible data. Mouse wheel zooms around the cursor,
+// dragging with the left button pans and HOME shows everything again.
+
+#define PLOT_BLOCK_SIZE 64
+#define PLOT_FANOUT 8
+#define PLOT_MAX_LEVELS 16
+#define PLOT_CHUNK_POINTS (64*1024)
+#define PLOT_MARGIN 0.05
+
+typedef enum {
+    PLOT_LINES = 0,
+    PLOT_POINTS,
+    COUNT_PLOT_STYLES,
+} Plot_Style;
+
+static const char *plot_style_names[COUNT_PLOT_STYLES] = {
+    [PLOT_LINES]  = "lines",
+    [PLOT_POINTS] = "points",
+};
+
+typedef struct {
+    float y_min;
+    float y_max;
+} Plot_Block;
+
+typedef struct {
+    Mapped_File file;
+    bool mapped;
+    // Interleaved x and y
+    const float *points;
+    size_t points_count;
+    Plot_Block *levels[PLOT_MAX_LEVELS];
+    size_t levels_counts[PLOT_MAX_LEVELS];
+    size_t levels_count;
+    bool unsorted;
+    Plot_Style style;
+
+    // Visible x range, y follows the data
+    double view_x0;
+    double view_x1;
+    double view_y0;
+    double view_y1;
+
+    // Vertices of the last view, rebuilt when the view or the size changes
+    bool has_vertices;
+    double vertices_x0;
+    double vertices_x1;
+    int vertices_width;
+    float *vertices;
+    size_t vertices_count;
+    size_t vertices_capacity;
+    // Raw points of the last view are streamed instead of copied to `vertices`
+    bool raw;
+    size_t raw_begin;
+    size_t raw_end;
+
+    GLuint program;
+    GLint transform_uniform;
+    GLuint vao;
+    GLuint vbo;
+} Plot;
+
+static const char *plot_vert_source =
+    "#version 330\n"
+    "layout(location = 0) in vec2 pos;\n"
+    "// xy is the origin of the view, zw is 2/size\n"
+    "uniform vec4 transform;\n"
+    "void main(void)\n"
+    "{\n"
+    "    gl_Position = vec4((pos - transform.xy)*transform.zw - 1.0, 0.0, 1.0);\n"
+    "}\n";
+
+static const char *plot_frag_source =
+    "#version 330\n"
+    "out vec4 out_color;\n"
+    "void main(void)\n"
+    "{\n"
+    "    out_color = vec4(0.3, 0.8, 1.0, 1.0);\n"
+    "}\n";
+
+static inline float plot_x(const Plot *plot, size_t i)
+{
+    return plot->points[2*i];
+}
+
+// Min and max y of the raw points [begin, end), also checks that x doesn't go down
+static Plot_Block plot_scan_points(const float *points, size_t begin, size_t end, bool *unsorted)
+{
+    Plot_Block block = {INFINITY, -INFINITY};
+    size_t i = begin;
+#ifdef LA_SSE2
+    // Two points per register: x0 y0 x1 y1
+    __m128 lo = _mm_set1_ps(INFINITY);
+    __m128 hi = _mm_set1_ps(-INFINITY);
+    __m128 down = _mm_setzero_ps();
+    for (; i + 3 <= end; i += 2) {
+        __m128 p = _mm_loadu_ps(points + 2*i);
+        __m128 next = _mm_loadu_ps(points + 2*i + 2);
+        lo = _mm_min_ps(lo, p);
+        hi = _mm_max_ps(hi, p);
+        down = _mm_or_ps(down, _mm_cmplt_ps(next, p));
+    }
+    // Only the y lanes of the extremes and the x lanes of the order matter
+    lo = _mm_min_ps(lo, _mm_shuffle_ps(lo, lo, _MM_SHUFFLE(1, 0, 3, 2)));
+    hi = _mm_max_ps(hi, _mm_shuffle_ps(hi, hi, _MM_SHUFFLE(1, 0, 3, 2)));
+    float lo_lanes[4], hi_lanes[4], down_lanes[4];
+    _mm_storeu_ps(lo_lanes, lo);
+    _mm_storeu_ps(hi_lanes, hi);
+    _mm_storeu_ps(down_lanes, down);
+    block.y_min = lo_lanes[1];
+    block.y_max = hi_lanes[1];
+    if (unsorted != NULL && (down_lanes[0] != 0.0f || down_lanes[2] != 0.0f)) *unsorted = true;
+#endif // LA_SSE2
+    for (; i < end; ++i) {
+        float y = points[2*i + 1];
+        if (y < block.y_min) block.y_min = y;
+        if (y > block.y_max) block.y_max = y;
+        if (unsorted != NULL && i + 1 < end && points[2*i + 2] < points[2*i]) *unsorted = true;
+    }
+    return block;
+}
+
+static Plot_Block plot_merge(Plot_Block a, Plot_Block b)
+{
+    return (Plot_Block) {
+        a.y_min < b.y_min ? a.y_min : b.y_min,
+        a.y_max > b.y_max ? a.y_max : b.y_max,
+    };
+}
+
+static Plot_Block plot_scan_blocks(const Plot_Block *blocks, size_t begin, size_t end)
+{
+    Plot_Block result = {INFINITY, -INFINITY};
+    for (size_t i = begin; i < end; ++i) result = plot_merge(result, blocks[i]);
+    return result;
+}
+
+typedef struct {
+    Plot *plot;
+    // Set by any batch, never cleared
+    Jobs_Mutex mutex;
+    bool unsorted;
+} Plot_Build;
+
+static void plot_build_first_level(void *arg, size_t begin, size_t end)
+{
+    Plot_Build *build = arg;
+    Plot *plot = build->plot;
+    bool unsorted = false;
+    for (size_t i = begin; i < end; ++i) {
+        size_t first = i*PLOT_BLOCK_SIZE;
+        size_t last = first + PLOT_BLOCK_SIZE;
+        if (last > plot->points_count) last = plot->points_count;
+        plot->levels[0][i] = plot_scan_points(plot->points, first, last, &unsorted);
+        // The order between this block and the next one
+        if (last < plot->points_count && plot_x(plot, last) < plot_x(plot, last - 1)) unsorted = true;
+    }
+    if (unsorted) {
+        jobs_mutex_lock(&build->mutex);
+        build->unsorted = true;
+        jobs_mutex_unlock(&build->mutex);
+    }
+}
+
+static void plot_free_levels(Plot *plot)
+{
+    for (size_t i = 0; i < plot->levels_count; ++i) {
+        mem_free(plot->levels[i]);
+        plot->levels[i] = NULL;
+    }
+    plot->levels_count = 0;
+}
+
+static bool plot_build_levels(Plot *plot, Job_Pool *pool)
+{
+    size_t count = (plot->points_count + PLOT_BLOCK_SIZE - 1)/PLOT_BLOCK_SIZE;
+    while (count > 0 && plot->levels_count < PLOT_MAX_LEVELS) {
+        Plot_Block *blocks = mem_alloc(MEM_TAG_PLOT, count*sizeof(*blocks));
+        if (blocks == NULL) return false;
+        size_t level = plot->levels_count++;
+        plot->levels[level] = blocks;
+        plot->levels_counts[level] = count;
+
+        if (level == 0) {
+            Plot_Build build = {.plot = plot};
+            jobs_mutex_init(&build.mutex);
+            job_pool_parallel_for(pool, count, 1024, plot_build_first_level, &build);
+            jobs_mutex_destroy(&build.mutex);
+            if (build.unsorted) {
+                plot->unsorted = true;
+                return false;
+            }
+        } else {
+            const Plot_Block *below = plot->levels[level - 1];
+            size_t below_count = plot->levels_counts[level - 1];
+            for (size_t i = 0; i < count; ++i) {
+                size_t end = (i + 1)*PLOT_FANOUT;
+                blocks[i] = plot_scan_blocks(below, i*PLOT_FANOUT, end < below_count ? end : below_count);
+            }
+        }
+
+        if (count == 1) break;
+        count = (count + PLOT_FANOUT - 1)/PLOT_FANOUT;
+    }
+    return true;
+}
+
+// Min and max y of the points [begin, end). The ends that don't cover a whole
+// block are scanned point by point, everything in between takes the biggest
+// blocks that fit.
+static Plot_Block plot_range(const Plot *plot, size_t begin, size_t end)
+{
+    Plot_Block result = {INFINITY, -INFINITY};
+    if (begin >= end) return result;
+
+    size_t head = (begin + PLOT_BLOCK_SIZE - 1)/PLOT_BLOCK_SIZE*PLOT_BLOCK_SIZE;
+    size_t tail = end/PLOT_BLOCK_SIZE*PLOT_BLOCK_SIZE;
+    if (head >= tail) return plot_scan_points(plot->points, begin, end, NULL);
+
+    result = plot_merge(plot_scan_points(plot->points, begin, head, NULL),
+                        plot_scan_points(plot->points, tail, end, NULL));
+
+    size_t lo = head/PLOT_BLOCK_SIZE;
+    size_t hi = tail/PLOT_BLOCK_SIZE;
+    for (size_t level = 0; lo < hi; ++level) {
+        const Plot_Block *blocks = plot->levels[level];
+        if (level + 1 >= plot->levels_count) {
+            result = plot_merge(result, plot_scan_blocks(blocks, lo, hi));
+            break;
+        }
+        size_t up_lo = (lo + PLOT_FANOUT - 1)/PLOT_FANOUT;
+        size_t up_hi = hi/PLOT_FANOUT;
+        if (up_lo >= up_hi) {
+            result = plot_merge(result, plot_scan_blocks(blocks, lo, hi));
+            break;
+        }
+        result = plot_merge(result, plot_scan_blocks(blocks, lo, up_lo*PLOT_FANOUT));
+        result = plot_merge(result, plot_scan_blocks(blocks, up_hi*PLOT_FANOUT, hi));
+        lo = up_lo;
+        hi = up_hi;
+    }
+    return result;
+}
+
+// Index of the first point with x >= `x`
+static size_t plot_lower_bound(const Plot *plot, double x)
+{
+    size_t lo = 0;
+    size_t hi = plot->points_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo)/2;
+        if ((double) plot_x(plot, mid) < x) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+void plot_reset_view(Plot *plot)
+{
+    if (plot->points_count == 0) return;
+    plot->view_x0 = plot_x(plot, 0);
+    plot->view_x1 = plot_x(plot, plot->points_count - 1);
+    if (plot->view_x1 <= plot->view_x0) plot->view_x1 = plot->view_x0 + 1.0;
+    plot->has_vertices = false;
+}
+
+// Scales the visible x range by `factor` around `anchor`, which is a position
+// on the screen from 0 on the left to 1 on the right
+void plot_zoom(Plot *plot, double factor, double anchor)
+{
+    if (plot->points_count == 0) return;
+    double width = plot->view_x1 - plot->view_x0;
+    double x = plot->view_x0 + anchor*width;
+    double new_width = width*factor;
+    // Beyond that float x can't tell the points apart anyway
+    double min_width = fabs(x)*1e-6 + 1e-30;
+    if (new_width < min_width) new_width = min_width;
+    plot->view_x0 = x - anchor*new_width;
+    plot->view_x1 = plot->view_x0 + new_width;
+}
+
+// Moves the visible x range by `amount` screens to the right
+void plot_pan(Plot *plot, double amount)
+{
+    double offset = (plot->view_x1 - plot->view_x0)*amount;
+    plot->view_x0 += offset;
+    plot->view_x1 += offset;
+}
+
+void plot_unload(Plot *plot)
+{
+    plot_free_levels(plot);
+    if (plot->mapped) unmap_file(&plot->file);
+    plot->mapped = false;
+    plot->points = NULL;
+    plot->points_count = 0;
+    plot->unsorted = false;
+    plot->has_vertices = false;
+}
+
+static bool plot_create_gl_objects(Plot *plot)
+{
+    if (!create_program(plot_vert_source, plot_frag_source, &plot->program)) return false;
+    plot->transform_uniform = glGetUniformLocation(plot->program, "transform");
+
+    GLint vao = 0;
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &vao);
+    glGenVertexArrays(1, &plot->vao);
+    glBindVertexArray(plot->vao);
+    glGenBuffers(1, &plot->vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, plot->vbo);
+    glBufferData(GL_ARRAY_BUFFER, PLOT_CHUNK_POINTS*2*sizeof(float), NULL, GL_STREAM_DRAW);
+    mem_track(MEM_TAG_GL_BUFFERS, PLOT_CHUNK_POINTS*2*sizeof(float));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2*sizeof(float), (void*) 0);
+    glBindVertexArray((GLuint) vao);
+    return true;
+}
+
+// `file_path` may be NULL, which just unloads the current plot
+bool plot_load(Plot *plot, Job_Pool *pool, const char *file_path, Plot_Style style)
+{
+    plot_unload(plot);
+    plot->style = style;
+    if (file_path == NULL) return true;
+
+    if (plot->program == 0 && !plot_create_gl_objects(plot)) {
+        fprintf(stderr, "ERROR: could not compile the plot shaders\n");
+        return false;
+    }
+
+    // Data dumps are too big to be worth packing, they always come from the file system
+    if (!map_file(file_path, &plot->file)) {
+        fprintf(stderr, "ERROR: could not map %s: %s\n", file_path, strerror(errno));
+        return false;
+    }
+    plot->mapped = true;
+    plot->points = plot->file.data;
+    plot->points_count = plot->file.size/(2*sizeof(float));
+    if (plot->file.size%(2*sizeof(float)) != 0) {
+        fprintf(stderr, "WARN: %s: ignoring %zu bytes after the last point\n",
+                file_path, plot->file.size%(2*sizeof(float)));
+    }
+    if (plot->points_count == 0) {
+        fprintf(stderr, "ERROR: %s: no points to plot\n", file_path);
+        plot_unload(plot);
+        return false;
+    }
+
+    double start = glfwGetTime();
+    if (!plot_build_levels(plot, pool)) {
+        if (plot->unsorted) {
+            fprintf(stderr, "ERROR: %s: x of the points must not go down\n", file_path);
+        } else {
+            fprintf(stderr, "ERROR: %s: could not allocate the min/max pyramid\n", file_path);
+        }
+        plot_unload(plot);
+        return false;
+    }
+
+    plot_reset_view(plot);
+    printf("Plot: %s, %zu points, %zu levels in %.1f ms\n", file_path, plot->points_count,
+           plot->levels_count, (glfwGetTime() - start)*1000.0);
+    return true;
+}
+
+static bool plot_reserve_vertices(Plot *plot, size_t count)
+{
+    if (count <= plot->vertices_capacity) return true;
+    float *vertices = mem_realloc(MEM_TAG_PLOT, plot->vertices, count*2*sizeof(float));
+    if (vertices == NULL) return false;
+    plot->vertices = vertices;
+    plot->vertices_capacity = count;
+    return true;
+}
+
+// Rebuilds the vertices for the current view and `width` pixel columns
+static void plot_update_vertices(Plot *plot, int width)
+{
+    plot->has_vertices = true;
+    plot->vertices_x0 = plot->view_x0;
+    plot->vertices_x1 = plot->view_x1;
+    plot->vertices_width = width;
+    plot->vertices_count = 0;
+
+    // One point around the view on both sides, so lines go to the edges of the screen
+    size_t begin = plot_lower_bound(plot, plot->view_x0);
+    size_t end = plot_lower_bound(plot, plot->view_x1);
+    if (begin > 0) begin -= 1;
+    if (end < plot->points_count) end += 1;
+
+    int columns = width;
+    if (columns > PLOT_CHUNK_POINTS/2) columns = PLOT_CHUNK_POINTS/2;
+
+    Plot_Block visible = {INFINITY, -INFINITY};
+    plot->raw = end - begin <= (size_t) columns;
+    if (plot->raw) {
+        plot->raw_begin = begin;
+        plot->raw_end = end;
+        visible = plot_scan_points(plot->points, begin, end, NULL);
+    } else if (plot_reserve_vertices(plot, 2*(size_t) columns)) {
+        double column_width = (plot->view_x1 - plot->view_x0)/columns;
+        size_t column_begin = plot_lower_bound(plot, plot->view_x0);
+        for (int column = 0; column < columns; ++column) {
+            double x1 = plot->view_x0 + (column + 1)*column_width;
+            size_t column_end = column + 1 == columns ? plot_lower_bound(plot, plot->view_x1) : plot_lower_bound(plot, x1);
+            if (column_end > column_begin) {
+                Plot_Block block = plot_range(plot, column_begin, column_end);
+                float x = (float) (x1 - 0.5*column_width);
+                float *v = plot->vertices + 2*plot->vertices_count;
+                v[0] = x; v[1] = block.y_min;
+                v[2] = x; v[3] = block.y_max;
+                plot->vertices_count += 2;
+                visible = plot_merge(visible, block);
+            }
+            column_begin = column_end;
+        }
+    }
+
+    if (visible.y_min <= visible.y_max) {
+        double margin = (visible.y_max - visible.y_min)*PLOT_MARGIN;
+        if (margin <= 0.0) margin = fabs(visible.y_max)*PLOT_MARGIN + 1.0;
+        plot->view_y0 = visible.y_min - margin;
+        plot->view_y1 = visible.y_max + margin;
+    }
+}
+
+static void plot_draw_vertices(Plot *plot, const float *vertices, size_t count)
+{
+    // Orphaning the buffer lets the driver keep drawing the previous chunk from the old storage
+    glBufferData(GL_ARRAY_BUFFER, PLOT_CHUNK_POINTS*2*sizeof(float), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, count*2*sizeof(float), vertices);
+    glDrawArrays(plot->style == PLOT_POINTS ? GL_POINTS : GL_LINE_STRIP, 0, (GLsizei) count);
+}
+
+// Draws the plot over whatever is on the screen
+void plot_render(Plot *plot, int width, int height)
+{
+    (void) height;
+    if (plot->points_count == 0 || width <= 0) return;
+
+    if (!plot->has_vertices || plot->vertices_x0 != plot->view_x0 ||
+            plot->vertices_x1 != plot->view_x1 || plot->vertices_width != width) {
+        plot_update_vertices(plot, width);
+    }
+
+    GLint vao = 0;
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &vao);
+
+    glUseProgram(plot->program);
+    glUniform4f(plot->transform_uniform, (GLfloat) plot->view_x0, (GLfloat) plot->view_y0,
+                (GLfloat) (2.0/(plot->view_x1 - plot->view_x0)), (GLfloat) (2.0/(plot->view_y1 - plot->view_y0)));
+    glBindVertexArray(plot->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, plot->vbo);
+
+    if (plot->raw) {
+        // Chunks overlap by one point so the line strip doesn't break between them
+        size_t i = plot->raw_begin;
+        while (i < plot->raw_end) {
+            size_t count = plot->raw_end - i;
+            if (count > PLOT_CHUNK_POINTS) count = PLOT_CHUNK_POINTS;
+            plot_draw_vertices(plot, plot->points + 2*i, count);
+            if (i + count >= plot->raw_end) break;
+            i += count - 1;
+        }
+    } else if (plot->vertices_count > 0) {
+        plot_draw_vertices(plot, plot->vertices, plot->vertices_count);
+    }
+
+    glBindVertexArray((GLuint) vao);
+}
+
+bool plot_style_by_name(String_View name, Plot_Style *style)
+{
+    for (Plot_Style s = 0; s < COUNT_PLOT_STYLES; ++s) {
+        if (sv_eq(name, sv_from_cstr(plot_style_names[s]))) {
+            *style = s;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,531 @@
+// Post-processing stack. render.conf enables the effects with
+//
+//   post = bloom aces fxaa vignette
+//
+// With any of them enabled the scene is rendered into an RGBA16F target
+// instead of the window and the effects run after it in a fixed order:
+//
+// - bloom: dual filter (Kawase) blur of the pixels brighter than
+//   `bloom_threshold` over a pyramid of R11F_G11F_B10F targets starting at
+//   half resolution. Every level is a 5 tap downsample of the previous one,
+//   then the levels are upsampled with 8 taps and added back on the way up.
+// - composite: the scene plus the bloom, tone mapped with `aces` (Narkowicz's
+//   fit) or `reinhard` if one of them is enabled,
+// - fxaa: FXAA, the console flavor with 9 fetches per pixel,
+// - vignette: darkens the corners by `vignette_strength`.
+//
+// The last pass draws straight into the window. Every pass is timed with a
+// GL_TIME_ELAPSED query, the results are picked up a few frames later so
+// timing never stalls the pipeline.
+//
+// Targets come from the Render_Targets pool (see targets.c). A pass releases
+// its input as soon as it's done with it, so ping-ponging between two
+// targets of the same size doesn't allocate. The scene may be rendered at a
+// different size than the window while the window is being resized, the
+// last pass stretches it to the window.
+
+#define POST_BLOOM_MAX_LEVELS 6
+#define POST_BLOOM_MIN_SIZE 4
+#define POST_TIMER_QUERIES 4
+
+typedef enum {
+    POST_BLOOM = 0,
+    POST_ACES,
+    POST_REINHARD,
+    POST_FXAA,
+    POST_VIGNETTE,
+    COUNT_POST_EFFECTS,
+} Post_Effect;
+
+static const char *post_effect_names[COUNT_POST_EFFECTS] = {
+    [POST_BLOOM]    = "bloom",
+    [POST_ACES]     = "aces",
+    [POST_REINHARD] = "reinhard",
+    [POST_FXAA]     = "fxaa",
+    [POST_VIGNETTE] = "vignette",
+};
+
+typedef enum {
+    POST_PASS_BLOOM = 0,
+    POST_PASS_COMPOSITE,
+    POST_PASS_FXAA,
+    POST_PASS_VIGNETTE,
+    COUNT_POST_PASSES,
+} Post_Pass;
+
+static const char *post_pass_names[COUNT_POST_PASSES] = {
+    [POST_PASS_BLOOM]     = "bloom",
+    [POST_PASS_COMPOSITE] = "composite",
+    [POST_PASS_FXAA]      = "fxaa",
+    [POST_PASS_VIGNETTE]  = "vignette",
+};
+
+typedef struct {
+    bool effects[COUNT_POST_EFFECTS];
+    float bloom_threshold;
+    float bloom_intensity;
+    float vignette_strength;
+} Post_Conf;
+
+static const Post_Conf post_conf_default = {
+    .bloom_threshold = 0.8f,
+    .bloom_intensity = 0.5f,
+    .vignette_strength = 0.35f,
+};
+
+typedef struct {
+    GLuint queries[POST_TIMER_QUERIES];
+    // Queries in flight, the oldest one is at `head`
+    size_t head;
+    size_t pending;
+    bool running;
+    // The pass ran in the last frame
+    bool active;
+    // Exponential moving average
+    double ms;
+    bool has_ms;
+} Post_Timer;
+
+typedef struct {
+    Post_Conf conf;
+    // F8 skips the whole stack without touching the configuration
+    bool bypass;
+    bool ready;
+
+    GLuint bloom_down_program;
+    GLint bloom_down_texel_uniform;
+    GLint bloom_down_threshold_uniform;
+    GLint bloom_down_prefilter_uniform;
+    GLuint bloom_up_program;
+    GLint bloom_up_texel_uniform;
+    GLuint composite_program;
+    GLint composite_bloom_uniform;
+    GLint composite_bloom_intensity_uniform;
+    GLint composite_tonemap_uniform;
+    GLuint fxaa_program;
+    GLint fxaa_texel_uniform;
+    GLuint vignette_program;
+    GLint vignette_strength_uniform;
+    GLuint vao;
+
+    Render_Target *scene;
+    int width;
+    int height;
+    // Size of the window the last pass draws into
+    int window_width;
+    int window_height;
+    GLint viewport[4];
+
+    Post_Timer timers[COUNT_POST_PASSES];
+} Post;
+
+static const char *post_vert_source =
+    "#version 330\n"
+    "out vec2 uv;\n"
+    "void main(void)\n"
+    "{\n"
+    "    // Triangle that covers the whole viewport\n"
+    "    vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);\n"
+    "    uv = p;\n"
+    "    gl_Position = vec4(p*2.0 - 1.0, 0.0, 1.0);\n"
+    "}\n";
+
+static const char *post_bloom_down_frag_source =
+    "#version 330\n"
+    "uniform sampler2D source;\n"
+    "uniform vec2 texel;\n"
+    "uniform float threshold;\n"
+    "uniform bool prefilter;\n"
+    "in vec2 uv;\n"
+    "out vec4 out_color;\n"
+    "vec3 fetch(vec2 p)\n"
+    "{\n"
+    "    vec3 c = texture(source, p).rgb;\n"
+    "    if (prefilter) {\n"
+    "        // A single NaN or infinity would spread over the whole bloom\n"
+    "        c = any(isnan(c)) ? vec3(0.0) : min(c, vec3(65000.0));\n"
+    "        float brightness = max(c.r, max(c.g, c.b));\n"
+    "        c *= max(brightness - threshold, 0.0)/max(brightness, 1e-4);\n"
+    "    }\n"
+    "    return c;\n"
+    "}\n"
+    "void main(void)\n"
+    "{\n"
+    "    vec3 sum = fetch(uv)*4.0;\n"
+    "    sum += fetch(uv - texel);\n"
+    "    sum += fetch(uv + texel);\n"
+    "    sum += fetch(uv + vec2(texel.x, -texel.y));\n"
+    "    sum += fetch(uv - vec2(texel.x, -texel.y));\n"
+    "    out_color = vec4(sum/8.0, 1.0);\n"
+    "}\n";
+
+static const char *post_bloom_up_frag_source =
+    "#version 330\n"
+    "uniform sampler2D source;\n"
+    "uniform vec2 texel;\n"
+    "in vec2 uv;\n"
+    "out vec4 out_color;\n"
+    "void main(void)\n"
+    "{\n"
+    "    vec2 h = texel*0.5;\n"
+    "    vec3 sum = texture(source, uv + vec2(-texel.x, 0.0)).rgb;\n"
+    "    sum += texture(source, uv + vec2(texel.x, 0.0)).rgb;\n"
+    "    sum += texture(source, uv + vec2(0.0, -texel.y)).rgb;\n"
+    "    sum += texture(source, uv + vec2(0.0, texel.y)).rgb;\n"
+    "    sum += texture(source, uv + vec2(-h.x, -h.y)).rgb*2.0;\n"
+    "    sum += texture(source, uv + vec2(-h.x, h.y)).rgb*2.0;\n"
+    "    sum += texture(source, uv + vec2(h.x, -h.y)).rgb*2.0;\n"
+    "    sum += texture(source, uv + vec2(h.x, h.y)).rgb*2.0;\n"
+    "    out_color = vec4(sum/12.0, 1.0);\n"
+    "}\n";
+
+static const char *post_composite_frag_source =
+    "#version 330\n"
+    "uniform sampler2D source;\n"
+    "uniform sampler2D bloom;\n"
+    "uniform float bloom_intensity;\n"
+    "uniform int tonemap;\n"
+    "in vec2 uv;\n"
+    "out vec4 out_color;\n"
+    "void main(void)\n"
+    "{\n"
+    "    vec3 c = texture(source, uv).rgb + texture(bloom, uv).rgb*bloom_intensity;\n"
+    "    if (tonemap == 1) {\n"
+    "        c = (c*(2.51*c + 0.03))/(c*(2.43*c + 0.59) + 0.14);\n"
+    "    } else if (tonemap == 2) {\n"
+    "        c = c/(1.0 + c);\n"
+    "    }\n"
+    "    out_color = vec4(clamp(c, 0.0, 1.0), 1.0);\n"
+    "}\n";
+
+static const char *post_fxaa_frag_source =
+    "#version 330\n"
+    "#define FXAA_REDUCE_MIN (1.0/128.0)\n"
+    "#define FXAA_REDUCE_MUL (1.0/8.0)\n"
+    "#define FXAA_SPAN_MAX 8.0\n"
+    "uniform sampler2D source;\n"
+    "uniform vec2 texel;\n"
+    "in vec2 uv;\n"
+    "out vec4 out_color;\n"
+    "void main(void)\n"
+    "{\n"
+    "    const vec3 weights = vec3(0.299, 0.587, 0.114);\n"
+    "    vec3 m = texture(source, uv).rgb;\n"
+    "    float luma_nw = dot(texture(source, uv + vec2(-texel.x, -texel.y)).rgb, weights);\n"
+    "    float luma_ne = dot(texture(source, uv + vec2(texel.x, -texel.y)).rgb, weights);\n"
+    "    float luma_sw = dot(texture(source, uv + vec2(-texel.x, texel.y)).rgb, weights);\n"
+    "    float luma_se = dot(texture(source, uv + vec2(texel.x, texel.y)).rgb, weights);\n"
+    "    float luma_m = dot(m, weights);\n"
+    "    float luma_min = min(luma_m, min(min(luma_nw, luma_ne), min(luma_sw, luma_se)));\n"
+    "    float luma_max = max(luma_m, max(max(luma_nw, luma_ne), max(luma_sw, luma_se)));\n"
+    "\n"
+    "    vec2 dir = vec2(-((luma_nw + luma_ne) - (luma_sw + luma_se)), (luma_nw + luma_sw) - (luma_ne + luma_se));\n"
+    "    float dir_reduce = max((luma_nw + luma_ne + luma_sw + luma_se)*(0.25*FXAA_REDUCE_MUL), FXAA_REDUCE_MIN);\n"
+    "    float dir_scale = 1.0/(min(abs(dir.x), abs(dir.y)) + dir_reduce);\n"
+    "    dir = clamp(dir*dir_scale, -FXAA_SPAN_MAX, FXAA_SPAN_MAX)*texel;\n"
+    "\n"
+    "    vec3 a = 0.5*(texture(source, uv + dir*(1.0/3.0 - 0.5)).rgb +\n"
+    "                  texture(source, uv + dir*(2.0/3.0 - 0.5)).rgb);\n"
+    "    vec3 b = a*0.5 + 0.25*(texture(source, uv - dir*0.5).rgb +\n"
+    "                           texture(source, uv + dir*0.5).rgb);\n"
+    "    float luma_b = dot(b, weights);\n"
+    "    out_color = vec4(luma_b < luma_min || luma_b > luma_max ? a : b, 1.0);\n"
+    "}\n";
+
+static const char *post_vignette_frag_source =
+    "#version 330\n"
+    "uniform sampler2D source;\n"
+    "uniform float strength;\n"
+    "in vec2 uv;\n"
+    "out vec4 out_color;\n"
+    "void main(void)\n"
+    "{\n"
+    "    vec2 d = uv - 0.5;\n"
+    "    // 1.0 in the corners\n"
+    "    float r = dot(d, d)*2.0;\n"
+    "    out_color = vec4(texture(source, uv).rgb*(1.0 - strength*r*r), 1.0);\n"
+    "}\n";
+
+bool post_effect_by_name(String_View name, Post_Effect *effect)
+{
+    for (Post_Effect e = 0; e < COUNT_POST_EFFECTS; ++e) {
+        if (sv_eq(name, sv_from_cstr(post_effect_names[e]))) {
+            *effect = e;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void post_timer_poll(Post_Timer *timer)
+{
+    while (timer->pending > 0) {
+        GLuint query = timer->queries[timer->head];
+        GLint available = 0;
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) break;
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+        double ms = (double) ns/1e6;
+        timer->ms = timer->has_ms ? timer->ms*0.9 + ms*0.1 : ms;
+        timer->has_ms = true;
+        timer->head = (timer->head + 1) % POST_TIMER_QUERIES;
+        timer->pending -= 1;
+    }
+}
+
+// Skips timing the pass when all the queries are still in flight
+static void post_timer_begin(Post_Timer *timer)
+{
+    timer->active = true;
+    timer->running = timer->pending < POST_TIMER_QUERIES;
+    if (timer->running) {
+        glBeginQuery(GL_TIME_ELAPSED, timer->queries[(timer->head + timer->pending) % POST_TIMER_QUERIES]);
+    }
+}
+
+static void post_timer_end(Post_Timer *timer)
+{
+    if (!timer->running) return;
+    glEndQuery(GL_TIME_ELAPSED);
+    timer->pending += 1;
+    timer->running = false;
+}
+
+static bool post_create_gl_objects(Post *post)
+{
+    if (!create_program(post_vert_source, post_bloom_down_frag_source, &post->bloom_down_program)) return false;
+    post->bloom_down_texel_uniform = glGetUniformLocation(post->bloom_down_program, "texel");
+    post->bloom_down_threshold_uniform = glGetUniformLocation(post->bloom_down_program, "threshold");
+    post->bloom_down_prefilter_uniform = glGetUniformLocation(post->bloom_down_program, "prefilter");
+
+    if (!create_program(post_vert_source, post_bloom_up_frag_source, &post->bloom_up_program)) return false;
+    post->bloom_up_texel_uniform = glGetUniformLocation(post->bloom_up_program, "texel");
+
+    if (!create_program(post_vert_source, post_composite_frag_source, &post->composite_program)) return false;
+    post->composite_bloom_uniform = glGetUniformLocation(post->composite_program, "bloom");
+    post->composite_bloom_intensity_uniform = glGetUniformLocation(post->composite_program, "bloom_intensity");
+    post->composite_tonemap_uniform = glGetUniformLocation(post->composite_program, "tonemap");
+
+    if (!create_program(post_vert_source, post_fxaa_frag_source, &post->fxaa_program)) return false;
+    post->fxaa_texel_uniform = glGetUniformLocation(post->fxaa_program, "texel");
+
+    if (!create_program(post_vert_source, post_vignette_frag_source, &post->vignette_program)) return false;
+    post->vignette_strength_uniform = glGetUniformLocation(post->vignette_program, "strength");
+
+    glGenVertexArrays(1, &post->vao);
+    for (Post_Pass pass = 0; pass < COUNT_POST_PASSES; ++pass) {
+        glGenQueries(POST_TIMER_QUERIES, post->timers[pass].queries);
+    }
+    return true;
+}
+
+bool post_load(Post *post, const Post_Conf *conf)
+{
+    post->conf = *conf;
+    if (!post->ready) {
+        bool any = false;
+        for (Post_Effect e = 0; e < COUNT_POST_EFFECTS; ++e) any = any || conf->effects[e];
+        if (!any) return true;
+
+        if (!post_create_gl_objects(post)) {
+            fprintf(stderr, "ERROR: could not compile the post-processing shaders\n");
+            memset(post->conf.effects, 0, sizeof(post->conf.effects));
+            return false;
+        }
+        post->ready = true;
+    }
+    return true;
+}
+
+// Whether the scene has to be rendered into post_scene_texture()
+bool post_enabled(const Post *post)
+{
+    if (!post->ready || post->bypass) return false;
+    for (Post_Effect e = 0; e < COUNT_POST_EFFECTS; ++e) {
+        if (post->conf.effects[e]) return true;
+    }
+    return false;
+}
+
+// Redirects rendering into a `width` x `height` scene target. Call before
+// clearing the frame. `post` doesn't need to be loaded when only the scene
+// target is needed.
+bool post_begin(Post *post, Render_Targets *targets, int width, int height)
+{
+    if (width <= 0 || height <= 0) return false;
+    post->width = width;
+    post->height = height;
+    post->scene = render_targets_acquire(targets, width, height, GL_RGBA16F, 1);
+    if (post->scene == NULL) return false;
+    glBindFramebuffer(GL_FRAMEBUFFER, post->scene->framebuffer);
+    glGetIntegerv(GL_VIEWPORT, post->viewport);
+    glViewport(0, 0, width, height);
+    return true;
+}
+
+GLuint post_scene_texture(const Post *post)
+{
+    return post->scene != NULL ? post->scene->texture : 0;
+}
+
+// Draws into the window when `target` is NULL
+static void post_draw(const Post *post, GLuint program, GLuint source, Render_Target *target)
+{
+    glUseProgram(program);
+    glBindTexture(GL_TEXTURE_2D, source);
+    if (target != NULL) {
+        glBindFramebuffer(GL_FRAMEBUFFER, target->framebuffer);
+        glViewport(0, 0, target->width, target->height);
+    } else {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, post->window_width, post->window_height);
+    }
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+// Blurred bright pixels of the scene at half resolution, NULL if it couldn't be made
+static Render_Target *post_bloom(Post *post, Render_Targets *targets)
+{
+    Render_Target *levels[POST_BLOOM_MAX_LEVELS] = {0};
+    size_t levels_count = 0;
+    int width = post->width;
+    int height = post->height;
+    GLuint source = post->scene->texture;
+
+    glUseProgram(post->bloom_down_program);
+    glUniform1f(post->bloom_down_threshold_uniform, post->conf.bloom_threshold);
+    while (levels_count < POST_BLOOM_MAX_LEVELS && width/2 >= POST_BLOOM_MIN_SIZE && height/2 >= POST_BLOOM_MIN_SIZE) {
+        glUniform2f(post->bloom_down_texel_uniform, 1.0f/(float) width, 1.0f/(float) height);
+        glUniform1i(post->bloom_down_prefilter_uniform, levels_count == 0);
+        width /= 2;
+        height /= 2;
+        Render_Target *level = render_targets_acquire(targets, width, height, GL_R11F_G11F_B10F, 1);
+        if (level == NULL) break;
+        post_draw(post, post->bloom_down_program, source, level);
+        levels[levels_count++] = level;
+        source = level->texture;
+    }
+
+    // Every level gets the blur of the level below added to it
+    GLint blend_src = 0;
+    GLint blend_dst = 0;
+    glGetIntegerv(GL_BLEND_SRC_RGB, &blend_src);
+    glGetIntegerv(GL_BLEND_DST_RGB, &blend_dst);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    glUseProgram(post->bloom_up_program);
+    for (size_t i = levels_count; i-- > 1;) {
+        glUniform2f(post->bloom_up_texel_uniform, 1.0f/(float) levels[i]->width, 1.0f/(float) levels[i]->height);
+        post_draw(post, post->bloom_up_program, levels[i]->texture, levels[i - 1]);
+        render_targets_release(levels[i]);
+    }
+    glBlendFunc((GLenum) blend_src, (GLenum) blend_dst);
+    glDisable(GL_BLEND);
+
+    return levels_count > 0 ? levels[0] : NULL;
+}
+
+// Runs the effects over the scene and draws the result into the
+// `window_width` x `window_height` window
+void post_end(Post *post, Render_Targets *targets, int window_width, int window_height)
+{
+    if (post->scene == NULL) return;
+
+    post->window_width = window_width;
+    post->window_height = window_height;
+    GLint vao = 0;
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &vao);
+    GLboolean blend = glIsEnabled(GL_BLEND);
+    glDisable(GL_BLEND);
+    glBindVertexArray(post->vao);
+    glActiveTexture(GL_TEXTURE0);
+
+    bool enabled = post_enabled(post);
+    const bool *effects = post->conf.effects;
+    bool composite = enabled && (effects[POST_BLOOM] || effects[POST_ACES] || effects[POST_REINHARD]);
+    bool fxaa = enabled && effects[POST_FXAA];
+    bool vignette = enabled && effects[POST_VIGNETTE];
+    for (Post_Pass pass = 0; pass < COUNT_POST_PASSES; ++pass) {
+        post_timer_poll(&post->timers[pass]);
+        post->timers[pass].active = false;
+    }
+
+    Render_Target *current = post->scene;
+    Render_Target *bloom = NULL;
+    if (composite && effects[POST_BLOOM]) {
+        post_timer_begin(&post->timers[POST_PASS_BLOOM]);
+        bloom = post_bloom(post, targets);
+        post_timer_end(&post->timers[POST_PASS_BLOOM]);
+    }
+
+    // Passes draw into the window when no pass comes after them
+    if (composite) {
+        Render_Target *target = NULL;
+        if (fxaa || vignette) target = render_targets_acquire(targets, post->width, post->height, GL_RGBA8, 1);
+        post_timer_begin(&post->timers[POST_PASS_COMPOSITE]);
+        glUseProgram(post->composite_program);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, bloom != NULL ? bloom->texture : current->texture);
+        glActiveTexture(GL_TEXTURE0);
+        glUniform1i(post->composite_bloom_uniform, 1);
+        // The upsampling adds up all the levels
+        glUniform1f(post->composite_bloom_intensity_uniform, bloom != NULL ? post->conf.bloom_intensity : 0.0f);
+        glUniform1i(post->composite_tonemap_uniform, effects[POST_ACES] ? 1 : effects[POST_REINHARD] ? 2 : 0);
+        post_draw(post, post->composite_program, current->texture, target);
+        post_timer_end(&post->timers[POST_PASS_COMPOSITE]);
+        render_targets_release(bloom);
+        if (current != post->scene) render_targets_release(current);
+        current = target;
+    }
+
+    if (fxaa && current != NULL) {
+        Render_Target *target = NULL;
+        if (vignette) target = render_targets_acquire(targets, post->width, post->height, GL_RGBA8, 1);
+        post_timer_begin(&post->timers[POST_PASS_FXAA]);
+        glUseProgram(post->fxaa_program);
+        glUniform2f(post->fxaa_texel_uniform, 1.0f/(float) post->width, 1.0f/(float) post->height);
+        post_draw(post, post->fxaa_program, current->texture, target);
+        post_timer_end(&post->timers[POST_PASS_FXAA]);
+        if (current != post->scene) render_targets_release(current);
+        current = target;
+    }
+
+    if (vignette && current != NULL) {
+        post_timer_begin(&post->timers[POST_PASS_VIGNETTE]);
+        glUseProgram(post->vignette_program);
+        glUniform1f(post->vignette_strength_uniform, post->conf.vignette_strength);
+        post_draw(post, post->vignette_program, current->texture, NULL);
+        post_timer_end(&post->timers[POST_PASS_VIGNETTE]);
+        if (current != post->scene) render_targets_release(current);
+        current = NULL;
+    }
+
+    // Nothing drew into the window yet, e.g. with only the frame stats enabled
+    if (current != NULL) {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, current->framebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        bool stretch = post->width != window_width || post->height != window_height;
+        glBlitFramebuffer(0, 0, post->width, post->height, 0, 0, window_width, window_height,
+                          GL_COLOR_BUFFER_BIT, stretch ? GL_LINEAR : GL_NEAREST);
+        if (current != post->scene) render_targets_release(current);
+    }
+
+    render_targets_release(post->scene);
+    post->scene = NULL;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindVertexArray((GLuint) vao);
+    if (blend) glEnable(GL_BLEND);
+    glViewport(post->viewport[0], post->viewport[1], post->viewport[2], post->viewport[3]);
+}
+
+void post_print_timers(const Post *post)
+{
+    if (!post_enabled(post)) return;
+    printf("Post-processing GPU time:\n");
+    for (Post_Pass pass = 0; pass < COUNT_POST_PASSES; ++pass) {
+        const Post_Timer *timer = &post->timers[pass];
+        if (timer->active && timer->has_ms) printf("  %-10s %8.3f ms\n", post_pass_names[pass], timer->ms);
+    }
+}
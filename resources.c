@@ -0,0 +1,490 @@
+// Resource manager for GL objects: textures and shader programs.
+//
+// Resources are referred to by typed handles that carry a generation, so a
+// handle to a released resource is detected instead of silently aliasing
+// whatever reused its slot. Loading the same content twice (same file, or a
+// different file with identical bytes) returns the existing resource with its
+// refcount bumped.
+//
+// Textures count towards `vram_budget`. When the budget is exceeded the least
+// recently used textures are evicted: their GL objects are deleted but their
+// slots and handles stay valid, and the next resources_use_texture() reloads
+// them from the asset pack or the file system.
+
+typedef enum {
+    RESOURCE_TEXTURE = 0,
+    RESOURCE_PROGRAM,
+    COUNT_RESOURCE_KINDS,
+} Resource_Kind;
+
+typedef struct {
+    uint32_t index;
+    uint32_t generation;
+} Texture_Handle;
+
+typedef struct {
+    uint32_t index;
+    uint32_t generation;
+} Program_Handle;
+
+typedef struct {
+    Resource_Kind kind;
+    bool alive;
+    uint32_t generation;
+    uint32_t refcount;
+    // Textures: path of the image. Programs: vertex and fragment paths separated by '\n'.
+    char *key;
+    Hash128 content_hash;
+    GLuint id;
+    size_t vram_bytes;
+    uint64_t last_used_frame;
+    int width;
+    int height;
+} Resource;
+
+typedef struct {
+    // Slot 0 is never used so zero-initialized handles are always invalid
+    Resource *items;
+    size_t count;
+    size_t capacity;
+    size_t vram_used;
+    // 0 means unlimited
+    size_t vram_budget;
+    uint64_t frame;
+    size_t evictions;
+    size_t reloads;
+} Resource_Manager;
+
+static const char *resource_kind_names[COUNT_RESOURCE_KINDS] = {
+    [RESOURCE_TEXTURE] = "texture",
+    [RESOURCE_PROGRAM] = "program",
+};
+
+static Resource *resources_alloc_slot(Resource_Manager *rm)
+{
+    if (rm->count == 0) rm->count = 1;
+
+    for (size_t i = 1; i < rm->count; ++i) {
+        if (!rm->items[i].alive) return &rm->items[i];
+    }
+
+    if (rm->count >= rm->capacity) {
+        size_t new_capacity = rm->capacity == 0 ? 16 : rm->capacity * 2;
+        Resource *new_items = mem_realloc(MEM_TAG_RESOURCES, rm->items, new_capacity * sizeof(*new_items));
+        if (new_items == NULL) return NULL;
+        memset(new_items + rm->capacity, 0, (new_capacity - rm->capacity) * sizeof(*new_items));
+        rm->items = new_items;
+        rm->capacity = new_capacity;
+    }
+
+    return &rm->items[rm->count++];
+}
+
+static Resource *resources_get(Resource_Manager *rm, Resource_Kind kind, uint32_t index, uint32_t generation)
+{
+    if (index == 0 || index >= rm->count) return NULL;
+    Resource *res = &rm->items[index];
+    if (!res->alive || res->kind != kind || res->generation != generation) return NULL;
+    return res;
+}
+
+static Resource *resources_find(Resource_Manager *rm, Resource_Kind kind, const char *key, Hash128 content_hash)
+{
+    // Same key and same content is the common case (F5 without edits), identical
+    // content under a different key still shares the GL object.
+    Resource *same_content = NULL;
+    for (size_t i = 1; i < rm->count; ++i) {
+        Resource *res = &rm->items[i];
+        if (!res->alive || res->kind != kind || !hash128_eq(res->content_hash, content_hash)) continue;
+        if (strcmp(res->key, key) == 0) return res;
+        if (same_content == NULL) same_content = res;
+    }
+    return same_content;
+}
+
+static uint32_t resources_index_of(const Resource_Manager *rm, const Resource *res)
+{
+    return (uint32_t) (res - rm->items);
+}
+
+// Image file opened for loading. The content hash is known right after
+// opening, so deduplication doesn't pay for decoding. Packed textures point
+// straight into the mapped pack, files are mapped and decoded by stb_image.
+// `noise:` paths are generated by noise.c instead, see there.
+typedef struct {
+    Hash128 content_hash;
+    Mapped_File file;
+    unsigned char *pixels;
+    int width;
+    int height;
+    bool owned;
+    // Procedural textures tile, so they are sampled with GL_REPEAT
+    bool tiling;
+    bool is_noise;
+    Noise_Spec noise;
+} Texture_Source;
+
+static bool texture_source_open(const char *file_path, Texture_Source *ts)
+{
+    memset(ts, 0, sizeof(*ts));
+
+    if (noise_is_spec(file_path)) {
+        if (!noise_parse_spec(file_path, &ts->noise)) return false;
+        ts->is_noise = true;
+        ts->tiling = true;
+        ts->width = ts->noise.size;
+        ts->height = ts->noise.size;
+        ts->content_hash = noise_spec_hash(&ts->noise);
+        return true;
+    }
+
+    const Pack_Entry *packed = find_packed_asset(file_path, PACK_ASSET_TEXTURE_RGBA8);
+    if (packed != NULL) {
+        ts->pixels = (unsigned char *) pack_entry_data(&asset_pack, packed);
+        ts->width = (int) packed->width;
+        ts->height = (int) packed->height;
+        ts->content_hash = packed->source_hash;
+        return true;
+    }
+
+    if (!map_file(file_path, &ts->file)) {
+        fprintf(stderr, "ERROR: could not load image %s: %s\n", file_path, strerror(errno));
+        return false;
+    }
+    ts->content_hash = hash128(ts->file.data, ts->file.size, 0);
+    return true;
+}
+
+static bool texture_source_decode(const char *file_path, Texture_Source *ts)
+{
+    if (ts->pixels != NULL) return true;
+
+    if (ts->is_noise) {
+        if (noise_cache_load(ts->content_hash, ts->noise.size, &ts->file, &ts->pixels)) return true;
+
+        ts->pixels = mem_alloc(MEM_TAG_IMAGES, (size_t) ts->width * ts->height * 4);
+        if (ts->pixels == NULL) {
+            fprintf(stderr, "ERROR: could not allocate memory for %s\n", file_path);
+            return false;
+        }
+        ts->owned = true;
+        if (!noise_generate(&ts->noise, &global_jobs, ts->pixels)) {
+            fprintf(stderr, "ERROR: could not generate %s\n", file_path);
+            return false;
+        }
+        noise_cache_save(ts->content_hash, ts->noise.size, ts->pixels);
+        return true;
+    }
+
+    ts->pixels = stbi_load_from_memory(ts->file.data, (int) ts->file.size, &ts->width, &ts->height, NULL, 4);
+    if (ts->pixels == NULL) {
+        fprintf(stderr, "ERROR: could not load image %s: %s\n", file_path, stbi_failure_reason());
+        return false;
+    }
+    ts->owned = true;
+    return true;
+}
+
+static void texture_source_close(Texture_Source *ts)
+{
+    // stb_image allocates through mem_alloc() as well, see mem.c
+    if (ts->owned) mem_free(ts->pixels);
+    unmap_file(&ts->file);
+    memset(ts, 0, sizeof(*ts));
+}
+
+static GLuint upload_texture(int width, int height, const void *pixels, bool tiling)
+{
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    GLint wrap = tiling ? GL_REPEAT : GL_CLAMP_TO_BORDER;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+
+    glTexImage2D(GL_TEXTURE_2D,
+                 0,
+                 GL_RGBA,
+                 width,
+                 height,
+                 0,
+                 GL_RGBA,
+                 GL_UNSIGNED_BYTE,
+                 pixels);
+
+    return texture;
+}
+
+static void resources_evict(Resource_Manager *rm, Resource *res)
+{
+    assert(res->kind == RESOURCE_TEXTURE);
+    glDeleteTextures(1, &res->id);
+    res->id = 0;
+    rm->vram_used -= res->vram_bytes;
+    mem_track(MEM_TAG_GL_TEXTURES, -(ptrdiff_t) res->vram_bytes);
+    rm->evictions += 1;
+    printf("Evicted texture %s (%zu KB)\n", res->key, res->vram_bytes / 1024);
+}
+
+// Evicts least recently used textures until the budget is met. Textures used
+// in the current frame are never evicted, so a frame that needs more than the
+// budget goes over it instead of thrashing.
+static void resources_enforce_budget(Resource_Manager *rm)
+{
+    if (rm->vram_budget == 0) return;
+
+    while (rm->vram_used > rm->vram_budget) {
+        Resource *lru = NULL;
+        for (size_t i = 1; i < rm->count; ++i) {
+            Resource *res = &rm->items[i];
+            if (!res->alive || res->kind != RESOURCE_TEXTURE || res->id == 0) continue;
+            if (res->last_used_frame == rm->frame) continue;
+            if (lru == NULL || res->last_used_frame < lru->last_used_frame) lru = res;
+        }
+        if (lru == NULL) break;
+        resources_evict(rm, lru);
+    }
+}
+
+static bool resources_make_texture_resident(Resource_Manager *rm, Resource *res, Texture_Source *ts)
+{
+    if (!texture_source_decode(res->key, ts)) return false;
+
+    res->id = upload_texture(ts->width, ts->height, ts->pixels, ts->tiling);
+    res->width = ts->width;
+    res->height = ts->height;
+    res->content_hash = ts->content_hash;
+    res->vram_bytes = (size_t) ts->width * ts->height * 4;
+    rm->vram_used += res->vram_bytes;
+    mem_track(MEM_TAG_GL_TEXTURES, (ptrdiff_t) res->vram_bytes);
+    return true;
+}
+
+// Loads a texture from an already opened (and possibly already decoded) source.
+// The source stays owned by the caller.
+Texture_Handle resources_load_texture_from_source(Resource_Manager *rm, const char *file_path, Texture_Source *ts)
+{
+    Resource *res = resources_find(rm, RESOURCE_TEXTURE, file_path, ts->content_hash);
+    if (res != NULL) {
+        res->refcount += 1;
+        return (Texture_Handle) { resources_index_of(rm, res), res->generation };
+    }
+
+    Texture_Handle handle = {0};
+    res = resources_alloc_slot(rm);
+    char *key = mem_strdup(MEM_TAG_RESOURCES, file_path);
+    if (res == NULL || key == NULL) {
+        fprintf(stderr, "ERROR: could not allocate memory for texture %s\n", file_path);
+        mem_free(key);
+        return handle;
+    }
+
+    res->kind = RESOURCE_TEXTURE;
+    res->key = key;
+    if (!resources_make_texture_resident(rm, res, ts)) {
+        mem_free(res->key);
+        res->key = NULL;
+        return handle;
+    }
+    res->alive = true;
+    res->refcount = 1;
+    res->last_used_frame = rm->frame;
+    handle = (Texture_Handle) { resources_index_of(rm, res), res->generation };
+
+    resources_enforce_budget(rm);
+    return handle;
+}
+
+Texture_Handle resources_load_texture(Resource_Manager *rm, const char *file_path)
+{
+    Texture_Source ts;
+    if (!texture_source_open(file_path, &ts)) return (Texture_Handle) {0};
+    Texture_Handle handle = resources_load_texture_from_source(rm, file_path, &ts);
+    texture_source_close(&ts);
+    return handle;
+}
+
+static void resources_destroy(Resource_Manager *rm, Resource *res)
+{
+    switch (res->kind) {
+    case RESOURCE_TEXTURE:
+        if (res->id != 0) {
+            glDeleteTextures(1, &res->id);
+            rm->vram_used -= res->vram_bytes;
+            mem_track(MEM_TAG_GL_TEXTURES, -(ptrdiff_t) res->vram_bytes);
+        }
+        break;
+    case RESOURCE_PROGRAM:
+        glDeleteProgram(res->id);
+        break;
+    default:
+        assert(0 && "unreachable");
+    }
+
+    mem_free(res->key);
+    uint32_t generation = res->generation + 1;
+    memset(res, 0, sizeof(*res));
+    res->generation = generation;
+}
+
+void resources_release_texture(Resource_Manager *rm, Texture_Handle handle)
+{
+    Resource *res = resources_get(rm, RESOURCE_TEXTURE, handle.index, handle.generation);
+    if (res == NULL) return;
+    assert(res->refcount > 0);
+    res->refcount -= 1;
+    if (res->refcount == 0) resources_destroy(rm, res);
+}
+
+// Returns the GL texture of the handle reloading it if it was evicted, 0 for invalid handles
+GLuint resources_use_texture(Resource_Manager *rm, Texture_Handle handle)
+{
+    Resource *res = resources_get(rm, RESOURCE_TEXTURE, handle.index, handle.generation);
+    if (res == NULL) return 0;
+
+    res->last_used_frame = rm->frame;
+    if (res->id == 0) {
+        Texture_Source ts;
+        if (!texture_source_open(res->key, &ts)) return 0;
+        bool ok = resources_make_texture_resident(rm, res, &ts);
+        texture_source_close(&ts);
+        if (!ok) return 0;
+        rm->reloads += 1;
+        resources_enforce_budget(rm);
+    }
+    return res->id;
+}
+
+Program_Handle resources_load_program_from_sources(Resource_Manager *rm,
+                                                  const char *vert_file_path, const char *frag_file_path,
+                                                  const char *vert_source, const char *frag_source)
+{
+    Program_Handle handle = {0};
+
+    size_t key_size = strlen(vert_file_path) + 1 + strlen(frag_file_path) + 1;
+    char *key = mem_alloc(MEM_TAG_RESOURCES, key_size);
+    if (key == NULL) return handle;
+    snprintf(key, key_size, "%s\n%s", vert_file_path, frag_file_path);
+
+    Hash_State hs;
+    hash_init(&hs, 0);
+    // The NUL separates the sources so moving text between them changes the hash
+    hash_update(&hs, vert_source, strlen(vert_source) + 1);
+    hash_update(&hs, frag_source, strlen(frag_source) + 1);
+    Hash128 content_hash = hash_digest128(&hs);
+
+    Resource *res = resources_find(rm, RESOURCE_PROGRAM, key, content_hash);
+    if (res != NULL) {
+        res->refcount += 1;
+        handle = (Program_Handle) { resources_index_of(rm, res), res->generation };
+        goto defer;
+    }
+
+    GLuint vert = 0;
+    if (!compile_shader_source(vert_source, GL_VERTEX_SHADER, &vert)) {
+        fprintf(stderr, "ERROR: failed to compile `%s` shader file\n", vert_file_path);
+        glDeleteShader(vert);
+        goto defer;
+    }
+
+    GLuint frag = 0;
+    if (!compile_shader_source(frag_source, GL_FRAGMENT_SHADER, &frag)) {
+        fprintf(stderr, "ERROR: failed to compile `%s` shader file\n", frag_file_path);
+        glDeleteShader(vert);
+        glDeleteShader(frag);
+        goto defer;
+    }
+
+    GLuint program = 0;
+    if (!link_program(vert, frag, &program)) {
+        glDeleteProgram(program);
+        goto defer;
+    }
+
+    res = resources_alloc_slot(rm);
+    if (res == NULL) {
+        glDeleteProgram(program);
+        goto defer;
+    }
+
+    res->kind = RESOURCE_PROGRAM;
+    res->alive = true;
+    res->refcount = 1;
+    res->key = key;
+    key = NULL;
+    res->content_hash = content_hash;
+    res->id = program;
+    res->last_used_frame = rm->frame;
+    handle = (Program_Handle) { resources_index_of(rm, res), res->generation };
+
+defer:
+    mem_free(key);
+    return handle;
+}
+
+Program_Handle resources_load_program(Resource_Manager *rm, const char *vert_file_path, const char *frag_file_path)
+{
+    Program_Handle handle = {0};
+
+    char *vert_source = slurp_asset_into_malloced_cstr(vert_file_path, MEM_TAG_SHADERS);
+    if (vert_source == NULL) {
+        fprintf(stderr, "ERROR: failed to read file `%s`: %s\n", vert_file_path, strerror(errno));
+        return handle;
+    }
+    char *frag_source = slurp_asset_into_malloced_cstr(frag_file_path, MEM_TAG_SHADERS);
+    if (frag_source == NULL) {
+        fprintf(stderr, "ERROR: failed to read file `%s`: %s\n", frag_file_path, strerror(errno));
+        mem_free(vert_source);
+        return handle;
+    }
+
+    handle = resources_load_program_from_sources(rm, vert_file_path, frag_file_path, vert_source, frag_source);
+    mem_free(vert_source);
+    mem_free(frag_source);
+    return handle;
+}
+
+void resources_release_program(Resource_Manager *rm, Program_Handle handle)
+{
+    Resource *res = resources_get(rm, RESOURCE_PROGRAM, handle.index, handle.generation);
+    if (res == NULL) return;
+    assert(res->refcount > 0);
+    res->refcount -= 1;
+    if (res->refcount == 0) resources_destroy(rm, res);
+}
+
+// Returns the GL program of the handle, 0 for invalid handles
+GLuint resources_use_program(Resource_Manager *rm, Program_Handle handle)
+{
+    Resource *res = resources_get(rm, RESOURCE_PROGRAM, handle.index, handle.generation);
+    if (res == NULL) return 0;
+    res->last_used_frame = rm->frame;
+    return res->id;
+}
+
+void resources_begin_frame(Resource_Manager *rm)
+{
+    rm->frame += 1;
+}
+
+void resources_print_summary(const Resource_Manager *rm)
+{
+    size_t counts[COUNT_RESOURCE_KINDS] = {0};
+    size_t resident = 0;
+    for (size_t i = 1; i < rm->count; ++i) {
+        const Resource *res = &rm->items[i];
+        if (!res->alive) continue;
+        counts[res->kind] += 1;
+        if (res->id != 0) resident += 1;
+    }
+
+    printf("Resources:");
+    for (Resource_Kind kind = 0; kind < COUNT_RESOURCE_KINDS; ++kind) {
+        printf(" %zu %s(s),", counts[kind], resource_kind_names[kind]);
+    }
+    printf(" %zu resident, VRAM %zu/%zu KB, %zu evictions, %zu reloads\n",
+           resident, rm->vram_used / 1024, rm->vram_budget / 1024, rm->evictions, rm->reloads);
+}
@@ -0,0 +1,253 @@
+// Scenes are sets of vertex shader, fragment shader and texture listed in
+// render.conf. All of them are loaded in the background at startup and stay
+// resident, so switching between them is just a matter of using different
+// handles.
+//
+// Loading is split in two halves. The prepare job runs on the job pool and
+// does everything that doesn't need the GL context: reading the shader
+// sources and reading and decoding the texture. The main thread then picks up
+// prepared scenes, compiles/uploads them through the resource manager and
+// marks them ready.
+
+#define SCENES_CAP 9
+#define SCENE_TUNES_CAP 8
+#define SCENE_SWEEPS_CAP 8
+
+typedef struct {
+    const char *name;
+    const char *vert_path;
+    const char *frag_path;
+    const char *texture_path;
+    // `tune` keys, a define name followed by its candidate values, see autotune.c
+    const char *tunes[SCENE_TUNES_CAP];
+    size_t tunes_count;
+    // `sweep` keys, a uniform name followed by from, to and steps, see sweep.c
+    const char *sweeps[SCENE_SWEEPS_CAP];
+    size_t sweeps_count;
+} Scene_Conf;
+
+typedef enum {
+    SCENE_LOADING = 0,
+    SCENE_PREPARED,
+    SCENE_READY,
+    SCENE_FAILED,
+} Scene_State;
+
+typedef struct {
+    Scene_Conf conf;
+    // Written by the prepare job, read by the main thread. Guarded by `scenes_mutex`.
+    Scene_State state;
+
+    // Prepared data, owned by the scene until it's uploaded
+    char *vert_source;
+    char *frag_source;
+    Texture_Source texture_source;
+    bool has_texture_source;
+
+    // Valid once the scene is ready
+    Program_Handle program;
+    Texture_Handle texture;
+    GLint uniforms[COUNT_UNIFORMS];
+    Timeline_Locations timeline_locations;
+    // The autotune was done or applied from the cache
+    bool tuned;
+} Scene;
+
+typedef struct {
+    Scene items[SCENES_CAP];
+    size_t count;
+    size_t current;
+    // Scene the user switched to before it was ready
+    bool has_pending;
+    size_t pending;
+} Scenes;
+
+static Jobs_Mutex scenes_mutex;
+
+void scenes_init(void)
+{
+    jobs_mutex_init(&scenes_mutex);
+}
+
+static Scene_State scene_get_state(const Scene *scene)
+{
+    jobs_mutex_lock(&scenes_mutex);
+    Scene_State state = scene->state;
+    jobs_mutex_unlock(&scenes_mutex);
+    return state;
+}
+
+static void scene_prepare_job(void *arg)
+{
+    Scene *scene = arg;
+    bool ok = true;
+
+    if (scene->conf.vert_path == NULL || scene->conf.frag_path == NULL) {
+        fprintf(stderr, "ERROR: scene `%s` needs both vert and frag\n", scene->conf.name);
+        jobs_mutex_lock(&scenes_mutex);
+        scene->state = SCENE_FAILED;
+        jobs_mutex_unlock(&scenes_mutex);
+        return;
+    }
+
+    scene->vert_source = slurp_asset_into_malloced_cstr(scene->conf.vert_path, MEM_TAG_SHADERS);
+    if (scene->vert_source == NULL) {
+        fprintf(stderr, "ERROR: failed to read file `%s`: %s\n", scene->conf.vert_path, strerror(errno));
+        ok = false;
+    }
+
+    scene->frag_source = slurp_asset_into_malloced_cstr(scene->conf.frag_path, MEM_TAG_SHADERS);
+    if (scene->frag_source == NULL) {
+        fprintf(stderr, "ERROR: failed to read file `%s`: %s\n", scene->conf.frag_path, strerror(errno));
+        ok = false;
+    }
+
+    // A broken texture doesn't fail the scene, the shaders still work without it
+    if (scene->conf.texture_path != NULL && texture_source_open(scene->conf.texture_path, &scene->texture_source)) {
+        scene->has_texture_source = true;
+        texture_source_decode(scene->conf.texture_path, &scene->texture_source);
+    }
+
+    jobs_mutex_lock(&scenes_mutex);
+    scene->state = ok ? SCENE_PREPARED : SCENE_FAILED;
+    jobs_mutex_unlock(&scenes_mutex);
+}
+
+static void scene_free_prepared(Scene *scene)
+{
+    mem_free(scene->vert_source);
+    mem_free(scene->frag_source);
+    scene->vert_source = NULL;
+    scene->frag_source = NULL;
+    if (scene->has_texture_source) {
+        texture_source_close(&scene->texture_source);
+        scene->has_texture_source = false;
+    }
+}
+
+static void scene_upload(Scene *scene, Resource_Manager *rm)
+{
+    scene->program = resources_load_program_from_sources(rm,
+                     scene->conf.vert_path, scene->conf.frag_path,
+                     scene->vert_source, scene->frag_source);
+
+    if (scene->has_texture_source && scene->texture_source.pixels != NULL) {
+        scene->texture = resources_load_texture_from_source(rm, scene->conf.texture_path, &scene->texture_source);
+    }
+
+    GLuint program = resources_use_program(rm, scene->program);
+    for (Uniform index = 0; index < COUNT_UNIFORMS; ++index) {
+        scene->uniforms[index] = program != 0 ? glGetUniformLocation(program, uniform_names[index]) : -1;
+    }
+    scene->timeline_locations = (Timeline_Locations) {0};
+
+    scene_free_prepared(scene);
+
+    jobs_mutex_lock(&scenes_mutex);
+    scene->state = program != 0 ? SCENE_READY : SCENE_FAILED;
+    jobs_mutex_unlock(&scenes_mutex);
+}
+
+// Replaces the program of a ready scene, e.g. with a tuned variant of its shaders
+void scene_set_program(Scene *scene, Resource_Manager *rm, Program_Handle program)
+{
+    resources_release_program(rm, scene->program);
+    scene->program = program;
+    GLuint id = resources_use_program(rm, program);
+    for (Uniform index = 0; index < COUNT_UNIFORMS; ++index) {
+        scene->uniforms[index] = id != 0 ? glGetUniformLocation(id, uniform_names[index]) : -1;
+    }
+    scene->timeline_locations = (Timeline_Locations) {0};
+}
+
+// Starts loading `confs` in the background. Expects `scenes` to be unloaded.
+void scenes_load(Scenes *scenes, Job_Pool *pool, const Scene_Conf *confs, size_t confs_count)
+{
+    size_t current = scenes->current;
+    memset(scenes, 0, sizeof(*scenes));
+    scenes->count = confs_count < SCENES_CAP ? confs_count : SCENES_CAP;
+    scenes->current = current < scenes->count ? current : 0;
+
+    for (size_t i = 0; i < scenes->count; ++i) {
+        scenes->items[i].conf = confs[i];
+        scenes->items[i].state = SCENE_LOADING;
+    }
+
+    // The current scene goes first, the rest is prefetched behind it
+    job_pool_submit(pool, scene_prepare_job, &scenes->items[scenes->current]);
+    for (size_t i = 0; i < scenes->count; ++i) {
+        if (i != scenes->current) job_pool_submit(pool, scene_prepare_job, &scenes->items[i]);
+    }
+}
+
+// Uploads at most one prepared scene, so a burst of finished jobs doesn't
+// stall a single frame. Returns false when there was nothing to upload.
+bool scenes_upload_prepared(Scenes *scenes, Resource_Manager *rm)
+{
+    size_t order[SCENES_CAP];
+    size_t order_count = 0;
+    order[order_count++] = scenes->has_pending ? scenes->pending : scenes->current;
+    for (size_t i = 0; i < scenes->count; ++i) {
+        if (i != order[0]) order[order_count++] = i;
+    }
+
+    for (size_t i = 0; i < order_count && order[i] < scenes->count; ++i) {
+        Scene *scene = &scenes->items[order[i]];
+        if (scene_get_state(scene) != SCENE_PREPARED) continue;
+
+        scene_upload(scene, rm);
+        printf("Scene %zu `%s` is %s\n", order[i] + 1, scene->conf.name,
+               scene->state == SCENE_READY ? "ready" : "FAILED");
+        if (scenes->has_pending && scenes->pending == order[i]) {
+            scenes->current = scenes->pending;
+            scenes->has_pending = false;
+        }
+        return true;
+    }
+
+    // Scenes that failed in the prepare job never get uploaded, don't wait for them
+    if (scenes->has_pending && scene_get_state(&scenes->items[scenes->pending]) == SCENE_FAILED) {
+        scenes->current = scenes->pending;
+        scenes->has_pending = false;
+    }
+
+    return false;
+}
+
+// Expects no prepare jobs of `scenes` to be in flight
+void scenes_unload(Scenes *scenes, Resource_Manager *rm)
+{
+    for (size_t i = 0; i < scenes->count; ++i) {
+        Scene *scene = &scenes->items[i];
+        scene_free_prepared(scene);
+        resources_release_program(rm, scene->program);
+        resources_release_texture(rm, scene->texture);
+    }
+    scenes->count = 0;
+}
+
+// Switching to a scene that is still loading makes it the current one as soon as it's ready
+void scenes_switch(Scenes *scenes, size_t index)
+{
+    if (index >= scenes->count) {
+        fprintf(stderr, "ERROR: there is no scene %zu, render.conf defines %zu\n", index + 1, scenes->count);
+        return;
+    }
+
+    Scene_State state = scene_get_state(&scenes->items[index]);
+    if (state == SCENE_READY || state == SCENE_FAILED) {
+        scenes->current = index;
+        scenes->has_pending = false;
+        printf("Scene %zu `%s`\n", index + 1, scenes->items[index].conf.name);
+    } else {
+        scenes->pending = index;
+        scenes->has_pending = true;
+        printf("Scene %zu `%s` is still loading\n", index + 1, scenes->items[index].conf.name);
+    }
+}
+
+Scene *scenes_current(Scenes *scenes)
+{
+    if (scenes->current >= scenes->count) return NULL;
+    return &scenes->items[scenes->current];
+}
@@ -0,0 +1,693 @@
+// Headless render server, started with `-serve <spool_dir>`. Clients drop
+// job files into the spool directory and the server renders them with a
+// hidden window and writes the results as PNGs. A job is a `<name>.job`
+// file in the format of render.conf:
+//
+//   frag = shaders/thumb.frag
+//   width = 256
+//   height = 256
+//   time = 1.5
+//   mouse = 128 128
+//   bands = 0.1 0.2 0.3 0.4
+//   output = thumbs/42.png
+//
+// `vert` defaults to SERVER_DEFAULT_VERT, `texture` is optional and
+// `output` defaults to `<name>.png` next to the job. Clients should write
+// the job under another name and rename it to `.job` once it's complete.
+// The server takes a job by renaming it to `<name>.taken`, so the job is
+// taken exactly once, and deletes it once its PNG is written. A job that
+// can't be rendered is left as `<name>.failed`. The PNG is written under a
+// temporary name and renamed too, so it's complete as soon as it appears.
+// A file called `stop` in the spool directory makes the server finish the
+// jobs it has and exit.
+//
+// Switching programs is the expensive part of rendering many small jobs,
+// so the oldest jobs are taken at once, up to SERVER_BATCH_CAP of them and
+// SERVER_BATCH_PIXELS pixels, and sorted by size, shaders and texture
+// before they are rendered back to back. All the jobs of a size share one
+// target from the Render_Targets pool, every job is read back into its
+// own part of a pixel pack buffer right after it is drawn, and the buffer
+// is only mapped once the whole batch is submitted, so the GPU doesn't
+// stall between jobs. The PNG encoding happens on the job pool while the
+// next batch renders. The pool is trimmed to SERVER_TARGETS_KEEP targets
+// after every batch, so a stream of different sizes doesn't fill it.
+// Programs and textures are kept by path for the lifetime of the server,
+// restart it to pick up edited shaders.
+//
+// Every SERVER_REPORT_SECONDS the server prints the throughput and the
+// latency of the jobs, from finding the job in the spool to writing its PNG.
+
+#define SERVER_QUEUE_CAP 1024
+#define SERVER_BATCH_CAP 32
+// A single larger job still makes a batch on its own
+#define SERVER_BATCH_PIXELS (4096*4096)
+#define SERVER_TARGETS_KEEP 8
+#define SERVER_PROGRAMS_CAP 64
+#define SERVER_TEXTURES_CAP 64
+#define SERVER_LATENCIES_CAP 4096
+#define SERVER_POLL_MS 10
+#define SERVER_REPORT_SECONDS 5.0
+#define SERVER_MAX_SIZE 8192
+#define SERVER_DEFAULT_VERT "shaders/main.vert"
+
+typedef struct {
+    // Contents of the job file, the paths point into it
+    char *content;
+    char *job_path;
+    char *output_path;
+    const char *vert_path;
+    const char *frag_path;
+    const char *texture_path;
+    int width;
+    int height;
+    float time;
+    float mouse[2];
+    float bands[4];
+    double queued_at;
+} Server_Job;
+
+typedef struct {
+    char *vert_path;
+    char *frag_path;
+    Program_Handle program;
+    GLint uniforms[COUNT_UNIFORMS];
+    size_t last_used_batch;
+} Server_Program;
+
+typedef struct {
+    char *path;
+    Texture_Handle texture;
+    size_t last_used_batch;
+} Server_Texture;
+
+typedef struct {
+    const char *spool_dir;
+    Resource_Manager *rm;
+    Render_Targets *targets;
+    Job_Pool *pool;
+    GLsizei vertices_count;
+
+    Server_Job *queue[SERVER_QUEUE_CAP];
+    size_t queue_count;
+
+    Server_Program programs[SERVER_PROGRAMS_CAP];
+    size_t programs_count;
+    Server_Texture textures[SERVER_TEXTURES_CAP];
+    size_t textures_count;
+    GLuint current_program;
+    // Where the batch is read back to
+    GLuint pbo;
+    size_t pbo_bytes;
+    size_t batches;
+    size_t program_switches;
+
+    // Updated by the encoding jobs
+    Jobs_Mutex mutex;
+    size_t done;
+    size_t failed;
+    double latencies[SERVER_LATENCIES_CAP];
+    size_t latencies_count;
+
+    double report_time;
+    size_t report_done;
+} Server;
+
+typedef struct {
+    Server *server;
+    unsigned char *pixels;
+    int width;
+    int height;
+    char *output_path;
+    char *job_path;
+    double queued_at;
+} Server_Encode;
+
+static void server_sleep_ms(unsigned ms)
+{
+#ifdef _WIN32
+    Sleep(ms);
+#else
+    usleep(ms*1000);
+#endif // _WIN32
+}
+
+static char *server_join_path(const char *dir, const char *name, const char *ext)
+{
+    size_t size = strlen(dir) + 1 + strlen(name) + strlen(ext) + 1;
+    char *path = mem_alloc(MEM_TAG_CONFIG, size);
+    if (path != NULL) snprintf(path, size, "%s/%s%s", dir, name, ext);
+    return path;
+}
+
+static bool server_file_exists(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) return false;
+    fclose(f);
+    return true;
+}
+
+static int server_cstr_cmp(const void *a, const void *b)
+{
+    return strcmp(*(char * const*) a, *(char * const*) b);
+}
+
+// Lists up to `cap` names of `.job` files in `dir`, sorted so jobs named
+// after the time they were made are taken in order. The names are malloced.
+static size_t server_list_jobs(const char *dir, char **names, size_t cap)
+{
+    size_t count = 0;
+#ifdef _WIN32
+    char *pattern = server_join_path(dir, "*", ".job");
+    if (pattern == NULL) return 0;
+    WIN32_FIND_DATAA data;
+    HANDLE find = FindFirstFileA(pattern, &data);
+    mem_free(pattern);
+    if (find == INVALID_HANDLE_VALUE) return 0;
+    do {
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) continue;
+        names[count] = mem_strdup(MEM_TAG_CONFIG, data.cFileName);
+        if (names[count] != NULL) count += 1;
+    } while (count < cap && FindNextFileA(find, &data));
+    FindClose(find);
+#else
+    DIR *d = opendir(dir);
+    if (d == NULL) return 0;
+    struct dirent *entry;
+    while (count < cap && (entry = readdir(d)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+        if (!sv_ends_with(sv_from_cstr(entry->d_name), SV(".job"))) continue;
+        names[count] = mem_strdup(MEM_TAG_CONFIG, entry->d_name);
+        if (names[count] != NULL) count += 1;
+    }
+    closedir(d);
+#endif // _WIN32
+    qsort(names, count, sizeof(names[0]), server_cstr_cmp);
+    return count;
+}
+
+static void server_job_free(Server_Job *job)
+{
+    if (job == NULL) return;
+    mem_free(job->content);
+    mem_free(job->job_path);
+    mem_free(job->output_path);
+    mem_free(job);
+}
+
+// Parses the contents of the job file, errors are reported like the ones of render.conf
+static bool server_job_parse(Server_Job *job, const char *spool_dir, const char *name)
+{
+    bool ok = true;
+    String_View content = sv_from_cstr(job->content);
+    job->vert_path = SERVER_DEFAULT_VERT;
+    for (int row = 0; content.count > 0; row++) {
+        String_View line = sv_chop_by_delim(&content, '\n');
+        const char *line_start = line.data;
+        line = sv_trim_left(line);
+        if (line.count == 0 || line.data[0] == '#') continue;
+
+        String_View key = sv_trim(sv_chop_by_delim(&line, '='));
+        String_View value = sv_trim_left(line);
+        // Safe for the same reasons as in reload_render_conf()
+        ((char*)value.data)[value.count] = '\0';
+
+        if (sv_eq(key, SV("vert"))) {
+            job->vert_path = value.data;
+        } else if (sv_eq(key, SV("frag"))) {
+            job->frag_path = value.data;
+        } else if (sv_eq(key, SV("texture"))) {
+            job->texture_path = value.data;
+        } else if (sv_eq(key, SV("output"))) {
+            mem_free(job->output_path);
+            job->output_path = mem_strdup(MEM_TAG_CONFIG, value.data);
+        } else if (sv_eq(key, SV("width"))) {
+            job->width = (int) sv_to_u64(value);
+        } else if (sv_eq(key, SV("height"))) {
+            job->height = (int) sv_to_u64(value);
+        } else if (sv_eq(key, SV("time"))) {
+            job->time = strtof(value.data, NULL);
+        } else if (sv_eq(key, SV("mouse"))) {
+            char *end = (char*) value.data;
+            for (size_t i = 0; i < 2; ++i) job->mouse[i] = strtof(end, &end);
+        } else if (sv_eq(key, SV("bands"))) {
+            char *end = (char*) value.data;
+            for (size_t i = 0; i < 4; ++i) job->bands[i] = strtof(end, &end);
+        } else {
+            printf("%s:%d:%ld: ERROR: unsupported key `"SV_Fmt"`\n",
+                   job->job_path, row, key.data - line_start, SV_Arg(key));
+            ok = false;
+        }
+    }
+
+    if (job->frag_path == NULL) {
+        printf("%s: ERROR: no `frag` provided\n", job->job_path);
+        ok = false;
+    }
+    if (job->width <= 0 || job->height <= 0 || job->width > SERVER_MAX_SIZE || job->height > SERVER_MAX_SIZE) {
+        printf("%s: ERROR: `width` and `height` must be between 1 and %d, got %dx%d\n",
+               job->job_path, SERVER_MAX_SIZE, job->width, job->height);
+        ok = false;
+    }
+    if (job->output_path == NULL) {
+        String_View stem = sv_from_cstr(name);
+        stem.count -= SV(".job").count;
+        char *stem_cstr = mem_alloc(MEM_TAG_CONFIG, stem.count + 1);
+        if (stem_cstr != NULL) {
+            memcpy(stem_cstr, stem.data, stem.count);
+            stem_cstr[stem.count] = '\0';
+            job->output_path = server_join_path(spool_dir, stem_cstr, ".png");
+            mem_free(stem_cstr);
+        }
+        if (job->output_path == NULL) ok = false;
+    }
+    return ok;
+}
+
+// Keeps the job file around as `<name>.failed` so the client can tell what happened
+static void server_fail_job_file(const char *taken_path)
+{
+    size_t size = strlen(taken_path) + sizeof(".failed");
+    char *failed_path = mem_alloc(MEM_TAG_CONFIG, size);
+    if (failed_path == NULL) return;
+    String_View stem = sv_from_cstr(taken_path);
+    stem.count -= SV(".taken").count;
+    snprintf(failed_path, size, SV_Fmt".failed", SV_Arg(stem));
+#ifdef _WIN32
+    remove(failed_path);
+#endif // _WIN32
+    rename(taken_path, failed_path);
+    mem_free(failed_path);
+}
+
+// Takes the new jobs of the spool into the queue
+static void server_scan(Server *server)
+{
+    if (server->queue_count >= SERVER_QUEUE_CAP) return;
+    static char *names[SERVER_QUEUE_CAP];
+    size_t count = server_list_jobs(server->spool_dir, names, SERVER_QUEUE_CAP - server->queue_count);
+    double now = glfwGetTime();
+    for (size_t i = 0; i < count; ++i) {
+        Server_Job *job = mem_alloc(MEM_TAG_CONFIG, sizeof(*job));
+        char *job_path = server_join_path(server->spool_dir, names[i], "");
+        if (job != NULL) {
+            memset(job, 0, sizeof(*job));
+            job->queued_at = now;
+            job->job_path = server_join_path(server->spool_dir, names[i], ".taken");
+        }
+        // Renaming takes the job atomically, it fails if another server on the same spool took it first
+        if (job == NULL || job_path == NULL || job->job_path == NULL || rename(job_path, job->job_path) != 0) {
+            server_job_free(job);
+            mem_free(job_path);
+            mem_free(names[i]);
+            continue;
+        }
+        job->content = slurp_file_into_malloced_cstr(job->job_path, MEM_TAG_CONFIG);
+        if (job->content == NULL || !server_job_parse(job, server->spool_dir, names[i])) {
+            if (job->content == NULL) {
+                fprintf(stderr, "ERROR: could not read %s: %s\n", job->job_path, strerror(errno));
+            }
+            server_fail_job_file(job->job_path);
+            server->failed += 1;
+            server_job_free(job);
+        } else {
+            server->queue[server->queue_count++] = job;
+        }
+        mem_free(job_path);
+        mem_free(names[i]);
+    }
+}
+
+static int server_job_cmp(const void *a, const void *b)
+{
+    const Server_Job *x = *(Server_Job * const*) a;
+    const Server_Job *y = *(Server_Job * const*) b;
+    int result = (x->width > y->width) - (x->width < y->width);
+    if (result == 0) result = (x->height > y->height) - (x->height < y->height);
+    if (result == 0) result = strcmp(x->vert_path, y->vert_path);
+    if (result == 0) result = strcmp(x->frag_path, y->frag_path);
+    if (result == 0) result = strcmp(x->texture_path ? x->texture_path : "", y->texture_path ? y->texture_path : "");
+    return result;
+}
+
+static void server_program_free(Server *server, Server_Program *program)
+{
+    resources_release_program(server->rm, program->program);
+    mem_free(program->vert_path);
+    mem_free(program->frag_path);
+}
+
+// Returns NULL if the shaders don't compile. Failures aren't kept, so a fixed
+// shader is picked up by the next job that uses it.
+static Server_Program *server_program(Server *server, const char *vert_path, const char *frag_path)
+{
+    for (size_t i = 0; i < server->programs_count; ++i) {
+        Server_Program *program = &server->programs[i];
+        if (strcmp(program->vert_path, vert_path) == 0 && strcmp(program->frag_path, frag_path) == 0) {
+            program->last_used_batch = server->batches;
+            return program;
+        }
+    }
+
+    Program_Handle handle = resources_load_program(server->rm, vert_path, frag_path);
+    GLuint id = resources_use_program(server->rm, handle);
+    if (id == 0) {
+        resources_release_program(server->rm, handle);
+        return NULL;
+    }
+
+    Server_Program *program = NULL;
+    if (server->programs_count < SERVER_PROGRAMS_CAP) {
+        program = &server->programs[server->programs_count++];
+    } else {
+        program = &server->programs[0];
+        for (size_t i = 1; i < server->programs_count; ++i) {
+            if (server->programs[i].last_used_batch < program->last_used_batch) program = &server->programs[i];
+        }
+        server_program_free(server, program);
+    }
+    program->vert_path = mem_strdup(MEM_TAG_CONFIG, vert_path);
+    program->frag_path = mem_strdup(MEM_TAG_CONFIG, frag_path);
+    program->program = handle;
+    program->last_used_batch = server->batches;
+    for (Uniform index = 0; index < COUNT_UNIFORMS; ++index) {
+        program->uniforms[index] = glGetUniformLocation(id, uniform_names[index]);
+    }
+    if (program->vert_path == NULL || program->frag_path == NULL) {
+        server_program_free(server, program);
+        *program = server->programs[--server->programs_count];
+        return NULL;
+    }
+    return program;
+}
+
+// Returns 0 if the texture can't be loaded
+static GLuint server_texture(Server *server, const char *path)
+{
+    for (size_t i = 0; i < server->textures_count; ++i) {
+        Server_Texture *texture = &server->textures[i];
+        if (strcmp(texture->path, path) == 0) {
+            texture->last_used_batch = server->batches;
+            return resources_use_texture(server->rm, texture->texture);
+        }
+    }
+
+    Texture_Handle handle = resources_load_texture(server->rm, path);
+    GLuint id = resources_use_texture(server->rm, handle);
+    char *path_copy = mem_strdup(MEM_TAG_CONFIG, path);
+    if (id == 0 || path_copy == NULL) {
+        resources_release_texture(server->rm, handle);
+        mem_free(path_copy);
+        return 0;
+    }
+
+    Server_Texture *texture = NULL;
+    if (server->textures_count < SERVER_TEXTURES_CAP) {
+        texture = &server->textures[server->textures_count++];
+    } else {
+        texture = &server->textures[0];
+        for (size_t i = 1; i < server->textures_count; ++i) {
+            if (server->textures[i].last_used_batch < texture->last_used_batch) texture = &server->textures[i];
+        }
+        resources_release_texture(server->rm, texture->texture);
+        mem_free(texture->path);
+    }
+    texture->path = path_copy;
+    texture->texture = handle;
+    texture->last_used_batch = server->batches;
+    return id;
+}
+
+static void server_encode_job(void *arg)
+{
+    Server_Encode *encode = arg;
+    Server *server = encode->server;
+
+    size_t size = strlen(encode->output_path) + TEMP_FILE_PATH_EXTRA;
+    char *tmp_path = mem_alloc(MEM_TAG_CAPTURE, size);
+    bool ok = tmp_path != NULL;
+    if (ok) {
+        temp_file_path(encode->output_path, tmp_path, size);
+        ok = save_rgb_png(tmp_path, encode->width, encode->height, encode->pixels);
+        ok = commit_temp_file(tmp_path, encode->output_path, ok);
+    }
+    if (ok) {
+        remove(encode->job_path);
+    } else {
+        fprintf(stderr, "ERROR: could not write %s: %s\n", encode->output_path, strerror(errno));
+        server_fail_job_file(encode->job_path);
+    }
+    double latency = glfwGetTime() - encode->queued_at;
+
+    jobs_mutex_lock(&server->mutex);
+    if (ok) {
+        server->done += 1;
+        if (server->latencies_count < SERVER_LATENCIES_CAP) {
+            server->latencies[server->latencies_count++] = latency;
+        }
+    } else {
+        server->failed += 1;
+    }
+    jobs_mutex_unlock(&server->mutex);
+
+    mem_free(tmp_path);
+    mem_free(encode->pixels);
+    mem_free(encode->output_path);
+    mem_free(encode->job_path);
+    mem_free(encode);
+}
+
+static void server_draw(Server *server, const Server_Program *program, const Server_Job *job)
+{
+    static_assert(COUNT_UNIFORMS == 7, "Update the server uniforms");
+    GLuint id = resources_use_program(server->rm, program->program);
+    if (id != server->current_program) {
+        glUseProgram(id);
+        server->current_program = id;
+        server->program_switches += 1;
+    }
+    glUniform2f(program->uniforms[RESOLUTION_UNIFORM], (GLfloat) job->width, (GLfloat) job->height);
+    glUniform1f(program->uniforms[TIME_UNIFORM], job->time);
+    glUniform2f(program->uniforms[MOUSE_UNIFORM], job->mouse[0], job->mouse[1]);
+    glUniform1i(program->uniforms[SPECTRUM_UNIFORM], 1);
+    glUniform1i(program->uniforms[VIDEO_UNIFORM], 2);
+    glUniform4f(program->uniforms[BANDS_UNIFORM], job->bands[0], job->bands[1], job->bands[2], job->bands[3]);
+    glUniform1f(program->uniforms[NYQUIST_UNIFORM], AUDIO_DEFAULT_SAMPLE_RATE*0.5f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, server->vertices_count, 1);
+}
+
+// Binds the pixel pack buffer with room for `bytes`, it only ever grows
+static void server_bind_pbo(Server *server, size_t bytes)
+{
+    if (server->pbo == 0) glGenBuffers(1, &server->pbo);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, server->pbo);
+    if (bytes <= server->pbo_bytes) return;
+    glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr) bytes, NULL, GL_STREAM_READ);
+    mem_track(MEM_TAG_GL_BUFFERS, (ptrdiff_t) (bytes - server->pbo_bytes));
+    server->pbo_bytes = bytes;
+}
+
+// Renders the oldest jobs of the queue and hands their pixels to the job pool
+static void server_render_batch(Server *server)
+{
+    Server_Job *batch[SERVER_BATCH_CAP];
+    size_t offsets[SERVER_BATCH_CAP];
+    bool rendered[SERVER_BATCH_CAP] = {0};
+    size_t count = 0;
+    size_t pixels_count = 0;
+    while (count < server->queue_count && count < SERVER_BATCH_CAP) {
+        const Server_Job *job = server->queue[count];
+        size_t job_pixels = (size_t) job->width*job->height;
+        if (count > 0 && pixels_count + job_pixels > SERVER_BATCH_PIXELS) break;
+        pixels_count += job_pixels;
+        count += 1;
+    }
+    memcpy(batch, server->queue, count*sizeof(batch[0]));
+    server->queue_count -= count;
+    memmove(server->queue, server->queue + count, server->queue_count*sizeof(server->queue[0]));
+    qsort(batch, count, sizeof(batch[0]), server_job_cmp);
+    server->batches += 1;
+
+    size_t bytes = 0;
+    for (size_t i = 0; i < count; ++i) {
+        offsets[i] = bytes;
+        bytes += (size_t) batch[i]->width*batch[i]->height*3;
+    }
+    server_bind_pbo(server, bytes);
+
+    size_t failed = 0;
+    Render_Target *target = NULL;
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    for (size_t i = 0; i < count; ++i) {
+        Server_Job *job = batch[i];
+        // Jobs are sorted by size, so every size acquires its target once
+        if (target != NULL && (target->width != job->width || target->height != job->height)) {
+            render_targets_release(target);
+            target = NULL;
+        }
+        Server_Program *program = server_program(server, job->vert_path, job->frag_path);
+        GLuint texture = 0;
+        if (program != NULL && job->texture_path != NULL) {
+            texture = server_texture(server, job->texture_path);
+            if (texture == 0) program = NULL;
+        }
+        if (program != NULL && target == NULL) {
+            target = render_targets_acquire(server->targets, job->width, job->height, GL_RGBA8, 1);
+        }
+        if (program == NULL || target == NULL) continue;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, target->framebuffer);
+        glViewport(0, 0, job->width, job->height);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        server_draw(server, program, job);
+        // With the pack buffer bound the pointer is the offset into it
+        read_rgb_pixels(job->width, job->height, (unsigned char*) offsets[i]);
+        rendered[i] = true;
+    }
+    render_targets_release(target);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // Mapping waits for the GPU to finish the whole batch
+    const unsigned char *mapped = NULL;
+    if (bytes > 0) mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr) bytes, GL_MAP_READ_BIT);
+    for (size_t i = 0; i < count; ++i) {
+        Server_Job *job = batch[i];
+        if (!rendered[i] || mapped == NULL) {
+            fprintf(stderr, "ERROR: could not render %s\n", job->job_path);
+            server_fail_job_file(job->job_path);
+            failed += 1;
+            server_job_free(job);
+            continue;
+        }
+        Server_Encode *encode = mem_alloc(MEM_TAG_CAPTURE, sizeof(*encode));
+        unsigned char *pixels = mem_alloc(MEM_TAG_CAPTURE, (size_t) job->width*job->height*3);
+        if (encode == NULL || pixels == NULL) {
+            fprintf(stderr, "ERROR: could not allocate memory for %s\n", job->output_path);
+            server_fail_job_file(job->job_path);
+            failed += 1;
+            mem_free(encode);
+            mem_free(pixels);
+        } else {
+            memcpy(pixels, mapped + offsets[i], (size_t) job->width*job->height*3);
+            *encode = (Server_Encode) {
+                .server = server,
+                .pixels = pixels,
+                .width = job->width,
+                .height = job->height,
+                .output_path = job->output_path,
+                .job_path = job->job_path,
+                .queued_at = job->queued_at,
+            };
+            // Owned by the encoding job now
+            job->output_path = NULL;
+            job->job_path = NULL;
+            if (!job_pool_submit(server->pool, server_encode_job, encode)) server_encode_job(encode);
+        }
+        server_job_free(job);
+    }
+    if (mapped != NULL) glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    render_targets_end_frame(server->targets);
+    render_targets_trim(server->targets, SERVER_TARGETS_KEEP);
+    resources_begin_frame(server->rm);
+
+    jobs_mutex_lock(&server->mutex);
+    server->failed += failed;
+    jobs_mutex_unlock(&server->mutex);
+}
+
+static int server_double_cmp(const void *a, const void *b)
+{
+    double x = *(const double*) a;
+    double y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+static void server_report(Server *server, double now)
+{
+    static double latencies[SERVER_LATENCIES_CAP];
+    jobs_mutex_lock(&server->mutex);
+    size_t done = server->done;
+    size_t failed = server->failed;
+    size_t count = server->latencies_count;
+    memcpy(latencies, server->latencies, count*sizeof(latencies[0]));
+    server->latencies_count = 0;
+    jobs_mutex_unlock(&server->mutex);
+
+    double seconds = now - server->report_time;
+    size_t jobs = done - server->report_done;
+    server->report_time = now;
+    server->report_done = done;
+    if (jobs == 0) return;
+
+    printf("Server: %.1f jobs/s", seconds > 0.0 ? (double) jobs/seconds : 0.0);
+    if (count > 0) {
+        qsort(latencies, count, sizeof(latencies[0]), server_double_cmp);
+        printf(", latency p50 %.1f ms, p95 %.1f ms, max %.1f ms",
+               latencies[count/2]*1000.0, latencies[(count - 1)*95/100]*1000.0, latencies[count - 1]*1000.0);
+    }
+    printf(", %zu done, %zu failed, %zu queued, %zu program switches in %zu batches\n",
+           done, failed, server->queue_count, server->program_switches, server->batches);
+    fflush(stdout);
+}
+
+// Serves the spool until a `stop` file shows up in it
+bool server_run(const char *spool_dir, Job_Pool *pool, Resource_Manager *rm, Render_Targets *targets,
+                GLsizei vertices_count)
+{
+    static Server server = {0};
+    server.spool_dir = spool_dir;
+    server.pool = pool;
+    server.rm = rm;
+    server.targets = targets;
+    server.vertices_count = vertices_count;
+    jobs_mutex_init(&server.mutex);
+    mem_track(MEM_TAG_RENDERER, sizeof(server));
+
+    char *stop_path = server_join_path(spool_dir, "stop", "");
+    if (stop_path == NULL) return false;
+    printf("Server: serving %s, create %s to stop\n", spool_dir, stop_path);
+    fflush(stdout);
+
+    // The spectrum and the video are not available to jobs
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_1D, 0);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+
+    server.report_time = glfwGetTime();
+    bool stopping = false;
+    for (;;) {
+        // Checked before scanning, so the jobs submitted before `stop` are all served
+        if (!stopping && server_file_exists(stop_path)) stopping = true;
+        server_scan(&server);
+        if (server.queue_count > 0) {
+            server_render_batch(&server);
+        } else if (stopping) {
+            break;
+        } else {
+            server_sleep_ms(SERVER_POLL_MS);
+        }
+
+        double now = glfwGetTime();
+        if (now - server.report_time >= SERVER_REPORT_SECONDS) server_report(&server, now);
+    }
+
+    job_pool_wait(pool);
+    server_report(&server, glfwGetTime());
+    remove(stop_path);
+    mem_free(stop_path);
+    for (size_t i = 0; i < server.programs_count; ++i) server_program_free(&server, &server.programs[i]);
+    for (size_t i = 0; i < server.textures_count; ++i) {
+        resources_release_texture(rm, server.textures[i].texture);
+        mem_free(server.textures[i].path);
+    }
+    if (server.pbo != 0) {
+        glDeleteBuffers(1, &server.pbo);
+        mem_track(MEM_TAG_GL_BUFFERS, -(ptrdiff_t) server.pbo_bytes);
+    }
+    printf("Server: stopped, %zu jobs done, %zu failed\n", server.done, server.failed);
+    return true;
+}
@@ -0,0 +1,23 @@
+#version 330
+
+precision mediump float;
+
+uniform vec2 resolution;
+uniform float time;
+uniform vec2 mouse;
+uniform sampler2D tex;
+
+in vec2 uv;
+in vec4 color;
+out vec4 out_color;
+
+// Procedural textures tile, so they can be sampled at any scale
+#define TILES 3.0
+
+void main(void) {
+    vec2 aspect = vec2(resolution.x / resolution.y, 1.0);
+    float a = texture(tex, uv*aspect*TILES + vec2(time*0.05, 0.0)).r;
+    float b = texture(tex, uv*aspect*TILES*0.5 - vec2(0.0, time*0.03)).r;
+    float n = a*b;
+    out_color = vec4(mix(vec3(0.05, 0.1, 0.3), vec3(1.0, 0.8, 0.5), n), 1.0);
+}
@@ -0,0 +1,25 @@
+#version 330
+
+precision mediump float;
+
+uniform vec2 resolution;
+uniform float time;
+uniform vec2 mouse;
+uniform sampler1D spectrum;
+uniform vec4 bands;
+uniform float nyquist;
+
+in vec2 uv;
+in vec4 color;
+out vec4 out_color;
+
+void main(void) {
+    // Log frequency axis, the bins are linear from 0 to half the sample rate
+    float bin = exp2(mix(log2(20.0), log2(20000.0), uv.x)) / nyquist;
+    float level = texture(spectrum, bin).r;
+    float bar = step(uv.y, level);
+
+    vec3 background = vec3(0.05) + 0.3*vec3(bands.x, bands.y*0.5, bands.z + bands.w);
+    vec3 foreground = mix(vec3(0.2, 0.6, 1.0), vec3(1.0, 0.4, 0.2), uv.y);
+    out_color = vec4(mix(background, foreground, bar), 1.0);
+}
@@ -0,0 +1,28 @@
+#version 330
+
+precision mediump float;
+
+uniform vec2 resolution;
+uniform float time;
+uniform vec2 mouse;
+uniform sampler2D video;
+
+in vec2 uv;
+in vec4 color;
+out vec4 out_color;
+
+void main(void) {
+    // Video rows go from top to bottom like the rows of images
+    vec3 c = texture(video, vec2(uv.x, 1.0 - uv.y)).rgb;
+
+    // Left of the mouse is the original, right of it is graded
+    if (gl_FragCoord.x > mouse.x) {
+        float luma = dot(c, vec3(0.299, 0.587, 0.114));
+        c = mix(vec3(luma), c, 1.4);
+        c = smoothstep(0.0, 1.0, c);
+        float vignette = 1.0 - 0.6*dot(uv - 0.5, uv - 0.5);
+        c *= vignette;
+    }
+
+    out_color = vec4(c, 1.0);
+}
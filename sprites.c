@@ -0,0 +1,946 @@
+// Sprites. render.conf can scatter a field of textured quads over a square
+// world bigger than the window:
+//
+//   sprites = 100000
+//   sprite_textures = assets/tsodinW.png assets/tsodinSleep.png
+//   sprite_world = 8192
+//   sprite_scroll = 200
+//   sprite_submit = auto
+//
+// Every texture is a material, a layer of one texture array. The sprites are
+// placed by a fixed seed, so the same configuration always gives the same
+// field, and uploaded once. The window looks at the world from a camera that
+// bounces between its edges at `sprite_scroll` pixels per second.
+//
+// The world is split into SPRITES_CELL_SIZE cells and the sprites are sorted
+// by material and then by the cell they are in, so every (material, cell)
+// pair is a batch of consecutive instances. Every frame the cells in view are
+// picked and their batches are submitted in one of two ways:
+//
+// - draws: one glDrawArraysInstanced per batch with the material in
+//   uniforms, works on every GL 3.3 context,
+// - indirect: the batches are written into an indirect buffer as draw
+//   commands, their materials into a shader storage buffer, and all of them
+//   go in a single glMultiDrawArraysIndirect. The vertex shader fetches the
+//   material of its draw with gl_DrawIDARB. Needs GL 4.3 and
+//   ARB_shader_draw_parameters.
+// - gpu: the CPU doesn't look at the sprites at all. Compute shaders test
+//   every sprite against the view and compact the visible ones into another
+//   buffer, keeping their order so overlapping sprites don't flicker: every
+//   workgroup counts its visible sprites with a prefix sum in shared memory,
+//   a single workgroup scans the counts into offsets and the total goes
+//   straight into the instance count of an indirect draw command, then
+//   every workgroup writes its sprites at its offset. The draw is one
+//   glDrawArraysIndirect. Needs GL 4.3.
+//
+// `auto` picks the first of gpu, indirect and draws the context can do.
+//
+// The textures can be sprite sheets of equally sized frames that the
+// sprites play as flipbooks:
+//
+//   sprite_frames = 8 4
+//   sprite_clip = 0 8 12
+//   sprite_clip = 8 16 24
+//
+// `sprite_frames` is the number of columns and rows of every sheet, and
+// every `sprite_clip` is a range of frames, counted left to right and top to
+// bottom, played in a loop at a number of frames per second. Every sprite
+// gets a clip, a start time and a playback rate from the seed, and the
+// vertex shader picks the frame out of the `time` uniform, so animating
+// costs nothing on the CPU and nothing is uploaded after the load. Without
+// clips every sprite shows the first frame.
+
+#define SPRITES_MATERIALS_CAP 16
+#define SPRITES_CLIPS_CAP 16
+#define SPRITES_CELL_SIZE 256
+#define SPRITES_MIN_SIZE 16.0f
+#define SPRITES_MAX_SIZE 64.0f
+// Sprites start their clips up to this many seconds before the first frame
+#define SPRITES_MAX_START 8.0f
+#define SPRITES_MIN_RATE 0.75f
+#define SPRITES_MAX_RATE 1.25f
+#define SPRITES_CULL_GROUP_SIZE 256
+#define SPRITES_CULL_GROUPS_CAP 65535
+
+typedef enum {
+    SPRITES_SUBMIT_AUTO = 0,
+    SPRITES_SUBMIT_DRAWS,
+    SPRITES_SUBMIT_INDIRECT,
+    SPRITES_SUBMIT_GPU,
+    COUNT_SPRITES_SUBMITS,
+} Sprites_Submit;
+
+static const char *sprites_submit_names[COUNT_SPRITES_SUBMITS] = {
+    [SPRITES_SUBMIT_AUTO]     = "auto",
+    [SPRITES_SUBMIT_DRAWS]    = "draws",
+    [SPRITES_SUBMIT_INDIRECT] = "indirect",
+    [SPRITES_SUBMIT_GPU]      = "gpu",
+};
+
+typedef struct {
+    size_t count;
+    const char *texture_paths[SPRITES_MATERIALS_CAP];
+    size_t textures_count;
+    int world_size;
+    float scroll;
+    Sprites_Submit submit;
+    // Columns and rows of the sprite sheets
+    int frames[2];
+    // First frame, number of frames and frames per second
+    float clips[SPRITES_CLIPS_CAP][3];
+    size_t clips_count;
+} Sprites_Conf;
+
+static const Sprites_Conf sprites_conf_default = {
+    .world_size = 4096,
+    .scroll = 200.0f,
+    .frames = {1, 1},
+};
+
+// Position and size in world pixels, y goes down. The clip starts playing
+// at `start` seconds, `rate` times as fast as its frames per second. Same
+// layout as `Sprite` of the culling shaders.
+typedef struct {
+    float x, y, w, h;
+    uint8_t tint[4];
+    uint32_t material;
+    float start;
+    float rate;
+    uint32_t clip;
+} Sprite_Instance;
+static_assert(sizeof(Sprite_Instance) == 36, "Update `Sprite` of the sprite culling shaders");
+
+// Layout of glMultiDrawArraysIndirect
+typedef struct {
+    GLuint count;
+    GLuint instance_count;
+    GLuint first;
+    GLuint base_instance;
+} Sprites_Draw_Command;
+
+// std430 layout of the `draws` buffer of the indirect vertex shader
+typedef struct {
+    float uv_scale[2];
+    float layer;
+    float pad;
+} Sprites_Draw_Data;
+
+typedef struct {
+    Sprites_Conf conf;
+    Sprite_Instance *instances;
+    size_t count;
+    int cells_per_side;
+    size_t cells_count;
+    // Instances of batch `b = material*cells_count + cell` are
+    // [batch_first[b], batch_first[b + 1])
+    uint32_t *batch_first;
+    size_t batches_count;
+
+    GLuint texture;
+    size_t materials_count;
+    size_t texture_bytes;
+    float uv_scales[SPRITES_MATERIALS_CAP][2];
+    // The clips of the conf, or a single frame without them
+    float clips[SPRITES_CLIPS_CAP][3];
+    size_t clips_count;
+
+    bool can_indirect;
+    bool can_gpu;
+    // Never SPRITES_SUBMIT_AUTO
+    Sprites_Submit submit;
+    GLuint program;
+    GLint camera_uniform;
+    GLint resolution_uniform;
+    GLint uv_scale_uniform;
+    GLint layer_uniform;
+    GLint textures_uniform;
+    GLint time_uniform;
+    GLint frames_uniform;
+    GLint clips_uniform;
+    GLuint indirect_program;
+    GLint indirect_camera_uniform;
+    GLint indirect_resolution_uniform;
+    GLint indirect_textures_uniform;
+    GLint indirect_time_uniform;
+    GLint indirect_frames_uniform;
+    GLint indirect_clips_uniform;
+    GLuint gpu_program;
+    GLint gpu_camera_uniform;
+    GLint gpu_resolution_uniform;
+    GLint gpu_textures_uniform;
+    GLint gpu_uv_scales_uniform;
+    GLint gpu_time_uniform;
+    GLint gpu_frames_uniform;
+    GLint gpu_clips_uniform;
+    GLuint cull_count_program;
+    GLint cull_count_view_uniform;
+    GLint cull_count_sprites_count_uniform;
+    GLuint cull_scan_program;
+    GLint cull_scan_groups_count_uniform;
+    GLuint cull_scatter_program;
+    GLint cull_scatter_view_uniform;
+    GLint cull_scatter_sprites_count_uniform;
+    GLuint gpu_vao;
+    GLuint visible_buffer;
+    GLuint group_counts_buffer;
+    GLuint gpu_command_buffer;
+    size_t gpu_buffers_bytes;
+    GLuint vao;
+    GLuint instance_buffer;
+    GLuint command_buffer;
+    GLuint draw_data_buffer;
+    Sprites_Draw_Command *commands;
+    Sprites_Draw_Data *draw_data;
+
+    // What the last frame submitted
+    size_t visible_batches;
+    size_t visible_instances;
+    size_t draw_calls;
+    double submit_ms;
+} Sprites;
+
+// The frame of the clip is counted in integers, float division by the
+// number of columns could land a frame in the wrong row
+#define SPRITES_VERT_BODY \
+    "layout(location = 0) in vec4 rect;\n" \
+    "layout(location = 1) in vec4 tint;\n" \
+    "layout(location = 3) in vec2 playback;\n" \
+    "layout(location = 4) in float clip;\n" \
+    "uniform vec2 camera;\n" \
+    "uniform vec2 resolution;\n" \
+    "uniform float time;\n" \
+    "uniform ivec2 frames;\n" \
+    "uniform vec3 clips[16];\n" \
+    "out vec3 uv;\n" \
+    "flat out vec2 uv_min;\n" \
+    "flat out vec2 uv_max;\n" \
+    "out vec4 color;\n" \
+    "void main(void)\n" \
+    "{\n" \
+    "    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);\n" \
+    "    vec2 pixel = rect.xy + corner*rect.zw - camera;\n" \
+    "    gl_Position = vec4(pixel.x/resolution.x*2.0 - 1.0, 1.0 - pixel.y/resolution.y*2.0, 0.0, 1.0);\n" \
+    "    vec3 c = clips[int(clip)];\n" \
+    "    int played = int(floor(max(time - playback.x, 0.0)*playback.y*c.z));\n" \
+    "    int frame = int(c.x) + played % max(int(c.y), 1);\n" \
+    "    vec2 cell = vec2(frame % frames.x, frame / frames.x);\n" \
+    "    vec2 size = UV_SCALE/vec2(frames);\n" \
+    "    uv = vec3((cell + corner)*size, LAYER);\n" \
+    "    uv_min = cell*size;\n" \
+    "    uv_max = (cell + 1.0)*size;\n" \
+    "    color = tint;\n" \
+    "}\n"
+
+static const char *sprites_vert_source =
+    "#version 330\n"
+    "uniform vec2 uv_scale;\n"
+    "uniform float layer;\n"
+    "#define UV_SCALE uv_scale\n"
+    "#define LAYER layer\n"
+    SPRITES_VERT_BODY;
+
+static const char *sprites_indirect_vert_source =
+    "#version 430\n"
+    "#extension GL_ARB_shader_draw_parameters : require\n"
+    "struct Draw {\n"
+    "    vec2 uv_scale;\n"
+    "    float layer;\n"
+    "    float pad;\n"
+    "};\n"
+    "layout(std430, binding = 0) readonly buffer Draws {\n"
+    "    Draw draws[];\n"
+    "};\n"
+    "#define UV_SCALE draws[gl_DrawIDARB].uv_scale\n"
+    "#define LAYER draws[gl_DrawIDARB].layer\n"
+    SPRITES_VERT_BODY;
+
+static_assert(SPRITES_MATERIALS_CAP == 16, "Update the size of uv_scales in the GPU sprite shader");
+static_assert(SPRITES_CLIPS_CAP == 16, "Update the size of clips in the sprite shaders");
+static const char *sprites_gpu_vert_source =
+    "#version 430\n"
+    "layout(location = 2) in float material;\n"
+    "uniform vec2 uv_scales[16];\n"
+    "#define UV_SCALE uv_scales[int(material)]\n"
+    "#define LAYER material\n"
+    SPRITES_VERT_BODY;
+
+// Every workgroup finds its visible sprites and their order with an
+// inclusive prefix sum in shared memory. Without SCATTER it stores how many
+// there are, with SCATTER it writes them at the offset the scan pass made
+// out of the count.
+#define SPRITES_CULL_BODY \
+    "layout(local_size_x = 256) in;\n" \
+    "struct Sprite {\n" \
+    "    float x, y, w, h;\n" \
+    "    uint tint;\n" \
+    "    uint material;\n" \
+    "    float start, rate;\n" \
+    "    uint clip;\n" \
+    "};\n" \
+    "layout(std430, binding = 0) readonly buffer Sprites {\n" \
+    "    Sprite sprites[];\n" \
+    "};\n" \
+    "layout(std430, binding = 1) buffer Group_Counts {\n" \
+    "    uint group_counts[];\n" \
+    "};\n" \
+    "layout(std430, binding = 2) writeonly buffer Visible {\n" \
+    "    Sprite visible[];\n" \
+    "};\n" \
+    "uniform vec4 view;\n" \
+    "uniform int sprites_count;\n" \
+    "shared uint scan[256];\n" \
+    "void main(void)\n" \
+    "{\n" \
+    "    uint i = gl_GlobalInvocationID.x;\n" \
+    "    uint l = gl_LocalInvocationID.x;\n" \
+    "    Sprite s = Sprite(0.0, 0.0, 0.0, 0.0, 0u, 0u, 0.0, 0.0, 0u);\n" \
+    "    bool keep = false;\n" \
+    "    if (i < uint(sprites_count)) {\n" \
+    "        s = sprites[i];\n" \
+    "        keep = s.x < view.z && s.y < view.w && s.x + s.w > view.x && s.y + s.h > view.y;\n" \
+    "    }\n" \
+    "    scan[l] = keep ? 1u : 0u;\n" \
+    "    memoryBarrierShared();\n" \
+    "    barrier();\n" \
+    "    for (uint offset = 1u; offset < 256u; offset <<= 1) {\n" \
+    "        uint v = l >= offset ? scan[l - offset] : 0u;\n" \
+    "        memoryBarrierShared();\n" \
+    "        barrier();\n" \
+    "        scan[l] += v;\n" \
+    "        memoryBarrierShared();\n" \
+    "        barrier();\n" \
+    "    }\n" \
+    "#ifdef SCATTER\n" \
+    "    if (keep) visible[group_counts[gl_WorkGroupID.x] + scan[l] - 1u] = s;\n" \
+    "#else\n" \
+    "    if (l == 255u) group_counts[gl_WorkGroupID.x] = scan[255];\n" \
+    "#endif\n" \
+    "}\n"
+
+static_assert(SPRITES_CULL_GROUP_SIZE == 256, "Update the workgroup size of the sprite culling shaders");
+static const char *sprites_cull_count_source =
+    "#version 430\n"
+    SPRITES_CULL_BODY;
+
+static const char *sprites_cull_scatter_source =
+    "#version 430\n"
+    "#define SCATTER\n"
+    SPRITES_CULL_BODY;
+
+// A single workgroup turns the counts into exclusive offsets 256 at a time
+// and makes the draw command out of the total
+static const char *sprites_cull_scan_source =
+    "#version 430\n"
+    "layout(local_size_x = 256) in;\n"
+    "layout(std430, binding = 1) buffer Group_Counts {\n"
+    "    uint group_counts[];\n"
+    "};\n"
+    "layout(std430, binding = 3) writeonly buffer Command {\n"
+    "    uint count;\n"
+    "    uint instance_count;\n"
+    "    uint first;\n"
+    "    uint base_instance;\n"
+    "};\n"
+    "uniform int groups_count;\n"
+    "shared uint scan[256];\n"
+    "void main(void)\n"
+    "{\n"
+    "    uint l = gl_LocalInvocationID.x;\n"
+    "    uint carry = 0u;\n"
+    "    for (uint base = 0u; base < uint(groups_count); base += 256u) {\n"
+    "        uint i = base + l;\n"
+    "        uint v = i < uint(groups_count) ? group_counts[i] : 0u;\n"
+    "        scan[l] = v;\n"
+    "        memoryBarrierShared();\n"
+    "        barrier();\n"
+    "        for (uint offset = 1u; offset < 256u; offset <<= 1) {\n"
+    "            uint u = l >= offset ? scan[l - offset] : 0u;\n"
+    "            memoryBarrierShared();\n"
+    "            barrier();\n"
+    "            scan[l] += u;\n"
+    "            memoryBarrierShared();\n"
+    "            barrier();\n"
+    "        }\n"
+    "        if (i < uint(groups_count)) group_counts[i] = carry + scan[l] - v;\n"
+    "        carry += scan[255];\n"
+    "        memoryBarrierShared();\n"
+    "        barrier();\n"
+    "    }\n"
+    "    if (l == 0u) {\n"
+    "        count = 4u;\n"
+    "        instance_count = carry;\n"
+    "        first = 0u;\n"
+    "        base_instance = 0u;\n"
+    "    }\n"
+    "}\n";
+
+static const char *sprites_frag_source =
+    "#version 330\n"
+    "uniform sampler2DArray textures;\n"
+    "in vec3 uv;\n"
+    "flat in vec2 uv_min;\n"
+    "flat in vec2 uv_max;\n"
+    "in vec4 color;\n"
+    "out vec4 out_color;\n"
+    "void main(void)\n"
+    "{\n"
+    "    // Keeps the filtering away from the neighbouring frames and the unused part of the layer\n"
+    "    vec2 half_texel = 0.5/vec2(textureSize(textures, 0).xy);\n"
+    "    out_color = texture(textures, vec3(clamp(uv.xy, uv_min + half_texel, uv_max - half_texel), uv.z))*color;\n"
+    "}\n";
+
+bool sprites_submit_by_name(String_View name, Sprites_Submit *submit)
+{
+    for (Sprites_Submit s = 0; s < COUNT_SPRITES_SUBMITS; ++s) {
+        if (sv_eq(name, sv_from_cstr(sprites_submit_names[s]))) {
+            *submit = s;
+            return true;
+        }
+    }
+    return false;
+}
+
+void sprites_unload(Sprites *sprites)
+{
+    mem_free(sprites->instances);
+    mem_free(sprites->batch_first);
+    mem_free(sprites->commands);
+    mem_free(sprites->draw_data);
+    sprites->instances = NULL;
+    sprites->batch_first = NULL;
+    sprites->commands = NULL;
+    sprites->draw_data = NULL;
+    if (sprites->count > 0) {
+        mem_track(MEM_TAG_GL_BUFFERS, -(ptrdiff_t) (sprites->count*sizeof(Sprite_Instance)));
+    }
+    if (sprites->gpu_buffers_bytes > 0) {
+        mem_track(MEM_TAG_GL_BUFFERS, -(ptrdiff_t) sprites->gpu_buffers_bytes);
+        sprites->gpu_buffers_bytes = 0;
+    }
+    sprites->count = 0;
+    sprites->batches_count = 0;
+    if (sprites->texture != 0) {
+        glDeleteTextures(1, &sprites->texture);
+        mem_track(MEM_TAG_GL_TEXTURES, -(ptrdiff_t) sprites->texture_bytes);
+        sprites->texture = 0;
+        sprites->texture_bytes = 0;
+    }
+    sprites->materials_count = 0;
+}
+
+static void sprites_instance_pointers(size_t first)
+{
+    size_t offset = first*sizeof(Sprite_Instance);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(Sprite_Instance),
+                          (void*) (offset + offsetof(Sprite_Instance, x)));
+    glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Sprite_Instance),
+                          (void*) (offset + offsetof(Sprite_Instance, tint)));
+    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(Sprite_Instance),
+                          (void*) (offset + offsetof(Sprite_Instance, start)));
+    glVertexAttribPointer(4, 1, GL_UNSIGNED_INT, GL_FALSE, sizeof(Sprite_Instance),
+                          (void*) (offset + offsetof(Sprite_Instance, clip)));
+}
+
+static void sprites_playback_uniforms(const Sprites *sprites, GLint time_uniform, GLint frames_uniform,
+                                      GLint clips_uniform, double time)
+{
+    glUniform1f(time_uniform, (GLfloat) time);
+    glUniform2i(frames_uniform, sprites->conf.frames[0], sprites->conf.frames[1]);
+    glUniform3fv(clips_uniform, (GLsizei) sprites->clips_count, &sprites->clips[0][0]);
+}
+
+static bool sprites_create_gl_objects(Sprites *sprites)
+{
+    if (!create_program(sprites_vert_source, sprites_frag_source, &sprites->program)) return false;
+    sprites->camera_uniform = glGetUniformLocation(sprites->program, "camera");
+    sprites->resolution_uniform = glGetUniformLocation(sprites->program, "resolution");
+    sprites->uv_scale_uniform = glGetUniformLocation(sprites->program, "uv_scale");
+    sprites->layer_uniform = glGetUniformLocation(sprites->program, "layer");
+    sprites->textures_uniform = glGetUniformLocation(sprites->program, "textures");
+    sprites->time_uniform = glGetUniformLocation(sprites->program, "time");
+    sprites->frames_uniform = glGetUniformLocation(sprites->program, "frames");
+    sprites->clips_uniform = glGetUniformLocation(sprites->program, "clips");
+
+    GLint major = 0;
+    GLint minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    sprites->can_indirect = (major > 4 || (major == 4 && minor >= 3)) &&
+                            glMultiDrawArraysIndirect != NULL && glBindBufferBase != NULL &&
+                            glfwExtensionSupported("GL_ARB_shader_draw_parameters");
+    if (sprites->can_indirect) {
+        if (create_program(sprites_indirect_vert_source, sprites_frag_source, &sprites->indirect_program)) {
+            sprites->indirect_camera_uniform = glGetUniformLocation(sprites->indirect_program, "camera");
+            sprites->indirect_resolution_uniform = glGetUniformLocation(sprites->indirect_program, "resolution");
+            sprites->indirect_textures_uniform = glGetUniformLocation(sprites->indirect_program, "textures");
+            sprites->indirect_time_uniform = glGetUniformLocation(sprites->indirect_program, "time");
+            sprites->indirect_frames_uniform = glGetUniformLocation(sprites->indirect_program, "frames");
+            sprites->indirect_clips_uniform = glGetUniformLocation(sprites->indirect_program, "clips");
+            glGenBuffers(1, &sprites->command_buffer);
+            glGenBuffers(1, &sprites->draw_data_buffer);
+        } else {
+            fprintf(stderr, "WARN: could not compile the indirect sprite shader, falling back to separate draws\n");
+            sprites->can_indirect = false;
+        }
+    }
+
+    sprites->can_gpu = (major > 4 || (major == 4 && minor >= 3)) && glDispatchCompute != NULL &&
+                       glMemoryBarrier != NULL && glDrawArraysIndirect != NULL && glBindBufferBase != NULL;
+    if (sprites->can_gpu) {
+        if (create_program(sprites_gpu_vert_source, sprites_frag_source, &sprites->gpu_program) &&
+                create_compute_program(sprites_cull_count_source, &sprites->cull_count_program) &&
+                create_compute_program(sprites_cull_scan_source, &sprites->cull_scan_program) &&
+                create_compute_program(sprites_cull_scatter_source, &sprites->cull_scatter_program)) {
+            sprites->gpu_camera_uniform = glGetUniformLocation(sprites->gpu_program, "camera");
+            sprites->gpu_resolution_uniform = glGetUniformLocation(sprites->gpu_program, "resolution");
+            sprites->gpu_textures_uniform = glGetUniformLocation(sprites->gpu_program, "textures");
+            sprites->gpu_uv_scales_uniform = glGetUniformLocation(sprites->gpu_program, "uv_scales");
+            sprites->gpu_time_uniform = glGetUniformLocation(sprites->gpu_program, "time");
+            sprites->gpu_frames_uniform = glGetUniformLocation(sprites->gpu_program, "frames");
+            sprites->gpu_clips_uniform = glGetUniformLocation(sprites->gpu_program, "clips");
+            sprites->cull_count_view_uniform = glGetUniformLocation(sprites->cull_count_program, "view");
+            sprites->cull_count_sprites_count_uniform = glGetUniformLocation(sprites->cull_count_program, "sprites_count");
+            sprites->cull_scan_groups_count_uniform = glGetUniformLocation(sprites->cull_scan_program, "groups_count");
+            sprites->cull_scatter_view_uniform = glGetUniformLocation(sprites->cull_scatter_program, "view");
+            sprites->cull_scatter_sprites_count_uniform = glGetUniformLocation(sprites->cull_scatter_program, "sprites_count");
+            glGenBuffers(1, &sprites->visible_buffer);
+            glGenBuffers(1, &sprites->group_counts_buffer);
+            glGenBuffers(1, &sprites->gpu_command_buffer);
+        } else {
+            fprintf(stderr, "WARN: could not compile the sprite culling shaders, culling on the CPU\n");
+            sprites->can_gpu = false;
+        }
+    }
+
+    GLint vao = 0;
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &vao);
+    glGenVertexArrays(1, &sprites->vao);
+    glBindVertexArray(sprites->vao);
+    glGenBuffers(1, &sprites->instance_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, sprites->instance_buffer);
+    // Location 2 is the material, only the GPU culled sprites take it from the instance
+    static const GLuint attributes[] = {0, 1, 3, 4};
+    for (size_t i = 0; i < sizeof(attributes)/sizeof(attributes[0]); ++i) {
+        glEnableVertexAttribArray(attributes[i]);
+        glVertexAttribDivisor(attributes[i], 1);
+    }
+    if (sprites->can_gpu) {
+        // The culled sprites are drawn straight from the buffer the culling wrote them into
+        glGenVertexArrays(1, &sprites->gpu_vao);
+        glBindVertexArray(sprites->gpu_vao);
+        glBindBuffer(GL_ARRAY_BUFFER, sprites->visible_buffer);
+        for (GLuint i = 0; i < 5; ++i) {
+            glEnableVertexAttribArray(i);
+            glVertexAttribDivisor(i, 1);
+        }
+        sprites_instance_pointers(0);
+        glVertexAttribPointer(2, 1, GL_UNSIGNED_INT, GL_FALSE, sizeof(Sprite_Instance),
+                              (void*) offsetof(Sprite_Instance, material));
+    }
+    glBindVertexArray((GLuint) vao);
+    return true;
+}
+
+// Every material is a layer of the array, the smaller images sit in the top
+// left corner of their layer and `uv_scales` tells how much of it they cover
+static bool sprites_load_textures(Sprites *sprites, const Sprites_Conf *conf)
+{
+    Texture_Source sources[SPRITES_MATERIALS_CAP];
+    size_t opened = 0;
+    int width = 1;
+    int height = 1;
+    bool ok = true;
+    for (; opened < conf->textures_count; ++opened) {
+        const char *path = conf->texture_paths[opened];
+        if (!texture_source_open(path, &sources[opened])) {
+            ok = false;
+            break;
+        }
+        if (!texture_source_decode(path, &sources[opened])) {
+            opened += 1;
+            ok = false;
+            break;
+        }
+        if (sources[opened].width > width) width = sources[opened].width;
+        if (sources[opened].height > height) height = sources[opened].height;
+    }
+
+    if (ok) {
+        size_t layers = conf->textures_count > 0 ? conf->textures_count : 1;
+        glGenTextures(1, &sprites->texture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, sprites->texture);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width, height, (GLsizei) layers, 0,
+                     GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        sprites->texture_bytes = (size_t) width*height*layers*4;
+        mem_track(MEM_TAG_GL_TEXTURES, (ptrdiff_t) sprites->texture_bytes);
+
+        if (conf->textures_count == 0) {
+            // Without textures the sprites are plain quads of their tint
+            static const uint8_t white[4] = {255, 255, 255, 255};
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, 1, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, white);
+            sprites->uv_scales[0][0] = 1.0f/(float) width;
+            sprites->uv_scales[0][1] = 1.0f/(float) height;
+        }
+        for (size_t i = 0; i < conf->textures_count; ++i) {
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, (GLint) i, sources[i].width, sources[i].height, 1,
+                            GL_RGBA, GL_UNSIGNED_BYTE, sources[i].pixels);
+            sprites->uv_scales[i][0] = (float) sources[i].width/(float) width;
+            sprites->uv_scales[i][1] = (float) sources[i].height/(float) height;
+        }
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        sprites->materials_count = layers;
+    }
+
+    for (size_t i = 0; i < opened; ++i) texture_source_close(&sources[i]);
+    return ok;
+}
+
+static uint32_t sprites_random(uint32_t *state)
+{
+    // xorshift32
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static float sprites_random_float(uint32_t *state)
+{
+    return (float) (sprites_random(state) >> 8)/(float) (1 << 24);
+}
+
+// Scatters the sprites over the world and sorts them into batches with a
+// counting sort by (material, cell)
+static bool sprites_generate(Sprites *sprites)
+{
+    size_t count = sprites->count;
+    sprites->cells_per_side = (sprites->conf.world_size + SPRITES_CELL_SIZE - 1)/SPRITES_CELL_SIZE;
+    sprites->cells_count = (size_t) sprites->cells_per_side*sprites->cells_per_side;
+    sprites->batches_count = sprites->materials_count*sprites->cells_count;
+
+    sprites->instances = mem_alloc(MEM_TAG_SPRITES, count*sizeof(Sprite_Instance));
+    sprites->batch_first = mem_alloc(MEM_TAG_SPRITES, (sprites->batches_count + 1)*sizeof(uint32_t));
+    sprites->commands = mem_alloc(MEM_TAG_SPRITES, sprites->batches_count*sizeof(Sprites_Draw_Command));
+    sprites->draw_data = mem_alloc(MEM_TAG_SPRITES, sprites->batches_count*sizeof(Sprites_Draw_Data));
+    Sprite_Instance *unsorted = mem_alloc(MEM_TAG_SPRITES, count*sizeof(Sprite_Instance));
+    uint32_t *keys = mem_alloc(MEM_TAG_SPRITES, count*sizeof(uint32_t));
+    bool ok = sprites->instances != NULL && sprites->batch_first != NULL && sprites->commands != NULL &&
+              sprites->draw_data != NULL && unsorted != NULL && keys != NULL;
+
+    if (ok) {
+        memset(sprites->batch_first, 0, (sprites->batches_count + 1)*sizeof(uint32_t));
+        uint32_t state = 0x9E3779B9;
+        // Playback has a seed of its own so clips don't move the sprites around
+        uint32_t playback_state = 0x85EBCA6B;
+        float world = (float) sprites->conf.world_size;
+        for (size_t i = 0; i < count; ++i) {
+            Sprite_Instance *sprite = &unsorted[i];
+            float size = SPRITES_MIN_SIZE + (SPRITES_MAX_SIZE - SPRITES_MIN_SIZE)*sprites_random_float(&state);
+            sprite->w = size;
+            sprite->h = size;
+            sprite->x = (world - size)*sprites_random_float(&state);
+            sprite->y = (world - size)*sprites_random_float(&state);
+            for (size_t c = 0; c < 3; ++c) sprite->tint[c] = (uint8_t) (128 + sprites_random(&state)%128);
+            sprite->tint[3] = 255;
+            size_t material = sprites_random(&state)%sprites->materials_count;
+            sprite->material = (uint32_t) material;
+            size_t cell = (size_t) (sprite->y/SPRITES_CELL_SIZE)*sprites->cells_per_side +
+                          (size_t) (sprite->x/SPRITES_CELL_SIZE);
+            sprite->start = -SPRITES_MAX_START*sprites_random_float(&playback_state);
+            sprite->rate = SPRITES_MIN_RATE + (SPRITES_MAX_RATE - SPRITES_MIN_RATE)*sprites_random_float(&playback_state);
+            sprite->clip = (uint32_t) (sprites_random(&playback_state)%sprites->clips_count);
+            keys[i] = (uint32_t) (material*sprites->cells_count + cell);
+            sprites->batch_first[keys[i] + 1] += 1;
+        }
+        for (size_t b = 0; b < sprites->batches_count; ++b) {
+            sprites->batch_first[b + 1] += sprites->batch_first[b];
+        }
+        // batch_first doubles as the insertion cursor, it's shifted back after
+        for (size_t i = 0; i < count; ++i) {
+            sprites->instances[sprites->batch_first[keys[i]]++] = unsorted[i];
+        }
+        memmove(sprites->batch_first + 1, sprites->batch_first, sprites->batches_count*sizeof(uint32_t));
+        sprites->batch_first[0] = 0;
+    }
+
+    mem_free(unsorted);
+    mem_free(keys);
+    return ok;
+}
+
+bool sprites_load(Sprites *sprites, const Sprites_Conf *conf)
+{
+    sprites_unload(sprites);
+    sprites->conf = *conf;
+    if (conf->count == 0) return true;
+    if (conf->world_size <= 0 || conf->count > UINT32_MAX) {
+        fprintf(stderr, "ERROR: invalid sprite world size %d or count %zu\n", conf->world_size, conf->count);
+        return false;
+    }
+
+    int frames_count = conf->frames[0]*conf->frames[1];
+    if (conf->frames[0] <= 0 || conf->frames[1] <= 0) {
+        fprintf(stderr, "ERROR: invalid sprite sheet of %dx%d frames\n", conf->frames[0], conf->frames[1]);
+        return false;
+    }
+    for (size_t i = 0; i < conf->clips_count; ++i) {
+        const float *clip = conf->clips[i];
+        if (clip[0] < 0.0f || clip[1] < 1.0f || clip[0] + clip[1] > (float) frames_count) {
+            fprintf(stderr, "ERROR: sprite clip %zu plays frames %g to %g, but the sprite sheets have %d\n",
+                    i, clip[0], clip[0] + clip[1] - 1.0f, frames_count);
+            return false;
+        }
+    }
+    if (conf->clips_count > 0) {
+        memcpy(sprites->clips, conf->clips, sizeof(sprites->clips));
+        sprites->clips_count = conf->clips_count;
+    } else {
+        memset(sprites->clips, 0, sizeof(sprites->clips));
+        sprites->clips[0][1] = 1.0f;
+        sprites->clips_count = 1;
+    }
+
+    if (sprites->program == 0 && !sprites_create_gl_objects(sprites)) {
+        fprintf(stderr, "ERROR: could not compile the sprite shaders\n");
+        return false;
+    }
+    size_t groups_count = (conf->count + SPRITES_CULL_GROUP_SIZE - 1)/SPRITES_CULL_GROUP_SIZE;
+    bool can_gpu = sprites->can_gpu && groups_count <= SPRITES_CULL_GROUPS_CAP;
+    switch (conf->submit) {
+    case SPRITES_SUBMIT_AUTO:
+        sprites->submit = can_gpu ? SPRITES_SUBMIT_GPU :
+                          sprites->can_indirect ? SPRITES_SUBMIT_INDIRECT : SPRITES_SUBMIT_DRAWS;
+        break;
+    case SPRITES_SUBMIT_DRAWS:
+        sprites->submit = SPRITES_SUBMIT_DRAWS;
+        break;
+    case SPRITES_SUBMIT_INDIRECT:
+        if (!sprites->can_indirect) {
+            fprintf(stderr, "WARN: indirect sprite submission needs GL 4.3 with ARB_shader_draw_parameters, "
+                    "falling back to separate draws\n");
+        }
+        sprites->submit = sprites->can_indirect ? SPRITES_SUBMIT_INDIRECT : SPRITES_SUBMIT_DRAWS;
+        break;
+    case SPRITES_SUBMIT_GPU:
+        if (!can_gpu) {
+            fprintf(stderr, "WARN: GPU sprite culling needs GL 4.3 and at most %d sprites, culling on the CPU\n",
+                    SPRITES_CULL_GROUPS_CAP*SPRITES_CULL_GROUP_SIZE);
+        }
+        sprites->submit = can_gpu ? SPRITES_SUBMIT_GPU :
+                          sprites->can_indirect ? SPRITES_SUBMIT_INDIRECT : SPRITES_SUBMIT_DRAWS;
+        break;
+    default:
+        assert(0 && "unreachable");
+    }
+
+    sprites->count = conf->count;
+    if (!sprites_load_textures(sprites, conf) || !sprites_generate(sprites)) {
+        fprintf(stderr, "ERROR: could not load the sprites\n");
+        sprites->count = 0;
+        sprites_unload(sprites);
+        return false;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, sprites->instance_buffer);
+    glBufferData(GL_ARRAY_BUFFER, sprites->count*sizeof(Sprite_Instance), sprites->instances, GL_STATIC_DRAW);
+    mem_track(MEM_TAG_GL_BUFFERS, (ptrdiff_t) (sprites->count*sizeof(Sprite_Instance)));
+    if (sprites->submit == SPRITES_SUBMIT_INDIRECT) {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, sprites->command_buffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, sprites->batches_count*sizeof(Sprites_Draw_Command), NULL, GL_STREAM_DRAW);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, sprites->draw_data_buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sprites->batches_count*sizeof(Sprites_Draw_Data), NULL, GL_STREAM_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+    if (sprites->submit == SPRITES_SUBMIT_GPU) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, sprites->visible_buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sprites->count*sizeof(Sprite_Instance), NULL, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, sprites->group_counts_buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, groups_count*sizeof(uint32_t), NULL, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, sprites->gpu_command_buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(Sprites_Draw_Command), NULL, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        sprites->gpu_buffers_bytes = sprites->count*sizeof(Sprite_Instance) + groups_count*sizeof(uint32_t) +
+                                     sizeof(Sprites_Draw_Command);
+        mem_track(MEM_TAG_GL_BUFFERS, (ptrdiff_t) sprites->gpu_buffers_bytes);
+    }
+
+    printf("Sprites: %zu in %zu batches of %zu materials, %zu clips, %s submission\n", sprites->count,
+           sprites->batches_count, sprites->materials_count, conf->clips_count, sprites_submit_names[sprites->submit]);
+    return true;
+}
+
+static float sprites_ping_pong(float x, float range)
+{
+    if (range <= 0.0f) return 0.0f;
+    float t = fmodf(x, 2.0f*range);
+    return t < range ? t : 2.0f*range - t;
+}
+
+// Draws the sprites in view over whatever is in the `width` x `height` framebuffer
+void sprites_render(Sprites *sprites, int width, int height, double time)
+{
+    if (sprites->count == 0 || width <= 0 || height <= 0) return;
+    double start = glfwGetTime();
+
+    float world = (float) sprites->conf.world_size;
+    float camera_x = floorf(sprites_ping_pong((float) time*sprites->conf.scroll, world - (float) width));
+    float camera_y = floorf(sprites_ping_pong((float) time*sprites->conf.scroll*0.5f, world - (float) height));
+
+    // Sprites belong to the cell of their top left corner, so they can stick
+    // out of it by SPRITES_MAX_SIZE to the right and down
+    int last = sprites->cells_per_side - 1;
+    int cx0 = (int) floorf((camera_x - SPRITES_MAX_SIZE)/SPRITES_CELL_SIZE);
+    int cy0 = (int) floorf((camera_y - SPRITES_MAX_SIZE)/SPRITES_CELL_SIZE);
+    int cx1 = (int) floorf((camera_x + (float) width)/SPRITES_CELL_SIZE);
+    int cy1 = (int) floorf((camera_y + (float) height)/SPRITES_CELL_SIZE);
+    if (cx0 < 0) cx0 = 0;
+    if (cy0 < 0) cy0 = 0;
+    if (cx1 > last) cx1 = last;
+    if (cy1 > last) cy1 = last;
+
+    GLint vao = 0;
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &vao);
+    glBindVertexArray(sprites->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, sprites->instance_buffer);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, sprites->texture);
+
+    sprites->visible_batches = 0;
+    sprites->visible_instances = 0;
+    sprites->draw_calls = 0;
+    if (sprites->submit == SPRITES_SUBMIT_GPU) {
+        // Culled per sprite rather than per cell, so the view is enough
+        GLuint groups_count = (GLuint) ((sprites->count + SPRITES_CULL_GROUP_SIZE - 1)/SPRITES_CULL_GROUP_SIZE);
+        float view_x1 = camera_x + (float) width;
+        float view_y1 = camera_y + (float) height;
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, sprites->instance_buffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, sprites->group_counts_buffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, sprites->visible_buffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, sprites->gpu_command_buffer);
+
+        glUseProgram(sprites->cull_count_program);
+        glUniform4f(sprites->cull_count_view_uniform, camera_x, camera_y, view_x1, view_y1);
+        glUniform1i(sprites->cull_count_sprites_count_uniform, (GLint) sprites->count);
+        glDispatchCompute(groups_count, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        glUseProgram(sprites->cull_scan_program);
+        glUniform1i(sprites->cull_scan_groups_count_uniform, (GLint) groups_count);
+        glDispatchCompute(1, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        glUseProgram(sprites->cull_scatter_program);
+        glUniform4f(sprites->cull_scatter_view_uniform, camera_x, camera_y, view_x1, view_y1);
+        glUniform1i(sprites->cull_scatter_sprites_count_uniform, (GLint) sprites->count);
+        glDispatchCompute(groups_count, 1, 1);
+        glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+        glUseProgram(sprites->gpu_program);
+        glUniform2f(sprites->gpu_camera_uniform, camera_x, camera_y);
+        glUniform2f(sprites->gpu_resolution_uniform, (GLfloat) width, (GLfloat) height);
+        glUniform1i(sprites->gpu_textures_uniform, 0);
+        glUniform2fv(sprites->gpu_uv_scales_uniform, (GLsizei) sprites->materials_count, &sprites->uv_scales[0][0]);
+        sprites_playback_uniforms(sprites, sprites->gpu_time_uniform, sprites->gpu_frames_uniform,
+                                  sprites->gpu_clips_uniform, time);
+        glBindVertexArray(sprites->gpu_vao);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, sprites->gpu_command_buffer);
+        glDrawArraysIndirect(GL_TRIANGLE_STRIP, NULL);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        sprites->draw_calls = 1;
+    } else if (sprites->submit == SPRITES_SUBMIT_INDIRECT) {
+        glUseProgram(sprites->indirect_program);
+        glUniform2f(sprites->indirect_camera_uniform, camera_x, camera_y);
+        glUniform2f(sprites->indirect_resolution_uniform, (GLfloat) width, (GLfloat) height);
+        glUniform1i(sprites->indirect_textures_uniform, 0);
+        sprites_playback_uniforms(sprites, sprites->indirect_time_uniform, sprites->indirect_frames_uniform,
+                                  sprites->indirect_clips_uniform, time);
+        size_t commands_count = 0;
+        for (size_t material = 0; material < sprites->materials_count; ++material) {
+            for (int cy = cy0; cy <= cy1; ++cy) {
+                for (int cx = cx0; cx <= cx1; ++cx) {
+                    size_t batch = material*sprites->cells_count + (size_t) cy*sprites->cells_per_side + cx;
+                    uint32_t first = sprites->batch_first[batch];
+                    uint32_t count = sprites->batch_first[batch + 1] - first;
+                    if (count == 0) continue;
+                    sprites->commands[commands_count] = (Sprites_Draw_Command) {
+                        .count = 4,
+                        .instance_count = count,
+                        .first = 0,
+                        .base_instance = first,
+                    };
+                    sprites->draw_data[commands_count] = (Sprites_Draw_Data) {
+                        .uv_scale = {sprites->uv_scales[material][0], sprites->uv_scales[material][1]},
+                        .layer = (float) material,
+                    };
+                    commands_count += 1;
+                    sprites->visible_instances += count;
+                }
+            }
+        }
+        sprites->visible_batches = commands_count;
+        if (commands_count > 0) {
+            sprites_instance_pointers(0);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, sprites->command_buffer);
+            glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commands_count*sizeof(Sprites_Draw_Command), sprites->commands);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, sprites->draw_data_buffer);
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, commands_count*sizeof(Sprites_Draw_Data), sprites->draw_data);
+            glMultiDrawArraysIndirect(GL_TRIANGLE_STRIP, NULL, (GLsizei) commands_count, 0);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+            sprites->draw_calls = 1;
+        }
+    } else {
+        glUseProgram(sprites->program);
+        glUniform2f(sprites->camera_uniform, camera_x, camera_y);
+        glUniform2f(sprites->resolution_uniform, (GLfloat) width, (GLfloat) height);
+        glUniform1i(sprites->textures_uniform, 0);
+        sprites_playback_uniforms(sprites, sprites->time_uniform, sprites->frames_uniform,
+                                  sprites->clips_uniform, time);
+        for (size_t material = 0; material < sprites->materials_count; ++material) {
+            glUniform2f(sprites->uv_scale_uniform, sprites->uv_scales[material][0], sprites->uv_scales[material][1]);
+            glUniform1f(sprites->layer_uniform, (GLfloat) material);
+            for (int cy = cy0; cy <= cy1; ++cy) {
+                for (int cx = cx0; cx <= cx1; ++cx) {
+                    size_t batch = material*sprites->cells_count + (size_t) cy*sprites->cells_per_side + cx;
+                    uint32_t first = sprites->batch_first[batch];
+                    uint32_t count = sprites->batch_first[batch + 1] - first;
+                    if (count == 0) continue;
+                    // GL 3.3 has no base instance, the instance attributes are moved to the batch instead
+                    sprites_instance_pointers(first);
+                    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei) count);
+                    sprites->visible_batches += 1;
+                    sprites->visible_instances += count;
+                    sprites->draw_calls += 1;
+                }
+            }
+        }
+    }
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    glBindVertexArray((GLuint) vao);
+    double ms = (glfwGetTime() - start)*1000.0;
+    sprites->submit_ms = sprites->submit_ms > 0.0 ? sprites->submit_ms*0.9 + ms*0.1 : ms;
+}
+
+void sprites_print_stats(const Sprites *sprites)
+{
+    if (sprites->count == 0) return;
+    if (sprites->submit == SPRITES_SUBMIT_GPU) {
+        // Only the GPU knows how many sprites survived, reading it back waits for the last frame
+        Sprites_Draw_Command command = {0};
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, sprites->gpu_command_buffer);
+        glGetBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(command), &command);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        printf("Sprites: %u of %zu visible, culled on the GPU, 3 dispatches and 1 draw call (gpu), "
+               "%.3f ms CPU to submit\n", command.instance_count, sprites->count, sprites->submit_ms);
+        return;
+    }
+    printf("Sprites: %zu of %zu visible in %zu batches, %zu draw calls (%s), %.3f ms CPU to submit\n",
+           sprites->visible_instances, sprites->count, sprites->visible_batches, sprites->draw_calls,
+           sprites_submit_names[sprites->submit], sprites->submit_ms);
+}
@@ -28,6 +28,8 @@
 #include <string.h>
 #include <ctype.h>
 
+#include "hash.h"
+
 #ifndef SVDEF
 #define SVDEF
 #endif // SVDEF
@@ -71,6 +73,8 @@ SVDEF bool sv_eq_ignorecase(String_View a, String_View b);
 SVDEF bool sv_starts_with(String_View sv, String_View prefix);
 SVDEF bool sv_ends_with(String_View sv, String_View suffix);
 SVDEF uint64_t sv_to_u64(String_View sv);
+SVDEF uint64_t sv_hash(String_View sv, uint64_t seed);
+SVDEF Hash128 sv_hash128(String_View sv, uint64_t seed);
 
 #endif  // SV_H_
 
@@ -286,6 +290,16 @@ SVDEF uint64_t sv_to_u64(String_View sv)
     return result;
 }
 
+SVDEF uint64_t sv_hash(String_View sv, uint64_t seed)
+{
+    return hash64(sv.data, sv.count, seed);
+}
+
+SVDEF Hash128 sv_hash128(String_View sv, uint64_t seed)
+{
+    return hash128(sv.data, sv.count, seed);
+}
+
 SVDEF String_View sv_chop_left_while(String_View *sv, bool (*predicate)(char x))
 {
     size_t i = 0;
@@ -0,0 +1,318 @@
+// Parameter sweeps. A scene in render.conf can list float uniforms of its
+// fragment shader with a range to sweep them over:
+//
+//   frag = shaders/clouds.frag
+//   sweep = density 0.1 1.0 8
+//   sweep = time 0 4 6
+//   sweep_cell = 192 108
+//
+// F11 renders every combination of the values, `from` to `to` in `steps`
+// evenly spaced steps, into its own cell of a contact sheet and saves it as
+// SWEEP_PNG_PATH with the values of every cell listed in SWEEP_TXT_PATH.
+// The first uniform changes fastest, along the rows.
+//
+// All the cells are one instanced draw. The values of every combination go
+// into an instance buffer, the vertex shader places the quad of an instance
+// into its cell of the sheet and passes the values on as flat varyings.
+// The fragment shader of the scene gets `#define`s that turn the swept
+// uniforms into those varyings, with their declarations blanked out, and
+// gl_FragCoord made relative to the cell, so it renders every cell as if
+// the cell was the whole window. `resolution` is the size of a cell and
+// the mouse is in its middle.
+
+#define SWEEP_PARAMS_CAP 8
+#define SWEEP_CELLS_CAP 4096
+#define SWEEP_PNG_PATH "sweep.png"
+#define SWEEP_TXT_PATH "sweep.txt"
+
+static_assert(SWEEP_PARAMS_CAP == 8, "The sweep shaders pass the values as two vec4s");
+
+typedef struct {
+    String_View name;
+    float from;
+    float to;
+    size_t steps;
+} Sweep_Param;
+
+typedef struct {
+    Sweep_Param params[SWEEP_PARAMS_CAP];
+    size_t params_count;
+    size_t cells_count;
+} Sweep_Space;
+
+static const char *sweep_vert_source =
+    "#version 330\n"
+    "layout(location = 0) in vec4 values0;\n"
+    "layout(location = 1) in vec4 values1;\n"
+    "uniform ivec2 grid;\n"
+    "uniform vec2 cell;\n"
+    "out vec2 uv;\n"
+    "out vec4 color;\n"
+    "flat out vec4 sweep_values0;\n"
+    "flat out vec4 sweep_values1;\n"
+    "flat out vec2 sweep_origin;\n"
+    "void main(void)\n"
+    "{\n"
+    "    const vec2 corners[6] = vec2[6](vec2(0, 0), vec2(1, 0), vec2(0, 1), vec2(0, 1), vec2(1, 0), vec2(1, 1));\n"
+    "    vec2 corner = corners[gl_VertexID];\n"
+    "    // Cell 0 is at the top left\n"
+    "    ivec2 index = ivec2(gl_InstanceID % grid.x, grid.y - 1 - gl_InstanceID / grid.x);\n"
+    "    vec2 position = (vec2(index) + corner)/vec2(grid);\n"
+    "    gl_Position = vec4(position*2.0 - 1.0, 0.0, 1.0);\n"
+    "    uv = corner;\n"
+    "    color = vec4(0.0);\n"
+    "    sweep_values0 = values0;\n"
+    "    sweep_values1 = values1;\n"
+    "    sweep_origin = vec2(index)*cell;\n"
+    "}\n";
+
+static bool sweep_parse_space(const Scene_Conf *conf, Sweep_Space *space)
+{
+    memset(space, 0, sizeof(*space));
+    space->cells_count = 1;
+    for (size_t i = 0; i < conf->sweeps_count; ++i) {
+        Sweep_Param *param = &space->params[space->params_count++];
+        String_View sweep = sv_from_cstr(conf->sweeps[i]);
+        param->name = sv_chop_by_delim(&sweep, ' ');
+        char *end = (char*) sweep.data;
+        param->from = strtof(end, &end);
+        param->to = strtof(end, &end);
+        param->steps = (size_t) strtoull(end, &end, 10);
+        if (param->steps == 0 || space->cells_count*param->steps > SWEEP_CELLS_CAP) {
+            fprintf(stderr, "ERROR: `"SV_Fmt"` makes no cells or more than %d\n",
+                    SV_Arg(param->name), SWEEP_CELLS_CAP);
+            return false;
+        }
+        space->cells_count *= param->steps;
+    }
+    return true;
+}
+
+static float sweep_value(const Sweep_Space *space, size_t cell, size_t p)
+{
+    for (size_t i = 0; i < p; ++i) cell /= space->params[i].steps;
+    const Sweep_Param *param = &space->params[p];
+    size_t step = cell % param->steps;
+    if (param->steps == 1) return param->from;
+    return param->from + (param->to - param->from)*(float) step/(float) (param->steps - 1);
+}
+
+// Blanks out `uniform float <name>;` so the define of the swept value doesn't clash with it
+static void sweep_blank_declaration(char *source, String_View name)
+{
+    char *line = source;
+    while (*line != '\0') {
+        char *eol = strchr(line, '\n');
+        size_t length = eol != NULL ? (size_t) (eol - line) : strlen(line);
+        String_View rest = sv_trim((String_View) { .count = length, .data = line });
+        String_View words[4];
+        size_t words_count = 0;
+        while (rest.count > 0 && words_count < 4) {
+            words[words_count++] = sv_chop_by_delim(&rest, ' ');
+            rest = sv_trim_left(rest);
+        }
+        if (rest.count == 0 && words_count >= 3 && sv_eq(words[0], SV("uniform")) && sv_eq(words[1], SV("float"))) {
+            String_View declared = words[2];
+            bool semicolon = words_count == 4 && sv_eq(words[3], SV(";"));
+            if (words_count == 3 && declared.count > 0 && declared.data[declared.count - 1] == ';') {
+                declared.count -= 1;
+                semicolon = true;
+            }
+            if (semicolon && sv_eq(declared, name)) memset(line, ' ', length);
+        }
+        if (eol == NULL) break;
+        line = eol + 1;
+    }
+}
+
+// `frag_source` of a scene rewritten to take the swept uniforms from the
+// instance. `#line` keeps the line numbers of compile errors pointing into
+// the file.
+static char *sweep_frag_source(const Sweep_Space *space, const char *frag_source)
+{
+    const char *insert = frag_source;
+    int line = 1;
+    const char *version = strstr(frag_source, "#version");
+    if (version != NULL) {
+        for (const char *p = frag_source; p < version; ++p) line += *p == '\n';
+        const char *eol = strchr(version, '\n');
+        insert = eol != NULL ? eol + 1 : version + strlen(version);
+        line += 1;
+    }
+
+    static const char *header =
+        "flat in vec4 sweep_values0;\n"
+        "flat in vec4 sweep_values1;\n"
+        "flat in vec2 sweep_origin;\n"
+        "#define gl_FragCoord (gl_FragCoord - vec4(sweep_origin, 0.0, 0.0))\n";
+    size_t size = strlen(frag_source) + strlen(header) + 64;
+    for (size_t p = 0; p < space->params_count; ++p) size += space->params[p].name.count + 48;
+    char *source = mem_alloc(MEM_TAG_SHADERS, size);
+    if (source == NULL) return NULL;
+
+    int n = snprintf(source, size, "%.*s%s", (int) (insert - frag_source), frag_source, header);
+    for (size_t p = 0; p < space->params_count; ++p) {
+        n += snprintf(source + n, size - (size_t) n, "#define "SV_Fmt" sweep_values%zu.%c\n",
+                      SV_Arg(space->params[p].name), p/4, "xyzw"[p%4]);
+    }
+    int body = n + snprintf(source + n, size - (size_t) n, "#line %d\n", line);
+    snprintf(source + body, size - (size_t) body, "%s", insert);
+    for (size_t p = 0; p < space->params_count; ++p) sweep_blank_declaration(source + body, space->params[p].name);
+    return source;
+}
+
+static bool sweep_save(const Sweep_Space *space, int columns, int width, int height, unsigned char *pixels)
+{
+    if (!save_rgb_png(SWEEP_PNG_PATH, width, height, pixels)) {
+        fprintf(stderr, "ERROR: could not save %s: %s\n", SWEEP_PNG_PATH, strerror(errno));
+        return false;
+    }
+
+    FILE *f = fopen(SWEEP_TXT_PATH, "w");
+    if (f == NULL) {
+        fprintf(stderr, "ERROR: could not save %s: %s\n", SWEEP_TXT_PATH, strerror(errno));
+        return false;
+    }
+    for (size_t cell = 0; cell < space->cells_count; ++cell) {
+        fprintf(f, "%zu %zu %zu", cell, cell/(size_t) columns, cell%(size_t) columns);
+        for (size_t p = 0; p < space->params_count; ++p) {
+            fprintf(f, " "SV_Fmt"=%g", SV_Arg(space->params[p].name), sweep_value(space, cell, p));
+        }
+        fprintf(f, "\n");
+    }
+    fclose(f);
+    return true;
+}
+
+// Renders the contact sheet of `scene`, `time`, `bands` and the tracks of
+// `timeline` are used unless they are swept
+bool sweep_scene(const Scene *scene, Resource_Manager *rm, Render_Targets *targets, const Timeline *timeline,
+                 int cell_width, int cell_height, float time, const float *bands, float nyquist)
+{
+    if (scene == NULL || scene_get_state(scene) != SCENE_READY) {
+        fprintf(stderr, "ERROR: the scene is not ready for a sweep\n");
+        return false;
+    }
+    if (scene->conf.sweeps_count == 0) {
+        fprintf(stderr, "ERROR: scene `%s` has no `sweep` keys\n", scene->conf.name);
+        return false;
+    }
+    Sweep_Space space;
+    if (!sweep_parse_space(&scene->conf, &space)) return false;
+
+    // Close to square sheets, rows are cells_count/columns rounded up
+    int columns = (int) ceil(sqrt((double) space.cells_count*cell_height/cell_width));
+    if (columns < 1) columns = 1;
+    if ((size_t) columns > space.cells_count) columns = (int) space.cells_count;
+    int rows = (int) ((space.cells_count + (size_t) columns - 1)/(size_t) columns);
+    int width = columns*cell_width;
+    int height = rows*cell_height;
+    GLint max_size = 0;
+    GLint max_viewport[2] = {0};
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+    glGetIntegerv(GL_MAX_VIEWPORT_DIMS, max_viewport);
+    // The sheet is a texture and a viewport, whichever is smaller limits it
+    int max_width = max_size < max_viewport[0] ? max_size : max_viewport[0];
+    int max_height = max_size < max_viewport[1] ? max_size : max_viewport[1];
+    if (width > max_width || height > max_height) {
+        fprintf(stderr, "ERROR: a sweep of %zu cells of %dx%d makes a %dx%d sheet, the GPU can do up to %dx%d\n",
+                space.cells_count, cell_width, cell_height, width, height, max_width, max_height);
+        return false;
+    }
+
+    bool result = true;
+    char *frag_source = slurp_asset_into_malloced_cstr(scene->conf.frag_path, MEM_TAG_SHADERS);
+    char *source = frag_source != NULL ? sweep_frag_source(&space, frag_source) : NULL;
+    float *values = mem_alloc(MEM_TAG_RENDERER, space.cells_count*SWEEP_PARAMS_CAP*sizeof(float));
+    unsigned char *pixels = mem_alloc(MEM_TAG_CAPTURE, (size_t) width*height*3);
+    Render_Target *target = render_targets_acquire(targets, width, height, GL_RGBA8, 1);
+    GLuint program = 0;
+    GLuint vao = 0;
+    GLuint vbo = 0;
+    GLuint query = 0;
+    if (source == NULL || values == NULL || pixels == NULL || target == NULL) {
+        fprintf(stderr, "ERROR: could not prepare the sweep of scene `%s`\n", scene->conf.name);
+        result = false;
+        goto defer;
+    }
+    if (!create_program(sweep_vert_source, source, &program)) {
+        fprintf(stderr, "ERROR: could not compile the sweep of scene `%s`\n", scene->conf.name);
+        result = false;
+        goto defer;
+    }
+
+    memset(values, 0, space.cells_count*SWEEP_PARAMS_CAP*sizeof(float));
+    for (size_t cell = 0; cell < space.cells_count; ++cell) {
+        for (size_t p = 0; p < space.params_count; ++p) {
+            values[cell*SWEEP_PARAMS_CAP + p] = sweep_value(&space, cell, p);
+        }
+    }
+    GLint prev_vao = 0;
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &prev_vao);
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glGenBuffers(1, &vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) (space.cells_count*SWEEP_PARAMS_CAP*sizeof(float)),
+                 values, GL_STATIC_DRAW);
+    for (GLuint i = 0; i < 2; ++i) {
+        glEnableVertexAttribArray(i);
+        glVertexAttribPointer(i, 4, GL_FLOAT, GL_FALSE, SWEEP_PARAMS_CAP*sizeof(float),
+                              (void*) (i*4*sizeof(float)));
+        glVertexAttribDivisor(i, 1);
+    }
+
+    static_assert(COUNT_UNIFORMS == 7, "Update the sweep uniforms");
+    glUseProgram(program);
+    glUniform2i(glGetUniformLocation(program, "grid"), columns, rows);
+    glUniform2f(glGetUniformLocation(program, "cell"), (GLfloat) cell_width, (GLfloat) cell_height);
+    glUniform2f(glGetUniformLocation(program, uniform_names[RESOLUTION_UNIFORM]),
+                (GLfloat) cell_width, (GLfloat) cell_height);
+    glUniform1f(glGetUniformLocation(program, uniform_names[TIME_UNIFORM]), time);
+    glUniform2f(glGetUniformLocation(program, uniform_names[MOUSE_UNIFORM]),
+                (GLfloat) cell_width*0.5f, (GLfloat) cell_height*0.5f);
+    glUniform1i(glGetUniformLocation(program, uniform_names[SPECTRUM_UNIFORM]), 1);
+    glUniform1i(glGetUniformLocation(program, uniform_names[VIDEO_UNIFORM]), 2);
+    glUniform4f(glGetUniformLocation(program, uniform_names[BANDS_UNIFORM]), bands[0], bands[1], bands[2], bands[3]);
+    glUniform1f(glGetUniformLocation(program, uniform_names[NYQUIST_UNIFORM]), nyquist);
+    Timeline_Locations timeline_locations = {0};
+    timeline_upload(timeline, &timeline_locations, program);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, resources_use_texture(rm, scene->texture));
+
+    GLint framebuffer = 0;
+    GLint viewport[4];
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glBindFramebuffer(GL_FRAMEBUFFER, target->framebuffer);
+    glViewport(0, 0, width, height);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glGenQueries(1, &query);
+    glBeginQuery(GL_TIME_ELAPSED, query);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 6, (GLsizei) space.cells_count);
+    glEndQuery(GL_TIME_ELAPSED);
+    read_rgb_pixels(width, height, pixels);
+    GLuint64 elapsed = 0;
+    glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+    glBindFramebuffer(GL_FRAMEBUFFER, (GLuint) framebuffer);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    glBindVertexArray((GLuint) prev_vao);
+
+    result = sweep_save(&space, columns, width, height, pixels);
+    if (result) {
+        printf("Sweep: %zu cells of %dx%d in one draw, %.3f ms on the GPU, saved %s and %s\n",
+               space.cells_count, cell_width, cell_height, (double) elapsed/1e6, SWEEP_PNG_PATH, SWEEP_TXT_PATH);
+    }
+
+defer:
+    if (query != 0) glDeleteQueries(1, &query);
+    if (vbo != 0) glDeleteBuffers(1, &vbo);
+    if (vao != 0) glDeleteVertexArrays(1, &vao);
+    glDeleteProgram(program);
+    render_targets_release(target);
+    mem_free(frag_source);
+    mem_free(source);
+    mem_free(values);
+    mem_free(pixels);
+    return result;
+}
@@ -0,0 +1,214 @@
+// Pool of offscreen render targets: a texture with a framebuffer, keyed by
+// size, format and sample count.
+//
+// Targets are acquired for as long as a pass renders into or samples from
+// them and released right after, so passes that run one after another
+// share the same few targets. A released target is kept for
+// RENDER_TARGETS_KEEP_FRAMES frames of disuse before it is deleted, so
+// switching effects on and off or going back to a previous window size
+// doesn't allocate again.
+//
+// Render_Size coalesces window resizes. Dragging the border of a window
+// changes its size every frame, and reallocating the full screen targets
+// every time thrashes video memory. The render size only follows the window
+// once the window has kept the same size for RENDER_SIZE_SETTLE_SECONDS,
+// until then the frame is rendered at the old size and stretched to the
+// window.
+
+#define RENDER_TARGETS_CAP 64
+#define RENDER_TARGETS_KEEP_FRAMES 120
+#define RENDER_SIZE_SETTLE_SECONDS 0.2
+
+typedef struct {
+    GLuint texture;
+    GLuint framebuffer;
+    int width;
+    int height;
+    GLenum format;
+    // 1 for regular textures, more for GL_TEXTURE_2D_MULTISAMPLE
+    int samples;
+    bool acquired;
+    size_t last_used_frame;
+    size_t vram_bytes;
+} Render_Target;
+
+typedef struct {
+    Render_Target targets[RENDER_TARGETS_CAP];
+    size_t count;
+    size_t frame;
+    size_t vram_used;
+    // Targets allocated since the start, to tell how much resizing reallocates
+    size_t allocations;
+} Render_Targets;
+
+typedef struct {
+    int width;
+    int height;
+    int pending_width;
+    int pending_height;
+    double pending_since;
+} Render_Size;
+
+static size_t render_target_format_bytes(GLenum format)
+{
+    switch (format) {
+    case GL_RGBA32F:
+        return 16;
+    case GL_RGBA16F:
+        return 8;
+    case GL_RGBA8:
+    case GL_R11F_G11F_B10F:
+    case GL_R32F:
+        return 4;
+    default:
+        assert(0 && "unreachable");
+        return 0;
+    }
+}
+
+static void render_target_delete(Render_Targets *rt, Render_Target *target)
+{
+    glDeleteFramebuffers(1, &target->framebuffer);
+    glDeleteTextures(1, &target->texture);
+    rt->vram_used -= target->vram_bytes;
+    mem_track(MEM_TAG_GL_TEXTURES, -(ptrdiff_t) target->vram_bytes);
+}
+
+static bool render_target_create(Render_Targets *rt, Render_Target *target)
+{
+    GLenum texture_target = target->samples > 1 ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D;
+    glGenTextures(1, &target->texture);
+    glBindTexture(texture_target, target->texture);
+    if (target->samples > 1) {
+        glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, target->samples, target->format,
+                                target->width, target->height, GL_TRUE);
+    } else {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, target->format, target->width, target->height, 0, GL_RGBA, GL_FLOAT, NULL);
+    }
+    glBindTexture(texture_target, 0);
+    target->vram_bytes = (size_t) target->width*target->height*target->samples*render_target_format_bytes(target->format);
+    rt->vram_used += target->vram_bytes;
+    mem_track(MEM_TAG_GL_TEXTURES, (ptrdiff_t) target->vram_bytes);
+
+    glGenFramebuffers(1, &target->framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, target->framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture_target, target->texture, 0);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "ERROR: render target %dx%d is incomplete: 0x%x\n", target->width, target->height, status);
+        render_target_delete(rt, target);
+        return false;
+    }
+    rt->allocations += 1;
+    return true;
+}
+
+// Returns NULL if the pool is full or the target can't be rendered into
+Render_Target *render_targets_acquire(Render_Targets *rt, int width, int height, GLenum format, int samples)
+{
+    assert(width > 0 && height > 0 && samples > 0);
+    for (size_t i = 0; i < rt->count; ++i) {
+        Render_Target *target = &rt->targets[i];
+        if (!target->acquired && target->width == width && target->height == height &&
+                target->format == format && target->samples == samples) {
+            target->acquired = true;
+            target->last_used_frame = rt->frame;
+            return target;
+        }
+    }
+
+    if (rt->count >= RENDER_TARGETS_CAP) {
+        fprintf(stderr, "ERROR: too many render targets, only %d are supported\n", RENDER_TARGETS_CAP);
+        return NULL;
+    }
+
+    Render_Target *target = &rt->targets[rt->count];
+    memset(target, 0, sizeof(*target));
+    target->width = width;
+    target->height = height;
+    target->format = format;
+    target->samples = samples;
+    if (!render_target_create(rt, target)) return NULL;
+    rt->count += 1;
+    target->acquired = true;
+    target->last_used_frame = rt->frame;
+    return target;
+}
+
+// `target` may be NULL
+void render_targets_release(Render_Target *target)
+{
+    if (target != NULL) target->acquired = false;
+}
+
+// Deletes the targets that were not used for RENDER_TARGETS_KEEP_FRAMES
+// frames. Moves targets around, so nothing may be acquired when it's called.
+void render_targets_end_frame(Render_Targets *rt)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < rt->count; ++i) {
+        Render_Target *target = &rt->targets[i];
+        assert(!target->acquired);
+        if (rt->frame - target->last_used_frame < RENDER_TARGETS_KEEP_FRAMES) {
+            rt->targets[count++] = *target;
+        } else {
+            render_target_delete(rt, target);
+        }
+    }
+    rt->count = count;
+    rt->frame += 1;
+}
+
+// Deletes the least recently used targets until at most `keep` are left, for
+// users like the render server that go through many sizes and would fill
+// the pool long before RENDER_TARGETS_KEEP_FRAMES pass. Nothing may be
+// acquired when it's called.
+void render_targets_trim(Render_Targets *rt, size_t keep)
+{
+    while (rt->count > keep) {
+        size_t oldest = 0;
+        for (size_t i = 1; i < rt->count; ++i) {
+            if (rt->targets[i].last_used_frame < rt->targets[oldest].last_used_frame) oldest = i;
+        }
+        assert(!rt->targets[oldest].acquired);
+        render_target_delete(rt, &rt->targets[oldest]);
+        rt->targets[oldest] = rt->targets[--rt->count];
+    }
+}
+
+void render_targets_print_summary(const Render_Targets *rt)
+{
+    printf("Render targets: %zu alive, %zu KB, %zu allocated since start\n",
+           rt->count, rt->vram_used/1024, rt->allocations);
+}
+
+// Moves the render size to `width` x `height` once the window settles there
+void render_size_update(Render_Size *size, int width, int height, double now)
+{
+    if (width == size->width && height == size->height) {
+        size->pending_width = width;
+        size->pending_height = height;
+        return;
+    }
+
+    // The very first size and coming back from being minimized don't need to settle
+    if (size->width <= 0 || size->height <= 0) {
+        size->width = size->pending_width = width;
+        size->height = size->pending_height = height;
+        return;
+    }
+
+    if (width != size->pending_width || height != size->pending_height) {
+        size->pending_width = width;
+        size->pending_height = height;
+        size->pending_since = now;
+    } else if (now - size->pending_since >= RENDER_SIZE_SETTLE_SECONDS) {
+        size->width = width;
+        size->height = height;
+    }
+}
@@ -0,0 +1,376 @@
+// Tile layers. render.conf can name a map and the atlas of its tiles:
+//
+//   tilemap = level.csv
+//   tileset = assets/tiles.png
+//   tile_size = 16
+//   tile_scale = 2
+//
+// The map is text: rows of comma separated tile numbers, layers separated by
+// empty lines and drawn in the order they appear, `#` starts a comment.
+// 0 is an empty cell and N is the N-th `tile_size` square of the tileset
+// counting from 1 left to right and top to bottom, the same numbering as the
+// CSV export of Tiled.
+//
+// Every layer lives on the GPU as an R16UI texture with one texel per cell
+// and is drawn as a single quad. The fragment shader fetches the cell under
+// the pixel and the texel of the tile it points to, so the cost of a layer
+// doesn't depend on how many tiles it has and changing a tile uploads a
+// single texel. The map is anchored at the top left corner of the window,
+// every tile pixel is `tile_scale` screen pixels. Clicking with the right
+// mouse button cycles the tile under the cursor on the last layer.
+
+#define TILEMAP_LAYERS_CAP 16
+#define TILEMAP_SIZE_CAP 4096
+
+typedef struct {
+    // CPU copy of the layers, `width*height` cells one after another
+    uint16_t *cells;
+    GLuint textures[TILEMAP_LAYERS_CAP];
+    size_t layers_count;
+    int width;
+    int height;
+
+    GLuint tileset;
+    int tileset_columns;
+    int tiles_count;
+    int tile_size;
+    float tile_scale;
+
+    GLuint program;
+    GLint map_uniform;
+    GLint tileset_uniform;
+    GLint resolution_uniform;
+    GLint map_size_uniform;
+    GLint tile_pixels_uniform;
+    GLint tile_size_uniform;
+    GLint tileset_columns_uniform;
+    GLuint vao;
+} Tilemap;
+
+static const char *tilemap_vert_source =
+    "#version 330\n"
+    "uniform vec2 resolution;\n"
+    "uniform vec2 map_size;\n"
+    "uniform float tile_pixels;\n"
+    "out vec2 cell;\n"
+    "void main(void)\n"
+    "{\n"
+    "    // Quad over the whole layer drawn as a triangle strip, y goes down like the rows of the map\n"
+    "    vec2 p = vec2(gl_VertexID & 1, gl_VertexID >> 1);\n"
+    "    cell = p*map_size;\n"
+    "    vec2 pixel = cell*tile_pixels;\n"
+    "    gl_Position = vec4(pixel.x/resolution.x*2.0 - 1.0, 1.0 - pixel.y/resolution.y*2.0, 0.0, 1.0);\n"
+    "}\n";
+
+static const char *tilemap_frag_source =
+    "#version 330\n"
+    "uniform usampler2D map;\n"
+    "uniform sampler2D tileset;\n"
+    "uniform int tile_size;\n"
+    "uniform int tileset_columns;\n"
+    "in vec2 cell;\n"
+    "out vec4 out_color;\n"
+    "void main(void)\n"
+    "{\n"
+    "    int tile = int(texelFetch(map, ivec2(cell), 0).r) - 1;\n"
+    "    if (tile < 0) discard;\n"
+    "    ivec2 origin = ivec2(tile%tileset_columns, tile/tileset_columns)*tile_size;\n"
+    "    ivec2 inside = min(ivec2(fract(cell)*float(tile_size)), ivec2(tile_size - 1));\n"
+    "    out_color = texelFetch(tileset, origin + inside, 0);\n"
+    "    if (out_color.a == 0.0) discard;\n"
+    "}\n";
+
+static bool tilemap_is_digit(char x)
+{
+    return isdigit((unsigned char) x);
+}
+
+void tilemap_unload(Tilemap *tilemap)
+{
+    size_t cells_count = (size_t) tilemap->width*tilemap->height;
+    if (tilemap->textures[0] != 0) {
+        glDeleteTextures((GLsizei) tilemap->layers_count, tilemap->textures);
+        mem_track(MEM_TAG_GL_TEXTURES, -(ptrdiff_t) (tilemap->layers_count*cells_count*sizeof(uint16_t)));
+        memset(tilemap->textures, 0, sizeof(tilemap->textures));
+    }
+    if (tilemap->tileset != 0) {
+        glDeleteTextures(1, &tilemap->tileset);
+        mem_track(MEM_TAG_GL_TEXTURES, -(ptrdiff_t) ((size_t) tilemap->tiles_count*tilemap->tile_size*tilemap->tile_size*4));
+    }
+    mem_free(tilemap->cells);
+    tilemap->cells = NULL;
+    tilemap->layers_count = 0;
+    tilemap->width = 0;
+    tilemap->height = 0;
+    tilemap->tileset = 0;
+    tilemap->tiles_count = 0;
+}
+
+// Appends a row of cells to the map, growing it as needed. `row` and
+// `line_start` are only for the error messages.
+static bool tilemap_parse_row(Tilemap *tilemap, const char *file_path, int row, String_View line,
+                              const char *line_start, size_t *cells_count, size_t *cells_capacity)
+{
+    int width = 0;
+    while (line.count > 0) {
+        String_View value = sv_trim(sv_chop_by_delim(&line, ','));
+        // A trailing comma doesn't make an extra column
+        if (value.count == 0 && line.count == 0 && width > 0) break;
+        String_View digits = sv_take_left_while(value, tilemap_is_digit);
+        uint64_t tile = sv_to_u64(value);
+        if (value.count == 0 || digits.count != value.count || tile > UINT16_MAX) {
+            fprintf(stderr, "%s:%d:%ld: ERROR: expected a tile number, got `"SV_Fmt"`\n",
+                    file_path, row, value.data - line_start, SV_Arg(value));
+            return false;
+        }
+
+        if (*cells_count >= *cells_capacity) {
+            size_t capacity = *cells_capacity == 0 ? 1024 : *cells_capacity*2;
+            uint16_t *cells = mem_realloc(MEM_TAG_TILEMAP, tilemap->cells, capacity*sizeof(uint16_t));
+            if (cells == NULL) {
+                fprintf(stderr, "ERROR: %s: could not allocate the map\n", file_path);
+                return false;
+            }
+            tilemap->cells = cells;
+            *cells_capacity = capacity;
+        }
+        tilemap->cells[(*cells_count)++] = (uint16_t) tile;
+        width += 1;
+    }
+
+    if (tilemap->width == 0) tilemap->width = width;
+    if (width != tilemap->width) {
+        fprintf(stderr, "%s:%d:%ld: ERROR: row has %d tiles, the rows above have %d\n",
+                file_path, row, 0L, width, tilemap->width);
+        return false;
+    }
+    return true;
+}
+
+static bool tilemap_parse(Tilemap *tilemap, const char *file_path, char *content)
+{
+    size_t cells_count = 0;
+    size_t cells_capacity = 0;
+    int layer_height = 0;
+    String_View lines = sv_from_cstr(content);
+    for (int row = 0; lines.count > 0; row++) {
+        String_View line = sv_chop_by_delim(&lines, '\n');
+        const char *line_start = line.data;
+        line = sv_trim(line);
+        if (line.count > 0 && line.data[0] == '#') continue;
+
+        if (line.count == 0) {
+            if (layer_height == 0) continue;
+            if (tilemap->height == 0) tilemap->height = layer_height;
+            if (layer_height != tilemap->height) {
+                fprintf(stderr, "%s:%d:%ld: ERROR: layer has %d rows, the first one has %d\n",
+                        file_path, row, 0L, layer_height, tilemap->height);
+                return false;
+            }
+            tilemap->layers_count += 1;
+            layer_height = 0;
+            continue;
+        }
+
+        if (tilemap->layers_count >= TILEMAP_LAYERS_CAP) {
+            fprintf(stderr, "%s:%d:%ld: ERROR: too many layers, only %d are supported\n",
+                    file_path, row, 0L, TILEMAP_LAYERS_CAP);
+            return false;
+        }
+        if (!tilemap_parse_row(tilemap, file_path, row, line, line_start, &cells_count, &cells_capacity)) return false;
+        layer_height += 1;
+    }
+
+    if (layer_height > 0) {
+        if (tilemap->height == 0) tilemap->height = layer_height;
+        if (layer_height != tilemap->height) {
+            fprintf(stderr, "ERROR: %s: the last layer has %d rows, the first one has %d\n",
+                    file_path, layer_height, tilemap->height);
+            return false;
+        }
+        tilemap->layers_count += 1;
+    }
+
+    if (tilemap->layers_count == 0) {
+        fprintf(stderr, "ERROR: %s: no tiles\n", file_path);
+        return false;
+    }
+    if (tilemap->width > TILEMAP_SIZE_CAP || tilemap->height > TILEMAP_SIZE_CAP) {
+        fprintf(stderr, "ERROR: %s: map is %dx%d, at most %dx%d is supported\n",
+                file_path, tilemap->width, tilemap->height, TILEMAP_SIZE_CAP, TILEMAP_SIZE_CAP);
+        return false;
+    }
+    return true;
+}
+
+static bool tilemap_create_gl_objects(Tilemap *tilemap)
+{
+    if (!create_program(tilemap_vert_source, tilemap_frag_source, &tilemap->program)) return false;
+    tilemap->map_uniform = glGetUniformLocation(tilemap->program, "map");
+    tilemap->tileset_uniform = glGetUniformLocation(tilemap->program, "tileset");
+    tilemap->resolution_uniform = glGetUniformLocation(tilemap->program, "resolution");
+    tilemap->map_size_uniform = glGetUniformLocation(tilemap->program, "map_size");
+    tilemap->tile_pixels_uniform = glGetUniformLocation(tilemap->program, "tile_pixels");
+    tilemap->tile_size_uniform = glGetUniformLocation(tilemap->program, "tile_size");
+    tilemap->tileset_columns_uniform = glGetUniformLocation(tilemap->program, "tileset_columns");
+    glGenVertexArrays(1, &tilemap->vao);
+    return true;
+}
+
+static bool tilemap_load_tileset(Tilemap *tilemap, const char *tileset_path)
+{
+    Texture_Source ts;
+    if (!texture_source_open(tileset_path, &ts)) return false;
+    if (!texture_source_decode(tileset_path, &ts)) {
+        texture_source_close(&ts);
+        return false;
+    }
+
+    tilemap->tileset_columns = ts.width/tilemap->tile_size;
+    int rows = ts.height/tilemap->tile_size;
+    tilemap->tiles_count = tilemap->tileset_columns*rows;
+    if (tilemap->tiles_count == 0) {
+        fprintf(stderr, "ERROR: %s: %dx%d is smaller than one %dx%d tile\n",
+                tileset_path, ts.width, ts.height, tilemap->tile_size, tilemap->tile_size);
+        texture_source_close(&ts);
+        return false;
+    }
+
+    // Tiles are fetched texel by texel, the part of the image that doesn't fill a whole tile is cut off
+    glGenTextures(1, &tilemap->tileset);
+    glBindTexture(GL_TEXTURE_2D, tilemap->tileset);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, ts.width);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8,
+                 tilemap->tileset_columns*tilemap->tile_size, rows*tilemap->tile_size,
+                 0, GL_RGBA, GL_UNSIGNED_BYTE, ts.pixels);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    mem_track(MEM_TAG_GL_TEXTURES, (ptrdiff_t) ((size_t) tilemap->tiles_count*tilemap->tile_size*tilemap->tile_size*4));
+    texture_source_close(&ts);
+    return true;
+}
+
+// `file_path` may be NULL, which just unloads the current map
+bool tilemap_load(Tilemap *tilemap, const char *file_path, const char *tileset_path, int tile_size, float tile_scale)
+{
+    tilemap_unload(tilemap);
+    if (file_path == NULL) return true;
+    if (tileset_path == NULL) {
+        fprintf(stderr, "ERROR: %s: the map needs a `tileset`\n", file_path);
+        return false;
+    }
+    if (tile_size <= 0 || tile_scale <= 0.0f) {
+        fprintf(stderr, "ERROR: %s: invalid tile_size %d or tile_scale %f\n", file_path, tile_size, tile_scale);
+        return false;
+    }
+    tilemap->tile_size = tile_size;
+    tilemap->tile_scale = tile_scale;
+
+    if (tilemap->program == 0 && !tilemap_create_gl_objects(tilemap)) {
+        fprintf(stderr, "ERROR: could not compile the tilemap shaders\n");
+        return false;
+    }
+
+    char *content = slurp_asset_into_malloced_cstr(file_path, MEM_TAG_TILEMAP);
+    if (content == NULL) {
+        fprintf(stderr, "ERROR: could not load %s: %s\n", file_path, strerror(errno));
+        return false;
+    }
+    bool ok = tilemap_parse(tilemap, file_path, content);
+    mem_free(content);
+    if (!ok || !tilemap_load_tileset(tilemap, tileset_path)) {
+        tilemap_unload(tilemap);
+        return false;
+    }
+
+    size_t cells_count = (size_t) tilemap->width*tilemap->height;
+    size_t out_of_range = 0;
+    for (size_t i = 0; i < tilemap->layers_count*cells_count; ++i) {
+        if (tilemap->cells[i] > tilemap->tiles_count) {
+            tilemap->cells[i] = 0;
+            out_of_range += 1;
+        }
+    }
+    if (out_of_range > 0) {
+        fprintf(stderr, "WARN: %s: %zu cells point past the %d tiles of %s and are left empty\n",
+                file_path, out_of_range, tilemap->tiles_count, tileset_path);
+    }
+
+    glGenTextures((GLsizei) tilemap->layers_count, tilemap->textures);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+    for (size_t layer = 0; layer < tilemap->layers_count; ++layer) {
+        glBindTexture(GL_TEXTURE_2D, tilemap->textures[layer]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R16UI, tilemap->width, tilemap->height, 0,
+                     GL_RED_INTEGER, GL_UNSIGNED_SHORT, tilemap->cells + layer*cells_count);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    mem_track(MEM_TAG_GL_TEXTURES, (ptrdiff_t) (tilemap->layers_count*cells_count*sizeof(uint16_t)));
+
+    printf("Tilemap: %s, %dx%d, %zu layers, %d tiles of %s\n", file_path, tilemap->width, tilemap->height,
+           tilemap->layers_count, tilemap->tiles_count, tileset_path);
+    return true;
+}
+
+uint16_t tilemap_get_tile(const Tilemap *tilemap, size_t layer, int x, int y)
+{
+    assert(layer < tilemap->layers_count);
+    assert(0 <= x && x < tilemap->width && 0 <= y && y < tilemap->height);
+    return tilemap->cells[layer*tilemap->width*tilemap->height + (size_t) y*tilemap->width + x];
+}
+
+// Changes one cell, the layer is updated on the GPU with a single texel upload
+void tilemap_set_tile(Tilemap *tilemap, size_t layer, int x, int y, uint16_t tile)
+{
+    assert(layer < tilemap->layers_count);
+    assert(0 <= x && x < tilemap->width && 0 <= y && y < tilemap->height);
+    assert(tile <= tilemap->tiles_count);
+    tilemap->cells[layer*tilemap->width*tilemap->height + (size_t) y*tilemap->width + x] = tile;
+    glBindTexture(GL_TEXTURE_2D, tilemap->textures[layer]);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, 1, 1, GL_RED_INTEGER, GL_UNSIGNED_SHORT, &tile);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+// Finds the cell under the pixel (`px`, `py`), counted from the top left corner of the framebuffer
+bool tilemap_cell_at(const Tilemap *tilemap, double px, double py, int *x, int *y)
+{
+    if (tilemap->layers_count == 0) return false;
+    double tile_pixels = tilemap->tile_size*tilemap->tile_scale;
+    double cx = floor(px/tile_pixels);
+    double cy = floor(py/tile_pixels);
+    if (cx < 0 || cx >= tilemap->width || cy < 0 || cy >= tilemap->height) return false;
+    *x = (int) cx;
+    *y = (int) cy;
+    return true;
+}
+
+// Draws the layers over whatever is in the `width` x `height` framebuffer
+void tilemap_render(Tilemap *tilemap, int width, int height)
+{
+    if (tilemap->layers_count == 0 || width <= 0 || height <= 0) return;
+
+    GLint vao = 0;
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &vao);
+
+    glUseProgram(tilemap->program);
+    glUniform2f(tilemap->resolution_uniform, (GLfloat) width, (GLfloat) height);
+    glUniform2f(tilemap->map_size_uniform, (GLfloat) tilemap->width, (GLfloat) tilemap->height);
+    glUniform1f(tilemap->tile_pixels_uniform, (GLfloat) tilemap->tile_size*tilemap->tile_scale);
+    glUniform1i(tilemap->tile_size_uniform, tilemap->tile_size);
+    glUniform1i(tilemap->tileset_columns_uniform, tilemap->tileset_columns);
+    glUniform1i(tilemap->map_uniform, 0);
+    glUniform1i(tilemap->tileset_uniform, 1);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, tilemap->tileset);
+    glActiveTexture(GL_TEXTURE0);
+    glBindVertexArray(tilemap->vao);
+    for (size_t layer = 0; layer < tilemap->layers_count; ++layer) {
+        glBindTexture(GL_TEXTURE_2D, tilemap->textures[layer]);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    }
+
+    glBindVertexArray((GLuint) vao);
+}
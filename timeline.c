@@ -0,0 +1,423 @@
+// Keyframed uniforms. render.conf can name a timeline file:
+//
+//   timeline = intro.timeline
+//
+// which animates uniforms of the scenes over `time`:
+//
+//   # Every track is a float, vec2, vec3 or vec4 uniform
+//   track density float
+//   0    0.1  bezier
+//   2.5  1.0  step
+//   4    0.3
+//
+//   track tint vec3
+//   0    1 0 0
+//   3    0 0 1
+//
+// A key is a time followed by the value of the uniform and how to get to
+// the next key: `linear` (default), `step` or `bezier`, a cubic with
+// handles set automatically from the neighboring keys, so the curve goes
+// smoothly through every key. Before the first key and after the last the
+// value holds.
+//
+// The file is parsed once into flat arrays: key times per track, and for
+// every component of every track (a channel) the coefficients of the cubic
+// every segment turns into, whatever its kind, with one extra constant
+// segment for holding the last value. Every frame the segment of each
+// track is found from `time`, checking the one of the previous frame and
+// the one after it before falling back to a binary search. The segment
+// coefficients of every channel are then gathered into contiguous arrays
+// and the cubics are evaluated 4 channels at a time. The values only
+// depend on `time`, so offline renders are reproducible.
+//
+// Tracks are uploaded to every scene program that declares a uniform of
+// the same name, after the built-in uniforms, so a track can also override
+// those.
+
+#define TIMELINE_TRACKS_CAP 64
+#define TIMELINE_NAME_CAP 64
+
+typedef enum {
+    TIMELINE_LINEAR = 0,
+    TIMELINE_STEP,
+    TIMELINE_BEZIER,
+} Timeline_Interp;
+
+typedef struct {
+    size_t tracks_count;
+    char names[TIMELINE_TRACKS_CAP][TIMELINE_NAME_CAP];
+    uint32_t components[TIMELINE_TRACKS_CAP];
+    // Keys of track i are key_times[first_key[i]..first_key[i] + keys_count[i]]
+    uint32_t first_key[TIMELINE_TRACKS_CAP];
+    uint32_t keys_count[TIMELINE_TRACKS_CAP];
+    // Values of track i start at values[first_channel[i]]
+    uint32_t first_channel[TIMELINE_TRACKS_CAP];
+    float *key_times;
+    size_t keys_total;
+
+    // Channel i has a segment per key of its track at coeffs[channel_base[i]..]
+    size_t channels_count;
+    uint32_t *channel_track;
+    uint32_t *channel_base;
+    float *c0;
+    float *c1;
+    float *c2;
+    float *c3;
+
+    // Evaluated by timeline_update()
+    uint32_t segment[TIMELINE_TRACKS_CAP];
+    float u[TIMELINE_TRACKS_CAP];
+    float *values;
+
+    // Coefficients of the current segment and u of every channel, gathered
+    // as 5 arrays of channels_count floats: c0, c1, c2, c3, u
+    float *gathered;
+
+    // Tells the tracks of one load from another, so locations get looked up again
+    uint32_t generation;
+} Timeline;
+
+// Locations of the tracks in one program. Every owner of a program keeps
+// one next to its other uniform locations and zeroes it when the program
+// changes, so alternating programs, like the two sides of A/B, don't look
+// the tracks up again every frame.
+typedef struct {
+    GLuint program;
+    uint32_t generation;
+    GLint locations[TIMELINE_TRACKS_CAP];
+} Timeline_Locations;
+
+typedef struct {
+    float time;
+    float value[4];
+    Timeline_Interp interp;
+} Timeline_Key;
+
+void timeline_unload(Timeline *timeline)
+{
+    mem_free(timeline->key_times);
+    mem_free(timeline->channel_track);
+    mem_free(timeline->channel_base);
+    mem_free(timeline->c0);
+    mem_free(timeline->c1);
+    mem_free(timeline->c2);
+    mem_free(timeline->c3);
+    mem_free(timeline->values);
+    mem_free(timeline->gathered);
+    memset(timeline, 0, sizeof(*timeline));
+}
+
+static bool timeline_components_by_name(String_View name, uint32_t *components)
+{
+    static const char *names[] = {"float", "vec2", "vec3", "vec4"};
+    for (uint32_t i = 0; i < 4; ++i) {
+        if (sv_eq(name, sv_from_cstr(names[i]))) {
+            *components = i + 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool timeline_interp_by_name(String_View name, Timeline_Interp *interp)
+{
+    if (sv_eq(name, SV("linear"))) *interp = TIMELINE_LINEAR;
+    else if (sv_eq(name, SV("step"))) *interp = TIMELINE_STEP;
+    else if (sv_eq(name, SV("bezier"))) *interp = TIMELINE_BEZIER;
+    else return false;
+    return true;
+}
+
+// Slope of a channel at key k in value per second, taken from its neighbors
+static float timeline_slope(const Timeline_Key *keys, size_t count, size_t k, size_t c)
+{
+    size_t prev = k > 0 ? k - 1 : k;
+    size_t next = k + 1 < count ? k + 1 : k;
+    if (prev == next) return 0.0f;
+    return (keys[next].value[c] - keys[prev].value[c])/(keys[next].time - keys[prev].time);
+}
+
+// Turns the keys of a track into the cubic coefficients of its channels
+static void timeline_bake_track(Timeline *timeline, size_t track, const Timeline_Key *keys, size_t count)
+{
+    for (uint32_t c = 0; c < timeline->components[track]; ++c) {
+        size_t channel = timeline->first_channel[track] + c;
+        size_t base = timeline->channel_base[channel];
+        for (size_t k = 0; k < count; ++k) {
+            float p0 = keys[k].value[c];
+            float a = p0, b = 0.0f, cc = 0.0f, d = 0.0f;
+            // The last key makes the hold segment
+            if (k + 1 < count) {
+                float p3 = keys[k + 1].value[c];
+                switch (keys[k].interp) {
+                case TIMELINE_LINEAR:
+                    b = p3 - p0;
+                    break;
+                case TIMELINE_STEP:
+                    break;
+                case TIMELINE_BEZIER: {
+                    float h = keys[k + 1].time - keys[k].time;
+                    float p1 = p0 + timeline_slope(keys, count, k, c)*h/3.0f;
+                    float p2 = p3 - timeline_slope(keys, count, k + 1, c)*h/3.0f;
+                    b = 3.0f*(p1 - p0);
+                    cc = 3.0f*(p0 - 2.0f*p1 + p2);
+                    d = -p0 + 3.0f*p1 - 3.0f*p2 + p3;
+                } break;
+                default:
+                    assert(0 && "unreachable");
+                }
+            }
+            timeline->c0[base + k] = a;
+            timeline->c1[base + k] = b;
+            timeline->c2[base + k] = cc;
+            timeline->c3[base + k] = d;
+        }
+    }
+}
+
+// Reads the tracks into `timeline` and their keys into `keys`, which has
+// room for a key per line of the file
+static bool timeline_parse(Timeline *timeline, const char *file_path, char *content, Timeline_Key *keys)
+{
+    bool ok = true;
+    String_View rest = sv_from_cstr(content);
+    size_t keys_total = 0;
+    for (int row = 0; rest.count > 0; row++) {
+        String_View line = sv_chop_by_delim(&rest, '\n');
+        const char *line_start = line.data;
+        line = sv_trim(line);
+        if (line.count == 0 || line.data[0] == '#') continue;
+
+        String_View words = line;
+        String_View word = sv_chop_by_delim(&words, ' ');
+        words = sv_trim_left(words);
+        if (sv_eq(word, SV("track"))) {
+            String_View name = sv_chop_by_delim(&words, ' ');
+            String_View type = sv_trim(words);
+            uint32_t components = 0;
+            if (name.count == 0 || name.count >= TIMELINE_NAME_CAP || !timeline_components_by_name(type, &components)) {
+                printf("%s:%d:%ld: ERROR: expected `track <uniform> <float|vec2|vec3|vec4>`\n",
+                       file_path, row, line.data - line_start);
+                return false;
+            }
+            if (timeline->tracks_count >= TIMELINE_TRACKS_CAP) {
+                printf("%s:%d:%ld: ERROR: too many tracks, only %d are supported\n",
+                       file_path, row, line.data - line_start, TIMELINE_TRACKS_CAP);
+                return false;
+            }
+            size_t track = timeline->tracks_count++;
+            memcpy(timeline->names[track], name.data, name.count);
+            timeline->names[track][name.count] = '\0';
+            timeline->components[track] = components;
+            timeline->first_key[track] = (uint32_t) keys_total;
+            timeline->first_channel[track] = (uint32_t) timeline->channels_count;
+            timeline->channels_count += components;
+            continue;
+        }
+
+        if (timeline->tracks_count == 0) {
+            printf("%s:%d:%ld: ERROR: keys have to follow a `track`\n", file_path, row, line.data - line_start);
+            return false;
+        }
+        size_t track = timeline->tracks_count - 1;
+        uint32_t components = timeline->components[track];
+        Timeline_Key *key = &keys[keys_total];
+        memset(key, 0, sizeof(*key));
+        // Time, the values and the interpolation
+        size_t n = 0;
+        bool valid = true;
+        for (; word.count > 0; word = sv_chop_by_delim(&words, ' '), words = sv_trim_left(words)) {
+            char buffer[64];
+            if (word.count >= sizeof(buffer)) {
+                valid = false;
+                break;
+            }
+            memcpy(buffer, word.data, word.count);
+            buffer[word.count] = '\0';
+            char *end = NULL;
+            float number = strtof(buffer, &end);
+            if (*end == '\0' && n <= components) {
+                if (n == 0) key->time = number;
+                else key->value[n - 1] = number;
+            } else if (n != components + 1 || !timeline_interp_by_name(word, &key->interp)) {
+                valid = false;
+                break;
+            }
+            n += 1;
+        }
+        if (!valid || n < components + 1) {
+            printf("%s:%d:%ld: ERROR: expected a time, %u values and optionally linear, step or bezier\n",
+                   file_path, row, line.data - line_start, components);
+            ok = false;
+        } else if (timeline->keys_count[track] > 0 && !(key->time > keys[keys_total - 1].time)) {
+            printf("%s:%d:%ld: ERROR: keys have to go forward in time\n", file_path, row, line.data - line_start);
+            ok = false;
+        } else {
+            timeline->keys_count[track] += 1;
+            keys_total += 1;
+        }
+    }
+
+    for (size_t track = 0; track < timeline->tracks_count; ++track) {
+        if (timeline->keys_count[track] == 0) {
+            printf("%s: ERROR: track `%s` has no keys\n", file_path, timeline->names[track]);
+            ok = false;
+        }
+    }
+    timeline->keys_total = keys_total;
+    return ok;
+}
+
+bool timeline_load(Timeline *timeline, const char *file_path)
+{
+    static uint32_t generations = 0;
+    timeline_unload(timeline);
+    timeline->generation = ++generations;
+    if (file_path == NULL) return true;
+
+    char *content = slurp_asset_into_malloced_cstr(file_path, MEM_TAG_CONFIG);
+    if (content == NULL) {
+        fprintf(stderr, "ERROR: could not load timeline %s: %s\n", file_path, strerror(errno));
+        return false;
+    }
+    size_t lines = 1;
+    for (const char *p = content; *p != '\0'; ++p) lines += *p == '\n';
+    Timeline_Key *keys = mem_alloc(MEM_TAG_CONFIG, lines*sizeof(*keys));
+    bool ok = keys != NULL && timeline_parse(timeline, file_path, content, keys);
+
+    size_t coeffs_count = 0;
+    for (size_t track = 0; track < timeline->tracks_count; ++track) {
+        coeffs_count += (size_t) timeline->keys_count[track]*timeline->components[track];
+    }
+    if (ok) {
+        timeline->key_times = mem_alloc(MEM_TAG_CONFIG, timeline->keys_total*sizeof(float));
+        timeline->channel_track = mem_alloc(MEM_TAG_CONFIG, timeline->channels_count*sizeof(uint32_t));
+        timeline->channel_base = mem_alloc(MEM_TAG_CONFIG, timeline->channels_count*sizeof(uint32_t));
+        timeline->values = mem_alloc(MEM_TAG_CONFIG, timeline->channels_count*sizeof(float));
+        timeline->gathered = mem_alloc(MEM_TAG_CONFIG, 5*timeline->channels_count*sizeof(float));
+        timeline->c0 = mem_alloc(MEM_TAG_CONFIG, coeffs_count*sizeof(float));
+        timeline->c1 = mem_alloc(MEM_TAG_CONFIG, coeffs_count*sizeof(float));
+        timeline->c2 = mem_alloc(MEM_TAG_CONFIG, coeffs_count*sizeof(float));
+        timeline->c3 = mem_alloc(MEM_TAG_CONFIG, coeffs_count*sizeof(float));
+        ok = timeline->key_times != NULL && timeline->channel_track != NULL && timeline->channel_base != NULL &&
+             timeline->values != NULL && timeline->gathered != NULL && timeline->c0 != NULL && timeline->c1 != NULL &&
+             timeline->c2 != NULL && timeline->c3 != NULL;
+    }
+    if (ok) {
+        size_t base = 0;
+        for (size_t track = 0; track < timeline->tracks_count; ++track) {
+            for (uint32_t c = 0; c < timeline->components[track]; ++c) {
+                size_t channel = timeline->first_channel[track] + c;
+                timeline->channel_track[channel] = (uint32_t) track;
+                timeline->channel_base[channel] = (uint32_t) base;
+                base += timeline->keys_count[track];
+            }
+            const Timeline_Key *track_keys = keys + timeline->first_key[track];
+            timeline_bake_track(timeline, track, track_keys, timeline->keys_count[track]);
+            for (uint32_t k = 0; k < timeline->keys_count[track]; ++k) {
+                timeline->key_times[timeline->first_key[track] + k] = track_keys[k].time;
+            }
+        }
+    }
+    mem_free(content);
+    mem_free(keys);
+    if (!ok) {
+        timeline_unload(timeline);
+        return false;
+    }
+    printf("Timeline: %s, %zu tracks, %zu keys\n", file_path, timeline->tracks_count, timeline->keys_total);
+    return true;
+}
+
+// Segment of `track` at `time`, starting from the one of the previous frame
+static uint32_t timeline_find_segment(const Timeline *timeline, size_t track, float time, uint32_t cached)
+{
+    const float *times = timeline->key_times + timeline->first_key[track];
+    uint32_t count = timeline->keys_count[track];
+    // Segment k covers [times[k], times[k + 1]), the last one holds from the last key on
+    for (uint32_t k = cached; k < count && k <= cached + 1; ++k) {
+        if (times[k] <= time && (k + 1 == count || time < times[k + 1])) return k;
+    }
+    if (time < times[0]) return 0;
+    uint32_t lo = 0;
+    uint32_t hi = count;
+    // Last key at or before `time`
+    while (hi - lo > 1) {
+        uint32_t mid = lo + (hi - lo)/2;
+        if (times[mid] <= time) lo = mid;
+        else hi = mid;
+    }
+    return lo;
+}
+
+void timeline_update(Timeline *timeline, double time)
+{
+    float t = (float) time;
+    for (size_t track = 0; track < timeline->tracks_count; ++track) {
+        const float *times = timeline->key_times + timeline->first_key[track];
+        uint32_t count = timeline->keys_count[track];
+        uint32_t k = timeline_find_segment(timeline, track, t, timeline->segment[track]);
+        float u = 0.0f;
+        if (k + 1 < count && t > times[k]) u = (t - times[k])/(times[k + 1] - times[k]);
+        timeline->segment[track] = k;
+        timeline->u[track] = u;
+    }
+
+    // Every channel is the same cubic, whatever the kind of its segment, so
+    // once the coefficients are side by side the channels evaluate in lanes
+    size_t n = timeline->channels_count;
+    float *c0 = timeline->gathered;
+    float *c1 = c0 + n;
+    float *c2 = c1 + n;
+    float *c3 = c2 + n;
+    float *us = c3 + n;
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t track = timeline->channel_track[i];
+        size_t k = timeline->channel_base[i] + timeline->segment[track];
+        c0[i] = timeline->c0[k];
+        c1[i] = timeline->c1[k];
+        c2[i] = timeline->c2[k];
+        c3[i] = timeline->c3[k];
+        us[i] = timeline->u[track];
+    }
+
+    size_t i = 0;
+#ifdef LA_SSE2
+    for (; i + 4 <= n; i += 4) {
+        __m128 u = _mm_loadu_ps(us + i);
+        __m128 v = _mm_loadu_ps(c3 + i);
+        v = _mm_add_ps(_mm_loadu_ps(c2 + i), _mm_mul_ps(u, v));
+        v = _mm_add_ps(_mm_loadu_ps(c1 + i), _mm_mul_ps(u, v));
+        v = _mm_add_ps(_mm_loadu_ps(c0 + i), _mm_mul_ps(u, v));
+        _mm_storeu_ps(timeline->values + i, v);
+    }
+#endif // LA_SSE2
+    for (; i < n; ++i) {
+        timeline->values[i] = c0[i] + us[i]*(c1[i] + us[i]*(c2[i] + us[i]*c3[i]));
+    }
+}
+
+// Sets the tracks of the timeline on `program`, which has to be in use
+void timeline_upload(const Timeline *timeline, Timeline_Locations *cache, GLuint program)
+{
+    if (timeline->tracks_count == 0 || program == 0) return;
+    if (cache->program != program || cache->generation != timeline->generation) {
+        for (size_t track = 0; track < timeline->tracks_count; ++track) {
+            cache->locations[track] = glGetUniformLocation(program, timeline->names[track]);
+        }
+        cache->program = program;
+        cache->generation = timeline->generation;
+    }
+    for (size_t track = 0; track < timeline->tracks_count; ++track) {
+        GLint location = cache->locations[track];
+        if (location < 0) continue;
+        const float *value = timeline->values + timeline->first_channel[track];
+        switch (timeline->components[track]) {
+        case 1: glUniform1fv(location, 1, value); break;
+        case 2: glUniform2fv(location, 1, value); break;
+        case 3: glUniform3fv(location, 1, value); break;
+        case 4: glUniform4fv(location, 1, value); break;
+        default: assert(0 && "unreachable");
+        }
+    }
+}
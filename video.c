@@ -0,0 +1,439 @@
+// Video textures from Y4M files. render.conf can name one:
+//
+//   video = clip.y4m
+//
+// The file is mapped and indexed once, frames are never decoded on the CPU.
+// Every frame the Y, U and V planes of the video frame at the current `time`
+// are copied into a pixel buffer object and uploaded from there into three R8
+// textures, and a small built-in shader converts them into the RGBA texture
+// that scenes sample as `video`. Video frames are picked by `time` alone and
+// the video loops, so offline renders with a fixed time step are
+// reproducible.
+//
+// Only 4:2:0 chroma subsampling is supported, which is what encoders produce
+// by default. Chroma is not interpolated. Colors are BT.601, limited range
+// unless the file says XCOLORRANGE=FULL.
+//
+// A read-ahead job on the job pool touches the pages of the next
+// VIDEO_READ_AHEAD_FRAMES frames, so the main thread doesn't stall on page
+// faults when the file is not in the page cache yet.
+
+#define Y4M_MAGIC "YUV4MPEG2 "
+#define VIDEO_READ_AHEAD_FRAMES 8
+#define VIDEO_PAGE_SIZE 4096
+#define VIDEO_PBOS 2
+
+typedef enum {
+    VIDEO_PLANE_Y = 0,
+    VIDEO_PLANE_U,
+    VIDEO_PLANE_V,
+    COUNT_VIDEO_PLANES,
+} Video_Plane;
+
+static const char *video_plane_names[COUNT_VIDEO_PLANES] = {
+    [VIDEO_PLANE_Y] = "plane_y",
+    [VIDEO_PLANE_U] = "plane_u",
+    [VIDEO_PLANE_V] = "plane_v",
+};
+
+typedef struct {
+    Mapped_File file;
+    bool mapped;
+    int width;
+    int height;
+    uint64_t fps_num;
+    uint64_t fps_den;
+    bool full_range;
+    // Offsets of the pixel data of every frame in the file. Frame headers can
+    // carry parameters, so frames are not evenly spaced.
+    size_t *frames;
+    size_t frames_count;
+    size_t plane_offsets[COUNT_VIDEO_PLANES];
+    int plane_widths[COUNT_VIDEO_PLANES];
+    int plane_heights[COUNT_VIDEO_PLANES];
+    size_t frame_size;
+
+    // GL objects are created on the first video and reused by the later ones
+    GLuint program;
+    GLint plane_uniforms[COUNT_VIDEO_PLANES];
+    GLint full_range_uniform;
+    GLuint framebuffer;
+    GLuint planes[COUNT_VIDEO_PLANES];
+    GLuint texture;
+    size_t texture_bytes;
+    // Uploads alternate between the buffers, so copying a frame into one of
+    // them doesn't wait for the upload of the previous frame from the other
+    GLuint pbos[VIDEO_PBOS];
+    size_t pbo_bytes;
+    size_t current_pbo;
+    bool has_frame;
+    size_t frame;
+
+    // Guards `prefetching`, which is cleared by the read-ahead job
+    Jobs_Mutex prefetch_mutex;
+    bool prefetching;
+    size_t prefetch_begin;
+    size_t prefetch_end;
+    // Keeps the reads of the read-ahead job from being optimized away
+    volatile uint8_t prefetch_sink;
+} Video;
+
+static const char *video_vert_source =
+    "#version 330\n"
+    "void main(void)\n"
+    "{\n"
+    "    // Triangle that covers the whole viewport\n"
+    "    vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);\n"
+    "    gl_Position = vec4(p*2.0 - 1.0, 0.0, 1.0);\n"
+    "}\n";
+
+static const char *video_frag_source =
+    "#version 330\n"
+    "uniform sampler2D plane_y;\n"
+    "uniform sampler2D plane_u;\n"
+    "uniform sampler2D plane_v;\n"
+    "uniform bool full_range;\n"
+    "out vec4 out_color;\n"
+    "void main(void)\n"
+    "{\n"
+    "    // Unfiltered fetches are a lot cheaper on software rasterizers\n"
+    "    ivec2 p = ivec2(gl_FragCoord.xy);\n"
+    "    float y = texelFetch(plane_y, p, 0).r;\n"
+    "    float u = texelFetch(plane_u, p/2, 0).r - 0.5;\n"
+    "    float v = texelFetch(plane_v, p/2, 0).r - 0.5;\n"
+    "    if (!full_range) {\n"
+    "        y = (y - 16.0/255.0)*(255.0/219.0);\n"
+    "        u *= 255.0/224.0;\n"
+    "        v *= 255.0/224.0;\n"
+    "    }\n"
+    "    vec3 rgb = vec3(y + 1.402*v, y - 0.344136*u - 0.714136*v, y + 1.772*u);\n"
+    "    out_color = vec4(clamp(rgb, 0.0, 1.0), 1.0);\n"
+    "}\n";
+
+static bool video_parse_y4m(Video *video, const char *file_path)
+{
+    String_View content = sv_from_parts(video->file.data, video->file.size);
+    if (!sv_starts_with(content, SV(Y4M_MAGIC))) {
+        fprintf(stderr, "ERROR: %s is not a Y4M file\n", file_path);
+        return false;
+    }
+
+    String_View header;
+    if (!sv_try_chop_by_delim(&content, '\n', &header)) {
+        fprintf(stderr, "ERROR: %s: unterminated Y4M header\n", file_path);
+        return false;
+    }
+    sv_chop_left(&header, strlen(Y4M_MAGIC));
+
+    video->fps_num = 25;
+    video->fps_den = 1;
+    video->full_range = false;
+    String_View colorspace = SV("420jpeg");
+    while (header.count > 0) {
+        String_View param = sv_chop_by_delim(&header, ' ');
+        if (param.count == 0) continue;
+        char tag = param.data[0];
+        sv_chop_left(&param, 1);
+        switch (tag) {
+        case 'W':
+            video->width = (int) sv_to_u64(param);
+            break;
+        case 'H':
+            video->height = (int) sv_to_u64(param);
+            break;
+        case 'F':
+            video->fps_num = sv_to_u64(sv_chop_by_delim(&param, ':'));
+            video->fps_den = sv_to_u64(param);
+            break;
+        case 'C':
+            colorspace = param;
+            break;
+        case 'X':
+            if (sv_eq(param, SV("COLORRANGE=FULL"))) video->full_range = true;
+            break;
+        default:
+            // Interlacing, aspect ratio and comments don't change the pixel data
+            break;
+        }
+    }
+
+    if (video->width <= 0 || video->height <= 0 || video->fps_num == 0 || video->fps_den == 0) {
+        fprintf(stderr, "ERROR: %s: invalid Y4M size or frame rate\n", file_path);
+        return false;
+    }
+    if (!sv_starts_with(colorspace, SV("420"))) {
+        fprintf(stderr, "ERROR: %s: unsupported Y4M colorspace `"SV_Fmt"`, only 4:2:0 is supported\n",
+                file_path, SV_Arg(colorspace));
+        return false;
+    }
+
+    int chroma_width = (video->width + 1)/2;
+    int chroma_height = (video->height + 1)/2;
+    size_t luma_size = (size_t) video->width*video->height;
+    size_t chroma_size = (size_t) chroma_width*chroma_height;
+    video->plane_widths[VIDEO_PLANE_Y] = video->width;
+    video->plane_heights[VIDEO_PLANE_Y] = video->height;
+    video->plane_offsets[VIDEO_PLANE_Y] = 0;
+    for (Video_Plane plane = VIDEO_PLANE_U; plane <= VIDEO_PLANE_V; ++plane) {
+        video->plane_widths[plane] = chroma_width;
+        video->plane_heights[plane] = chroma_height;
+        video->plane_offsets[plane] = luma_size + (plane - VIDEO_PLANE_U)*chroma_size;
+    }
+    video->frame_size = luma_size + 2*chroma_size;
+
+    // Every frame is `FRAME[ params]\n` followed by the planes
+    const char *base = video->file.data;
+    size_t capacity = 0;
+    while (content.count > 0) {
+        String_View frame_header;
+        if (!sv_try_chop_by_delim(&content, '\n', &frame_header) ||
+                !sv_starts_with(frame_header, SV("FRAME")) || content.count < video->frame_size) {
+            // A truncated last frame is dropped, anything else is corrupted
+            if (video->frames_count == 0) {
+                fprintf(stderr, "ERROR: %s: no complete frames\n", file_path);
+                return false;
+            }
+            fprintf(stderr, "WARN: %s: ignoring incomplete data after frame %zu\n", file_path, video->frames_count);
+            break;
+        }
+
+        if (video->frames_count >= capacity) {
+            capacity = capacity == 0 ? 256 : capacity*2;
+            size_t *frames = mem_realloc(MEM_TAG_VIDEO, video->frames, capacity*sizeof(*frames));
+            if (frames == NULL) {
+                fprintf(stderr, "ERROR: %s: could not allocate the frame index\n", file_path);
+                return false;
+            }
+            video->frames = frames;
+        }
+        video->frames[video->frames_count++] = (size_t) (content.data - base);
+        sv_chop_left(&content, video->frame_size);
+    }
+
+    return true;
+}
+
+static void video_read_ahead_job(void *arg)
+{
+    Video *video = arg;
+    const uint8_t *data = video->file.data;
+    uint8_t sink = 0;
+    for (size_t i = video->prefetch_begin; i < video->prefetch_end; ++i) {
+        const uint8_t *frame = data + video->frames[i % video->frames_count];
+        for (size_t offset = 0; offset < video->frame_size; offset += VIDEO_PAGE_SIZE) {
+            sink ^= frame[offset];
+        }
+    }
+    video->prefetch_sink = sink;
+
+    jobs_mutex_lock(&video->prefetch_mutex);
+    video->prefetching = false;
+    jobs_mutex_unlock(&video->prefetch_mutex);
+}
+
+// Once before the first video_load(), which already unloads and so takes the mutex
+void video_init(Video *video)
+{
+    jobs_mutex_init(&video->prefetch_mutex);
+}
+
+static bool video_is_prefetching(Video *video)
+{
+    jobs_mutex_lock(&video->prefetch_mutex);
+    bool prefetching = video->prefetching;
+    jobs_mutex_unlock(&video->prefetch_mutex);
+    return prefetching;
+}
+
+// Waits for the read-ahead job with `pool`, because it reads the mapping
+void video_unload(Video *video, Job_Pool *pool)
+{
+    if (video_is_prefetching(video)) job_pool_wait(pool);
+    if (video->mapped) unmap_file(&video->file);
+    video->mapped = false;
+    mem_free(video->frames);
+    video->frames = NULL;
+    video->frames_count = 0;
+    video->has_frame = false;
+}
+
+static void video_resize_gl_objects(Video *video)
+{
+    for (Video_Plane plane = 0; plane < COUNT_VIDEO_PLANES; ++plane) {
+        glBindTexture(GL_TEXTURE_2D, video->planes[plane]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, video->plane_widths[plane], video->plane_heights[plane],
+                     0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+    }
+
+    mem_track(MEM_TAG_GL_TEXTURES, -(ptrdiff_t) video->texture_bytes);
+    video->texture_bytes = (size_t) video->width*video->height*4 + video->frame_size;
+    mem_track(MEM_TAG_GL_TEXTURES, (ptrdiff_t) video->texture_bytes);
+    glBindTexture(GL_TEXTURE_2D, video->texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, video->width, video->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    mem_track(MEM_TAG_GL_BUFFERS, -(ptrdiff_t) video->pbo_bytes);
+    video->pbo_bytes = VIDEO_PBOS*video->frame_size;
+    mem_track(MEM_TAG_GL_BUFFERS, (ptrdiff_t) video->pbo_bytes);
+    for (size_t i = 0; i < VIDEO_PBOS; ++i) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, video->pbos[i]);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, video->frame_size, NULL, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+static bool video_create_gl_objects(Video *video)
+{
+    GLuint vert = 0;
+    GLuint frag = 0;
+    if (!compile_shader_source(video_vert_source, GL_VERTEX_SHADER, &vert)) return false;
+    if (!compile_shader_source(video_frag_source, GL_FRAGMENT_SHADER, &frag)) {
+        glDeleteShader(vert);
+        return false;
+    }
+    if (!link_program(vert, frag, &video->program)) {
+        glDeleteProgram(video->program);
+        video->program = 0;
+        return false;
+    }
+    for (Video_Plane plane = 0; plane < COUNT_VIDEO_PLANES; ++plane) {
+        video->plane_uniforms[plane] = glGetUniformLocation(video->program, video_plane_names[plane]);
+    }
+    video->full_range_uniform = glGetUniformLocation(video->program, "full_range");
+
+    glGenTextures(COUNT_VIDEO_PLANES, video->planes);
+    for (Video_Plane plane = 0; plane < COUNT_VIDEO_PLANES; ++plane) {
+        glBindTexture(GL_TEXTURE_2D, video->planes[plane]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+
+    glGenTextures(1, &video->texture);
+    glBindTexture(GL_TEXTURE_2D, video->texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &video->framebuffer);
+    glGenBuffers(VIDEO_PBOS, video->pbos);
+    return true;
+}
+
+// `file_path` may be NULL, which just unloads the current video
+bool video_load(Video *video, Job_Pool *pool, const char *file_path)
+{
+    video_unload(video, pool);
+    if (file_path == NULL) return true;
+
+    if (video->program == 0 && !video_create_gl_objects(video)) {
+        fprintf(stderr, "ERROR: could not compile the YUV conversion shader\n");
+        return false;
+    }
+
+    // Video frames are too big to be worth packing, they always come from the file system
+    if (!map_file(file_path, &video->file)) {
+        fprintf(stderr, "ERROR: could not map %s: %s\n", file_path, strerror(errno));
+        return false;
+    }
+    video->mapped = true;
+
+    if (!video_parse_y4m(video, file_path)) {
+        video_unload(video, pool);
+        return false;
+    }
+
+    video_resize_gl_objects(video);
+    glBindFramebuffer(GL_FRAMEBUFFER, video->framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, video->texture, 0);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "ERROR: %s: video framebuffer is incomplete: 0x%x\n", file_path, status);
+        video_unload(video, pool);
+        return false;
+    }
+
+    printf("Video: %s, %dx%d, %.2f fps, %zu frames\n", file_path, video->width, video->height,
+           (double) video->fps_num/(double) video->fps_den, video->frames_count);
+    return true;
+}
+
+static void video_upload_frame(Video *video, size_t frame)
+{
+    const uint8_t *data = (const uint8_t*) video->file.data + video->frames[frame];
+
+    video->current_pbo = (video->current_pbo + 1) % VIDEO_PBOS;
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, video->pbos[video->current_pbo]);
+    void *pixels = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, video->frame_size,
+                                    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (pixels == NULL) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return;
+    }
+    memcpy(pixels, data, video->frame_size);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    // Planes are tightly packed, odd widths are not aligned to 4
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (Video_Plane plane = 0; plane < COUNT_VIDEO_PLANES; ++plane) {
+        glBindTexture(GL_TEXTURE_2D, video->planes[plane]);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, video->plane_widths[plane], video->plane_heights[plane],
+                        GL_RED, GL_UNSIGNED_BYTE, (const void*) video->plane_offsets[plane]);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+static void video_convert(Video *video)
+{
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glBindFramebuffer(GL_FRAMEBUFFER, video->framebuffer);
+    glViewport(0, 0, video->width, video->height);
+
+    glUseProgram(video->program);
+    for (Video_Plane plane = 0; plane < COUNT_VIDEO_PLANES; ++plane) {
+        glActiveTexture(GL_TEXTURE0 + plane);
+        glBindTexture(GL_TEXTURE_2D, video->planes[plane]);
+        glUniform1i(video->plane_uniforms[plane], plane);
+    }
+    glActiveTexture(GL_TEXTURE0);
+    glUniform1i(video->full_range_uniform, video->full_range);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+// Uploads and converts the video frame at `time` unless it's already the
+// current one, and starts reading ahead the frames after it
+void video_update(Video *video, Job_Pool *pool, double time)
+{
+    if (video->frames_count == 0) return;
+
+    double position = time > 0.0 ? time*(double) video->fps_num/(double) video->fps_den : 0.0;
+    size_t frame = (size_t) position % video->frames_count;
+    if (video->has_frame && video->frame == frame) return;
+    video->has_frame = true;
+    video->frame = frame;
+
+    video_upload_frame(video, frame);
+    video_convert(video);
+
+    if (!video_is_prefetching(video)) {
+        video->prefetching = true;
+        video->prefetch_begin = frame + 1;
+        video->prefetch_end = frame + 1 + VIDEO_READ_AHEAD_FRAMES;
+        if (!job_pool_submit(pool, video_read_ahead_job, video)) video->prefetching = false;
+    }
+}
+
+// RGBA texture of the current video frame, 0 without a video
+GLuint video_texture(const Video *video)
+{
+    return video->frames_count > 0 ? video->texture : 0;
+}